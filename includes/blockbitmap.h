@@ -0,0 +1,85 @@
+//
+//  blockbitmap.h
+//  myfs
+//
+
+#ifndef blockbitmap_h
+#define blockbitmap_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define BB_MAX_PROBES 16
+
+/// @brief Free block map with a summary hierarchy
+///
+/// One bit per block, set for used blocks. The bits are stored in 64-bit words, so the map has the same layout as
+/// the byte-wise free block map on a little-endian host and can be read from and written to the container as is.
+///
+/// On top of the map, each summary level holds one bit per word of the level below, set if that word is full. A
+/// search for a free block walks up the levels only as far as needed to skip full regions, so its cost grows with
+/// the logarithm of the size of the container, not with the number of used blocks in front of the next free one.
+///
+/// This class is not thread-safe.
+class BlockBitmap {
+private:
+    uint64_t *words;
+    uint32_t numWords;
+    uint32_t numBits;
+    uint32_t numFree;
+
+    // summary[l] has one bit per word of level l, where level 0 are the words of the map
+    std::vector<std::vector<uint64_t> > summary;
+
+    BlockBitmap(const BlockBitmap &);
+    BlockBitmap &operator=(const BlockBitmap &);
+
+    uint64_t *getLevel(uint32_t level, uint32_t *size);
+    int64_t findZero(uint32_t level, uint64_t pos);
+    uint32_t runLength(uint32_t pos, uint32_t max) const;
+    void markFull(uint32_t level, uint32_t index);
+    void markNotFull(uint32_t level, uint32_t index);
+
+public:
+    BlockBitmap();
+    ~BlockBitmap();
+
+    /// @brief Allocate an empty map.
+    ///
+    /// \param [in] numBits Number of blocks covered by the map.
+    /// \param [in] numBytes Size of the map in bytes, at least (numBits+7)/8. Rounded up to full words.
+    void resize(uint32_t numBits, size_t numBytes);
+
+    /// @brief Recompute the summary levels and the number of free blocks.
+    ///
+    /// Must be called after the map was changed through getData(). Bits beyond numBits are marked as used.
+    void rebuild();
+
+    /// @brief Find and mark a run of free blocks.
+    ///
+    /// The search starts at hint and wraps around at the end of the map. A free run starting right at hint is always
+    /// taken, e.g. to extend the last extent of a file. Otherwise up to BB_MAX_PROBES free runs are examined and the
+    /// first one of want blocks, or the longest one, is taken, so short holes do not split large allocations.
+    /// \param [in] hint Preferred first block.
+    /// \param [in] want Number of blocks wanted, at least 1.
+    /// \param [out] start First allocated block.
+    /// \param [out] count Number of allocated blocks, 1 <= count <= want.
+    /// \return true on success, false if there is no free block.
+    bool allocate(uint32_t hint, uint32_t want, uint32_t *start, uint32_t *count);
+
+    /// @brief Mark a run of blocks as used.
+    void set(uint32_t start, uint32_t count);
+
+    /// @brief Mark a run of blocks as free.
+    void release(uint32_t start, uint32_t count);
+
+    bool isUsed(uint32_t blockNo) const { return (this->words[blockNo / 64] >> (blockNo % 64)) & 1; }
+
+    uint8_t *getData() { return (uint8_t *) this->words; }
+    size_t getDataSize() const { return (size_t) this->numWords * sizeof(uint64_t); }
+    uint32_t getNumBits() const { return this->numBits; }
+    uint32_t getNumFree() const { return this->numFree; }
+};
+
+#endif /* blockbitmap_h */
@@ -0,0 +1,181 @@
+//
+//  blockcache.h
+//  myfs
+//
+
+#ifndef blockcache_h
+#define blockcache_h
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "blockdevice.h"
+
+#define BC_DEFAULT_NUM_BLOCKS 1024
+#define BC_PREFETCH_QUEUE 64        // pending read-ahead requests, further requests are dropped
+
+/// @brief Write-back block cache
+///
+/// This class keeps a fixed number of blocks of a block device in memory. Blocks are replaced in LRU order. Writes
+/// only mark the cached copy as dirty, the block is written to the device when it gets evicted or when the cache is
+/// flushed. All methods may be called from several threads at the same time.
+///
+/// Blocks can also be read ahead, by the caller or by a background thread. Read-ahead blocks that are used by
+/// readBlocks() count as read-ahead hits and are moved to the end of the LRU order, since streamed data is rarely read
+/// twice. Read-ahead blocks that are evicted or overwritten before they are used count as wasted.
+class BlockCache {
+private:
+    struct Entry {
+        uint32_t blockNo;
+        bool valid;
+        bool dirty;
+        bool prefetched;    // read ahead and not used yet
+        int32_t prev;       // towards most recently used
+        int32_t next;       // towards least recently used
+    };
+
+    BlockDevice *blockDevice;
+    uint32_t blockSize;
+    uint32_t numBlocks;
+
+    char *data;
+    Entry *entries;
+    std::unordered_map<uint32_t, uint32_t> index;
+
+    mutable std::mutex lock;
+
+    int32_t head;   // most recently used entry
+    int32_t tail;   // least recently used entry
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writeBacks;
+    uint64_t prefetchedBlocks;
+    uint64_t prefetchHits;
+    uint64_t prefetchWasted;
+
+    // a read ahead is discarded if the device was written while the blocks were read
+    uint64_t writeSeq;          // incremented by each completed write to the device
+    uint32_t writesInFlight;    // writes to the device done without holding the lock
+
+    std::thread prefetchThread;
+    std::mutex prefetchLock;
+    std::condition_variable prefetchCond;   // background thread waits here for requests
+    std::condition_variable prefetchIdle;   // waitPrefetch() waits here for the background thread
+    std::deque<std::pair<uint32_t, uint32_t> > prefetchQueue;
+    bool prefetchBusy;
+    bool prefetchStop;
+
+    BlockCache(const BlockCache &);
+    BlockCache &operator=(const BlockCache &);
+
+    void unlink(int32_t e);
+    void pushFront(int32_t e);
+    void pushBack(int32_t e);
+    int getSlot(uint32_t blockNo, int32_t *slot);
+    int replace(uint32_t blockNo, int32_t *slot);
+    int writeBack(int32_t e);
+    int32_t lookup(uint32_t blockNo) const;
+    void prefetchLoop();
+
+public:
+    /// @brief Create a new block cache.
+    ///
+    /// \param blockDevice Block device the cache is layered on. The device must be opened before the cache is used.
+    /// \param numBlocks Number of blocks held in memory.
+    BlockCache(BlockDevice *blockDevice, uint32_t numBlocks= BC_DEFAULT_NUM_BLOCKS);
+    ~BlockCache();
+
+    /// @brief Read a block.
+    ///
+    /// Copy the content of block blockNo into the buffer. The block is read from the device if it is not cached.
+    /// \param [in] blockNo Number of the block to read.
+    /// \param [out] buffer Buffer for storing the content of the block, at least one block in size.
+    /// \return 0 on success, -ERRNO on failure.
+    int read(uint32_t blockNo, char *buffer);
+
+    /// @brief Write a block.
+    ///
+    /// Copy the buffer into the cached copy of block blockNo and mark it as dirty. The device is only accessed if a
+    /// dirty block has to be evicted.
+    /// \param [in] blockNo Number of the block to write.
+    /// \param [in] buffer Buffer storing the content to write, at least one block in size.
+    /// \return 0 on success, -ERRNO on failure.
+    int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read a sequence of blocks.
+    ///
+    /// Cached blocks are copied from the cache, each run of consecutive uncached blocks is read from the device with a
+    /// single call. Blocks read from the device are not inserted into the cache, so bulk data does not evict hot
+    /// metadata.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] count Number of blocks to read.
+    /// \param [out] buffer Buffer for storing the content of the blocks, at least count blocks in size.
+    /// \return 0 on success, -ERRNO on failure.
+    int readBlocks(uint32_t blockNo, uint32_t count, char *buffer);
+
+    /// @brief Write a sequence of blocks.
+    ///
+    /// The blocks are written through to the device with a single call. Cached copies of the blocks are updated.
+    /// \param [in] blockNo Number of the first block to write.
+    /// \param [in] count Number of blocks to write.
+    /// \param [in] buffer Buffer storing the content to write, at least count blocks in size.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeBlocks(uint32_t blockNo, uint32_t count, char *buffer);
+
+    /// @brief Write all dirty blocks to the device.
+    ///
+    /// Blocks are written in ascending order, runs of consecutive dirty blocks are written with a single call. The
+    /// cached copies stay valid.
+    /// \return 0 on success, -ERRNO of the first failed write otherwise.
+    int flush();
+
+    /// @brief Flush the cache and drop all cached blocks.
+    /// \return 0 on success, -ERRNO on failure.
+    int invalidate();
+
+    /// @brief Read blocks ahead into the cache.
+    ///
+    /// Blocks that are cached already are skipped. At most half of the cache is filled by one call.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] count Number of blocks to read.
+    /// \return 0 on success, -ERRNO on failure.
+    int prefetch(uint32_t blockNo, uint32_t count);
+
+    /// @brief Read blocks ahead into the cache in the background.
+    ///
+    /// The request is queued for a background thread, which is started with the first request. Requests beyond
+    /// BC_PREFETCH_QUEUE pending ones are dropped, errors are ignored.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] count Number of blocks to read.
+    void prefetchAsync(uint32_t blockNo, uint32_t count);
+
+    /// @brief Wait until all queued read-ahead requests are done.
+    void waitPrefetch();
+
+    /// @brief Drop the queued read-ahead requests and stop the background thread.
+    ///
+    /// Must be called before the block device is closed. A later request starts the thread again.
+    void stopPrefetch();
+
+    /// @brief Count the blocks at the start of a sequence whose content on the device is up to date.
+    /// \param [in] blockNo Number of the first block.
+    /// \param [in] count Number of blocks.
+    /// \return Number of blocks in front of the first dirty one, count if none of them is dirty.
+    uint32_t countClean(uint32_t blockNo, uint32_t count) const;
+
+    uint32_t getNumBlocks() const { return numBlocks; }
+    uint32_t getNumDirty() const;
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    uint64_t getWriteBacks() const;
+    uint64_t getPrefetchedBlocks() const;
+    uint64_t getPrefetchHits() const;
+    uint64_t getPrefetchWasted() const;
+};
+
+#endif /* blockcache_h */
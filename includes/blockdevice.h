@@ -13,19 +13,111 @@
 
 #include <stdio.h>
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "bufferpool.h"
+#include "ioring.h"
 
 #define BD_BLOCK_SIZE 512
+#define BD_MAP_RESERVE ((uint64_t) 1 << 36)     // address space reserved for a mapped container
+#define BD_MAP_GROW ((uint64_t) 1 << 20)        // a mapped container grows in steps of this size
+#define BD_DIRECT_ALIGN 512                     // alignment of addresses and sizes for O_DIRECT transfers
+#define BD_STRIPE_CHUNK 65536                   // default bytes on one member of a striped container before the next
+
+struct StripeMember;
+
+/// @brief Transfer of consecutive blocks, several of them can be submitted together with BlockDevice::submit().
+///
+/// The blocks are either in one buffer or, e.g. for blocks scattered over a cache, in a buffer of their own each.
+struct BlockTransfer {
+    bool write;
+    uint32_t blockNo;
+    uint32_t count;
+    char *buffer;               // count consecutive blocks, or NULL if buffers is used
+    char **buffers;             // count buffers of one block each
+    int result;                 // 0 on success, -ERRNO on failure, set by BlockDevice::submit()
+};
 
 /// @brief Emulate a block device
 ///
 /// This class emulates access to a generic block device (e.g. a hard disc or USB drive partition) using the
-/// local file system.
+/// local file system. All accesses use positioned I/O (pread/pwrite), so a block device object may be used by several
+/// threads at the same time.
+///
+/// In mapped mode the container file is mapped into memory instead, blocks are copied from and to the page cache
+/// directly and blockPtr() gives access to a block without any copy. The mapping lives in an address range of
+/// BD_MAP_RESERVE bytes that is reserved when the container is attached, so the address of a block never changes while
+/// the container grows.
+///
+/// In direct mode the container file is opened with O_DIRECT, so its blocks are not cached by the kernel a second time.
+/// Transfers from and to buffers that are not aligned to BD_DIRECT_ALIGN are bounced through aligned buffers of a
+/// BufferPool; BlockCache allocates its blocks aligned, so its transfers are never bounced.
+///
+/// With io_uring enabled, transfers are submitted through an IoRing instead of positioned system calls. Several
+/// transfers can then be submitted together with submit() and run in parallel, e.g. the runs of dirty blocks written
+/// by a cache flush.
+///
+/// A container may be striped over several files, e.g. on different discs. The bytes of the container are distributed
+/// round-robin in chunks of a fixed size: chunk c is at byte (c / N) * chunkSize of member c % N. Each member has a
+/// worker thread, a transfer is split at the chunk boundaries and the parts of the members run in parallel, so a
+/// large sequential transfer keeps all discs busy. Striped containers are not mapped and do not use io_uring. The
+/// members and the chunk size are not recorded in the container, they must be the same every time it is opened.
 class BlockDevice {
 private:
     uint32_t blockSize;
     int contFile;
     // uint32_t size;
-    
+
+    bool mapped;
+    char *map;                      // start of the reserved address range, NULL if no mapping is attached
+    std::atomic<uint64_t> mapSize;  // size of the container file, all of it is mapped
+    uint64_t mapLength;             // mapped bytes, mapSize rounded up to whole pages
+    std::mutex growLock;
+
+    bool useRing;
+    IoRing *ring;                   // NULL if positioned system calls are used
+    char *ringBuffer;               // buffer registered with the ring
+    size_t ringBufferLength;
+
+    bool useDirect;
+    bool direct;                    // the container file is opened with O_DIRECT
+    BufferPool bufferPool;          // bounce buffers for unaligned transfers in direct mode
+    std::atomic<uint64_t> numBounced;
+
+    std::vector<std::string> stripePaths;   // members after the container file, empty if it is not striped
+    uint32_t stripeChunk;
+    std::vector<StripeMember *> members;    // all members of an open striped container, the container file first
+    std::atomic<uint64_t> numStriped;
+
+    std::atomic<uint64_t> numReads;
+    std::atomic<uint64_t> numWrites;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> bytesWritten;
+
+    BlockDevice(const BlockDevice &);
+    BlockDevice &operator=(const BlockDevice &);
+
+    int attachMap();
+    int detachMap();
+    int growMap(uint64_t end);
+    int extendMap(uint64_t size);
+    void copyFromMap(uint64_t pos, size_t len, char *buffer) const;
+    int openFile(const char *path, int flags, int mode);
+    int createFile(const char *path);
+    int attachStripes(bool create);
+    void detachStripes();
+    int attachRing();
+    void detachRing();
+    int transfer(struct iovec *iov, int iovcnt, uint64_t pos, bool write);
+    int transferDirect(struct iovec *iov, int iovcnt, uint64_t pos, bool write);
+    int transferBounced(struct iovec *iov, int iovcnt, uint64_t pos, bool write);
+    int transferStriped(struct iovec *iov, int iovcnt, uint64_t pos, bool write);
+    bool isAligned(const struct iovec *iov, int iovcnt) const;
+
 public:
     /// @brief Create a new block device.
     ///
@@ -33,6 +125,63 @@ public:
     /// \param blockSize Block size.
     BlockDevice(uint32_t blockSize);
 
+    /// @brief Select memory-mapped access.
+    ///
+    /// The mode is applied when the next container file is opened or created, so this method must be called before
+    /// open() or create().
+    /// \param [in] mapped True for memory-mapped access, false for read/write system calls.
+    void setMapped(bool mapped) { this->mapped= mapped; }
+    bool isMapped() const { return this->mapped && this->stripePaths.empty(); }
+
+    /// @brief Select io_uring access.
+    ///
+    /// Like setMapped(), the mode is applied when the next container file is opened or created. It is ignored in
+    /// mapped mode. If the kernel does not support io_uring, positioned system calls are used.
+    /// \param [in] useRing True for io_uring, false for positioned system calls.
+    void setIoRing(bool useRing) { this->useRing= useRing; }
+    bool isIoRing() const { return this->ring != NULL; }
+    IoRing *getIoRing() const { return this->ring; }
+
+    /// @brief Select direct access, bypassing the page cache of the kernel.
+    ///
+    /// Like setMapped(), the mode is applied when the next container file is opened or created. It is ignored in
+    /// mapped mode. If the file system of the container does not support O_DIRECT, the page cache is used.
+    /// \param [in] useDirect True for O_DIRECT, false for buffered access.
+    void setDirect(bool useDirect) { this->useDirect= useDirect; }
+    bool isDirect() const { return this->direct; }
+    BufferPool *getBufferPool() { return &this->bufferPool; }
+
+    /// @brief Stripe the container over several files.
+    ///
+    /// Like setMapped(), the layout is applied when the next container file is opened or created. The file given to
+    /// open() or create() is the first member, the other members are given here. Mapped mode and io_uring are ignored
+    /// for a striped container, direct mode applies to all of its members.
+    /// \param [in] paths Paths of the other members, in the order of their chunks.
+    /// \param [in] count Number of other members, 0 for a container that is not striped.
+    /// \param [in] chunkSize Bytes on one member before the next member follows, a multiple of BD_DIRECT_ALIGN, 0 for
+    /// BD_STRIPE_CHUNK.
+    void setStripes(const char *const *paths, unsigned count, uint32_t chunkSize= 0);
+    unsigned getNumStripes() const { return (unsigned) this->members.size(); }
+    uint32_t getStripeChunk() const { return this->stripeChunk; }
+
+    /// @brief Get the file descriptor of the container file, e.g. for splicing blocks to another file.
+    ///
+    /// Block blockNo starts at byte blockNo * getBlockSize() of the file.
+    /// \return The file descriptor, -1 if no container file is open or the container is striped.
+    int getFileDescriptor() const { return this->members.empty() ? this->contFile : -1; }
+
+    /// @brief Register a buffer that is used for many transfers, e.g. the memory of a block cache.
+    ///
+    /// With io_uring, transfers of single blocks from and to the buffer use the fixed buffer operations. Only one
+    /// buffer is registered at a time, the registration is kept when the container is opened again.
+    /// \param [in] buffer Start of the buffer.
+    /// \param [in] length Size of the buffer in bytes.
+    void registerBuffer(char *buffer, size_t length);
+
+    /// @brief Drop the registration of a buffer before it is freed.
+    /// \param [in] buffer Start of the buffer given to registerBuffer().
+    void unregisterBuffer(char *buffer);
+
     /// @brief Open an existing container file.
     ///
     /// This methods opens an existing container file and attaches it to the block device object.
@@ -72,6 +221,91 @@ public:
     /// \param [out] buffer Buffer storing the content to write.
     /// \return 0 on success, -ERRNO on failure.
     int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read a sequence of blocks.
+    ///
+    /// This method reads count consecutive blocks starting with block blockNo from the container file using a single
+    /// system call. Note that the size of the buffer must be at least count blocks.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] count Number of blocks to read.
+    /// \param [out] buffer Buffer for storing the content of the blocks.
+    /// \return 0 on success, -ERRNO on failure.
+    int readBlocks(uint32_t blockNo, uint32_t count, char *buffer);
+
+    /// @brief Write a sequence of blocks.
+    ///
+    /// This method writes count consecutive blocks starting with block blockNo into the container file using a single
+    /// system call. Note that the size of the buffer must be at least count blocks.
+    /// \param [in] blockNo Number of the first block to write.
+    /// \param [in] count Number of blocks to write.
+    /// \param [in] buffer Buffer storing the content to write.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeBlocks(uint32_t blockNo, uint32_t count, char *buffer);
+
+    /// @brief Read a sequence of blocks into separate buffers (scatter).
+    ///
+    /// This method reads count consecutive blocks starting with block blockNo from the container file. Block i is
+    /// stored in buffers[i], each buffer must be at least one block in size.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] count Number of blocks to read.
+    /// \param [out] buffers Array of count buffers.
+    /// \return 0 on success, -ERRNO on failure.
+    int readBlocksv(uint32_t blockNo, uint32_t count, char **buffers);
+
+    /// @brief Write a sequence of blocks from separate buffers (gather).
+    ///
+    /// This method writes count consecutive blocks starting with block blockNo into the container file. The content
+    /// of block i is given by buffers[i], each buffer must be at least one block in size.
+    /// \param [in] blockNo Number of the first block to write.
+    /// \param [in] count Number of blocks to write.
+    /// \param [in] buffers Array of count buffers.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeBlocksv(uint32_t blockNo, uint32_t count, char **buffers);
+
+    /// @brief Perform a batch of transfers.
+    ///
+    /// With io_uring all transfers are submitted with a single system call and the method waits until all of them
+    /// are done. Otherwise they are done one after the other. Each transfer counts as a single read or write.
+    /// \param [in,out] transfers Array of transfers, their buffers must not overlap. The result of each transfer is
+    /// stored in it.
+    /// \param [in] count Number of transfers.
+    /// \return 0 on success, -ERRNO of the first failed transfer otherwise.
+    int submit(BlockTransfer *transfers, size_t count);
+
+    /// @brief Get direct access to a block of a mapped container.
+    ///
+    /// The pointer refers to the page cache of the container file and stays valid until the container is closed. It
+    /// must not be used to change the block, use write() instead, so the mapping can grow where necessary.
+    /// \param [in] blockNo Number of the block.
+    /// \return Pointer to the content of the block, NULL if the device is not mapped or the block lies beyond the end
+    /// of the container file.
+    const char *blockPtr(uint32_t blockNo) const;
+
+    /// @brief Flush the container file.
+    ///
+    /// This method forces all data written to the container file to the underlying storage. In mapped mode the
+    /// modified pages are written back with msync() first.
+    /// \return 0 on success, -ERRNO on failure.
+    int sync();
+
+    /// @brief Get the block size of the device.
+    /// \return Block size in bytes.
+    uint32_t getBlockSize() const { return blockSize; }
+
+    /// @brief Change the block size of the device.
+    ///
+    /// Block numbers of later transfers refer to the new block size. The content of the container is not changed.
+    /// \param [in] blockSize Block size, a multiple of 512.
+    void setBlockSize(uint32_t blockSize);
+
+    /// @brief I/O counters, each multi-block transfer counts as a single read or write.
+    uint64_t getNumReads() const { return numReads.load(std::memory_order_relaxed); }
+    uint64_t getNumWrites() const { return numWrites.load(std::memory_order_relaxed); }
+    uint64_t getBytesRead() const { return bytesRead.load(std::memory_order_relaxed); }
+    uint64_t getBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+    uint64_t getNumBounced() const { return numBounced.load(std::memory_order_relaxed); }
+    /// @brief Number of transfers split over several members of a striped container.
+    uint64_t getNumStriped() const { return numStriped.load(std::memory_order_relaxed); }
 };
 
 #endif /* blockdevice_h */
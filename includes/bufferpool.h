@@ -0,0 +1,62 @@
+//
+//  bufferpool.h
+//  myfs
+//
+
+#ifndef bufferpool_h
+#define bufferpool_h
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define BP_ALIGNMENT 4096               // buffers start at page boundaries
+#define BP_BUFFER_SIZE (256 * 1024)
+#define BP_MAX_FREE 8                   // released buffers kept for reuse, further ones are freed
+
+/// @brief Pool of aligned I/O buffers
+///
+/// Transfers with O_DIRECT need buffers whose address and size are aligned. The pool hands out page-aligned buffers
+/// of a fixed size and keeps up to BP_MAX_FREE released buffers for the next requests, so a bounced transfer does not
+/// allocate memory. All methods may be called from several threads at the same time.
+class BufferPool {
+private:
+    size_t bufferSize;
+    uint32_t maxFree;
+    std::mutex lock;
+    std::vector<char *> freeBuffers;
+
+    uint64_t numAllocated;
+    uint64_t numReused;
+
+    BufferPool(const BufferPool &);
+    BufferPool &operator=(const BufferPool &);
+
+public:
+    /// @brief Create an empty pool.
+    /// \param bufferSize Size of each buffer, rounded up to a multiple of BP_ALIGNMENT.
+    /// \param maxFree Number of released buffers kept for reuse.
+    BufferPool(size_t bufferSize= BP_BUFFER_SIZE, uint32_t maxFree= BP_MAX_FREE);
+    ~BufferPool();
+
+    /// @brief Take a buffer from the pool.
+    /// \return Buffer of getBufferSize() bytes, NULL if no memory is left.
+    char *get();
+
+    /// @brief Return a buffer taken with get().
+    /// \param [in] buffer The buffer.
+    void put(char *buffer);
+
+    size_t getBufferSize() const { return bufferSize; }
+    uint64_t getNumAllocated();
+    uint64_t getNumReused();
+
+    /// @brief Allocate memory starting at a page boundary, e.g. the blocks of a cache.
+    /// \param [in] size Number of bytes.
+    /// \return The memory, NULL if no memory is left. It is freed with freeAligned().
+    static char *allocAligned(size_t size);
+    static void freeAligned(char *buffer);
+};
+
+#endif /* bufferpool_h */
@@ -0,0 +1,57 @@
+//
+//  chunkarena.h
+//  myfs
+//
+
+#ifndef chunkarena_h
+#define chunkarena_h
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define CA_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define CA_CHUNKS_PER_SLAB 64
+
+/// @brief Pool of fixed-size memory chunks
+///
+/// Chunks are carved from slabs of CA_CHUNKS_PER_SLAB chunks. Released chunks go to a free list and are handed out
+/// again by later allocations, so allocating and releasing a chunk is a constant-time list operation that never calls
+/// malloc() or free() once the pool has grown to its working size. Slabs are only returned to the system when the
+/// arena is destroyed. All methods may be called from several threads at the same time.
+class ChunkArena {
+private:
+    struct FreeChunk {
+        FreeChunk *next;
+    };
+
+    size_t chunkSize;
+    std::vector<char *> slabs;
+    FreeChunk *freeList;
+    uint64_t numFree;
+
+    mutable std::mutex lock;
+
+    ChunkArena(const ChunkArena &);
+    ChunkArena &operator=(const ChunkArena &);
+
+public:
+    /// @brief Create an empty arena.
+    /// \param chunkSize Size of each chunk in bytes, at least sizeof(void *).
+    explicit ChunkArena(size_t chunkSize= CA_DEFAULT_CHUNK_SIZE);
+    ~ChunkArena();
+
+    /// @brief Take a chunk from the pool. The content of the chunk is undefined.
+    /// \return The chunk, NULL if no memory is left.
+    char *alloc();
+
+    /// @brief Return a chunk to the pool.
+    void release(char *chunk);
+
+    size_t getChunkSize() const { return this->chunkSize; }
+    uint64_t getNumChunks() const;
+    uint64_t getNumFree() const;
+};
+
+#endif /* chunkarena_h */
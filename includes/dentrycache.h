@@ -0,0 +1,92 @@
+//
+//  dentrycache.h
+//  myfs
+//
+
+#ifndef dentrycache_h
+#define dentrycache_h
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define DC_DEFAULT_NUM_ENTRIES 4096
+#define DC_NEGATIVE UINT32_MAX          // inode number of negative entries, the path does not exist
+
+/// @brief Cache of resolved paths
+///
+/// Maps full paths, e.g. "/a/b", to inode numbers, so a path is resolved without walking its components from the
+/// root directory again. Paths that do not exist are cached as negative entries. The cache holds a fixed number of
+/// entries that are replaced in LRU order.
+///
+/// The file system keeps the cache consistent with its directories: an entry is stale as soon as the directory entry
+/// it went through changes, so invalidate() is called for the path of every file that is created, removed or renamed.
+/// All methods may be called from several threads at the same time.
+class DentryCache {
+private:
+    struct Entry {
+        std::string path;
+        uint32_t inode;         // DC_NEGATIVE for negative entries
+        bool used;
+        int32_t prev;           // towards most recently used
+        int32_t next;           // towards least recently used
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, int32_t> index;
+
+    mutable std::mutex lock;
+
+    int32_t head;   // most recently used entry
+    int32_t tail;   // least recently used entry
+
+    uint64_t hits;
+    uint64_t negativeHits;
+    uint64_t misses;
+
+    DentryCache(const DentryCache &);
+    DentryCache &operator=(const DentryCache &);
+
+    void unlink(int32_t e);
+    void pushFront(int32_t e);
+    void drop(int32_t e);
+
+public:
+    /// @brief Create an empty cache.
+    /// \param numEntries Maximum number of cached paths, at least 1.
+    explicit DentryCache(uint32_t numEntries= DC_DEFAULT_NUM_ENTRIES);
+
+    /// @brief Look up a path.
+    /// \param [in] path Start of the path.
+    /// \param [in] length Length of the path, so a prefix of a longer path can be looked up.
+    /// \param [out] inode Inode number of the path, DC_NEGATIVE if the path does not exist.
+    /// \return true if the path is cached, false otherwise.
+    bool lookup(const char *path, size_t length, uint32_t *inode);
+
+    /// @brief Cache a resolved path.
+    /// \param [in] path Start of the path.
+    /// \param [in] length Length of the path.
+    /// \param [in] inode Inode number of the path, DC_NEGATIVE if the path does not exist.
+    void insert(const char *path, size_t length, uint32_t inode);
+
+    /// @brief Drop a path and, for a directory, all paths below it.
+    ///
+    /// Paths are only cached below directories, so for a file just the path itself is dropped. For a directory all
+    /// entries are looked at, which costs time in the size of the cache. Paths below "/" are everything.
+    /// \param [in] path Path of the changed directory entry.
+    /// \param [in] isDir True if the entry is a directory, false for a file or a path that did not exist.
+    void invalidate(const char *path, bool isDir);
+
+    /// @brief Drop all entries.
+    void clear();
+
+    uint32_t getNumEntries() const;
+    uint64_t getHits() const;
+    uint64_t getNegativeHits() const;
+    uint64_t getMisses() const;
+};
+
+#endif /* dentrycache_h */
@@ -0,0 +1,100 @@
+//
+//  dirindex.h
+//  myfs
+//
+
+#ifndef dirindex_h
+#define dirindex_h
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// @brief In-memory index of all directories
+///
+/// Maps pairs of a directory inode and a file name to inode numbers with an open-addressing hash table (linear
+/// probing), so lookups take constant time independent of the number of entries. Each entry carries an additional
+/// value for the file system, e.g. the directory block holding the entry on disk. The entries of each directory are
+/// linked into a list, so a directory is listed without looking at the entries of the others.
+///
+/// Entries are identified by a small integer that stays valid until the entry is removed. Removed identifiers are
+/// reused by later insertions. This class is not thread-safe.
+class DirIndex {
+private:
+    struct Entry {
+        std::string name;
+        uint32_t parent;        // inode of the directory holding the entry
+        uint32_t hash;
+        uint32_t inode;
+        uint32_t aux;
+        int32_t prev;           // neighbours in the list of the directory, -1 at the ends
+        int32_t next;
+        bool used;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int32_t> freeEntries;
+    std::unordered_map<uint32_t, int32_t> children;     // first entry of each directory that has entries
+
+    std::vector<int32_t> table;     // entry identifiers, DI_EMPTY or DI_DELETED
+    uint32_t numUsed;
+    uint32_t numDeleted;
+
+    int32_t findSlot(uint32_t parent, const char *name, uint32_t hash) const;
+    void place(int32_t id);
+    void rehash(uint32_t size);
+    void reserve();
+    void link(int32_t id);
+    void unlink(int32_t id);
+
+public:
+    DirIndex();
+
+    /// @brief Hash a directory inode and a file name (FNV-1a).
+    static uint32_t hash(uint32_t parent, const char *name);
+
+    /// @brief Find an entry.
+    /// \param [in] parent Inode number of the directory.
+    /// \param [in] name Name of the file.
+    /// \return Identifier of the entry, -1 if the directory has no entry with this name.
+    int find(uint32_t parent, const char *name) const;
+
+    /// @brief Add an entry. There must be no entry with the same name in the directory.
+    /// \param [in] parent Inode number of the directory.
+    /// \param [in] name Name of the file.
+    /// \param [in] inode Inode number of the file.
+    /// \param [in] aux Additional value stored with the entry.
+    /// \return Identifier of the new entry.
+    int insert(uint32_t parent, const char *name, uint32_t inode, uint32_t aux= 0);
+
+    /// @brief Remove an entry.
+    void remove(int id);
+
+    /// @brief Move an entry to a new name, possibly in another directory. There must be no entry there.
+    void rename(int id, uint32_t parent, const char *name);
+
+    /// @brief First entry of a directory, for iterating over its entries together with nextChild().
+    /// \return Identifier of the entry, -1 if the directory is empty.
+    int firstChild(uint32_t parent) const;
+    int nextChild(int id) const { return this->entries[id].next; }
+    bool hasChildren(uint32_t parent) const { return this->children.count(parent) > 0; }
+
+    /// @brief Remove all entries.
+    void clear();
+
+    uint32_t size() const { return this->numUsed; }
+
+    /// @brief Upper bound of the identifiers, for iterating over all entries together with isUsed().
+    int end() const { return (int) this->entries.size(); }
+    bool isUsed(int id) const { return this->entries[id].used; }
+
+    const char *getName(int id) const { return this->entries[id].name.c_str(); }
+    uint32_t getParent(int id) const { return this->entries[id].parent; }
+    uint32_t getHash(int id) const { return this->entries[id].hash; }
+    uint32_t getInode(int id) const { return this->entries[id].inode; }
+    uint32_t getAux(int id) const { return this->entries[id].aux; }
+    void setAux(int id, uint32_t aux) { this->entries[id].aux= aux; }
+};
+
+#endif /* dirindex_h */
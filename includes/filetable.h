@@ -0,0 +1,73 @@
+//
+//  filetable.h
+//  myfs
+//
+
+#ifndef filetable_h
+#define filetable_h
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define FT_HANDLES_PER_SLAB 256
+#define FT_MAX_HANDLES (1 << 20)
+
+/// @brief Open file, referenced by fuse_file_info::fh.
+///
+/// The handle carries everything a read or write needs, so these operations never look at the path. The cursor and
+/// offset are hints updated by the operations on the handle, they may be read and written by several threads at the
+/// same time.
+struct MyFsHandle {
+    uint32_t ino;
+    void *file;                             // file object of the in-memory file system, NULL for on-disk mode
+    std::atomic<uint32_t> extentCursor;     // extent used by the last transfer, see MyOnDiskFS::mapBlocks()
+    std::atomic<uint64_t> nextOffset;       // end of the last read or write
+    std::atomic<uint32_t> raWindow;         // read-ahead window in blocks, 0 while the access is not sequential
+    std::atomic<uint32_t> raEnd;            // first block not read ahead yet
+    std::atomic<bool> spliced;              // a read was spliced from the container, see MyOnDiskFS::fuseReadBuf()
+    MyFsHandle *nextFree;
+};
+
+/// @brief Table of open files
+///
+/// Handles are carved from slabs of FT_HANDLES_PER_SLAB handles that are only freed with the table, so a handle does
+/// not move while the file is open and its address can be stored in fuse_file_info::fh. Released handles go to a
+/// free list. The table grows on demand up to its capacity, so a large capacity costs no memory until files are
+/// actually opened. All methods may be called from several threads at the same time.
+class FileTable {
+private:
+    std::vector<MyFsHandle *> slabs;
+    MyFsHandle *freeList;
+    uint32_t capacity;
+    uint32_t numOpen;
+
+    mutable std::mutex lock;
+
+    FileTable(const FileTable &);
+    FileTable &operator=(const FileTable &);
+
+public:
+    /// @brief Create an empty table.
+    /// \param capacity Maximum number of open files, at most FT_MAX_HANDLES.
+    explicit FileTable(uint32_t capacity);
+    ~FileTable();
+
+    /// @brief Change the maximum number of open files, files already open stay open.
+    void setCapacity(uint32_t capacity);
+    uint32_t getCapacity() const;
+
+    /// @brief Allocate a handle for an open file.
+    /// \param [in] ino Inode number of the file.
+    /// \param [in] file File object of the in-memory file system, NULL for on-disk mode.
+    /// \return The handle, NULL if the table is full.
+    MyFsHandle *open(uint32_t ino, void *file= NULL);
+
+    /// @brief Release the handle of a closed file.
+    void release(MyFsHandle *handle);
+
+    uint32_t getNumOpen() const;
+};
+
+#endif /* filetable_h */
@@ -0,0 +1,130 @@
+//
+//  ioring.h
+//  myfs
+//
+
+#ifndef ioring_h
+#define ioring_h
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <sys/uio.h>
+
+#define IORING_DEFAULT_ENTRIES 64
+
+/// @brief A positioned transfer submitted to an IoRing.
+///
+/// The iovec array is advanced while the transfer proceeds, so it must stay valid and must not be shared with other
+/// requests until IoRing::transfer() returns.
+struct IoRequest {
+    bool write;
+    uint64_t pos;               // byte position in the file
+    struct iovec *iov;
+    int iovcnt;
+    int result;                 // 0 on success, -ERRNO on failure, set by IoRing::transfer()
+
+    // state while the request is in flight
+    bool queued;
+    bool done;
+    size_t *remaining;          // requests of the same call that are not done yet
+};
+
+/// @brief Asynchronous I/O through a Linux io_uring
+///
+/// This class submits a batch of positioned reads and writes to the kernel with a single system call and waits for
+/// their completions, without a thread per transfer. Transfers into or out of the registered buffer use the fixed
+/// buffer operations, which do not map the pages of the buffer for every transfer.
+///
+/// Several threads may call transfer() at the same time. Their requests share the ring; one of the waiting threads
+/// reaps the completions for all of them, the others sleep until their requests are done. Short transfers, e.g. at
+/// the end of the file, are continued like with pread/pwrite, data beyond the end of the file is read as zeros.
+///
+/// io_uring is only available on Linux. On other platforms, or kernels without io_uring, init() fails and the caller
+/// keeps using positioned system calls.
+class IoRing {
+private:
+    int ringFd;
+    int fileFd;
+    unsigned entries;
+
+    void *sqMap;
+    void *cqMap;
+    size_t sqMapSize;
+    size_t cqMapSize;
+    void *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    void *cqes;
+
+    char *fixedBase;            // registered buffer, NULL if there is none
+    size_t fixedLength;
+
+    std::mutex lock;
+    std::condition_variable reaped;     // waiting threads sleep here while another one reaps
+    bool reaping;
+    unsigned inFlight;                  // submission queue entries without completion
+    std::vector<IoRequest *> unsent;    // queued entries the kernel has not accepted yet
+
+    uint64_t numCalls;
+    uint64_t numRequests;
+    uint64_t numFixed;
+
+    IoRing(const IoRing &);
+    IoRing &operator=(const IoRing &);
+
+    void queue(IoRequest *request);
+    int enter(unsigned toSubmit, unsigned minComplete);
+    void submit();
+    void reap();
+    void complete(IoRequest *request, int res);
+
+public:
+    IoRing();
+    ~IoRing();
+
+    /// @brief Set up the ring for a file.
+    /// \param [in] fd File descriptor of the file, it must stay open until close() is called.
+    /// \param [in] entries Number of transfers that may be in flight at the same time.
+    /// \return 0 on success, -ENOSYS if io_uring is not supported, -ERRNO on other failures.
+    int init(int fd, unsigned entries= IORING_DEFAULT_ENTRIES);
+
+    /// @brief Tear down the ring, no transfer may be in flight.
+    void close();
+
+    bool isActive() const { return ringFd >= 0; }
+
+    /// @brief Register a buffer for the fixed buffer operations.
+    ///
+    /// Only one buffer is registered at a time. The buffer must stay allocated until unregisterBuffer() is called.
+    /// \param [in] base Start of the buffer.
+    /// \param [in] length Size of the buffer in bytes.
+    /// \return 0 on success, -ERRNO on failure, e.g. if the buffer exceeds RLIMIT_MEMLOCK.
+    int registerBuffer(char *base, size_t length);
+
+    /// @brief Drop the registered buffer, no transfer may be in flight.
+    void unregisterBuffer();
+
+    /// @brief Transfer a batch of requests.
+    ///
+    /// All requests are submitted together, as far as the ring has room for them, and the method waits until all of
+    /// them are done.
+    /// \param [in,out] requests Requests to transfer, the result of each request is stored in it.
+    /// \param [in] count Number of requests.
+    /// \return 0 on success, -ERRNO of the first failed request otherwise.
+    int transfer(IoRequest *requests, size_t count);
+
+    /// @brief Number of transfer() calls, submitted requests and requests using the registered buffer.
+    uint64_t getNumCalls();
+    uint64_t getNumRequests();
+    uint64_t getNumFixed();
+};
+
+#endif /* ioring_h */
@@ -0,0 +1,119 @@
+//
+//  journal.h
+//  myfs
+//
+
+#ifndef journal_h
+#define journal_h
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "blockdevice.h"
+#include "blockcache.h"
+
+/// @brief Write-ahead journal for meta data blocks
+///
+/// Changed meta data blocks are collected in memory by write() and written to the journal region of the container
+/// together by commit(), as one transaction with a single sequential write. Only then are they handed to the block
+/// cache, which writes them in place when they are evicted or flushed. So the blocks in place always hold the state
+/// of a committed transaction, or a later one that the journal can restore: replay() writes the images of all
+/// committed transactions in place again after a crash. File data written in the meantime reaches the container
+/// before the transaction commits, the block cache is flushed first.
+///
+/// The journal region is used as a circular log. When a transaction does not fit behind the last one, the block cache
+/// is flushed, so all logged blocks are in place, and the journal starts over behind its header.
+///
+/// A block that is freed while it is logged is revoked, so replaying an earlier transaction cannot overwrite file
+/// data stored in the block later.
+///
+/// All methods may be called from several threads at the same time. The caller makes sure that no operation is
+/// half done when it calls commit().
+class Journal {
+private:
+    BlockDevice *blockDevice;
+    BlockCache *blockCache;
+    uint32_t blockSize;
+    uint32_t start;             // first block of the journal region, its header
+    uint32_t numBlocks;
+    uint32_t seq;               // sequence number of the next transaction
+    uint32_t head;              // next free block of the region
+
+    mutable std::mutex lock;
+    std::map<uint32_t, std::vector<char> > images;   // blocks changed by the running transaction
+    std::set<uint32_t> revoked;                     // blocks freed by the running transaction
+    std::unordered_set<uint32_t> logged;            // blocks logged since the journal started over
+
+    uint64_t numCommits;
+    uint64_t numLogged;
+
+    Journal(const Journal &);
+    Journal &operator=(const Journal &);
+
+    int writeHeader();
+    int restart();
+
+public:
+    /// @brief Create a journal on a region of a block device.
+    ///
+    /// \param blockDevice Block device holding the journal, opened with the block size of the file system.
+    /// \param blockCache Block cache the logged blocks are handed to after their commit.
+    /// \param start First block of the journal region.
+    /// \param numBlocks Size of the journal region, at least JOURNAL_MIN_BLOCKS.
+    Journal(BlockDevice *blockDevice, BlockCache *blockCache, uint32_t start, uint32_t numBlocks);
+
+    /// @brief Start with an empty journal.
+    /// \return 0 on success, -ERRNO on failure.
+    int format();
+
+    /// @brief Write the blocks of all committed transactions in place and empty the journal.
+    ///
+    /// Must be called before the meta data is read and before the block cache is used. Transactions are replayed in
+    /// order up to the first one that is incomplete, e.g. because its commit block has not reached the container.
+    /// \param [out] numReplayed Number of replayed transactions.
+    /// \return 0 on success, -EINVAL if the region holds no journal, -ERRNO on other failures.
+    int replay(uint32_t *numReplayed);
+
+    /// @brief Read a block changed by the running transaction.
+    /// \param [in] blockNo Number of the block.
+    /// \param [out] buffer Buffer for the content of the block, at least one block in size.
+    /// \return true if the block has been changed, false if its content must be read from the block cache.
+    bool read(uint32_t blockNo, char *buffer) const;
+
+    /// @brief Change a meta data block in the running transaction.
+    /// \param [in] blockNo Number of the block.
+    /// \param [in] buffer New content of the block, at least one block in size.
+    void write(uint32_t blockNo, const char *buffer);
+
+    /// @brief Forget about freed blocks.
+    ///
+    /// Changes of the running transaction are dropped, logged images are not replayed anymore.
+    /// \param [in] blockNo First freed block.
+    /// \param [in] count Number of freed blocks.
+    void revoke(uint32_t blockNo, uint32_t count);
+
+    /// @brief Commit the running transaction.
+    ///
+    /// The block cache is flushed and the transaction is written to the journal and forced to the disk. Its commit
+    /// block is written and forced to the disk after that, so the commit block never gets there before the rest.
+    /// A transaction that is larger than the whole journal is written in place directly, it is not crash-safe.
+    /// \return 1 if a transaction was committed, 0 if nothing has changed, -ERRNO on failure.
+    int commit();
+
+    /// @brief Write all committed blocks in place and start the journal over.
+    ///
+    /// Called after the last commit before the container is closed, so a later mount replays nothing.
+    /// \return 0 on success, -ERRNO on failure.
+    int checkpoint();
+
+    /// @brief Number of blocks changed by the running transaction.
+    uint32_t getNumPending() const;
+    uint64_t getNumCommits() const;
+    uint64_t getNumLogged() const;
+};
+
+#endif /* journal_h */
@@ -0,0 +1,91 @@
+//
+//  logger.h
+//  myfs
+//
+
+#ifndef logger_h
+#define logger_h
+
+#include <stdio.h>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define LOGGER_NUM_RECORDS 4096
+#define LOGGER_RECORD_SIZE 512          // longer messages are truncated
+#define LOGGER_DRAIN_INTERVAL_MS 50
+
+/// @brief Asynchronous logger
+///
+/// Messages are formatted into a ring buffer of LOGGER_NUM_RECORDS records by the calling thread and written to the
+/// log file by a background thread, so logging a message does not cost a system call. Claiming a record is a single
+/// compare-and-swap, several threads may log at the same time without taking a lock. If the ring buffer is full the
+/// message is dropped and counted, the logging thread never waits for the log file.
+///
+/// Messages written while no log file is open go to stderr directly.
+class Logger {
+private:
+    struct Record {
+        std::atomic<uint64_t> seq;      // position this record is free for, position + 1 once it is filled
+        uint32_t length;
+        char text[LOGGER_RECORD_SIZE];
+    };
+
+    Record *records;
+    uint32_t numRecords;                // power of two
+    std::atomic<uint64_t> writePos;
+    std::atomic<uint64_t> readPos;
+    std::atomic<uint64_t> numDropped;
+    uint64_t numReported;               // dropped messages already noted in the log file
+
+    std::atomic<int> level;
+    std::atomic<bool> active;           // log file is open & drain thread is running
+
+    FILE *file;
+    std::thread drainThread;
+    std::mutex drainLock;
+    std::condition_variable drainCond;  // drain thread waits here for messages
+    std::condition_variable doneCond;   // flush() waits here for the drain thread
+    bool stop;
+
+    Logger(const Logger &);
+    Logger &operator=(const Logger &);
+
+    void drainLoop();
+    bool drain();
+
+public:
+    /// @brief Create a logger without a log file.
+    /// \param numRecords Capacity of the ring buffer, rounded up to a power of two.
+    explicit Logger(uint32_t numRecords= LOGGER_NUM_RECORDS);
+    ~Logger();
+
+    /// @brief Open the log file and start the background thread.
+    ///
+    /// An existing log file is truncated.
+    /// \param [in] path Path of the log file.
+    /// \return 0 on success, -ERRNO on failure.
+    int open(const char *path);
+
+    /// @brief Write all pending messages, stop the background thread and close the log file.
+    void close();
+
+    /// @brief Wait until all messages logged so far are written to the log file.
+    void flush();
+
+    /// @brief Set the level of the messages to log, see LOG_LEVEL_* in macros.h.
+    void setLevel(int level) { this->level.store(level, std::memory_order_relaxed); }
+    int getLevel() const { return this->level.load(std::memory_order_relaxed); }
+    bool isEnabled(int level) const { return level <= this->level.load(std::memory_order_relaxed); }
+
+    /// @brief Log a message.
+    /// \param [in] fmt printf() style format string, followed by its arguments.
+    void write(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    /// @brief Number of messages dropped because the ring buffer was full.
+    uint64_t getNumDropped() const { return this->numDropped.load(std::memory_order_relaxed); }
+};
+
+#endif /* logger_h */
@@ -0,0 +1,31 @@
+//
+//  lz4codec.h
+//  myfs
+//
+
+#ifndef lz4codec_h
+#define lz4codec_h
+
+#include <cstddef>
+#include <cstdint>
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_LAST_LITERALS 5         // the last bytes of a block are always literals
+#define LZ4_MATCH_LIMIT 12          // no match starts within the last bytes of a block
+
+/// @brief Compression in the LZ4 block format.
+///
+/// The output is a plain LZ4 block, i.e. a sequence of tokens, literals and match offsets without a frame header, as
+/// read by LZ4_decompress_safe() of the reference library. The compressor is a single-pass greedy matcher with a
+/// small hash table on the stack, so it needs no memory besides the output buffer.
+///
+/// All methods are thread-safe.
+class Lz4Codec {
+public:
+    static size_t compress(const char *src, size_t size, char *dst, size_t capacity);
+    static int decompress(const char *src, size_t size, char *dst, size_t capacity);
+};
+
+#endif /* lz4codec_h */
@@ -15,28 +15,40 @@ fprintf(stderr, str "\n");\
 exit(-1);\
 } while(0)
 
-#ifdef DEBUG
+// Log levels. A message is logged if its level does not exceed the level of the logger, see Logger::setLevel().
+// Messages above LOG_COMPILE_LEVEL are not compiled at all.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_INFO 1            // LOG(), LOGF()
+#define LOG_LEVEL_METHODS 2         // LOGM()
+#define LOG_LEVEL_RETURNS 3         // RETURN()
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_RETURNS
+#endif
+
+#if defined(DEBUG) && LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
 #define LOGF(fmt, ...) \
-do { fprintf(this->logFile, "\t" fmt "\n", __VA_ARGS__); } while (0)
+do { if(this->logger.isEnabled(LOG_LEVEL_INFO)) this->logger.write("\t" fmt "\n", __VA_ARGS__); } while (0)
 
 #define LOG(text) \
-do { fprintf(this->logFile, "\t" text "\n"); } while (0)
+do { if(this->logger.isEnabled(LOG_LEVEL_INFO)) this->logger.write("\t" text "\n"); } while (0)
 #else
 #define LOGF(fmt, ...)
 #define LOG(text)
 #endif
 
-#ifdef DEBUG_METHODS
+#if defined(DEBUG_METHODS) && LOG_COMPILE_LEVEL >= LOG_LEVEL_METHODS
 #define LOGM() \
-do { fprintf(this->logFile, "%s:%d:%s()\n", __FILE__, \
+do { if(this->logger.isEnabled(LOG_LEVEL_METHODS)) this->logger.write("%s:%d:%s()\n", __FILE__, \
 __LINE__, __func__); } while (0)
 #else
 #define LOGM()
 #endif
 
-#ifdef DEBUG_RETURN_VALUES
+#if defined(DEBUG_RETURN_VALUES) && LOG_COMPILE_LEVEL >= LOG_LEVEL_RETURNS
 #define RETURN(ret) \
-fprintf(this->logFile, "%s() returned %d\n", __func__, ret); return ret;
+do { if(this->logger.isEnabled(LOG_LEVEL_RETURNS)) this->logger.write("%s() returned %d\n", __func__, ret); } \
+while (0); return ret;
 #else
 #define RETURN(ret) return ret;
 #endif
@@ -14,6 +14,26 @@
 struct MyFsInfo {
     char *logFile;
     char *contFile;
+    char **contFiles;           // all files of a striped container, contFile is the first
+    unsigned int numContFiles;
+    unsigned int stripeChunk;   // bytes on one file of a striped container before the next, 0 for BD_STRIPE_CHUNK
+    unsigned int cacheBlocks;
+    int multithreaded;
+    int mapped;
+    int logLevel;               // see LOG_LEVEL_* in macros.h
+    unsigned int maxOpenFiles;  // 0 for NUM_OPEN_FILES
+    unsigned int blockSize;     // block size of a new container, 0 for DEFAULT_BLOCK_SIZE
+    int compress;               // compress the clusters of files written from now on
+    unsigned int commitInterval;    // seconds between journal commits, 0 for JOURNAL_COMMIT_INTERVAL
+    int uring;                  // access the container file through io_uring
+    int direct;                 // open the container file with O_DIRECT
+    int splice;                 // let FUSE splice reads from the container file
+    char *imageFile;            // snapshot image of the in-memory file system, NULL for none
+    int noatime;                // reads do not update the access time
+    int strictatime;            // every read updates the access time
+    unsigned int relatime;      // seconds after which a read updates the access time, 0 for RELATIME_INTERVAL
+    int checksum;               // keep checksums of the data blocks of a new container
+    unsigned int scrubInterval; // seconds between background scrubs of the checksummed blocks, 0 for none
 };
 
 #endif /* myfs_info_h */
@@ -9,11 +9,267 @@
 #ifndef myfs_structs_h
 #define myfs_structs_h
 
+#include <cstddef>
+#include <cstdint>
+
 #define NAME_LENGTH 255
-#define BLOCK_SIZE 512
-#define NUM_DIR_ENTRIES 64
-#define NUM_OPEN_FILES 64
+#define NUM_OPEN_FILES 64                           // default maximum number of open files, see -o maxopenfiles
+#define NUM_INODE_LOCKS 256
+#define DIRTY_MAX_SIZE (1 << 20)                    // bytes of a file buffered before they are allocated & written
+#define DIRTY_TOTAL_SIZE (16 * DIRTY_MAX_SIZE)      // bytes buffered for all files together
+#define RA_MIN_BLOCKS 8                             // read-ahead window after the first sequential read
+#define RA_MAX_BLOCKS 256                           // read-ahead window limit, at most a quarter of the block cache
+#define COMPRESS_CLUSTER_SIZE 65536                 // bytes compressed together with -o compress
+#define CLUSTER_CACHE_SIZE 16                       // decompressed clusters kept in memory
+#define JOURNAL_COMMIT_INTERVAL 5                   // default seconds between journal commits, see -o commit
+#define JOURNAL_BATCH_BLOCKS 256                    // logged blocks that trigger a commit before the interval ends
+#define RELATIME_INTERVAL 86400                     // default seconds after which a read updates atime, see -o relatime
+#define ATIME_NEVER (-1)                            // reads do not update atime, see -o noatime
+#define CHECKSUM_BATCH_BLOCKS 64                    // blocks whose checksums are computed together
+#define SCRUB_BATCH_BLOCKS 256                      // blocks of a file checked by one step of the scrubber
+
+// --- On-disk layout ---
+//
+// The block size is chosen when the container is formatted, see -o blocksize, and recorded in the superblock. All
+// structures below must fit into the smallest block size.
+//
+// Block 0 holds the superblock. It is followed by the free block map (one bit per block of the container, set for
+// used blocks), the inode table, the journal and, with -o checksum, the block checksums: the CRC-32C of every block of
+// the container followed by one bit per block, set if the checksum is known. All remaining blocks are data blocks. The
+// (root) directory is stored in the data blocks of the root inode as a hash table of directory blocks.
+
+#define MYFS_MAGIC 0x5346794d          // "MyFS"
+#define MYFS_VERSION 7
+#define MYFS_STATE_CLEAN 1
+#define MIN_BLOCK_SIZE 512
+#define MAX_BLOCK_SIZE 65536
+#define DEFAULT_BLOCK_SIZE 4096
+#define DEFAULT_CONTAINER_SIZE ((uint64_t) 512 << 20)
+
+#define ROOT_INODE 0
+#define BYTES_PER_INODE 8192            // the inode table gets one inode per BYTES_PER_INODE bytes of the container
+#define MIN_NUM_INODES 64
+#define INODE_NUM_EXTENTS 12
+#define INODE_INLINE_SIZE 196           // bytes of a small file stored in the inode instead of a data block
+#define INODE_INLINE 1                  // inode flag: the content of the file is stored in the inode
+
+#define DIR_INITIAL_BUCKETS 4
+#define DIR_BUCKET_LOAD 12              // average number of entries per bucket before the directory is rehashed
+
+/// @brief Superblock of the on-disk file system.
+struct MyFsSuperBlock {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t numBlocks;         // total number of blocks in the container
+    uint32_t bitmapStart;       // first block of the free block map
+    uint32_t bitmapBlocks;
+    uint32_t inodeStart;        // first block of the inode table
+    uint32_t inodeBlocks;
+    uint32_t dataStart;         // first data block
+    uint32_t numInodes;
+    uint32_t dirBuckets;        // number of hash buckets of the directory
+    uint32_t state;             // MYFS_STATE_CLEAN after a clean unmount, 0 while mounted
+    uint32_t checkpointInode;   // hidden file holding the checkpoint, 0 for none
+    uint32_t journalStart;      // first block of the journal
+    uint32_t journalBlocks;
+    uint32_t numFreeBlocks;     // free data blocks, only valid in MYFS_STATE_CLEAN
+    uint32_t numFreeInodes;     // free inodes, only valid in MYFS_STATE_CLEAN
+    uint32_t checksumStart;     // first block of the block checksums, their content is only valid in MYFS_STATE_CLEAN
+    uint32_t checksumBlocks;    // 0 for a container without checksums
+};
+
+/// @brief Run of physically contiguous blocks of a file.
+///
+/// Maps the file blocks logical, ..., logical+length-1 to the container blocks start, ..., start+length-1. An extent
+/// with compressed != 0 holds a single compressed cluster instead: the LZ4 block of compressed bytes for the file
+/// blocks logical, ..., logical+length-1 is stored in as few container blocks as needed from start on.
+struct MyFsExtent {
+    uint32_t logical;
+    uint32_t start;
+    uint32_t length;
+    uint32_t compressed;
+};
+
+/// @brief Inode of the on-disk file system.
+///
+/// The first INODE_NUM_EXTENTS extents of a file are stored in the inode, further extents in a chain of extent
+/// blocks starting at extentBlock. Extents are sorted by their logical block number. A mode of 0 marks a free inode.
+/// Files of up to INODE_INLINE_SIZE bytes are stored in the inode itself: the flag INODE_INLINE is set, the file has
+/// no extents and data holds the content, zero behind the end of the file.
+struct MyFsInode {
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size;
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
+    uint32_t flags;
+    uint32_t numExtents;
+    uint32_t extentBlock;
+    union {
+        MyFsExtent extents[INODE_NUM_EXTENTS];
+        char data[INODE_INLINE_SIZE];
+    };
+};
+
+static_assert(MIN_BLOCK_SIZE % sizeof(MyFsInode) == 0, "inodes must not cross block boundaries");
+static_assert(INODE_INLINE_SIZE >= INODE_NUM_EXTENTS * sizeof(MyFsExtent), "inline data must cover the extents");
+
+#define EXTENTS_PER_BLOCK(blockSize) (((blockSize) - 2 * sizeof(uint32_t)) / sizeof(MyFsExtent))
+
+/// @brief Block holding extents that do not fit into the inode.
+///
+/// The extents fill the rest of the block, there is room for EXTENTS_PER_BLOCK(blockSize) of them.
+struct MyFsExtentBlock {
+    uint32_t next;              // next block of the chain, 0 for the last one
+    uint32_t count;
+    MyFsExtent extents[1];
+};
+
+static_assert(sizeof(MyFsExtentBlock) <= MIN_BLOCK_SIZE, "extent block exceeds block size");
+
+/// @brief Header of a directory block.
+///
+/// The root inode holds the entries of all directories, a directory is an inode without blocks of its own. The first
+/// dirBuckets blocks of the root inode are the buckets of a hash table, an entry is stored in the bucket
+/// hash(parent, name) % dirBuckets. If a bucket is full, further entries go to a chain of overflow blocks behind the
+/// buckets. The header is followed by packed records of variable length, they fill at most DIR_BLOCK_SPACE(blockSize)
+/// bytes of the block.
+struct MyFsDirBlockHeader {
+    uint32_t next;              // directory block number of the next overflow block, 0 for none
+    uint16_t used;              // bytes in use, including the header
+    uint16_t reserved;
+};
+
+/// @brief Record of a directory block. The name follows the record without a terminating '\0'.
+struct MyFsDirRecord {
+    uint32_t inode;
+    uint32_t parent;            // inode of the directory holding the entry
+    uint32_t hash;              // DirIndex::hash() of the parent and the name
+    uint16_t length;            // of the record including the name and padding
+    uint16_t nameLength;
+};
+
+#define DIR_RECORD_SIZE(nameLength) ((sizeof(MyFsDirRecord) + (nameLength) + 3) & ~(size_t) 3)
+
+// bytes of a directory block that may be used, MyFsDirBlockHeader::used must not wrap in blocks of 64 KiB
+#define DIR_BLOCK_SPACE(blockSize) ((blockSize) > 0xfffc ? (size_t) 0xfffc : (size_t) (blockSize))
+
+static_assert(sizeof(MyFsDirBlockHeader) + DIR_RECORD_SIZE(NAME_LENGTH) <= MIN_BLOCK_SIZE,
+              "directory record exceeds block size");
+
+// --- Checkpoint ---
+//
+// A clean unmount stores the used inode map and the directory entries in a hidden file, the checkpoint. A mount after
+// a clean unmount loads the checkpoint instead of scanning the inode table and the directory, the blocks of the inode
+// table are then read on first access.
+
+#define MYFS_CHECKPOINT_MAGIC 0x4b43794d   // "MyCK"
+
+/// @brief Header of the checkpoint. It is followed by the used inode map and the directory entries.
+struct MyFsCheckpoint {
+    uint32_t magic;
+    uint32_t numInodes;
+    uint32_t mapSize;           // bytes of the used inode map
+    uint32_t numEntries;        // number of directory entries
+    uint32_t numFree;           // free blocks, must match the free block map
+    uint32_t allocHint;         // next-fit position for files without blocks
+};
+
+/// @brief Directory entry of the checkpoint. The name follows the entry without a terminating '\0'.
+struct MyFsCheckpointEntry {
+    uint32_t inode;
+    uint32_t parent;
+    uint32_t dirBlock;          // directory block holding the entry
+    uint16_t length;            // of the entry including the name and padding
+    uint16_t nameLength;
+};
+
+#define CHECKPOINT_ENTRY_SIZE(nameLength) ((sizeof(MyFsCheckpointEntry) + (nameLength) + 3) & ~(size_t) 3)
+
+// --- Journal ---
+//
+// Changed meta data blocks, i.e. the superblock, the free block map, the inode table, extent blocks and directory
+// blocks, are logged to the journal before they are written in place. The first block of the journal is its header,
+// transactions follow one after another. A transaction consists of descriptor blocks, each followed by the images of
+// the blocks it lists, and a commit block. A transaction is valid if its sequence number is the next one expected and
+// the checksum of its commit block matches. When the journal is full, all blocks logged so far are written in place
+// and the journal starts over at the block behind the header.
+
+#define MYFS_JOURNAL_MAGIC 0x4e4a794d      // "MyJN"
+#define JOURNAL_HEADER 1
+#define JOURNAL_DESCRIPTOR 2
+#define JOURNAL_COMMIT 3
+#define JOURNAL_MIN_BLOCKS 64
+#define JOURNAL_MAX_BLOCKS 4096
+
+/// @brief Header, descriptor or commit block of the journal.
+///
+/// The header holds the sequence number of the first transaction behind it. A descriptor lists count blocks, whose
+/// images follow it, and numRevoked blocks whose images in earlier transactions must not be replayed, since the
+/// blocks were freed and may hold file data now. The commit block holds the checksum of the descriptors and images of
+/// its transaction.
+struct MyFsJournalBlock {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t numRevoked;
+    uint32_t checksum;
+    uint32_t blocks[1];         // count logged blocks, then numRevoked revoked blocks
+};
+
+#define JOURNAL_TAGS_PER_BLOCK(blockSize) (((blockSize) - offsetof(MyFsJournalBlock, blocks)) / sizeof(uint32_t))
+
+// --- Snapshot image ---
+//
+// With -o image, the in-memory file system stores all files in an image file when it is unmounted, or when the
+// snapshot attribute of the root directory is set. The image holds a header, the content chunks, then the inode
+// records, the chunk map and the names. Each inode record names the directory holding the file. Sections are
+// referenced by their byte offset in the image, so the image can be mapped at any address. The chunks start at a
+// multiple of IMAGE_ALIGN, so a mount maps the image and uses each chunk in place, its pages are only read when they
+// are accessed.
+
+#define MYFS_IMAGE_MAGIC 0x4d49794d        // "MyIM"
+#define MYFS_IMAGE_VERSION 2
+#define IMAGE_ALIGN 65536                   // at least the page size of all platforms
+#define IMAGE_NO_CHUNK 0xffffffff           // chunk map entry of a chunk that is not allocated
+
+/// @brief Header of the snapshot image.
+struct MyFsImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t imageSize;         // detects truncated images
+    uint64_t chunkSize;
+    uint32_t numInodes;         // inode records, including free inodes
+    uint32_t numChunks;         // stored content chunks
+    uint64_t numMapEntries;     // entries of the chunk map
+    uint64_t chunkOffset;       // first content chunk, a multiple of IMAGE_ALIGN
+    uint64_t inodeOffset;       // first inode record
+    uint64_t mapOffset;         // chunk map, one uint32_t per chunk of each file, IMAGE_NO_CHUNK for holes
+    uint64_t nameOffset;        // names of the files, without terminating '\0'
+    uint64_t nameSize;
+};
 
-// TODO: Add structures of your file system here
+/// @brief Inode record of the snapshot image, a mode of 0 marks a free inode.
+struct MyFsImageInode {
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size;
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
+    uint64_t firstEntry;        // first entry of the file in the chunk map
+    uint32_t numEntries;        // one entry per chunk up to the last allocated one
+    uint32_t nameLength;
+    uint64_t name;              // position of the name in the name section
+    uint32_t parent;            // inode of the directory holding the file
+    uint32_t reserved;
+};
 
 #endif /* myfs_structs_h */
@@ -11,14 +11,23 @@
 
 #include <fuse.h>
 #include <cmath>
+#include <mutex>
+#include <string>
 
 #include "blockdevice.h"
 #include "myfs-structs.h"
+#include "rwlock.h"
+#include "logger.h"
+#include "opstats.h"
+#include "filetable.h"
+#include "dentrycache.h"
+
+struct MyFsInfo;
 
 class MyFS {
 protected:
     static MyFS *_instance;
-    FILE *logFile;
+    Logger logger;
 
     BlockDevice *blockDevice;
     
@@ -26,6 +35,16 @@ public:
     static MyFS *Instance();
     
     // TODO: [PART 2] You may add attributes of your file system here
+
+    // Locks for the multithreaded mode. Lock order: dirLock, inodeLocks (ascending inode number), allocLock
+    RWLock dirLock;              // directories, i.e., mapping of names to inodes
+    InodeLockTable inodeLocks;   // meta data & content of single files
+    std::mutex allocLock;        // block & inode allocation
+
+    OpStats stats;               // calls of the FUSE operations, counted by the wrap_* functions
+    FileTable openFiles;         // handles of the open files, stored in fuse_file_info::fh
+    DentryCache dentries;        // resolved paths, changed with the directories under dirLock
+    int64_t atimeInterval;       // seconds after which a read updates the access time, 0 always, ATIME_NEVER never
     
     MyFS();
     virtual ~MyFS();
@@ -48,6 +67,10 @@ public:
     virtual int fuseOpen(const char *path, struct fuse_file_info *fileInfo);
     virtual int fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
+#if FUSE_VERSION >= 29
+    virtual int fuseReadBuf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fileInfo);
+    virtual int fuseWriteBuf(const char *path, struct fuse_bufvec *buf, off_t offset, struct fuse_file_info *fileInfo);
+#endif
     virtual int fuseStatfs(const char *path, struct statvfs *statInfo);
     virtual int fuseFlush(const char *path, struct fuse_file_info *fileInfo);
     virtual int fuseRelease(const char *path, struct fuse_file_info *fileInfo);
@@ -71,6 +94,15 @@ public:
     virtual void fuseDestroy();
     
     // TODO: [PART 2] You may add methods of your file system here
+    static int checkPath(const char *path);
+    int resolvePath(const char *path, uint32_t *ino);
+    int resolveParent(const char *path, uint32_t *parent, const char **name);
+    int resolvePrefix(const char *path, size_t length, uint32_t *ino);
+    virtual int lookupEntry(uint32_t dir, const char *name, uint32_t *ino);
+    virtual bool isDirectory(uint32_t ino);
+    void initAtime(const MyFsInfo *info);
+    bool isAtimeStale(int64_t atime, int64_t mtime, int64_t ctime, int64_t now) const;
+    virtual void reportStats(std::string &out);
     
 };
 
@@ -8,10 +8,38 @@
 
 #include <fuse.h>
 #include <cmath>
+#include <atomic>
+#include <string>
+#include <vector>
 
 #include "myfs.h"
 #include "blockdevice.h"
 #include "myfs-structs.h"
+#include "dirindex.h"
+#include "chunkarena.h"
+
+#define MEM_CHUNK_SIZE CA_DEFAULT_CHUNK_SIZE
+#define MYFS_SNAPSHOT_XATTR "user.myfs.snapshot"
+
+/// @brief File of the in-memory file system.
+///
+/// The content is kept in chunks of MEM_CHUNK_SIZE bytes from the chunk arena of the file system. Chunks that were
+/// never written are not allocated and read as zeros. Bytes behind the end of the file in its last chunk are zero.
+struct MyFsMemFile {
+    uint32_t ino;
+    mode_t mode;
+    nlink_t nlink;              // 0 once the file is removed from the directory
+    uid_t uid;
+    gid_t gid;
+    time_t atime;
+    time_t mtime;
+    time_t ctime;
+    uint32_t openCount;         // the file is freed when it is neither linked nor open
+
+    std::vector<char *> chunks;     // NULL for chunks that are not allocated
+    uint32_t numChunks;             // number of allocated chunks
+    size_t size;
+};
 
 /// @brief In-memory implementation of a simple file system.
 class MyInMemoryFS : public MyFS {
@@ -22,6 +50,16 @@ public:
     static MyInMemoryFS *Instance();
 
     // TODO: [PART 1] Add attributes of your file system here
+    std::vector<MyFsMemFile *> files;       // indexed by inode number, NULL for free inodes
+    std::vector<uint32_t> freeInodes;
+    DirIndex dirIndex;                      // entries of all directories
+    ChunkArena arena;                       // storage for the content of all files
+    std::string imageFile;                  // snapshot image, see -o image, empty for none
+    char *imageMap;                         // mapping of the image loaded by fuseInit(), NULL for none
+    size_t imageSize;
+    std::atomic<uint64_t> numImageChunks;   // chunks of the mapping still used by files
+    std::atomic<uint64_t> numUsedChunks;    // chunks used by all files, from the arena or the image
+    std::atomic<uint32_t> numFiles;         // allocated inodes, including the root directory
 
     MyInMemoryFS();
     ~MyInMemoryFS();
@@ -32,11 +70,14 @@ public:
     // For Documentation see https://libfuse.github.io/doxygen/structfuse__operations.html
     virtual int fuseGetattr(const char *path, struct stat *statbuf);
     virtual int fuseMknod(const char *path, mode_t mode, dev_t dev);
+    virtual int fuseMkdir(const char *path, mode_t mode);
     virtual int fuseUnlink(const char *path);
+    virtual int fuseRmdir(const char *path);
     virtual int fuseRename(const char *path, const char *newpath);
     virtual int fuseChmod(const char *path, mode_t mode);
     virtual int fuseChown(const char *path, uid_t uid, gid_t gid);
     virtual int fuseTruncate(const char *path, off_t newSize);
+    virtual int fuseUtime(const char *path, struct utimbuf *ubuf);
     virtual int fuseOpen(const char *path, struct fuse_file_info *fileInfo);
     virtual int fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
@@ -44,9 +85,33 @@ public:
     virtual void* fuseInit(struct fuse_conn_info *conn);
     virtual int fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
+    virtual int fuseStatfs(const char *path, struct statvfs *statInfo);
+#ifdef __APPLE__
+    virtual int fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags, uint32_t x);
+#else
+    virtual int fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags);
+#endif
     virtual void fuseDestroy();
 
+    virtual void reportStats(std::string &out);
+
     // TODO: Add methods of your file system here
+    virtual int lookupEntry(uint32_t dir, const char *name, uint32_t *ino);
+    virtual bool isDirectory(uint32_t ino);
+    int createFile(const char *path, mode_t mode, nlink_t nlink);
+    void removeEntry(int entry);
+    void touchDir(uint32_t dir, int nlinkDelta);
+    uint32_t allocFile();
+    void freeFile(uint32_t ino);
+    void unlinkFile(uint32_t ino);
+    int readFile(MyFsMemFile *file, char *buf, size_t size, off_t offset);
+    int writeFile(MyFsMemFile *file, const char *buf, size_t size, off_t offset);
+    int resizeFile(MyFsMemFile *file, off_t newSize);
+    void releaseChunks(MyFsMemFile *file, size_t from);
+    void releaseChunk(char *chunk);
+    bool isImageChunk(const char *chunk) const;
+    int saveImage(const char *path);
+    int loadImage(const char *path);
 
 };
 
@@ -6,42 +6,248 @@
 #ifndef MYFS_MYONDISKFS_H
 #define MYFS_MYONDISKFS_H
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "myfs.h"
+#include "myfs-structs.h"
+#include "blockcache.h"
+#include "blockbitmap.h"
+#include "dirindex.h"
+#include "journal.h"
+
+/// @brief In-memory state of an inode that is not stored in the inode table.
+struct MyFsInodeInfo {
+    std::vector<MyFsExtent> extents;        // all extents of the file, sorted by logical block
+    std::vector<uint32_t> extentBlocks;     // chain of blocks storing the extents beyond the inode
+    uint32_t numBlocks;                     // file blocks up to the end of the last extent, holes included
+    uint32_t usedBlocks;                    // number of allocated blocks
+    uint32_t numCompressed;                 // number of compressed clusters among the extents
+    uint32_t allocHint;                     // next-fit position for the next blocks of the file
+    std::vector<char> dirty;                // content of the buffered blocks, see MyOnDiskFS::bufferWrite()
+    uint32_t dirtyFirst;                    // first buffered file block
+    uint32_t dirtyCount;                    // number of buffered blocks, 0 if nothing is buffered
+    bool sizeChanged;                       // buffered writes grew the file, see MyOnDiskFS::flushFile()
+    bool lazyTimes;                         // times changed in memory only, see MyOnDiskFS::updateInode()
+    uint32_t spliceRefs;                    // open handles with spliced reads, see MyOnDiskFS::fuseReadBuf()
+    std::vector<std::pair<uint32_t, uint32_t> > pinnedRuns;  // blocks freed while spliceRefs > 0, start and count
+};
+
+/// @brief Decompressed cluster in the cluster cache of the on-disk file system.
+struct MyFsCachedCluster {
+    uint32_t start;                         // first container block of the compressed cluster, 0 for a free entry
+    uint64_t lastUse;
+    std::vector<char> data;
+};
+
+#define MYFS_COMPRESSION_XATTR "user.myfs.compression"
+
+#define CHECKSUM_VALID ((uint64_t) 1 << 32)     // see MyOnDiskFS::checksums
 
 /// @brief On-disk implementation of a simple file system.
 class MyOnDiskFS : public MyFS {
 protected:
     // BlockDevice blockDevice;
+    BlockCache *blockCache;
 
 public:
     static MyOnDiskFS *Instance();
 
     // TODO: [PART 1] Add attributes of your file system here
+    MyFsSuperBlock superBlock;
+    uint32_t blockSize;             // of the container, the superblock records it
+    uint32_t cacheBlocks;           // size of the block cache, see -o cacheblocks
+    BlockBitmap bitmap;             // in-memory copy of the free block map, freed blocks stay used until their commit
+    std::vector<uint64_t> freedMap; // blocks freed by the running transaction, one bit per block, see freeBlocks()
+    std::vector<std::pair<uint32_t, uint32_t> > freedRuns;  // the same blocks as runs of start and count
+    uint32_t numFreed;              // number of blocks in freedRuns
+    uint32_t numPinned;             // freed blocks pinned by spliced reads, see MyFsInodeInfo::pinnedRuns
+    MyFsInode *inodes;              // in-memory copy of the inode table
+    MyFsInodeInfo *inodeInfo;
+    std::atomic<bool> *inodeLoaded; // per block of the inode table, see loadInode()
+    std::mutex loadLock;            // serializes loading blocks of the inode table
+    BlockBitmap inodeMap;           // used inodes, only kept in memory
+    DirIndex dirIndex;              // entries of all directories, aux is the directory block holding the entry
+    uint32_t allocHint;             // next-fit position for files without blocks
+    std::atomic<uint32_t> numDirtyBlocks;   // blocks buffered for all files
+    std::atomic<uint32_t> numFreeBlocks;    // copies of the free counts of the maps, read by fuseStatfs()
+    std::atomic<uint32_t> numFreeInodes;
+    std::mutex metaLock;            // serializes updates of meta data blocks
+    std::vector<uint32_t> lazyInodes;       // inodes with lazyTimes, written by the next commit
+    std::mutex lazyLock;            // guards lazyInodes, taken after the inode locks
+    std::atomic<uint64_t> numLazyUpdates;   // inode writes saved by keeping the times in memory
+    bool compress;                  // compress clusters when buffered blocks are written, see -o compress
+    uint32_t clusterBlocks;         // blocks per compressed cluster
+    std::vector<MyFsCachedCluster> clusterCache;
+    uint64_t clusterClock;
+    std::mutex clusterLock;         // guards the cluster cache, taken after all other locks
+    Journal *journal;               // logs the changed meta data blocks
+    RWLock journalLock;             // held shared by operations changing meta data, taken before all other locks
+    uint32_t commitInterval;        // seconds between journal commits, see -o commit
+    std::thread commitThread;
+    std::mutex commitMutex;
+    std::condition_variable commitCond;     // the commit thread waits here for the next interval or a full batch
+    bool commitStop;
+    bool splice;                    // serve large reads from the container file descriptor, see -o splice
+    std::atomic<uint64_t> bytesSpliced;     // read by FUSE from the container file directly
+    std::atomic<uint64_t> bytesCopied;      // read into memory buffers by fuseReadBuf()
+    bool useChecksums;              // format a new container with block checksums, see -o checksum
+    std::atomic<uint64_t> *checksums;       // per container block CHECKSUM_VALID | CRC-32C, 0 if unknown, or NULL
+    std::atomic<uint64_t> numVerified;      // blocks read and checked against their checksum
+    std::atomic<uint64_t> numAdopted;       // blocks read without a known checksum, which was taken from the content
+    std::atomic<uint64_t> numChecksumErrors;
+    uint32_t scrubInterval;         // seconds between scrubs, 0 for none, see -o scrub
+    std::thread scrubThread;
+    std::mutex scrubMutex;
+    std::condition_variable scrubCond;
+    std::atomic<bool> scrubStop;    // also ends a running scrub early
+    std::atomic<uint64_t> numScrubbed;      // blocks read from the device by scrub()
+    std::atomic<uint64_t> numScrubs;        // finished scrubs
 
     MyOnDiskFS();
     ~MyOnDiskFS();
 
     static void SetInstance();
 
+    BlockCache *getBlockCache() const { return this->blockCache; }
+
     // --- Methods called by FUSE ---
     // For Documentation see https://libfuse.github.io/doxygen/structfuse__operations.html
     virtual int fuseGetattr(const char *path, struct stat *statbuf);
     virtual int fuseMknod(const char *path, mode_t mode, dev_t dev);
+    virtual int fuseMkdir(const char *path, mode_t mode);
     virtual int fuseUnlink(const char *path);
+    virtual int fuseRmdir(const char *path);
     virtual int fuseRename(const char *path, const char *newpath);
     virtual int fuseChmod(const char *path, mode_t mode);
     virtual int fuseChown(const char *path, uid_t uid, gid_t gid);
     virtual int fuseTruncate(const char *path, off_t newSize);
+    virtual int fuseUtime(const char *path, struct utimbuf *ubuf);
     virtual int fuseOpen(const char *path, struct fuse_file_info *fileInfo);
     virtual int fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
+#if FUSE_VERSION >= 29
+    virtual int fuseReadBuf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fileInfo);
+#endif
+    virtual int fuseFlush(const char *path, struct fuse_file_info *fileInfo);
     virtual int fuseRelease(const char *path, struct fuse_file_info *fileInfo);
+    virtual int fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo);
     virtual void* fuseInit(struct fuse_conn_info *conn);
     virtual int fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
+#ifdef __APPLE__
+    virtual int fuseGetxattr(const char *path, const char *name, char *value, size_t size, uint x);
+#else
+    virtual int fuseGetxattr(const char *path, const char *name, char *value, size_t size);
+#endif
+    virtual int fuseListxattr(const char *path, char *list, size_t size);
+    virtual int fuseStatfs(const char *path, struct statvfs *statInfo);
     virtual void fuseDestroy();
 
+    virtual void reportStats(std::string &out);
+
     // TODO: Add methods of your file system here
+    void allocTables();
+    static bool isValidBlockSize(uint32_t blockSize);
+    void updateFreeCounts();
+    void setBlockSize(uint32_t blockSize);
+    int format(uint32_t blockSize, uint32_t numBlocks);
+    int load();
+    int scanInodes();
+    int loadInode(uint32_t ino);
+    int loadCheckpoint();
+    int writeCheckpoint();
+    int loadChecksums();
+    int writeChecksums();
+    void setChecksums(uint32_t blockNo, uint32_t count, const char *data);
+    uint32_t verifyChecksums(uint32_t blockNo, uint32_t count, const char *data);
+    int scrub();
+    int scrubFile(uint32_t ino, std::vector<char> &buffer);
+    int scrubBlocks(uint32_t blockNo, uint32_t count, std::vector<char> &buffer);
+    void startScrubs();
+    void stopScrubs();
+    void scrubLoop();
+
+    int readMetaBlock(uint32_t blockNo, char *block);
+    int writeMetaBlock(uint32_t blockNo, char *block);
+    int writeMeta(uint32_t regionStart, size_t offset, const void *src, size_t size);
+    int commitJournal();
+    int commitTransaction();
+    void startCommits();
+    void stopCommits();
+    void commitLoop();
+    int writeSuperBlock();
+    int writeInode(uint32_t ino);
+    int updateInode(uint32_t ino, const MyFsInode *before);
+    void markLazy(uint32_t ino);
+    int writeLazyInodes();
+    void accessFile(uint32_t ino);
+
+    int readDirBlock(uint32_t dirBlock, char *block);
+    int writeDirBlock(uint32_t dirBlock, char *block);
+    int loadDir();
+    int rehashDir(uint32_t numBuckets);
+    int addDirEntry(uint32_t parent, const char *name, uint32_t ino);
+    int removeDirEntry(int entry);
+
+    int findDirEntry(uint32_t parent, const char *name);
+    virtual int lookupEntry(uint32_t dir, const char *name, uint32_t *ino);
+    virtual bool isDirectory(uint32_t ino);
+    int createFile(const char *path, mode_t mode, uint32_t nlink);
+    int removeEntry(int entry);
+    int touchDir(uint32_t dir, int nlinkDelta);
+    int allocInode();
+
+    int allocateBlocks(uint32_t hint, uint32_t want, uint32_t *start, uint32_t *count);
+    int freeBlocks(uint32_t start, uint32_t count, MyFsInodeInfo *owner= NULL);
+    int writeBitmap(uint32_t start, uint32_t count);
+    void releaseFreed();
+    void unpinBlocks(uint32_t ino);
+
+    int loadExtents(uint32_t ino);
+    int saveExtents(uint32_t ino, uint32_t from);
+    size_t findExtent(uint32_t ino, uint32_t block) const;
+    int mapBlocks(uint32_t ino, uint32_t first, uint32_t count, uint32_t *blocks,
+                  std::atomic<uint32_t> *cursor= NULL);
+    uint32_t countBlocks(uint32_t ino, uint32_t first, uint32_t count) const;
+    int fillBlocks(uint32_t ino, uint32_t first, uint32_t end);
+    int growBlocks(uint32_t ino, uint32_t numBlocks);
+    int shrinkBlocks(uint32_t ino, uint32_t numBlocks);
+    uint32_t storedBlocks(const MyFsExtent *extent) const;
+    void updateBlockEnd(uint32_t ino);
+    int releaseCluster(uint32_t ino, size_t e);
+
+    int readCluster(const MyFsExtent *extent, char *buf, size_t offset, size_t size);
+    void dropCluster(uint32_t start);
+    int expandCluster(uint32_t ino, size_t e);
+    int expandClusters(uint32_t ino, uint32_t first, uint32_t end);
+    int absorbClusters(uint32_t ino);
+    int storeCluster(uint32_t ino, uint32_t first, uint32_t count, const char *data);
+
+    int readFile(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor= NULL);
+    int readStored(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor= NULL);
+    int readRaw(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor= NULL);
+#if FUSE_VERSION >= 29
+    int spliceFile(uint32_t ino, size_t size, off_t offset, struct fuse_bufvec **bufp,
+                   std::atomic<uint32_t> *cursor= NULL);
+#endif
+    void readAhead(MyFsHandle *handle, off_t offset, size_t size);
+    int writeDirect(uint32_t ino, const char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor= NULL);
+    int bufferWrite(uint32_t ino, const char *buf, size_t size, off_t offset);
+    int writeInline(uint32_t ino, const char *buf, size_t size, off_t offset);
+    int moveInline(uint32_t ino);
+    int flushFile(uint32_t ino);
+    void dropBuffer(uint32_t ino);
+    int writeFile(uint32_t ino, const char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor= NULL);
+    int zeroFile(uint32_t ino, off_t from, off_t to);
+    int resizeFile(uint32_t ino, off_t newSize);
+    int removeFile(uint32_t ino);
+
+    int readDataBlocks(const uint32_t *blocks, uint32_t count, char *buffer);
+    int writeDataBlocks(const uint32_t *blocks, uint32_t count, char *buffer);
 
 };
 
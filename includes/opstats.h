@@ -0,0 +1,106 @@
+//
+//  opstats.h
+//  myfs
+//
+
+#ifndef opstats_h
+#define opstats_h
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define OS_SUB_BITS 3                                   // histogram buckets per power of two: 2^OS_SUB_BITS
+#define OS_NUM_BUCKETS ((40 - OS_SUB_BITS + 1) << OS_SUB_BITS)  // latencies up to 2^40 ns (~18 minutes)
+
+#define MYFS_STATS_XATTR "user.myfs.stats"
+
+/// @brief File system operations counted by OpStats.
+enum MyFsOp {
+    OP_GETATTR, OP_READLINK, OP_MKNOD, OP_MKDIR, OP_UNLINK, OP_RMDIR, OP_SYMLINK, OP_RENAME, OP_LINK, OP_CHMOD,
+    OP_CHOWN, OP_TRUNCATE, OP_UTIME, OP_OPEN, OP_READ, OP_WRITE, OP_STATFS, OP_FLUSH, OP_RELEASE, OP_FSYNC,
+    OP_SETXATTR, OP_GETXATTR, OP_LISTXATTR, OP_REMOVEXATTR, OP_OPENDIR, OP_READDIR, OP_RELEASEDIR, OP_FSYNCDIR,
+    OP_FTRUNCATE, OP_CREATE,
+    NUM_OPS
+};
+
+/// @brief Merged counters of one operation.
+struct OpSummary {
+    uint64_t count;
+    uint64_t errors;                    // calls returning -ERRNO
+    uint64_t bytes;                     // bytes read or written
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t buckets[OS_NUM_BUCKETS];   // latency histogram, see OpStats::bucket()
+};
+
+/// @brief Per-operation call counters and latency histograms
+///
+/// Each thread counts into a block of counters of its own, so recording a call takes no lock and does not share
+/// cache lines with other threads. The blocks are merged when the statistics are read. Latencies are sorted into
+/// log-linear buckets like an HDR histogram: 2^OS_SUB_BITS buckets per power of two, so the relative error of a
+/// percentile is at most 2^-OS_SUB_BITS.
+class OpStats {
+private:
+    struct OpCounters {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> totalNs;
+        std::atomic<uint64_t> maxNs;
+        std::atomic<uint64_t> buckets[OS_NUM_BUCKETS];
+    };
+
+    struct ThreadStats {
+        std::thread::id owner;
+        OpCounters ops[NUM_OPS];
+    };
+
+    uint64_t id;                        // tells the thread-local cache of ThreadStats which instance it belongs to
+    std::vector<ThreadStats *> threads;
+    mutable std::mutex lock;            // protects threads
+
+    OpStats(const OpStats &);
+    OpStats &operator=(const OpStats &);
+
+    ThreadStats *local();
+
+public:
+    OpStats();
+    ~OpStats();
+
+    /// @brief Current time in nanoseconds, for passing to record().
+    static uint64_t now();
+
+    /// @brief Histogram bucket of a latency.
+    static uint32_t bucket(uint64_t ns);
+    /// @brief Smallest latency sorted into a bucket.
+    static uint64_t bucketStart(uint32_t bucket);
+
+    static const char *getName(int op);
+
+    /// @brief Count a call.
+    /// \param [in] op Operation, see MyFsOp.
+    /// \param [in] start Time the call started, taken by now().
+    /// \param [in] ret Return value of the call, the number of bytes moved for OP_READ and OP_WRITE.
+    void record(int op, uint64_t start, int ret);
+
+    /// @brief Merge the counters of all threads.
+    /// \param [in] op Operation, see MyFsOp.
+    /// \param [out] summary Merged counters.
+    void getSummary(int op, OpSummary *summary) const;
+
+    /// @brief Latency below which a given fraction of the calls completed.
+    /// \param [in] summary Merged counters.
+    /// \param [in] fraction Fraction of the calls, 0 < fraction <= 1.
+    /// \return Upper bound of the bucket holding the percentile in nanoseconds, 0 if there were no calls.
+    static uint64_t percentile(const OpSummary *summary, double fraction);
+
+    /// @brief Append a table of all operations that were called to a report.
+    void report(std::string &out) const;
+};
+
+#endif /* opstats_h */
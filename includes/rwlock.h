@@ -0,0 +1,70 @@
+//
+//  rwlock.h
+//  myfs
+//
+
+#ifndef rwlock_h
+#define rwlock_h
+
+#include <pthread.h>
+#include <cstdint>
+
+/// @brief Reader/writer lock
+///
+/// Thin wrapper around a pthread reader/writer lock. Any number of readers or a single writer may hold the lock.
+class RWLock {
+private:
+    pthread_rwlock_t lock;
+
+    RWLock(const RWLock &);
+    RWLock &operator=(const RWLock &);
+
+public:
+    RWLock() { pthread_rwlock_init(&lock, NULL); }
+    ~RWLock() { pthread_rwlock_destroy(&lock); }
+
+    void readLock() { pthread_rwlock_rdlock(&lock); }
+    void writeLock() { pthread_rwlock_wrlock(&lock); }
+    void unlock() { pthread_rwlock_unlock(&lock); }
+};
+
+/// @brief Hold a reader/writer lock in read mode until the end of the scope.
+class ReadGuard {
+private:
+    RWLock &lock;
+
+public:
+    explicit ReadGuard(RWLock &lock) : lock(lock) { lock.readLock(); }
+    ~ReadGuard() { lock.unlock(); }
+};
+
+/// @brief Hold a reader/writer lock in write mode until the end of the scope.
+class WriteGuard {
+private:
+    RWLock &lock;
+
+public:
+    explicit WriteGuard(RWLock &lock) : lock(lock) { lock.writeLock(); }
+    ~WriteGuard() { lock.unlock(); }
+};
+
+/// @brief Table of per-inode reader/writer locks
+///
+/// Inodes are mapped to a fixed number of locks by their number, so the table does not grow with the number of
+/// inodes. Operations on different files only contend if their inodes share a lock.
+class InodeLockTable {
+private:
+    RWLock *locks;
+    uint32_t numLocks;
+
+    InodeLockTable(const InodeLockTable &);
+    InodeLockTable &operator=(const InodeLockTable &);
+
+public:
+    explicit InodeLockTable(uint32_t numLocks) : locks(new RWLock[numLocks]), numLocks(numLocks) {}
+    ~InodeLockTable() { delete [] locks; }
+
+    RWLock &get(uint32_t inode) { return locks[inode % numLocks]; }
+};
+
+#endif /* rwlock_h */
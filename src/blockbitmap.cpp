@@ -0,0 +1,208 @@
+//
+//  blockbitmap.cpp
+//  myfs
+//
+
+#include <cstring>
+#include <algorithm>
+
+#include "blockbitmap.h"
+
+#define BB_FULL (~(uint64_t) 0)
+
+BlockBitmap::BlockBitmap() {
+    this->words= NULL;
+    this->numWords= 0;
+    this->numBits= 0;
+    this->numFree= 0;
+}
+
+BlockBitmap::~BlockBitmap() {
+    delete [] this->words;
+}
+
+void BlockBitmap::resize(uint32_t numBits, size_t numBytes) {
+    numBytes= std::max(numBytes, ((size_t) numBits + 7) / 8);
+
+    delete [] this->words;
+    this->numWords= (uint32_t) ((numBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    this->words= new uint64_t[this->numWords];
+    memset(this->words, 0, (size_t) this->numWords * sizeof(uint64_t));
+    this->numBits= numBits;
+
+    rebuild();
+}
+
+void BlockBitmap::rebuild() {
+    // padding bits are used, so searches never return them
+    for(uint64_t b= this->numBits; b < (uint64_t) this->numWords * 64; b= (b / 64 + 1) * 64)
+        this->words[b / 64] |= BB_FULL << (b % 64);
+
+    this->numFree= 0;
+    for(uint32_t i= 0; i < this->numWords; i++)
+        this->numFree+= __builtin_popcountll(~this->words[i]);
+
+    this->summary.clear();
+    uint32_t size= this->numWords;
+    while(size > 1) {
+        const uint64_t *below= getLevel((uint32_t) this->summary.size(), &size);
+        std::vector<uint64_t> level((size + 63) / 64, 0);
+        for(uint32_t i= 0; i < size; i++) {
+            if(below[i] == BB_FULL)
+                level[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+        for(uint64_t i= size; i < (uint64_t) level.size() * 64; i= (i / 64 + 1) * 64)
+            level[i / 64] |= BB_FULL << (i % 64);
+
+        size= (uint32_t) level.size();
+        this->summary.push_back(level);
+    }
+}
+
+uint64_t *BlockBitmap::getLevel(uint32_t level, uint32_t *size) {
+    if(level == 0) {
+        *size= this->numWords;
+        return this->words;
+    }
+    *size= (uint32_t) this->summary[level - 1].size();
+    return this->summary[level - 1].data();
+}
+
+/// @brief Find the first zero bit at or after pos in a level.
+///
+/// If the word holding pos has no zero bit left, the level above tells the next word that is not full.
+/// \return Index of the bit, -1 if there is none.
+int64_t BlockBitmap::findZero(uint32_t level, uint64_t pos) {
+    uint32_t size;
+    uint64_t *w= getLevel(level, &size);
+
+    uint64_t i= pos / 64;
+    if(i >= size)
+        return -1;
+
+    uint64_t free= ~w[i] & (BB_FULL << (pos % 64));
+    if(free != 0)
+        return (int64_t) (i * 64 + __builtin_ctzll(free));
+
+    if(level == this->summary.size()) {
+        for(i++; i < size; i++) {
+            if(w[i] != BB_FULL)
+                return (int64_t) (i * 64 + __builtin_ctzll(~w[i]));
+        }
+        return -1;
+    }
+
+    int64_t next= findZero(level + 1, i + 1);
+    if(next < 0)
+        return -1;
+    return next * 64 + __builtin_ctzll(~w[next]);
+}
+
+/// @brief Count the free blocks starting at pos, at most max.
+uint32_t BlockBitmap::runLength(uint32_t pos, uint32_t max) const {
+    uint32_t n= 0;
+    while(n < max && (uint64_t) pos + n < this->numBits) {
+        uint32_t p= pos + n;
+        uint64_t bits= this->words[p / 64] >> (p % 64);
+        if(bits == 0) {
+            n+= 64 - p % 64;
+        } else {
+            n+= __builtin_ctzll(bits);
+            break;
+        }
+    }
+    return std::min(n, max);
+}
+
+void BlockBitmap::markFull(uint32_t level, uint32_t index) {
+    if(level == this->summary.size())
+        return;
+
+    uint64_t &word= this->summary[level][index / 64];
+    word|= (uint64_t) 1 << (index % 64);
+    if(word == BB_FULL)
+        markFull(level + 1, index / 64);
+}
+
+void BlockBitmap::markNotFull(uint32_t level, uint32_t index) {
+    if(level == this->summary.size())
+        return;
+
+    uint64_t &word= this->summary[level][index / 64];
+    bool wasFull= word == BB_FULL;
+    word&= ~((uint64_t) 1 << (index % 64));
+    if(wasFull)
+        markNotFull(level + 1, index / 64);
+}
+
+bool BlockBitmap::allocate(uint32_t hint, uint32_t want, uint32_t *start, uint32_t *count) {
+    if(this->numFree == 0 || want == 0)
+        return false;
+    if(hint >= this->numBits)
+        hint= 0;
+
+    uint32_t bestStart= 0;
+    uint32_t bestLength= 0;
+    uint64_t pos= hint;
+    bool wrapped= false;
+
+    for(int probe= 0; probe < BB_MAX_PROBES; probe++) {
+        int64_t b= findZero(0, pos);
+        if(b < 0 && !wrapped) {
+            wrapped= true;
+            b= findZero(0, 0);
+        }
+        if(b < 0 || (wrapped && b >= hint))
+            break;
+
+        uint32_t length= runLength((uint32_t) b, want);
+        if(length > bestLength) {
+            bestStart= (uint32_t) b;
+            bestLength= length;
+        }
+        if(length == want || b == hint)
+            break;
+        pos= (uint64_t) b + length;
+    }
+
+    if(bestLength == 0)
+        return false;
+
+    set(bestStart, bestLength);
+    *start= bestStart;
+    *count= bestLength;
+    return true;
+}
+
+void BlockBitmap::set(uint32_t start, uint32_t count) {
+    uint64_t end= (uint64_t) start + count;
+    for(uint64_t b= start; b < end; ) {
+        uint32_t i= (uint32_t) (b / 64);
+        uint32_t n= (uint32_t) std::min(64 - b % 64, end - b);
+        uint64_t mask= (n == 64 ? BB_FULL : (((uint64_t) 1 << n) - 1)) << (b % 64);
+
+        uint64_t changed= mask & ~this->words[i];
+        this->numFree-= __builtin_popcountll(changed);
+        this->words[i]|= mask;
+        if(changed != 0 && this->words[i] == BB_FULL)
+            markFull(0, i);
+        b+= n;
+    }
+}
+
+void BlockBitmap::release(uint32_t start, uint32_t count) {
+    uint64_t end= (uint64_t) start + count;
+    for(uint64_t b= start; b < end; ) {
+        uint32_t i= (uint32_t) (b / 64);
+        uint32_t n= (uint32_t) std::min(64 - b % 64, end - b);
+        uint64_t mask= (n == 64 ? BB_FULL : (((uint64_t) 1 << n) - 1)) << (b % 64);
+
+        uint64_t changed= mask & this->words[i];
+        bool wasFull= this->words[i] == BB_FULL;
+        this->numFree+= __builtin_popcountll(changed);
+        this->words[i]&= ~mask;
+        if(changed != 0 && wasFull)
+            markNotFull(0, i);
+        b+= n;
+    }
+}
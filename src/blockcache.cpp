@@ -0,0 +1,519 @@
+//
+//  blockcache.cpp
+//  myfs
+//
+
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <errno.h>
+
+#include "blockcache.h"
+
+BlockCache::BlockCache(BlockDevice *blockDevice, uint32_t numBlocks) {
+    assert(numBlocks > 0);
+
+    this->blockDevice= blockDevice;
+    this->blockSize= blockDevice->getBlockSize();
+    this->numBlocks= numBlocks;
+
+    // aligned, so transfers of a container opened with O_DIRECT are not bounced
+    this->data= BufferPool::allocAligned((size_t) numBlocks * this->blockSize);
+    if(this->data == NULL)
+        throw std::bad_alloc();
+    blockDevice->registerBuffer(this->data, (size_t) numBlocks * this->blockSize);
+    this->entries= new Entry[numBlocks];
+    this->index.reserve(numBlocks);
+
+    // chain all (invalid) entries, the first misses take them front to back
+    this->head= this->tail= -1;
+    for(uint32_t e= 0; e < numBlocks; e++) {
+        this->entries[e].blockNo= 0;
+        this->entries[e].valid= false;
+        this->entries[e].dirty= false;
+        this->entries[e].prefetched= false;
+        pushFront((int32_t) e);
+    }
+
+    this->hits= 0;
+    this->misses= 0;
+    this->writeBacks= 0;
+    this->prefetchedBlocks= 0;
+    this->prefetchHits= 0;
+    this->prefetchWasted= 0;
+
+    this->writeSeq= 0;
+    this->writesInFlight= 0;
+    this->prefetchBusy= false;
+    this->prefetchStop= false;
+}
+
+BlockCache::~BlockCache() {
+    stopPrefetch();
+    this->blockDevice->unregisterBuffer(this->data);
+    delete [] this->entries;
+    BufferPool::freeAligned(this->data);
+}
+
+void BlockCache::unlink(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    if(entry->prev >= 0)
+        this->entries[entry->prev].next= entry->next;
+    else
+        this->head= entry->next;
+
+    if(entry->next >= 0)
+        this->entries[entry->next].prev= entry->prev;
+    else
+        this->tail= entry->prev;
+
+    entry->prev= entry->next= -1;
+}
+
+void BlockCache::pushFront(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    entry->prev= -1;
+    entry->next= this->head;
+    if(this->head >= 0)
+        this->entries[this->head].prev= e;
+    this->head= e;
+    if(this->tail < 0)
+        this->tail= e;
+}
+
+void BlockCache::pushBack(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    entry->next= -1;
+    entry->prev= this->tail;
+    if(this->tail >= 0)
+        this->entries[this->tail].next= e;
+    this->tail= e;
+    if(this->head < 0)
+        this->head= e;
+}
+
+int BlockCache::writeBack(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    int ret= this->blockDevice->write(entry->blockNo, this->data + (size_t) e * this->blockSize);
+    if(ret >= 0) {
+        entry->dirty= false;
+        this->writeBacks++;
+    }
+    this->writeSeq++;
+    return ret;
+}
+
+// Reassign the least recently used entry to blockNo, which must not be cached. The entry is written back first if it
+// is dirty; *slot is returned with valid == false.
+int BlockCache::replace(uint32_t blockNo, int32_t *slot) {
+    int32_t victim= this->tail;
+    Entry *entry= &this->entries[victim];
+
+    if(entry->valid) {
+        if(entry->dirty) {
+            int ret= writeBack(victim);
+            if(ret < 0)
+                return ret;
+        }
+        if(entry->prefetched)
+            this->prefetchWasted++;
+        this->index.erase(entry->blockNo);
+    }
+
+    entry->blockNo= blockNo;
+    entry->valid= false;
+    entry->dirty= false;
+    entry->prefetched= false;
+    this->index[blockNo]= victim;
+    *slot= victim;
+
+    return 0;
+}
+
+// Find the entry for blockNo and make it the most recently used one. If the block is not cached, the least recently
+// used entry is reassigned, see replace().
+int BlockCache::getSlot(uint32_t blockNo, int32_t *slot) {
+    std::unordered_map<uint32_t, uint32_t>::iterator it= this->index.find(blockNo);
+
+    if(it != this->index.end()) {
+        this->hits++;
+        *slot= (int32_t) it->second;
+    } else {
+        this->misses++;
+        int ret= replace(blockNo, slot);
+        if(ret < 0)
+            return ret;
+    }
+
+    if(*slot != this->head) {
+        unlink(*slot);
+        pushFront(*slot);
+    }
+
+    return 0;
+}
+
+int BlockCache::read(uint32_t blockNo, char *buffer) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    int32_t e;
+    int ret= getSlot(blockNo, &e);
+    if(ret < 0)
+        return ret;
+
+    char *block= this->data + (size_t) e * this->blockSize;
+    if(!this->entries[e].valid) {
+        ret= this->blockDevice->read(blockNo, block);
+        if(ret < 0) {
+            this->index.erase(blockNo);
+            return ret;
+        }
+        this->entries[e].valid= true;
+    }
+    if(this->entries[e].prefetched) {
+        this->prefetchHits++;
+        this->entries[e].prefetched= false;
+    }
+
+    memcpy(buffer, block, this->blockSize);
+    return 0;
+}
+
+int BlockCache::write(uint32_t blockNo, char *buffer) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    int32_t e;
+    int ret= getSlot(blockNo, &e);
+    if(ret < 0)
+        return ret;
+
+    // the whole block is overwritten, so there is no need to fetch it first
+    memcpy(this->data + (size_t) e * this->blockSize, buffer, this->blockSize);
+    this->entries[e].valid= true;
+    this->entries[e].dirty= true;
+    if(this->entries[e].prefetched) {
+        this->prefetchWasted++;
+        this->entries[e].prefetched= false;
+    }
+
+    return 0;
+}
+
+int32_t BlockCache::lookup(uint32_t blockNo) const {
+    std::unordered_map<uint32_t, uint32_t>::const_iterator it= this->index.find(blockNo);
+    if(it == this->index.end() || !this->entries[it->second].valid)
+        return -1;
+    return (int32_t) it->second;
+}
+
+int BlockCache::readBlocks(uint32_t blockNo, uint32_t count, char *buffer) {
+    std::vector<BlockTransfer> runs;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        uint32_t b= 0;
+        while(b < count) {
+            int32_t e;
+            while(b < count && (e= lookup(blockNo + b)) >= 0) {
+                this->hits++;
+                memcpy(buffer + (size_t) b * this->blockSize, this->data + (size_t) e * this->blockSize,
+                       this->blockSize);
+                if(this->entries[e].prefetched) {
+                    // streamed data is rarely read twice, make room for the next blocks read ahead
+                    this->prefetchHits++;
+                    this->entries[e].prefetched= false;
+                    if(e != this->tail) {
+                        unlink(e);
+                        pushBack(e);
+                    }
+                }
+                b++;
+            }
+            uint32_t run= 0;
+            while(b + run < count && lookup(blockNo + b + run) < 0)
+                run++;
+            if(run > 0) {
+                BlockTransfer transfer= { false, blockNo + b, run, buffer + (size_t) b * this->blockSize, NULL, 0 };
+                runs.push_back(transfer);
+                this->misses+= run;
+                b+= run;
+            }
+        }
+    }
+
+    // read all runs of uncached blocks at once, without holding the lock
+    if(runs.empty())
+        return 0;
+    return this->blockDevice->submit(runs.data(), runs.size());
+}
+
+int BlockCache::writeBlocks(uint32_t blockNo, uint32_t count, char *buffer) {
+    {
+        // update cached copies first, so a concurrent flush cannot overwrite the new content with a stale copy
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        for(uint32_t b= 0; b < count; b++) {
+            int32_t e= lookup(blockNo + b);
+            if(e >= 0) {
+                memcpy(this->data + (size_t) e * this->blockSize, buffer + (size_t) b * this->blockSize,
+                       this->blockSize);
+                this->entries[e].dirty= false;
+                if(this->entries[e].prefetched) {
+                    this->prefetchWasted++;
+                    this->entries[e].prefetched= false;
+                }
+            }
+        }
+        this->writesInFlight++;
+    }
+
+    int ret= this->blockDevice->writeBlocks(blockNo, count, buffer);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    if(ret < 0) {
+        // the device still has the old content, keep the new one dirty so it is written back later
+        for(uint32_t b= 0; b < count; b++) {
+            int32_t e= lookup(blockNo + b);
+            if(e >= 0)
+                this->entries[e].dirty= true;
+        }
+    }
+    this->writesInFlight--;
+    this->writeSeq++;
+
+    return ret;
+}
+
+int BlockCache::flush() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    std::vector<std::pair<uint32_t, int32_t> > dirty;
+
+    for(uint32_t e= 0; e < this->numBlocks; e++) {
+        if(this->entries[e].valid && this->entries[e].dirty)
+            dirty.push_back(std::make_pair(this->entries[e].blockNo, (int32_t) e));
+    }
+    std::sort(dirty.begin(), dirty.end());
+
+    // each run of consecutive dirty blocks is one transfer, all of them are submitted together
+    std::vector<char *> buffers(dirty.size());
+    std::vector<BlockTransfer> runs;
+    std::vector<size_t> runStart;
+    size_t i= 0;
+    while(i < dirty.size()) {
+        size_t j= i;
+        do {
+            buffers[j]= this->data + (size_t) dirty[j].second * this->blockSize;
+            j++;
+        } while(j < dirty.size() && dirty[j].first == dirty[j - 1].first + 1);
+
+        BlockTransfer transfer= { true, dirty[i].first, (uint32_t) (j - i), NULL, &buffers[i], 0 };
+        runs.push_back(transfer);
+        runStart.push_back(i);
+        i= j;
+    }
+    if(runs.empty())
+        return 0;
+
+    int ret= this->blockDevice->submit(runs.data(), runs.size());
+    this->writeSeq+= runs.size();
+    for(size_t r= 0; r < runs.size(); r++) {
+        if(runs[r].result < 0)
+            continue;
+        for(size_t k= runStart[r]; k < runStart[r] + runs[r].count; k++)
+            this->entries[dirty[k].second].dirty= false;
+        this->writeBacks+= runs[r].count;
+    }
+
+    return ret;
+}
+
+int BlockCache::invalidate() {
+    int ret= flush();
+    if(ret < 0)
+        return ret;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(uint32_t e= 0; e < this->numBlocks; e++) {
+        if(this->entries[e].valid && this->entries[e].prefetched)
+            this->prefetchWasted++;
+        this->entries[e].valid= false;
+        this->entries[e].prefetched= false;
+    }
+    this->index.clear();
+    this->writeSeq++;
+
+    return 0;
+}
+
+int BlockCache::prefetch(uint32_t blockNo, uint32_t count) {
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        // a write in progress may or may not have reached the device yet
+        if(this->writesInFlight > 0)
+            return 0;
+
+        count= std::min(count, std::max(this->numBlocks / 2, (uint32_t) 1));
+        while(count > 0 && lookup(blockNo) >= 0) {
+            blockNo++;
+            count--;
+        }
+        while(count > 0 && lookup(blockNo + count - 1) >= 0)
+            count--;
+        if(count == 0)
+            return 0;
+
+        seq= this->writeSeq;
+    }
+
+    // read without holding the lock, like readBlocks()
+    std::vector<char> buffer((size_t) count * this->blockSize);
+    int ret= this->blockDevice->readBlocks(blockNo, count, buffer.data());
+    if(ret < 0)
+        return ret;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    // the blocks may have been written in the meantime, the content just read could be stale
+    if(this->writeSeq != seq || this->writesInFlight > 0)
+        return 0;
+
+    for(uint32_t b= 0; b < count; b++) {
+        if(lookup(blockNo + b) >= 0)
+            continue;
+
+        int32_t e;
+        ret= replace(blockNo + b, &e);
+        if(ret < 0)
+            return ret;
+        memcpy(this->data + (size_t) e * this->blockSize, buffer.data() + (size_t) b * this->blockSize,
+               this->blockSize);
+        this->entries[e].valid= true;
+        this->entries[e].prefetched= true;
+        if(e != this->head) {
+            unlink(e);
+            pushFront(e);
+        }
+        this->prefetchedBlocks++;
+    }
+
+    return 0;
+}
+
+void BlockCache::prefetchAsync(uint32_t blockNo, uint32_t count) {
+    std::lock_guard<std::mutex> guard(this->prefetchLock);
+
+    if(this->prefetchQueue.size() >= BC_PREFETCH_QUEUE)
+        return;
+    if(!this->prefetchThread.joinable())
+        this->prefetchThread= std::thread(&BlockCache::prefetchLoop, this);
+
+    this->prefetchQueue.push_back(std::make_pair(blockNo, count));
+    this->prefetchCond.notify_one();
+}
+
+void BlockCache::prefetchLoop() {
+    std::unique_lock<std::mutex> guard(this->prefetchLock);
+    for(;;) {
+        while(!this->prefetchStop && this->prefetchQueue.empty())
+            this->prefetchCond.wait(guard);
+        if(this->prefetchStop)
+            break;
+
+        std::pair<uint32_t, uint32_t> request= this->prefetchQueue.front();
+        this->prefetchQueue.pop_front();
+        this->prefetchBusy= true;
+
+        guard.unlock();
+        prefetch(request.first, request.second);
+        guard.lock();
+
+        this->prefetchBusy= false;
+        if(this->prefetchQueue.empty())
+            this->prefetchIdle.notify_all();
+    }
+}
+
+void BlockCache::waitPrefetch() {
+    std::unique_lock<std::mutex> guard(this->prefetchLock);
+    while(!this->prefetchQueue.empty() || this->prefetchBusy)
+        this->prefetchIdle.wait(guard);
+}
+
+void BlockCache::stopPrefetch() {
+    {
+        std::lock_guard<std::mutex> guard(this->prefetchLock);
+        this->prefetchQueue.clear();
+        this->prefetchStop= true;
+    }
+    this->prefetchCond.notify_one();
+    if(this->prefetchThread.joinable())
+        this->prefetchThread.join();
+
+    std::lock_guard<std::mutex> guard(this->prefetchLock);
+    this->prefetchStop= false;
+    this->prefetchBusy= false;
+    this->prefetchIdle.notify_all();
+}
+
+uint32_t BlockCache::countClean(uint32_t blockNo, uint32_t count) const {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(uint32_t b= 0; b < count; b++) {
+        int32_t e= lookup(blockNo + b);
+        if(e >= 0 && this->entries[e].dirty)
+            return b;
+    }
+    return count;
+}
+
+uint32_t BlockCache::getNumDirty() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    uint32_t n= 0;
+    for(uint32_t e= 0; e < this->numBlocks; e++) {
+        if(this->entries[e].valid && this->entries[e].dirty)
+            n++;
+    }
+    return n;
+}
+
+uint64_t BlockCache::getHits() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->hits;
+}
+
+uint64_t BlockCache::getMisses() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->misses;
+}
+
+uint64_t BlockCache::getWriteBacks() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->writeBacks;
+}
+
+uint64_t BlockCache::getPrefetchedBlocks() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->prefetchedBlocks;
+}
+
+uint64_t BlockCache::getPrefetchHits() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->prefetchHits;
+}
+
+uint64_t BlockCache::getPrefetchWasted() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->prefetchWasted;
+}
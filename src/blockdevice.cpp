@@ -11,42 +11,142 @@
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <limits.h>
 #include "macros.h"
 
 #include "blockdevice.h"
 
 #undef DEBUG
 
+struct StripeBatch;
+
+// the part of a transfer on one member of a striped container
+struct StripeRequest {
+    bool write;
+    uint64_t pos;               // byte position in the member
+    std::vector<struct iovec> iov;
+    int result;
+    StripeBatch *batch;
+};
+
+// the parts of a transfer handed to the workers, the caller waits until all of them are done
+struct StripeBatch {
+    std::mutex lock;
+    std::condition_variable done;
+    unsigned remaining;
+};
+
+struct StripeMember {
+    int fd;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable queued;
+    std::deque<StripeRequest *> requests;
+    bool stop;
+};
+
 BlockDevice::BlockDevice(uint32_t blockSize) {
+    setBlockSize(blockSize);
+    this->contFile= -1;
+
+    this->mapped= false;
+    this->map= NULL;
+    this->mapSize= 0;
+    this->mapLength= 0;
+
+    this->useRing= false;
+    this->ring= NULL;
+    this->ringBuffer= NULL;
+    this->ringBufferLength= 0;
+
+    this->useDirect= false;
+    this->direct= false;
+    this->numBounced= 0;
+
+    this->stripeChunk= BD_STRIPE_CHUNK;
+    this->numStriped= 0;
+
+    this->numReads= 0;
+    this->numWrites= 0;
+    this->bytesRead= 0;
+    this->bytesWritten= 0;
+}
+
+void BlockDevice::setBlockSize(uint32_t blockSize) {
     assert(blockSize % 512 == 0);
     this->blockSize= blockSize;
 }
 
+// Open the container file like ::open(), with O_DIRECT if direct mode is selected and the file system supports it.
+// The members of a striped container are opened one after the other, the device is direct if any of them is.
+int BlockDevice::openFile(const char *path, int flags, int mode) {
+    if(!this->useDirect || isMapped())
+        return ::open(path, flags, mode);
+
+#if defined(O_DIRECT)
+    int fd= ::open(path, flags | O_DIRECT, mode);
+    if(fd >= 0 || errno != EINVAL) {
+        if(fd >= 0)
+            this->direct= true;
+        return fd;
+    }
+    LOG("WARNING: The file system of the container does not support O_DIRECT, using the page cache");
+    return ::open(path, flags, mode);
+#elif defined(__APPLE__)
+    // no alignment is required for F_NOCACHE, bouncing unaligned transfers does no harm though
+    int fd= ::open(path, flags, mode);
+    if(fd >= 0 && ::fcntl(fd, F_NOCACHE, 1) == 0)
+        this->direct= true;
+    return fd;
+#else
+    return ::open(path, flags, mode);
+#endif
+}
+
+// Create a new file for the container, an existing file is truncated.
+// this method returns the file descriptor if successful, -1 with errno set otherwise
+int BlockDevice::createFile(const char *path) {
+    int fd = openFile(path, O_EXCL | O_RDWR | O_CREAT, 0666);
+    if (fd < 0 && errno == EEXIST) {
+        // file already exists, we must open & truncate
+        LOG("WARNING: container file already exists, truncating")
+        fd = openFile(path, O_EXCL | O_RDWR | O_TRUNC, 0);
+    }
+    return fd;
+}
+
 int BlockDevice::create(const char *path) {
 
     int ret= 0;
+    this->direct= false;
 
     // Open Container file
-    contFile = ::open(path, O_EXCL | O_RDWR | O_CREAT, 0666);
-    if (contFile < 0) {
-        if (errno == EEXIST) {
-            // file already exists, we must open & truncate
-            LOG("WARNING: container file already exists, truncating")
-            contFile = ::open(path, O_EXCL | O_RDWR | O_TRUNC);
-        }
-
-        if(contFile < 0) {
-            LOG("ERROR: unable to create container file");
-            ret= -errno;
-        }
+    contFile = createFile(path);
+    if(contFile < 0) {
+        LOG("ERROR: unable to create container file");
+        ret= -errno;
     }
     
 //    this->size= 0;
+
+    if(ret >= 0 && !this->stripePaths.empty())
+        ret= attachStripes(true);
+    if(ret >= 0 && isMapped())
+        ret= attachMap();
+    if(ret >= 0 && !this->mapped && this->members.empty() && this->useRing)
+        ret= attachRing();
     
     return ret;
 }
@@ -54,9 +154,10 @@ int BlockDevice::create(const char *path) {
 int BlockDevice::open(const char *path) {
 
     int ret= 0;
+    this->direct= false;
 
     // Open Container file
-    contFile = ::open(path, O_EXCL | O_RDWR);
+    contFile = openFile(path, O_EXCL | O_RDWR, 0);
     if (contFile < 0) {
         if (errno == ENOENT)
             LOG("ERROR: container file does not exists");
@@ -67,55 +168,643 @@ int BlockDevice::open(const char *path) {
 
     }
 
+    if(ret >= 0 && !this->stripePaths.empty())
+        ret= attachStripes(false);
+    if(ret >= 0 && isMapped())
+        ret= attachMap();
+    if(ret >= 0 && !this->mapped && this->members.empty() && this->useRing)
+        ret= attachRing();
+
     return ret;
 }
 
 
 int BlockDevice::close() {
 
-    int ret= 0;
+    detachRing();
+    detachStripes();
+    int ret= detachMap();
 
     if(::close(this->contFile) < 0)
         ret= -errno;
+    this->contFile= -1;
+    this->direct= false;
     
     return ret;
 }
 
+void BlockDevice::setStripes(const char *const *paths, unsigned count, uint32_t chunkSize) {
+    assert(chunkSize % BD_DIRECT_ALIGN == 0);
+
+    this->stripePaths.clear();
+    for(unsigned m= 0; m < count; m++)
+        this->stripePaths.push_back(paths[m]);
+    this->stripeChunk= chunkSize > 0 ? chunkSize : BD_STRIPE_CHUNK;
+}
+
+// Transfer the requests queued for a member of a striped container until the member is detached.
+static void runStripeMember(StripeMember *member);
+
+// Open or create the other members of a striped container and start a worker for every member. If the container
+// file exists, a missing member is an error, so the container is not replaced by a new one.
 // this method returns 0 if successful, -errno otherwise
-int BlockDevice::read(uint32_t blockNo, char *buffer) {
-#ifdef DEBUG
-    fprintf(stderr, "BlockDevice: Reading block %d\n", blockNo);
-#endif
-    off_t pos = (off_t) blockNo * this->blockSize;
-    if (lseek (this->contFile, pos, SEEK_SET) != pos)
+int BlockDevice::attachStripes(bool create) {
+    int ret= 0;
+    std::vector<int> fds(1, this->contFile);
+    for(size_t m= 0; m < this->stripePaths.size() && ret >= 0; m++) {
+        const char *path= this->stripePaths[m].c_str();
+        int fd= create ? createFile(path) : openFile(path, O_EXCL | O_RDWR, 0);
+        if(fd < 0) {
+            ret= errno == ENOENT ? -ENXIO : -errno;
+            LOGF("ERROR: unable to open member %s of the striped container, error %d", path, errno);
+        } else {
+            fds.push_back(fd);
+        }
+    }
+    if(ret < 0) {
+        for(size_t m= 1; m < fds.size(); m++)
+            ::close(fds[m]);
+        return ret;
+    }
+
+    for(size_t m= 0; m < fds.size(); m++) {
+        StripeMember *member= new StripeMember();
+        member->fd= fds[m];
+        member->stop= false;
+        member->worker= std::thread(runStripeMember, member);
+        this->members.push_back(member);
+    }
+    LOGF("Container is striped over %u files in chunks of %u bytes", (unsigned) this->members.size(),
+         this->stripeChunk);
+
+    return 0;
+}
+
+// Stop the workers and close the members, the container file itself is closed by the caller.
+void BlockDevice::detachStripes() {
+    for(size_t m= 0; m < this->members.size(); m++) {
+        StripeMember *member= this->members[m];
+        {
+            std::lock_guard<std::mutex> guard(member->lock);
+            member->stop= true;
+        }
+        member->queued.notify_one();
+        member->worker.join();
+        if(m > 0)
+            ::close(member->fd);
+        delete member;
+    }
+    this->members.clear();
+}
+
+// Reserve the address range for the mapping and map the current content of the container file.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::attachMap() {
+    struct stat st;
+    if(::fstat(this->contFile, &st) < 0)
         return -errno;
-    
-    int size = (this->blockSize);
-    ssize_t r = ::read(this->contFile, buffer, size);
-    if (r < 0)
+    if((uint64_t) st.st_size > BD_MAP_RESERVE)
+        return -EFBIG;
+
+    void *range= ::mmap(NULL, BD_MAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(range == MAP_FAILED) {
+        LOG("ERROR: unable to reserve address space for mapping the container file");
+        return -errno;
+    }
+    this->map= (char *) range;
+    this->mapSize= 0;
+    this->mapLength= 0;
+
+    return extendMap((uint64_t) st.st_size);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::detachMap() {
+    if(this->map == NULL)
+        return 0;
+
+    int ret= 0;
+    if(::msync(this->map, this->mapLength, MS_SYNC) < 0)
+        ret= -errno;
+    ::munmap(this->map, BD_MAP_RESERVE);
+
+    this->map= NULL;
+    this->mapSize= 0;
+    this->mapLength= 0;
+
+    return ret;
+}
+
+// Make sure the container file and its mapping extend at least up to byte position end. The container is extended in
+// steps of BD_MAP_GROW bytes, so writing a container block by block does not resize the file for every block.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::growMap(uint64_t end) {
+    if(end <= this->mapSize)
+        return 0;
+
+    std::lock_guard<std::mutex> guard(this->growLock);
+
+    if(end <= this->mapSize)
+        return 0;
+
+    uint64_t size= (end + BD_MAP_GROW - 1) / BD_MAP_GROW * BD_MAP_GROW;
+    if(size > BD_MAP_RESERVE)
+        return -ENOSPC;
+    if(::ftruncate(this->contFile, (off_t) size) < 0)
         return -errno;
-    if (r < size)
-        memset(buffer + r, 0, size - r);
+
+    return extendMap(size);
+}
+
+// Map the container file up to byte position size, which must not exceed the size of the file.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::extendMap(uint64_t size) {
+    // map the new part of the file behind the pages mapped so far
+    uint64_t pageSize= (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t length= (size + pageSize - 1) / pageSize * pageSize;
+    if(length > this->mapLength) {
+        void *p= ::mmap(this->map + this->mapLength, length - this->mapLength, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_FIXED, this->contFile, (off_t) this->mapLength);
+        if(p == MAP_FAILED)
+            return -errno;
+        this->mapLength= length;
+    }
+    // publish the new size only after the pages are mapped, readers do not take the lock
+    this->mapSize= size;
 
     return 0;
 }
 
+// Copy len bytes from the mapping starting at byte position pos, missing data at the end of the file is read as zeros.
+void BlockDevice::copyFromMap(uint64_t pos, size_t len, char *buffer) const {
+    uint64_t size= this->mapSize;
+    size_t n= pos >= size ? 0 : (size_t) std::min<uint64_t>(len, size - pos);
+
+    memcpy(buffer, this->map + pos, n);
+    memset(buffer + n, 0, len - n);
+}
+
+const char *BlockDevice::blockPtr(uint32_t blockNo) const {
+    uint64_t pos= (uint64_t) blockNo * this->blockSize;
+
+    if(this->map == NULL || pos + this->blockSize > this->mapSize)
+        return NULL;
+
+    return this->map + pos;
+}
+
+// Set up an io_uring for the container file. If the kernel does not provide one, positioned system calls are used.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::attachRing() {
+    IoRing *ring= new IoRing();
+    int ret= ring->init(this->contFile);
+    if(ret < 0) {
+        LOGF("WARNING: io_uring is not available (error %d), using positioned system calls", ret);
+        delete ring;
+        return 0;
+    }
+    this->ring= ring;
+
+    if(this->ringBuffer != NULL) {
+        ret= this->ring->registerBuffer(this->ringBuffer, this->ringBufferLength);
+        if(ret < 0)
+            LOGF("WARNING: Registering the cache buffer failed with error %d", ret);
+    }
+
+    return 0;
+}
+
+void BlockDevice::detachRing() {
+    delete this->ring;
+    this->ring= NULL;
+}
+
+void BlockDevice::registerBuffer(char *buffer, size_t length) {
+    this->ringBuffer= buffer;
+    this->ringBufferLength= length;
+
+    if(this->ring != NULL) {
+        int ret= this->ring->registerBuffer(buffer, length);
+        if(ret < 0)
+            LOGF("WARNING: Registering the cache buffer failed with error %d", ret);
+    }
+}
+
+void BlockDevice::unregisterBuffer(char *buffer) {
+    if(this->ringBuffer != buffer)
+        return;
+
+    this->ringBuffer= NULL;
+    this->ringBufferLength= 0;
+    if(this->ring != NULL)
+        this->ring->unregisterBuffer();
+}
+
+// Transfer the given buffers from/to the container file starting at byte position pos. Short transfers are
+// continued, missing data at the end of the file is read as zeros.
+// this function returns 0 if successful, -errno otherwise
+static int transferv(int fd, struct iovec *iov, int iovcnt, off_t pos, bool write) {
+    while(iovcnt > 0) {
+        int cnt= iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+        ssize_t r= write ? ::pwritev(fd, iov, cnt, pos) : ::preadv(fd, iov, cnt, pos);
+        if(r < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if(r == 0) {
+            if(write)
+                return -ENOSPC;
+            // end of container file reached
+            for(int i= 0; i < iovcnt; i++)
+                memset(iov[i].iov_base, 0, iov[i].iov_len);
+            return 0;
+        }
+
+        pos+= r;
+        while(r > 0 && (size_t) r >= iov->iov_len) {
+            r-= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(r > 0) {
+            iov->iov_base= (char *) iov->iov_base + r;
+            iov->iov_len-= r;
+        }
+    }
+
+    return 0;
+}
+
+static void runStripeMember(StripeMember *member) {
+    std::unique_lock<std::mutex> guard(member->lock);
+    for(;;) {
+        while(member->requests.empty() && !member->stop)
+            member->queued.wait(guard);
+        if(member->requests.empty())
+            return;
+        StripeRequest *request= member->requests.front();
+        member->requests.pop_front();
+        guard.unlock();
+
+        request->result= transferv(member->fd, request->iov.data(), (int) request->iov.size(), (off_t) request->pos,
+                                   request->write);
+        {
+            // the caller may return as soon as the count drops to zero, the batch must not be touched after that
+            std::lock_guard<std::mutex> batchGuard(request->batch->lock);
+            if(--request->batch->remaining == 0)
+                request->batch->done.notify_one();
+        }
+
+        guard.lock();
+    }
+}
+
+// Split a transfer at the chunk boundaries of a striped container. The chunks of one member are consecutive in the
+// member, so each member gets a single request. The workers of the members run all but one of them, the calling
+// thread runs the last one itself.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::transferStriped(struct iovec *iov, int iovcnt, uint64_t pos, bool write) {
+    size_t numMembers= this->members.size();
+    std::vector<StripeRequest> requests(numMembers);
+
+    for(int i= 0; i < iovcnt; i++) {
+        size_t offset= 0;
+        while(offset < iov[i].iov_len) {
+            uint64_t chunk= pos / this->stripeChunk;
+            size_t inChunk= (size_t) (pos % this->stripeChunk);
+            size_t len= std::min(iov[i].iov_len - offset, this->stripeChunk - inChunk);
+
+            StripeRequest *request= &requests[chunk % numMembers];
+            if(request->iov.empty())
+                request->pos= chunk / numMembers * this->stripeChunk + inChunk;
+            struct iovec part;
+            part.iov_base= (char *) iov[i].iov_base + offset;
+            part.iov_len= len;
+            request->iov.push_back(part);
+
+            offset+= len;
+            pos+= len;
+        }
+    }
+
+    StripeBatch batch;
+    batch.remaining= 0;
+    bool split= false;
+    size_t last= numMembers;
+    for(size_t m= 0; m < numMembers; m++) {
+        requests[m].write= write;
+        requests[m].result= 0;
+        requests[m].batch= &batch;
+        if(requests[m].iov.empty())
+            continue;
+        if(last < numMembers) {
+            // the request found before goes to its worker
+            StripeMember *member= this->members[last];
+            {
+                std::lock_guard<std::mutex> guard(member->lock);
+                member->requests.push_back(&requests[last]);
+                std::lock_guard<std::mutex> batchGuard(batch.lock);
+                batch.remaining++;
+            }
+            member->queued.notify_one();
+            split= true;
+        }
+        last= m;
+    }
+    if(last == numMembers)
+        return 0;
+    if(split)
+        this->numStriped.fetch_add(1, std::memory_order_relaxed);
+
+    requests[last].result= transferv(this->members[last]->fd, requests[last].iov.data(),
+                                     (int) requests[last].iov.size(), (off_t) requests[last].pos, write);
+
+    {
+        std::unique_lock<std::mutex> guard(batch.lock);
+        while(batch.remaining > 0)
+            batch.done.wait(guard);
+    }
+
+    int ret= 0;
+    for(size_t m= 0; m < numMembers && ret == 0; m++)
+        ret= requests[m].result;
+    return ret;
+}
+
+// Direct transfers need buffers that start and end at multiples of BD_DIRECT_ALIGN.
+bool BlockDevice::isAligned(const struct iovec *iov, int iovcnt) const {
+    for(int i= 0; i < iovcnt; i++) {
+        if((uintptr_t) iov[i].iov_base % BD_DIRECT_ALIGN != 0 || iov[i].iov_len % BD_DIRECT_ALIGN != 0)
+            return false;
+    }
+    return true;
+}
+
+// Transfer the given buffers, they are bounced through aligned buffers if the container is opened with O_DIRECT and
+// they are not aligned.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::transfer(struct iovec *iov, int iovcnt, uint64_t pos, bool write) {
+    if(this->direct && !isAligned(iov, iovcnt))
+        return transferBounced(iov, iovcnt, pos, write);
+
+    return transferDirect(iov, iovcnt, pos, write);
+}
+
+// Copy the data of an unaligned transfer through a buffer of the pool, one buffer size at a time.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::transferBounced(struct iovec *iov, int iovcnt, uint64_t pos, bool write) {
+    char *bounce= this->bufferPool.get();
+    if(bounce == NULL)
+        return -ENOMEM;
+    this->numBounced.fetch_add(1, std::memory_order_relaxed);
+
+    int ret= 0;
+    size_t bufferSize= this->bufferPool.getBufferSize();
+    int i= 0;
+    size_t offset= 0;           // within iov[i]
+    while(ret >= 0 && i < iovcnt) {
+        // the part of the buffers that is transferred next
+        int first= i;
+        size_t firstOffset= offset;
+        size_t len= 0;
+        while(len < bufferSize && i < iovcnt) {
+            size_t n= std::min(iov[i].iov_len - offset, bufferSize - len);
+            if(write)
+                memcpy(bounce + len, (char *) iov[i].iov_base + offset, n);
+            len+= n;
+            offset+= n;
+            if(offset == iov[i].iov_len) {
+                i++;
+                offset= 0;
+            }
+        }
+
+        struct iovec chunk;
+        chunk.iov_base= bounce;
+        chunk.iov_len= len;
+        ret= transferDirect(&chunk, 1, pos, write);
+        if(ret >= 0 && !write) {
+            size_t done= 0;
+            for(int j= first; done < len; j++) {
+                size_t start= j == first ? firstOffset : 0;
+                size_t n= std::min(iov[j].iov_len - start, len - done);
+                memcpy((char *) iov[j].iov_base + start, bounce + done, n);
+                done+= n;
+            }
+        }
+        pos+= len;
+    }
+
+    this->bufferPool.put(bounce);
+    return ret;
+}
+
+// Transfer the given buffers through the ring if there is one, over the members of a striped container, or with
+// positioned system calls otherwise.
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::transferDirect(struct iovec *iov, int iovcnt, uint64_t pos, bool write) {
+    if(!this->members.empty())
+        return transferStriped(iov, iovcnt, pos, write);
+    if(this->ring == NULL)
+        return transferv(this->contFile, iov, iovcnt, (off_t) pos, write);
+
+    IoRequest request;
+    request.write= write;
+    request.pos= pos;
+    request.iov= iov;
+    request.iovcnt= iovcnt;
+    return this->ring->transfer(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::read(uint32_t blockNo, char *buffer) {
+#ifdef DEBUG
+    fprintf(stderr, "BlockDevice: Reading block %d\n", blockNo);
+#endif
+    return readBlocks(blockNo, 1, buffer);
+}
+
 // this method returns 0 if successful, -errno otherwise
 int BlockDevice::write(uint32_t blockNo, char *buffer) {
 #ifdef DEBUG
     fprintf(stderr, "BlockDevice: Writing block %d\n", blockNo);
 #endif
-    off_t pos = (off_t) blockNo * this->blockSize;
-    if (lseek (this->contFile, pos, SEEK_SET) != pos)
+    return writeBlocks(blockNo, 1, buffer);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::readBlocks(uint32_t blockNo, uint32_t count, char *buffer) {
+    this->numReads.fetch_add(1, std::memory_order_relaxed);
+    this->bytesRead.fetch_add((uint64_t) count * this->blockSize, std::memory_order_relaxed);
+
+    if(this->map != NULL) {
+        copyFromMap((uint64_t) blockNo * this->blockSize, (size_t) count * this->blockSize, buffer);
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base= buffer;
+    iov.iov_len= (size_t) count * this->blockSize;
+
+    return transfer(&iov, 1, (uint64_t) blockNo * this->blockSize, false);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::writeBlocks(uint32_t blockNo, uint32_t count, char *buffer) {
+    this->numWrites.fetch_add(1, std::memory_order_relaxed);
+    this->bytesWritten.fetch_add((uint64_t) count * this->blockSize, std::memory_order_relaxed);
+
+    if(this->map != NULL) {
+        uint64_t pos= (uint64_t) blockNo * this->blockSize;
+        int ret= growMap(pos + (uint64_t) count * this->blockSize);
+        if(ret < 0)
+            return ret;
+        memcpy(this->map + pos, buffer, (size_t) count * this->blockSize);
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base= buffer;
+    iov.iov_len= (size_t) count * this->blockSize;
+
+    return transfer(&iov, 1, (uint64_t) blockNo * this->blockSize, true);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::readBlocksv(uint32_t blockNo, uint32_t count, char **buffers) {
+    this->numReads.fetch_add(1, std::memory_order_relaxed);
+    this->bytesRead.fetch_add((uint64_t) count * this->blockSize, std::memory_order_relaxed);
+
+    if(this->map != NULL) {
+        for(uint32_t b= 0; b < count; b++)
+            copyFromMap((uint64_t) (blockNo + b) * this->blockSize, this->blockSize, buffers[b]);
+        return 0;
+    }
+
+    struct iovec *iov= new struct iovec[count];
+    for(uint32_t b= 0; b < count; b++) {
+        iov[b].iov_base= buffers[b];
+        iov[b].iov_len= this->blockSize;
+    }
+
+    int ret= transfer(iov, count, (uint64_t) blockNo * this->blockSize, false);
+
+    delete [] iov;
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::writeBlocksv(uint32_t blockNo, uint32_t count, char **buffers) {
+    this->numWrites.fetch_add(1, std::memory_order_relaxed);
+    this->bytesWritten.fetch_add((uint64_t) count * this->blockSize, std::memory_order_relaxed);
+
+    if(this->map != NULL) {
+        uint64_t pos= (uint64_t) blockNo * this->blockSize;
+        int ret= growMap(pos + (uint64_t) count * this->blockSize);
+        if(ret < 0)
+            return ret;
+        for(uint32_t b= 0; b < count; b++)
+            memcpy(this->map + pos + (size_t) b * this->blockSize, buffers[b], this->blockSize);
+        return 0;
+    }
+
+    struct iovec *iov= new struct iovec[count];
+    for(uint32_t b= 0; b < count; b++) {
+        iov[b].iov_base= buffers[b];
+        iov[b].iov_len= this->blockSize;
+    }
+
+    int ret= transfer(iov, count, (uint64_t) blockNo * this->blockSize, true);
+
+    delete [] iov;
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::submit(BlockTransfer *transfers, size_t count) {
+    // unaligned buffers of a direct container are bounced one transfer after the other
+    bool batch= this->ring != NULL && this->map == NULL;
+    for(size_t t= 0; batch && this->direct && t < count; t++) {
+        if(transfers[t].buffer != NULL) {
+            struct iovec iov;
+            iov.iov_base= transfers[t].buffer;
+            iov.iov_len= (size_t) transfers[t].count * this->blockSize;
+            batch= isAligned(&iov, 1);
+        } else {
+            for(uint32_t b= 0; batch && b < transfers[t].count; b++)
+                batch= (uintptr_t) transfers[t].buffers[b] % BD_DIRECT_ALIGN == 0;
+        }
+    }
+
+    if(!batch) {
+        int ret= 0;
+        for(size_t t= 0; t < count; t++) {
+            BlockTransfer *transfer= &transfers[t];
+            if(transfer->buffer != NULL)
+                transfer->result= transfer->write ? writeBlocks(transfer->blockNo, transfer->count, transfer->buffer)
+                                                  : readBlocks(transfer->blockNo, transfer->count, transfer->buffer);
+            else
+                transfer->result= transfer->write ? writeBlocksv(transfer->blockNo, transfer->count, transfer->buffers)
+                                                  : readBlocksv(transfer->blockNo, transfer->count, transfer->buffers);
+            if(transfer->result < 0 && ret == 0)
+                ret= transfer->result;
+        }
+        return ret;
+    }
+
+    // one request per transfer, all submitted together
+    size_t numIov= 0;
+    for(size_t t= 0; t < count; t++)
+        numIov+= transfers[t].buffer != NULL ? 1 : transfers[t].count;
+    std::vector<struct iovec> iov(numIov);
+    std::vector<IoRequest> requests(count);
+
+    size_t i= 0;
+    for(size_t t= 0; t < count; t++) {
+        BlockTransfer *transfer= &transfers[t];
+        requests[t].write= transfer->write;
+        requests[t].pos= (uint64_t) transfer->blockNo * this->blockSize;
+        requests[t].iov= &iov[i];
+        if(transfer->buffer != NULL) {
+            iov[i].iov_base= transfer->buffer;
+            iov[i++].iov_len= (size_t) transfer->count * this->blockSize;
+            requests[t].iovcnt= transfer->count > 0 ? 1 : 0;
+        } else {
+            for(uint32_t b= 0; b < transfer->count; b++) {
+                iov[i].iov_base= transfer->buffers[b];
+                iov[i++].iov_len= this->blockSize;
+            }
+            requests[t].iovcnt= (int) transfer->count;
+        }
+
+        if(transfer->write) {
+            this->numWrites.fetch_add(1, std::memory_order_relaxed);
+            this->bytesWritten.fetch_add((uint64_t) transfer->count * this->blockSize, std::memory_order_relaxed);
+        } else {
+            this->numReads.fetch_add(1, std::memory_order_relaxed);
+            this->bytesRead.fetch_add((uint64_t) transfer->count * this->blockSize, std::memory_order_relaxed);
+        }
+    }
+
+    int ret= this->ring->transfer(requests.data(), count);
+    for(size_t t= 0; t < count; t++)
+        transfers[t].result= requests[t].result;
+
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::sync() {
+    if(this->map != NULL && ::msync(this->map, this->mapLength, MS_SYNC) < 0)
         return -errno;
 
-    int size = (this->blockSize);
-    ssize_t w = ::write(this->contFile, buffer, size);
-    if (w < 0)
+    if(::fsync(this->contFile) < 0)
         return -errno;
-    if (w < size)
-        return -ENOSPC;
+    for(size_t m= 1; m < this->members.size(); m++) {
+        if(::fsync(this->members[m]->fd) < 0)
+            return -errno;
+    }
 
     return 0;
 }
-
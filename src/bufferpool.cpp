@@ -0,0 +1,72 @@
+//
+//  bufferpool.cpp
+//  myfs
+//
+
+#include <cstdlib>
+
+#include "bufferpool.h"
+
+BufferPool::BufferPool(size_t bufferSize, uint32_t maxFree) {
+    this->bufferSize= (bufferSize + BP_ALIGNMENT - 1) / BP_ALIGNMENT * BP_ALIGNMENT;
+    this->maxFree= maxFree;
+    this->numAllocated= 0;
+    this->numReused= 0;
+}
+
+BufferPool::~BufferPool() {
+    for(size_t b= 0; b < this->freeBuffers.size(); b++)
+        freeAligned(this->freeBuffers[b]);
+}
+
+char *BufferPool::allocAligned(size_t size) {
+    void *p;
+    if(posix_memalign(&p, BP_ALIGNMENT, size > 0 ? size : 1) != 0)
+        return NULL;
+    return (char *) p;
+}
+
+void BufferPool::freeAligned(char *buffer) {
+    free(buffer);
+}
+
+char *BufferPool::get() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if(!this->freeBuffers.empty()) {
+            char *buffer= this->freeBuffers.back();
+            this->freeBuffers.pop_back();
+            this->numReused++;
+            return buffer;
+        }
+        this->numAllocated++;
+    }
+
+    // allocate without holding the lock
+    return allocAligned(this->bufferSize);
+}
+
+void BufferPool::put(char *buffer) {
+    if(buffer == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if(this->freeBuffers.size() < this->maxFree) {
+            this->freeBuffers.push_back(buffer);
+            return;
+        }
+    }
+
+    freeAligned(buffer);
+}
+
+uint64_t BufferPool::getNumAllocated() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numAllocated;
+}
+
+uint64_t BufferPool::getNumReused() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numReused;
+}
@@ -0,0 +1,70 @@
+//
+//  chunkarena.cpp
+//  myfs
+//
+
+#include <cassert>
+#include <cstdlib>
+
+#include "chunkarena.h"
+
+ChunkArena::ChunkArena(size_t chunkSize) {
+    assert(chunkSize >= sizeof(FreeChunk));
+
+    // keep chunks aligned for any data stored in them
+    this->chunkSize= (chunkSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    this->freeList= NULL;
+    this->numFree= 0;
+}
+
+ChunkArena::~ChunkArena() {
+    for(size_t s= 0; s < this->slabs.size(); s++)
+        free(this->slabs[s]);
+}
+
+char *ChunkArena::alloc() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if(this->freeList == NULL) {
+        char *slab= (char *) malloc(this->chunkSize * CA_CHUNKS_PER_SLAB);
+        if(slab == NULL)
+            return NULL;
+        this->slabs.push_back(slab);
+
+        // chain the chunks of the new slab front to back
+        for(int c= CA_CHUNKS_PER_SLAB - 1; c >= 0; c--) {
+            FreeChunk *chunk= (FreeChunk *) (slab + c * this->chunkSize);
+            chunk->next= this->freeList;
+            this->freeList= chunk;
+        }
+        this->numFree+= CA_CHUNKS_PER_SLAB;
+    }
+
+    FreeChunk *chunk= this->freeList;
+    this->freeList= chunk->next;
+    this->numFree--;
+
+    return (char *) chunk;
+}
+
+void ChunkArena::release(char *chunk) {
+    if(chunk == NULL)
+        return;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    FreeChunk *freeChunk= (FreeChunk *) chunk;
+    freeChunk->next= this->freeList;
+    this->freeList= freeChunk;
+    this->numFree++;
+}
+
+uint64_t ChunkArena::getNumChunks() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return (uint64_t) this->slabs.size() * CA_CHUNKS_PER_SLAB;
+}
+
+uint64_t ChunkArena::getNumFree() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numFree;
+}
@@ -0,0 +1,194 @@
+//
+//  crc32c.cpp
+//  myfs
+//
+
+#include <cstring>
+
+#include "crc32c.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_ARM 1
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#if defined(__clang__)
+#define CRC32C_TARGET __attribute__((target("crc")))
+#else
+#define CRC32C_TARGET __attribute__((target("+crc")))
+#endif
+#endif
+
+#define CRC32C_POLY 0x82F63B78u         // reflected Castagnoli polynomial
+
+// Lookup tables for eight bytes at a time: table[0] is the classic byte table, table[k] advances a byte k more bytes.
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        for(uint32_t i= 0; i < 256; i++) {
+            uint32_t crc= i;
+            for(int bit= 0; bit < 8; bit++)
+                crc= (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+            this->table[0][i]= crc;
+        }
+        for(uint32_t i= 0; i < 256; i++) {
+            for(int k= 1; k < 8; k++)
+                this->table[k][i]= (this->table[k - 1][i] >> 8) ^ this->table[0][this->table[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+static const Crc32cTables tables;
+
+// the crc arguments and results of the helpers are the inverted state, not a finished checksum
+
+static uint32_t tableUpdate(uint32_t crc, const uint8_t *p, size_t size) {
+    const uint32_t (*t)[256]= tables.table;
+
+    while(size >= 8) {
+        // the bytes are combined one by one, so this does not depend on the byte order of the machine
+        uint32_t lo= (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+        uint32_t hi= (uint32_t) p[4] | (uint32_t) p[5] << 8 | (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+        lo^= crc;
+        crc= t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+             t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p+= 8;
+        size-= 8;
+    }
+    while(size > 0) {
+        crc= (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+        size--;
+    }
+    return crc;
+}
+
+#if defined(CRC32C_X86)
+
+static bool detectHardware() {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+CRC32C_TARGET static inline uint32_t hwByte(uint32_t crc, uint8_t v) {
+    return _mm_crc32_u8(crc, v);
+}
+
+CRC32C_TARGET static inline uint32_t hwWord(uint32_t crc, uint64_t v) {
+#if defined(__x86_64__)
+    return (uint32_t) _mm_crc32_u64(crc, v);
+#else
+    return _mm_crc32_u32(_mm_crc32_u32(crc, (uint32_t) v), (uint32_t) (v >> 32));
+#endif
+}
+
+#elif defined(CRC32C_ARM)
+
+static bool detectHardware() {
+#if defined(__APPLE__)
+    return true;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+
+CRC32C_TARGET static inline uint32_t hwByte(uint32_t crc, uint8_t v) {
+    __asm__("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" ((uint32_t) v));
+    return crc;
+}
+
+CRC32C_TARGET static inline uint32_t hwWord(uint32_t crc, uint64_t v) {
+    __asm__("crc32cx %w0, %w0, %x1" : "+r" (crc) : "r" (v));
+    return crc;
+}
+
+#endif
+
+#if defined(CRC32C_TARGET)
+
+CRC32C_TARGET static uint32_t hwUpdate(uint32_t crc, const uint8_t *p, size_t size) {
+    while(size > 0 && ((uintptr_t) p & 7) != 0) {
+        crc= hwByte(crc, *p++);
+        size--;
+    }
+    while(size >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc= hwWord(crc, v);
+        p+= 8;
+        size-= 8;
+    }
+    while(size > 0) {
+        crc= hwByte(crc, *p++);
+        size--;
+    }
+    return crc;
+}
+
+// Three independent checksums in lockstep, the instruction takes a new word every cycle but its result only after
+// three. size is a multiple of 8.
+CRC32C_TARGET static void hwBlocks3(const uint8_t *a, const uint8_t *b, const uint8_t *c, size_t size,
+                                    uint32_t *crcs) {
+    uint32_t crcA= 0xFFFFFFFFu, crcB= 0xFFFFFFFFu, crcC= 0xFFFFFFFFu;
+    for(size_t i= 0; i < size; i+= 8) {
+        uint64_t va, vb, vc;
+        memcpy(&va, a + i, sizeof(va));
+        memcpy(&vb, b + i, sizeof(vb));
+        memcpy(&vc, c + i, sizeof(vc));
+        crcA= hwWord(crcA, va);
+        crcB= hwWord(crcB, vb);
+        crcC= hwWord(crcC, vc);
+    }
+    crcs[0]= ~crcA;
+    crcs[1]= ~crcB;
+    crcs[2]= ~crcC;
+}
+
+#else
+
+static bool detectHardware() {
+    return false;
+}
+
+static uint32_t hwUpdate(uint32_t crc, const uint8_t *p, size_t size) {
+    return tableUpdate(crc, p, size);
+}
+
+static void hwBlocks3(const uint8_t *a, const uint8_t *b, const uint8_t *c, size_t size, uint32_t *crcs) {
+}
+
+#endif
+
+static const bool hardware= detectHardware();
+
+bool Crc32c::isHardware() {
+    return hardware;
+}
+
+uint32_t Crc32c::compute(const void *data, size_t size, uint32_t crc) {
+    if(hardware)
+        return ~hwUpdate(~crc, (const uint8_t *) data, size);
+    return ~tableUpdate(~crc, (const uint8_t *) data, size);
+}
+
+uint32_t Crc32c::computeTable(const void *data, size_t size, uint32_t crc) {
+    return ~tableUpdate(~crc, (const uint8_t *) data, size);
+}
+
+void Crc32c::computeBlocks(const char *data, size_t blockSize, uint32_t count, uint32_t *crcs) {
+    const uint8_t *p= (const uint8_t *) data;
+    uint32_t b= 0;
+
+    if(hardware) {
+        for(; b + 3 <= count; b+= 3)
+            hwBlocks3(p + b * blockSize, p + (b + 1) * blockSize, p + (b + 2) * blockSize, blockSize, crcs + b);
+    }
+    for(; b < count; b++)
+        crcs[b]= compute(p + b * blockSize, blockSize);
+}
@@ -0,0 +1,165 @@
+//
+//  dentrycache.cpp
+//  myfs
+//
+
+#include <cassert>
+#include <cstring>
+
+#include "dentrycache.h"
+
+DentryCache::DentryCache(uint32_t numEntries) {
+    assert(numEntries > 0);
+
+    this->entries.resize(numEntries);
+    this->index.reserve(numEntries);
+
+    // chain all (unused) entries, the first insertions take them from the tail
+    this->head= this->tail= -1;
+    for(uint32_t e= 0; e < numEntries; e++) {
+        this->entries[e].inode= DC_NEGATIVE;
+        this->entries[e].used= false;
+        pushFront((int32_t) e);
+    }
+
+    this->hits= 0;
+    this->negativeHits= 0;
+    this->misses= 0;
+}
+
+void DentryCache::unlink(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    if(entry->prev >= 0)
+        this->entries[entry->prev].next= entry->next;
+    else
+        this->head= entry->next;
+
+    if(entry->next >= 0)
+        this->entries[entry->next].prev= entry->prev;
+    else
+        this->tail= entry->prev;
+
+    entry->prev= entry->next= -1;
+}
+
+void DentryCache::pushFront(int32_t e) {
+    Entry *entry= &this->entries[e];
+
+    entry->prev= -1;
+    entry->next= this->head;
+    if(this->head >= 0)
+        this->entries[this->head].prev= e;
+    else
+        this->tail= e;
+    this->head= e;
+}
+
+// Forget an entry, the lock must be held. Unused entries go to the tail, so they are taken first.
+void DentryCache::drop(int32_t e) {
+    Entry *entry= &this->entries[e];
+    this->index.erase(entry->path);
+    entry->path.clear();
+    entry->used= false;
+
+    unlink(e);
+    entry->prev= this->tail;
+    if(this->tail >= 0)
+        this->entries[this->tail].next= e;
+    else
+        this->head= e;
+    this->tail= e;
+}
+
+bool DentryCache::lookup(const char *path, size_t length, uint32_t *inode) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    std::unordered_map<std::string, int32_t>::const_iterator it= this->index.find(std::string(path, length));
+    if(it == this->index.end()) {
+        this->misses++;
+        return false;
+    }
+
+    int32_t e= it->second;
+    *inode= this->entries[e].inode;
+    if(*inode == DC_NEGATIVE)
+        this->negativeHits++;
+    else
+        this->hits++;
+    unlink(e);
+    pushFront(e);
+    return true;
+}
+
+void DentryCache::insert(const char *path, size_t length, uint32_t inode) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    std::string key(path, length);
+    std::unordered_map<std::string, int32_t>::const_iterator it= this->index.find(key);
+    int32_t e;
+    if(it != this->index.end()) {
+        e= it->second;
+    } else {
+        e= this->tail;
+        if(this->entries[e].used)
+            this->index.erase(this->entries[e].path);
+        this->entries[e].path= key;
+        this->entries[e].used= true;
+        this->index[key]= e;
+    }
+
+    this->entries[e].inode= inode;
+    unlink(e);
+    pushFront(e);
+}
+
+void DentryCache::invalidate(const char *path, bool isDir) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    size_t length= strlen(path);
+    if(length > 0 && path[length - 1] == '/')
+        length--;
+
+    if(!isDir) {
+        std::unordered_map<std::string, int32_t>::const_iterator it= this->index.find(std::string(path, length));
+        if(it != this->index.end())
+            drop(it->second);
+        return;
+    }
+
+    for(int32_t e= 0; e < (int32_t) this->entries.size(); e++) {
+        const std::string &p= this->entries[e].path;
+        if(this->entries[e].used && p.compare(0, length, path, length) == 0 &&
+           (p.size() == length || p[length] == '/'))
+            drop(e);
+    }
+}
+
+void DentryCache::clear() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(int32_t e= 0; e < (int32_t) this->entries.size(); e++) {
+        if(this->entries[e].used)
+            drop(e);
+    }
+}
+
+uint32_t DentryCache::getNumEntries() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return (uint32_t) this->index.size();
+}
+
+uint64_t DentryCache::getHits() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->hits;
+}
+
+uint64_t DentryCache::getNegativeHits() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->negativeHits;
+}
+
+uint64_t DentryCache::getMisses() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->misses;
+}
@@ -0,0 +1,182 @@
+//
+//  dirindex.cpp
+//  myfs
+//
+
+#include <cassert>
+#include <cstring>
+
+#include "dirindex.h"
+
+#define DI_EMPTY (-1)
+#define DI_DELETED (-2)
+#define DI_MIN_SIZE 16
+
+DirIndex::DirIndex() {
+    clear();
+}
+
+uint32_t DirIndex::hash(uint32_t parent, const char *name) {
+    uint32_t h= 2166136261u;
+    for(int b= 0; b < 4; b++) {
+        h^= (parent >> (8 * b)) & 0xff;
+        h*= 16777619u;
+    }
+    for(const unsigned char *p= (const unsigned char *) name; *p != '\0'; p++) {
+        h^= *p;
+        h*= 16777619u;
+    }
+    return h;
+}
+
+void DirIndex::clear() {
+    this->entries.clear();
+    this->freeEntries.clear();
+    this->children.clear();
+    this->table.assign(DI_MIN_SIZE, DI_EMPTY);
+    this->numUsed= 0;
+    this->numDeleted= 0;
+}
+
+/// @brief Find the slot of the table pointing to the entry with the given directory and name.
+/// \return Index of the slot, -1 if there is no such entry.
+int32_t DirIndex::findSlot(uint32_t parent, const char *name, uint32_t hash) const {
+    uint32_t mask= (uint32_t) this->table.size() - 1;
+    for(uint32_t s= hash & mask; ; s= (s + 1) & mask) {
+        int32_t id= this->table[s];
+        if(id == DI_EMPTY)
+            return -1;
+        if(id >= 0 && this->entries[id].hash == hash && this->entries[id].parent == parent &&
+           this->entries[id].name == name)
+            return (int32_t) s;
+    }
+}
+
+/// @brief Put an entry into the first free slot of its probe sequence.
+void DirIndex::place(int32_t id) {
+    uint32_t mask= (uint32_t) this->table.size() - 1;
+    uint32_t s= this->entries[id].hash & mask;
+    while(this->table[s] >= 0)
+        s= (s + 1) & mask;
+    if(this->table[s] == DI_DELETED)
+        this->numDeleted--;
+    this->table[s]= id;
+}
+
+void DirIndex::rehash(uint32_t size) {
+    this->table.assign(size, DI_EMPTY);
+    this->numDeleted= 0;
+    for(size_t id= 0; id < this->entries.size(); id++) {
+        if(this->entries[id].used)
+            place((int32_t) id);
+    }
+}
+
+int DirIndex::find(uint32_t parent, const char *name) const {
+    int32_t s= findSlot(parent, name, hash(parent, name));
+    return s < 0 ? -1 : this->table[s];
+}
+
+int DirIndex::firstChild(uint32_t parent) const {
+    std::unordered_map<uint32_t, int32_t>::const_iterator it= this->children.find(parent);
+    return it == this->children.end() ? -1 : it->second;
+}
+
+/// @brief Put an entry at the front of the list of its directory.
+void DirIndex::link(int32_t id) {
+    Entry *entry= &this->entries[id];
+    std::unordered_map<uint32_t, int32_t>::iterator it= this->children.find(entry->parent);
+    entry->prev= -1;
+    entry->next= it == this->children.end() ? -1 : it->second;
+    if(entry->next >= 0)
+        this->entries[entry->next].prev= id;
+    this->children[entry->parent]= id;
+}
+
+/// @brief Take an entry out of the list of its directory.
+void DirIndex::unlink(int32_t id) {
+    Entry *entry= &this->entries[id];
+    if(entry->next >= 0)
+        this->entries[entry->next].prev= entry->prev;
+    if(entry->prev >= 0)
+        this->entries[entry->prev].next= entry->next;
+    else if(entry->next >= 0)
+        this->children[entry->parent]= entry->next;
+    else
+        this->children.erase(entry->parent);
+}
+
+/// @brief Make room for one more slot.
+///
+/// The table is kept at most half full, counting deleted slots, so probe sequences stay short and always end at an
+/// empty slot. When rebuilt, the table is at most a quarter full.
+void DirIndex::reserve() {
+    if((this->numUsed + this->numDeleted + 1) * 2 > this->table.size()) {
+        uint32_t size= DI_MIN_SIZE;
+        while((this->numUsed + 1) * 4 > size)
+            size*= 2;
+        rehash(size);
+    }
+}
+
+int DirIndex::insert(uint32_t parent, const char *name, uint32_t inode, uint32_t aux) {
+    reserve();
+
+    int32_t id;
+    if(!this->freeEntries.empty()) {
+        id= this->freeEntries.back();
+        this->freeEntries.pop_back();
+    } else {
+        id= (int32_t) this->entries.size();
+        this->entries.push_back(Entry());
+    }
+
+    Entry *entry= &this->entries[id];
+    entry->name= name;
+    entry->parent= parent;
+    entry->hash= hash(parent, name);
+    entry->inode= inode;
+    entry->aux= aux;
+    entry->used= true;
+    place(id);
+    link(id);
+    this->numUsed++;
+
+    return id;
+}
+
+void DirIndex::remove(int id) {
+    Entry *entry= &this->entries[id];
+    assert(entry->used);
+
+    int32_t s= findSlot(entry->parent, entry->name.c_str(), entry->hash);
+    assert(s >= 0 && this->table[s] == id);
+    this->table[s]= DI_DELETED;
+    this->numDeleted++;
+    this->numUsed--;
+    unlink(id);
+
+    entry->used= false;
+    entry->name.clear();
+    this->freeEntries.push_back(id);
+}
+
+void DirIndex::rename(int id, uint32_t parent, const char *name) {
+    reserve();
+
+    Entry *entry= &this->entries[id];
+
+    int32_t s= findSlot(entry->parent, entry->name.c_str(), entry->hash);
+    assert(s >= 0 && this->table[s] == id);
+    this->table[s]= DI_DELETED;
+    this->numDeleted++;
+
+    if(parent != entry->parent) {
+        unlink(id);
+        entry->parent= parent;
+        link(id);
+    }
+    entry->name= name;
+    entry->hash= hash(parent, name);
+    place(id);
+}
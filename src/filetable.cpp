@@ -0,0 +1,70 @@
+//
+//  filetable.cpp
+//  myfs
+//
+
+#include "filetable.h"
+
+FileTable::FileTable(uint32_t capacity) {
+    this->freeList= NULL;
+    this->capacity= capacity < FT_MAX_HANDLES ? capacity : FT_MAX_HANDLES;
+    this->numOpen= 0;
+}
+
+FileTable::~FileTable() {
+    for(size_t s= 0; s < this->slabs.size(); s++)
+        delete [] this->slabs[s];
+}
+
+void FileTable::setCapacity(uint32_t capacity) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->capacity= capacity < FT_MAX_HANDLES ? capacity : FT_MAX_HANDLES;
+}
+
+uint32_t FileTable::getCapacity() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->capacity;
+}
+
+MyFsHandle *FileTable::open(uint32_t ino, void *file) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if(this->numOpen >= this->capacity)
+        return NULL;
+
+    if(this->freeList == NULL) {
+        MyFsHandle *slab= new MyFsHandle[FT_HANDLES_PER_SLAB];
+        for(int h= 0; h < FT_HANDLES_PER_SLAB; h++)
+            slab[h].nextFree= h + 1 < FT_HANDLES_PER_SLAB ? &slab[h + 1] : NULL;
+        this->slabs.push_back(slab);
+        this->freeList= slab;
+    }
+
+    MyFsHandle *handle= this->freeList;
+    this->freeList= handle->nextFree;
+    this->numOpen++;
+
+    handle->ino= ino;
+    handle->file= file;
+    handle->extentCursor.store(0, std::memory_order_relaxed);
+    handle->nextOffset.store(0, std::memory_order_relaxed);
+    handle->raWindow.store(0, std::memory_order_relaxed);
+    handle->raEnd.store(0, std::memory_order_relaxed);
+    handle->spliced.store(false, std::memory_order_relaxed);
+    handle->nextFree= NULL;
+
+    return handle;
+}
+
+void FileTable::release(MyFsHandle *handle) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    handle->nextFree= this->freeList;
+    this->freeList= handle;
+    this->numOpen--;
+}
+
+uint32_t FileTable::getNumOpen() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numOpen;
+}
@@ -0,0 +1,371 @@
+//
+//  ioring.cpp
+//  myfs
+//
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <limits.h>
+
+#include "ioring.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#define IORING_SUPPORTED 1
+#endif
+
+IoRing::IoRing() {
+    this->ringFd= -1;
+    this->fileFd= -1;
+    this->entries= 0;
+
+    this->sqMap= NULL;
+    this->cqMap= NULL;
+    this->sqMapSize= 0;
+    this->cqMapSize= 0;
+    this->sqes= NULL;
+    this->sqesSize= 0;
+    this->sqHead= this->sqTail= NULL;
+    this->sqMask= 0;
+    this->cqHead= this->cqTail= NULL;
+    this->cqMask= 0;
+    this->cqes= NULL;
+
+    this->fixedBase= NULL;
+    this->fixedLength= 0;
+
+    this->reaping= false;
+    this->inFlight= 0;
+
+    this->numCalls= 0;
+    this->numRequests= 0;
+    this->numFixed= 0;
+}
+
+IoRing::~IoRing() {
+    close();
+}
+
+uint64_t IoRing::getNumCalls() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numCalls;
+}
+
+uint64_t IoRing::getNumRequests() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numRequests;
+}
+
+uint64_t IoRing::getNumFixed() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numFixed;
+}
+
+#ifdef IORING_SUPPORTED
+
+int IoRing::init(int fd, unsigned entries) {
+    close();
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ringFd= (int) syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd < 0)
+        return -errno;
+    this->ringFd= ringFd;
+    this->fileFd= fd;
+    this->entries= params.sq_entries;
+
+    this->sqMapSize= params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cqMapSize= params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap= (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMap)
+        this->sqMapSize= this->cqMapSize= std::max(this->sqMapSize, this->cqMapSize);
+
+    void *p= mmap(NULL, this->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                  IORING_OFF_SQ_RING);
+    if(p == MAP_FAILED) {
+        int ret= -errno;
+        close();
+        return ret;
+    }
+    this->sqMap= p;
+
+    if(singleMap) {
+        this->cqMap= this->sqMap;
+    } else {
+        p= mmap(NULL, this->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(p == MAP_FAILED) {
+            int ret= -errno;
+            close();
+            return ret;
+        }
+        this->cqMap= p;
+    }
+
+    this->sqesSize= params.sq_entries * sizeof(struct io_uring_sqe);
+    p= mmap(NULL, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(p == MAP_FAILED) {
+        int ret= -errno;
+        close();
+        return ret;
+    }
+    this->sqes= p;
+
+    char *sq= (char *) this->sqMap;
+    this->sqHead= (unsigned *) (sq + params.sq_off.head);
+    this->sqTail= (unsigned *) (sq + params.sq_off.tail);
+    this->sqMask= *(unsigned *) (sq + params.sq_off.ring_mask);
+    // submission queue entries are always used in ring order
+    unsigned *array= (unsigned *) (sq + params.sq_off.array);
+    for(unsigned i= 0; i < params.sq_entries; i++)
+        array[i]= i;
+
+    char *cq= (char *) this->cqMap;
+    this->cqHead= (unsigned *) (cq + params.cq_off.head);
+    this->cqTail= (unsigned *) (cq + params.cq_off.tail);
+    this->cqMask= *(unsigned *) (cq + params.cq_off.ring_mask);
+    this->cqes= cq + params.cq_off.cqes;
+
+    return 0;
+}
+
+void IoRing::close() {
+    if(this->sqes != NULL)
+        munmap(this->sqes, this->sqesSize);
+    if(this->cqMap != NULL && this->cqMap != this->sqMap)
+        munmap(this->cqMap, this->cqMapSize);
+    if(this->sqMap != NULL)
+        munmap(this->sqMap, this->sqMapSize);
+    if(this->ringFd >= 0)
+        ::close(this->ringFd);
+
+    this->sqes= this->cqMap= this->sqMap= NULL;
+    this->ringFd= -1;
+    this->fileFd= -1;
+    this->fixedBase= NULL;
+    this->fixedLength= 0;
+}
+
+int IoRing::registerBuffer(char *base, size_t length) {
+    if(this->ringFd < 0)
+        return -EBADF;
+    unregisterBuffer();
+
+    struct iovec iov;
+    iov.iov_base= base;
+    iov.iov_len= length;
+    if(syscall(__NR_io_uring_register, this->ringFd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        return -errno;
+
+    this->fixedBase= base;
+    this->fixedLength= length;
+    return 0;
+}
+
+void IoRing::unregisterBuffer() {
+    if(this->ringFd < 0 || this->fixedBase == NULL)
+        return;
+
+    syscall(__NR_io_uring_register, this->ringFd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    this->fixedBase= NULL;
+    this->fixedLength= 0;
+}
+
+// Put a request into the submission queue, the lock must be held and the ring must have room for it.
+void IoRing::queue(IoRequest *request) {
+    unsigned tail= *this->sqTail;
+    struct io_uring_sqe *sqe= (struct io_uring_sqe *) this->sqes + (tail & this->sqMask);
+    memset(sqe, 0, sizeof(*sqe));
+
+    char *base= (char *) request->iov[0].iov_base;
+    if(request->iovcnt == 1 && this->fixedBase != NULL && base >= this->fixedBase &&
+       base + request->iov[0].iov_len <= this->fixedBase + this->fixedLength) {
+        sqe->opcode= request->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->addr= (uint64_t) (uintptr_t) base;
+        sqe->len= (uint32_t) request->iov[0].iov_len;
+        sqe->buf_index= 0;
+        this->numFixed++;
+    } else {
+        sqe->opcode= request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->addr= (uint64_t) (uintptr_t) request->iov;
+        sqe->len= (uint32_t) (request->iovcnt < IOV_MAX ? request->iovcnt : IOV_MAX);
+    }
+    sqe->fd= this->fileFd;
+    sqe->off= request->pos;
+    sqe->user_data= (uint64_t) (uintptr_t) request;
+
+    __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+    request->queued= true;
+    this->inFlight++;
+    this->numRequests++;
+    this->unsent.push_back(request);
+}
+
+// this method returns the result of io_uring_enter, -errno on failure
+int IoRing::enter(unsigned toSubmit, unsigned minComplete) {
+    int ret= (int) syscall(__NR_io_uring_enter, this->ringFd, toSubmit, minComplete,
+                           minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+// Hand the queued requests to the kernel, the lock must be held. Requests the kernel does not take are failed.
+void IoRing::submit() {
+    while(!this->unsent.empty()) {
+        int ret= enter((unsigned) this->unsent.size(), 0);
+        if(ret == -EINTR)
+            continue;
+        if(ret > 0) {
+            this->unsent.erase(this->unsent.begin(), this->unsent.begin() + ret);
+            continue;
+        }
+
+        // the entries are still at the end of the submission queue, take them back
+        __atomic_store_n(this->sqTail, *this->sqTail - (unsigned) this->unsent.size(), __ATOMIC_RELEASE);
+        for(size_t i= 0; i < this->unsent.size(); i++) {
+            this->unsent[i]->queued= false;
+            this->inFlight--;
+            complete(this->unsent[i], ret < 0 && ret != -EAGAIN ? ret : -EIO);
+        }
+        this->unsent.clear();
+    }
+}
+
+// Take all completions from the completion queue, the lock must be held.
+void IoRing::reap() {
+    unsigned head= *this->cqHead;
+    unsigned tail= __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+
+    while(head != tail) {
+        struct io_uring_cqe *cqe= (struct io_uring_cqe *) this->cqes + (head & this->cqMask);
+        IoRequest *request= (IoRequest *) (uintptr_t) cqe->user_data;
+        int res= cqe->res;
+        head++;
+
+        request->queued= false;
+        this->inFlight--;
+        complete(request, res);
+    }
+
+    __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+int IoRing::init(int fd, unsigned entries) {
+    return -ENOSYS;
+}
+
+void IoRing::close() {
+}
+
+int IoRing::registerBuffer(char *base, size_t length) {
+    return -ENOSYS;
+}
+
+void IoRing::unregisterBuffer() {
+}
+
+void IoRing::queue(IoRequest *request) {
+}
+
+int IoRing::enter(unsigned toSubmit, unsigned minComplete) {
+    return -ENOSYS;
+}
+
+void IoRing::submit() {
+}
+
+void IoRing::reap() {
+}
+
+#endif
+
+// Account for the result of a transfer. Interrupted and short transfers are left to be queued again.
+void IoRing::complete(IoRequest *request, int res) {
+    if(res == -EINTR || res == -EAGAIN)
+        return;
+
+    if(res < 0) {
+        request->result= res;
+    } else if(res == 0) {
+        if(request->write) {
+            request->result= -ENOSPC;
+        } else {
+            // end of file reached
+            for(int i= 0; i < request->iovcnt; i++)
+                memset(request->iov[i].iov_base, 0, request->iov[i].iov_len);
+        }
+    } else {
+        request->pos+= res;
+        size_t r= (size_t) res;
+        while(r > 0 && r >= request->iov->iov_len) {
+            r-= request->iov->iov_len;
+            request->iov++;
+            request->iovcnt--;
+        }
+        if(r > 0) {
+            request->iov->iov_base= (char *) request->iov->iov_base + r;
+            request->iov->iov_len-= r;
+        }
+        if(request->iovcnt > 0)
+            return;
+    }
+
+    request->done= true;
+    (*request->remaining)--;
+}
+
+int IoRing::transfer(IoRequest *requests, size_t count) {
+    if(this->ringFd < 0)
+        return -ENOSYS;
+
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->numCalls++;
+
+    size_t remaining= count;
+    for(size_t i= 0; i < count; i++) {
+        requests[i].result= 0;
+        requests[i].queued= false;
+        requests[i].done= false;
+        requests[i].remaining= &remaining;
+        if(requests[i].iovcnt == 0) {
+            requests[i].done= true;
+            remaining--;
+        }
+    }
+
+    for(;;) {
+        for(size_t i= 0; i < count && this->inFlight < this->entries; i++) {
+            if(!requests[i].queued && !requests[i].done)
+                queue(&requests[i]);
+        }
+        submit();
+        if(remaining == 0)
+            break;
+
+        // a single thread waits in the kernel, it reaps the completions for everybody
+        if(this->reaping) {
+            this->reaped.wait(guard);
+            continue;
+        }
+        this->reaping= true;
+        guard.unlock();
+        enter(0, 1);
+        guard.lock();
+        reap();
+        this->reaping= false;
+        this->reaped.notify_all();
+    }
+
+    int ret= 0;
+    for(size_t i= 0; i < count && ret == 0; i++)
+        ret= requests[i].result;
+    return ret;
+}
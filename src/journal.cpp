@@ -0,0 +1,320 @@
+//
+//  journal.cpp
+//  myfs
+//
+
+#include <cerrno>
+#include <cstring>
+
+#include "journal.h"
+#include "myfs-structs.h"
+
+// FNV-1a, detects transactions whose blocks have not all reached the container
+static uint32_t checksum(uint32_t sum, const char *data, size_t size) {
+    for(size_t i= 0; i < size; i++)
+        sum= (sum ^ (uint8_t) data[i]) * 16777619u;
+    return sum;
+}
+
+#define CHECKSUM_SEED 2166136261u
+
+Journal::Journal(BlockDevice *blockDevice, BlockCache *blockCache, uint32_t start, uint32_t numBlocks) {
+    this->blockDevice= blockDevice;
+    this->blockCache= blockCache;
+    this->blockSize= blockDevice->getBlockSize();
+    this->start= start;
+    this->numBlocks= numBlocks;
+    this->seq= 1;
+    this->head= 1;
+    this->numCommits= 0;
+    this->numLogged= 0;
+}
+
+// Write the header with the sequence number of the transaction at head.
+int Journal::writeHeader() {
+    std::vector<char> buffer(this->blockSize, 0);
+    MyFsJournalBlock *header= (MyFsJournalBlock *) buffer.data();
+    header->magic= MYFS_JOURNAL_MAGIC;
+    header->type= JOURNAL_HEADER;
+    header->seq= this->seq;
+
+    return this->blockDevice->write(this->start, buffer.data());
+}
+
+// Bring all committed blocks in place and start over behind the header. The lock must be held.
+int Journal::restart() {
+    int ret= this->blockCache->flush();
+    if(ret >= 0)
+        ret= this->blockDevice->sync();
+    if(ret < 0)
+        return ret;
+
+    this->head= 1;
+    this->logged.clear();
+    ret= writeHeader();
+    if(ret >= 0)
+        ret= this->blockDevice->sync();
+
+    return ret;
+}
+
+int Journal::format() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->seq= 1;
+    this->head= 1;
+    this->images.clear();
+    this->revoked.clear();
+    this->logged.clear();
+
+    return writeHeader();
+}
+
+int Journal::replay(uint32_t *numReplayed) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    *numReplayed= 0;
+    std::vector<char> buffer(this->blockSize);
+    std::vector<char> image(this->blockSize);
+    const MyFsJournalBlock *block= (const MyFsJournalBlock *) buffer.data();
+
+    int ret= this->blockDevice->read(this->start, buffer.data());
+    if(ret < 0)
+        return ret;
+    if(block->magic != MYFS_JOURNAL_MAGIC || block->type != JOURNAL_HEADER)
+        return -EINVAL;
+    uint32_t expected= block->seq;
+
+    // find the valid transactions, for each logged block remember where its image is
+    struct Transaction {
+        uint32_t seq;
+        std::vector<std::pair<uint32_t, uint32_t> > blocks;     // block in place, block of the image
+    };
+    std::vector<Transaction> transactions;
+    std::map<uint32_t, uint32_t> revokedBy;     // latest transaction that revoked a block
+    uint32_t perBlock= (uint32_t) JOURNAL_TAGS_PER_BLOCK(this->blockSize);
+    uint32_t pos= 1;
+    while(pos < this->numBlocks) {
+        Transaction transaction;
+        transaction.seq= expected;
+        std::vector<uint32_t> revokes;
+        uint32_t sum= CHECKSUM_SEED;
+        uint32_t p= pos;
+        bool committed= false;
+        while(p < this->numBlocks) {
+            ret= this->blockDevice->read(this->start + p, buffer.data());
+            if(ret < 0)
+                return ret;
+            if(block->magic != MYFS_JOURNAL_MAGIC || block->seq != expected)
+                break;
+
+            if(block->type == JOURNAL_COMMIT) {
+                committed= block->checksum == sum;
+                p++;
+                break;
+            }
+            if(block->type != JOURNAL_DESCRIPTOR || block->count + block->numRevoked > perBlock ||
+               p + 1 + block->count > this->numBlocks)
+                break;
+
+            sum= checksum(sum, buffer.data(), this->blockSize);
+            for(uint32_t i= 0; i < block->count; i++) {
+                ret= this->blockDevice->read(this->start + p + 1 + i, image.data());
+                if(ret < 0)
+                    return ret;
+                sum= checksum(sum, image.data(), this->blockSize);
+                transaction.blocks.push_back(std::make_pair(block->blocks[i], this->start + p + 1 + i));
+            }
+            revokes.insert(revokes.end(), block->blocks + block->count,
+                           block->blocks + block->count + block->numRevoked);
+            p+= 1 + block->count;
+        }
+        if(!committed)
+            break;
+
+        for(size_t r= 0; r < revokes.size(); r++)
+            revokedBy[revokes[r]]= expected;
+        transactions.push_back(transaction);
+        expected++;
+        pos= p;
+    }
+
+    // images of blocks revoked by a later transaction are skipped
+    for(size_t t= 0; t < transactions.size(); t++) {
+        for(size_t b= 0; b < transactions[t].blocks.size(); b++) {
+            uint32_t blockNo= transactions[t].blocks[b].first;
+            std::map<uint32_t, uint32_t>::const_iterator r= revokedBy.find(blockNo);
+            if(r != revokedBy.end() && r->second > transactions[t].seq)
+                continue;
+            ret= this->blockDevice->read(transactions[t].blocks[b].second, image.data());
+            if(ret >= 0)
+                ret= this->blockDevice->write(blockNo, image.data());
+            if(ret < 0)
+                return ret;
+        }
+    }
+
+    this->seq= expected;
+    this->images.clear();
+    this->revoked.clear();
+    ret= restart();
+    if(ret >= 0)
+        *numReplayed= (uint32_t) transactions.size();
+
+    return ret;
+}
+
+bool Journal::read(uint32_t blockNo, char *buffer) const {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    std::map<uint32_t, std::vector<char> >::const_iterator it= this->images.find(blockNo);
+    if(it == this->images.end())
+        return false;
+
+    memcpy(buffer, it->second.data(), this->blockSize);
+    return true;
+}
+
+void Journal::write(uint32_t blockNo, const char *buffer) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->images[blockNo].assign(buffer, buffer + this->blockSize);
+}
+
+void Journal::revoke(uint32_t blockNo, uint32_t count) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    uint32_t end= blockNo + count;
+    std::map<uint32_t, std::vector<char> >::iterator it= this->images.lower_bound(blockNo);
+    while(it != this->images.end() && it->first < end)
+        it= this->images.erase(it);
+
+    // usually only few of the freed blocks have ever been logged
+    if(count > this->logged.size()) {
+        for(std::unordered_set<uint32_t>::const_iterator l= this->logged.begin(); l != this->logged.end(); ++l) {
+            if(*l >= blockNo && *l < end)
+                this->revoked.insert(*l);
+        }
+    } else {
+        for(uint32_t b= blockNo; b < end; b++) {
+            if(this->logged.count(b) > 0)
+                this->revoked.insert(b);
+        }
+    }
+}
+
+int Journal::commit() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if(this->images.empty() && this->revoked.empty())
+        return 0;
+
+    uint32_t perBlock= (uint32_t) JOURNAL_TAGS_PER_BLOCK(this->blockSize);
+    uint32_t numTags= (uint32_t) (this->images.size() + this->revoked.size());
+    uint32_t numDescriptors= (numTags + perBlock - 1) / perBlock;
+    uint32_t size= numDescriptors + (uint32_t) this->images.size();     // without the commit block
+    int ret= 0;
+
+    if(size + 2 > this->numBlocks) {
+        // too large for the journal, write in place directly
+        ret= restart();
+        std::map<uint32_t, std::vector<char> >::iterator it;
+        for(it= this->images.begin(); ret >= 0 && it != this->images.end(); ++it)
+            ret= this->blockCache->write(it->first, it->second.data());
+        if(ret >= 0)
+            ret= this->blockCache->flush();
+        if(ret >= 0)
+            ret= this->blockDevice->sync();
+        if(ret < 0)
+            return ret;
+    } else {
+        if(this->head + size + 1 > this->numBlocks)
+            ret= restart();
+        if(ret < 0)
+            return ret;
+
+        // descriptors list the logged blocks first, then the revoked ones
+        std::vector<char> log((size_t) size * this->blockSize, 0);
+        std::map<uint32_t, std::vector<char> >::const_iterator image= this->images.begin();
+        std::set<uint32_t>::const_iterator revoke= this->revoked.begin();
+        uint32_t sum= CHECKSUM_SEED;
+        uint32_t pos= 0;
+        while(pos < size) {
+            char *data= &log[(size_t) pos * this->blockSize];
+            MyFsJournalBlock *descriptor= (MyFsJournalBlock *) data;
+            descriptor->magic= MYFS_JOURNAL_MAGIC;
+            descriptor->type= JOURNAL_DESCRIPTOR;
+            descriptor->seq= this->seq;
+            std::map<uint32_t, std::vector<char> >::const_iterator first= image;
+            while(image != this->images.end() && descriptor->count < perBlock)
+                descriptor->blocks[descriptor->count++]= (image++)->first;
+            while(revoke != this->revoked.end() && descriptor->count + descriptor->numRevoked < perBlock)
+                descriptor->blocks[descriptor->count + descriptor->numRevoked++]= *revoke++;
+            sum= checksum(sum, data, this->blockSize);
+            pos++;
+
+            for(; first != image; ++first, pos++) {
+                memcpy(&log[(size_t) pos * this->blockSize], first->second.data(), this->blockSize);
+                sum= checksum(sum, first->second.data(), this->blockSize);
+            }
+        }
+
+        // file data first, then the transaction, then its commit block
+        std::vector<char> buffer(this->blockSize, 0);
+        MyFsJournalBlock *commitBlock= (MyFsJournalBlock *) buffer.data();
+        commitBlock->magic= MYFS_JOURNAL_MAGIC;
+        commitBlock->type= JOURNAL_COMMIT;
+        commitBlock->seq= this->seq;
+        commitBlock->checksum= sum;
+
+        ret= this->blockCache->flush();
+        if(ret >= 0)
+            ret= this->blockDevice->writeBlocks(this->start + this->head, size, log.data());
+        if(ret >= 0)
+            ret= this->blockDevice->sync();
+        if(ret >= 0)
+            ret= this->blockDevice->write(this->start + this->head + size, buffer.data());
+        if(ret >= 0)
+            ret= this->blockDevice->sync();
+        if(ret < 0)
+            return ret;
+
+        this->head+= size + 1;
+        this->seq++;
+
+        // committed blocks may go in place now
+        std::map<uint32_t, std::vector<char> >::iterator it;
+        for(it= this->images.begin(); ret >= 0 && it != this->images.end(); ++it) {
+            ret= this->blockCache->write(it->first, it->second.data());
+            this->logged.insert(it->first);
+        }
+    }
+
+    this->numCommits++;
+    this->numLogged+= this->images.size();
+    this->images.clear();
+    this->revoked.clear();
+
+    return ret < 0 ? ret : 1;
+}
+
+int Journal::checkpoint() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    return restart();
+}
+
+uint32_t Journal::getNumPending() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return (uint32_t) this->images.size();
+}
+
+uint64_t Journal::getNumCommits() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numCommits;
+}
+
+uint64_t Journal::getNumLogged() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->numLogged;
+}
@@ -0,0 +1,173 @@
+//
+//  logger.cpp
+//  myfs
+//
+
+#include <cstdarg>
+#include <cerrno>
+#include <chrono>
+
+#include "logger.h"
+
+Logger::Logger(uint32_t numRecords) {
+    this->numRecords= 2;
+    while(this->numRecords < numRecords)
+        this->numRecords<<= 1;
+
+    this->records= new Record[this->numRecords];
+    for(uint32_t r= 0; r < this->numRecords; r++)
+        this->records[r].seq.store(r, std::memory_order_relaxed);
+
+    this->writePos= 0;
+    this->readPos= 0;
+    this->numDropped= 0;
+    this->numReported= 0;
+    this->level= 0;
+    this->active= false;
+
+    this->file= NULL;
+    this->stop= false;
+}
+
+Logger::~Logger() {
+    close();
+    delete [] this->records;
+}
+
+int Logger::open(const char *path) {
+    close();
+
+    this->file= fopen(path, "w+");
+    if(this->file == NULL)
+        return -errno;
+
+    this->stop= false;
+    this->numReported= this->numDropped;
+    this->drainThread= std::thread(&Logger::drainLoop, this);
+    this->active= true;
+
+    return 0;
+}
+
+void Logger::close() {
+    if(!this->active)
+        return;
+    this->active= false;
+
+    {
+        std::lock_guard<std::mutex> guard(this->drainLock);
+        this->stop= true;
+    }
+    this->drainCond.notify_one();
+    this->drainThread.join();
+
+    fclose(this->file);
+    this->file= NULL;
+}
+
+void Logger::flush() {
+    if(!this->active)
+        return;
+
+    uint64_t target= this->writePos.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> guard(this->drainLock);
+    while(this->readPos.load(std::memory_order_acquire) < target) {
+        this->drainCond.notify_one();
+        this->doneCond.wait_for(guard, std::chrono::milliseconds(LOGGER_DRAIN_INTERVAL_MS));
+    }
+}
+
+void Logger::write(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    if(!this->active) {
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        return;
+    }
+
+    // claim the next record, the sequence number tells whether the record is free, still in use by the drain thread
+    // or has just been taken by another thread
+    uint64_t pos= this->writePos.load(std::memory_order_relaxed);
+    Record *record;
+    for(;;) {
+        record= &this->records[pos & (this->numRecords - 1)];
+        int64_t diff= (int64_t) (record->seq.load(std::memory_order_acquire) - pos);
+        if(diff == 0) {
+            if(this->writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if(diff < 0) {
+            this->numDropped.fetch_add(1, std::memory_order_relaxed);
+            va_end(args);
+            return;
+        } else {
+            pos= this->writePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    int length= vsnprintf(record->text, LOGGER_RECORD_SIZE, fmt, args);
+    va_end(args);
+    if(length < 0)
+        length= 0;
+    if(length >= LOGGER_RECORD_SIZE) {
+        // keep the line break of truncated messages
+        length= LOGGER_RECORD_SIZE - 1;
+        record->text[length - 1]= '\n';
+    }
+    record->length= (uint32_t) length;
+    record->seq.store(pos + 1, std::memory_order_release);
+
+    // do not wait for the next interval if the ring buffer fills up
+    if(pos - this->readPos.load(std::memory_order_relaxed) == this->numRecords / 2)
+        this->drainCond.notify_one();
+}
+
+void Logger::drainLoop() {
+    std::unique_lock<std::mutex> guard(this->drainLock);
+    for(;;) {
+        bool stopping= this->stop;
+
+        guard.unlock();
+        drain();
+        guard.lock();
+
+        this->doneCond.notify_all();
+        if(stopping)
+            break;
+        if(!this->stop)
+            this->drainCond.wait_for(guard, std::chrono::milliseconds(LOGGER_DRAIN_INTERVAL_MS));
+    }
+}
+
+// Write all filled records to the log file, in the order they were claimed.
+// this method returns true if anything was written
+bool Logger::drain() {
+    bool written= false;
+
+    uint64_t pos= this->readPos.load(std::memory_order_relaxed);
+    for(;;) {
+        Record *record= &this->records[pos & (this->numRecords - 1)];
+        if(record->seq.load(std::memory_order_acquire) != pos + 1)
+            break;
+
+        fwrite(record->text, 1, record->length, this->file);
+        record->seq.store(pos + this->numRecords, std::memory_order_release);
+        pos++;
+        written= true;
+    }
+    this->readPos.store(pos, std::memory_order_release);
+
+    uint64_t dropped= this->numDropped.load(std::memory_order_relaxed);
+    if(dropped != this->numReported) {
+        fprintf(this->file, "\t[%llu log messages dropped]\n", (unsigned long long) (dropped - this->numReported));
+        this->numReported= dropped;
+        written= true;
+    }
+
+    if(written)
+        fflush(this->file);
+
+    return written;
+}
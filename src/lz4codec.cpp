@@ -0,0 +1,171 @@
+//
+//  lz4codec.cpp
+//  myfs
+//
+
+#include <cerrno>
+#include <cstring>
+
+#include "lz4codec.h"
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Store a length that does not fit into its 4 bits of the token as a run of 255s and a last byte.
+static inline uint8_t *putLength(uint8_t *op, size_t length) {
+    while(length >= 255) {
+        *op++= 255;
+        length-= 255;
+    }
+    *op++= (uint8_t) length;
+    return op;
+}
+
+/// @brief Compress a buffer.
+/// \param [in] src Data to compress.
+/// \param [in] size Number of bytes to compress.
+/// \param [out] dst Buffer for the compressed data.
+/// \param [in] capacity Size of dst.
+/// \return Size of the compressed data, 0 if it does not fit into capacity bytes.
+size_t Lz4Codec::compress(const char *src, size_t size, char *dst, size_t capacity) {
+    const uint8_t *in= (const uint8_t *) src;
+    const uint8_t *end= in + size;
+    const uint8_t *ip= in;
+    const uint8_t *anchor= in;
+    uint8_t *op= (uint8_t *) dst;
+    uint8_t *opEnd= op + capacity;
+
+    uint32_t table[1 << LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    if(size > LZ4_MATCH_LIMIT) {
+        const uint8_t *matchStop= end - LZ4_MATCH_LIMIT;
+        const uint8_t *extendStop= end - LZ4_LAST_LITERALS;
+        ip++;
+
+        while(ip < matchStop) {
+            uint32_t h= hash32(read32(ip));
+            const uint8_t *ref= in + table[h];
+            table[h]= (uint32_t) (ip - in);
+            if(ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(ref) != read32(ip)) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *mp= ip + LZ4_MIN_MATCH;
+            const uint8_t *rp= ref + LZ4_MIN_MATCH;
+            while(mp < extendStop && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            // token, literals, offset, extra length bytes
+            size_t literals= (size_t) (ip - anchor);
+            size_t match= (size_t) (mp - ip) - LZ4_MIN_MATCH;
+            if(opEnd - op < (ptrdiff_t) (1 + literals / 255 + 1 + literals + 2 + match / 255 + 1))
+                return 0;
+            uint8_t *token= op++;
+            *token= (uint8_t) ((literals < 15 ? literals : 15) << 4);
+            if(literals >= 15)
+                op= putLength(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op+= literals;
+            uint16_t offset= (uint16_t) (ip - ref);
+            *op++= (uint8_t) offset;
+            *op++= (uint8_t) (offset >> 8);
+            *token|= (uint8_t) (match < 15 ? match : 15);
+            if(match >= 15)
+                op= putLength(op, match - 15);
+
+            ip= mp;
+            anchor= ip;
+        }
+    }
+
+    // the last sequence only has literals
+    size_t literals= (size_t) (end - anchor);
+    if(opEnd - op < (ptrdiff_t) (1 + literals / 255 + 1 + literals))
+        return 0;
+    *op++= (uint8_t) ((literals < 15 ? literals : 15) << 4);
+    if(literals >= 15)
+        op= putLength(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op+= literals;
+
+    return (size_t) (op - (uint8_t *) dst);
+}
+
+/// @brief Decompress a buffer.
+///
+/// The input is checked, malformed blocks never make the method read or write outside of the buffers.
+/// \param [in] src Compressed data.
+/// \param [in] size Number of bytes of compressed data.
+/// \param [out] dst Buffer for the decompressed data.
+/// \param [in] capacity Size of dst.
+/// \return Size of the decompressed data, -EIO if the compressed data is malformed or does not fit into dst.
+int Lz4Codec::decompress(const char *src, size_t size, char *dst, size_t capacity) {
+    const uint8_t *ip= (const uint8_t *) src;
+    const uint8_t *ipEnd= ip + size;
+    uint8_t *out= (uint8_t *) dst;
+    uint8_t *op= out;
+    uint8_t *opEnd= out + capacity;
+
+    while(ip < ipEnd) {
+        uint8_t token= *ip++;
+
+        size_t literals= token >> 4;
+        if(literals == 15) {
+            uint8_t b;
+            do {
+                if(ip >= ipEnd)
+                    return -EIO;
+                b= *ip++;
+                literals+= b;
+            } while(b == 255);
+        }
+        if((size_t) (ipEnd - ip) < literals || (size_t) (opEnd - op) < literals)
+            return -EIO;
+        memcpy(op, ip, literals);
+        ip+= literals;
+        op+= literals;
+
+        // the last sequence ends after its literals
+        if(ip == ipEnd)
+            break;
+
+        if(ipEnd - ip < 2)
+            return -EIO;
+        size_t offset= ip[0] | ((size_t) ip[1] << 8);
+        ip+= 2;
+        if(offset == 0 || offset > (size_t) (op - out))
+            return -EIO;
+
+        size_t match= (token & 15) + LZ4_MIN_MATCH;
+        if((token & 15) == 15) {
+            uint8_t b;
+            do {
+                if(ip >= ipEnd)
+                    return -EIO;
+                b= *ip++;
+                match+= b;
+            } while(b == 255);
+        }
+        if((size_t) (opEnd - op) < match)
+            return -EIO;
+
+        // the match may overlap the bytes it produces
+        const uint8_t *ref= op - offset;
+        for(size_t i= 0; i < match; i++)
+            op[i]= ref[i];
+        op+= match;
+    }
+
+    return (int) (op - out);
+}
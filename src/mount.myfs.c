@@ -21,21 +21,60 @@
 struct fuse_operations myfs_oper;
 
 struct myfs_config {
-    char *containerFileName;
+    char **containerFileNames;      // one for each -c option, a container striped over several files
+    unsigned int numContainerFiles;
+    unsigned int stripeChunk;
     char *logFileName;
+    unsigned int cacheBlocks;
+    int multithreaded;
+    int mapped;
+    int logLevel;
+    unsigned int maxOpenFiles;
+    unsigned int blockSize;
+    int compress;
+    unsigned int commitInterval;
+    int uring;
+    int direct;
+    int splice;
+    char *imageFileName;
+    int noatime;
+    int strictatime;
+    unsigned int relatime;
+    int checksum;
+    unsigned int scrubInterval;
 };
 enum {
     KEY_HELP,
     KEY_VERSION,
+    KEY_CONTAINER,
 };
 
 #define MYFS_OPT(t, p, v) { t, offsetof(struct myfs_config, p), v }
 
 static struct fuse_opt myfs_opts[] = {
-        MYFS_OPT("-c %s",             containerFileName, 0),
-        MYFS_OPT("containerfile=%s",  containerFileName, 0),
+        FUSE_OPT_KEY("-c ",            KEY_CONTAINER),
+        FUSE_OPT_KEY("containerfile=", KEY_CONTAINER),
+        MYFS_OPT("stripechunk=%u",    stripeChunk, 0),
         MYFS_OPT("-l %s",             logFileName, 0),
         MYFS_OPT("logfile=%s",        logFileName, 0),
+        MYFS_OPT("cacheblocks=%u",    cacheBlocks, 0),
+        MYFS_OPT("-m",                multithreaded, 1),
+        MYFS_OPT("multithreaded",     multithreaded, 1),
+        MYFS_OPT("mmap",              mapped, 1),
+        MYFS_OPT("loglevel=%d",       logLevel, 0),
+        MYFS_OPT("maxopenfiles=%u",   maxOpenFiles, 0),
+        MYFS_OPT("blocksize=%u",      blockSize, 0),
+        MYFS_OPT("compress",          compress, 1),
+        MYFS_OPT("commit=%u",         commitInterval, 0),
+        MYFS_OPT("uring",             uring, 1),
+        MYFS_OPT("direct",            direct, 1),
+        MYFS_OPT("splice",            splice, 1),
+        MYFS_OPT("image=%s",          imageFileName, 0),
+        MYFS_OPT("noatime",           noatime, 1),
+        MYFS_OPT("strictatime",       strictatime, 1),
+        MYFS_OPT("relatime=%u",       relatime, 0),
+        MYFS_OPT("checksum",          checksum, 1),
+        MYFS_OPT("scrub=%u",          scrubInterval, 0),
 
         FUSE_OPT_KEY("-V",             KEY_VERSION),
         FUSE_OPT_KEY("--version",      KEY_VERSION),
@@ -46,7 +85,20 @@ static struct fuse_opt myfs_opts[] = {
 
 static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args *outargs)
 {
+    struct myfs_config *conf= data;
+    char **names;
+
     switch (key) {
+        case KEY_CONTAINER:
+            // "-cFILE" or "containerfile=FILE", the option may be given several times
+            names= realloc(conf->containerFileNames, (conf->numContainerFiles + 1) * sizeof(char *));
+            if(names == NULL)
+                return -1;
+            conf->containerFileNames= names;
+            names[conf->numContainerFiles++]= strdup(arg[0] == '-' ? arg + 2 : strchr(arg, '=') + 1);
+            return 0;
+
+
         case KEY_HELP:
             fuse_opt_add_arg(outargs, "-h");
             fuse_main(outargs->argc, outargs->argv, &myfs_oper, NULL);
@@ -54,9 +106,37 @@ static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args
                     "\n"
                     "Myfs options:\n"
                     "    -o containerfile=FILE\n"
-                    "    -c FILE            same as '-o containerfile=FILE'\n"
+                    "    -c FILE            same as '-o containerfile=FILE', several files stripe the container\n"
+                    "                       over them in their order (on-disk mode)\n"
+                    "    -o stripechunk=N   bytes on one file of a striped container before the next, a multiple\n"
+                    "                       of 512 (default 65536, on-disk mode)\n"
                     "    -o logfile=FILE\n"
-                    "    -l FILE            same as '-o logfile=FILE'\n");
+                    "    -l FILE            same as '-o logfile=FILE'\n"
+                    "    -o cacheblocks=N   number of blocks in the block cache (on-disk mode)\n"
+                    "    -o multithreaded\n"
+                    "    -m                 same as '-o multithreaded'\n"
+                    "    -o mmap            access the container file through a memory mapping (on-disk mode)\n"
+                    "    -o loglevel=N      0: no messages, 1: messages, 2: and method calls, 3: and return values (default)\n"
+                    "    -o maxopenfiles=N  maximum number of open files (default 64)\n"
+                    "    -o blocksize=N     block size of a new container, a power of two from 512 to 65536\n"
+                    "                       (default 4096, on-disk mode)\n"
+                    "    -o compress        compress files with LZ4 as they are written (on-disk mode)\n"
+                    "    -o commit=N        seconds between commits of the meta data journal (default 5, on-disk mode)\n"
+                    "    -o uring           access the container file through io_uring on Linux (on-disk mode)\n"
+                    "    -o direct          open the container file with O_DIRECT, bypassing the page cache\n"
+                    "                       (on-disk mode)\n"
+                    "    -o splice          splice whole blocks of reads from the container file, readers may see\n"
+                    "                       blocks freed by a concurrent truncate (on-disk mode, FUSE 2.9, not with\n"
+                    "                       checksums)\n"
+                    "    -o checksum        keep CRC-32C checksums of the data blocks of a new container and verify\n"
+                    "                       them on reads (on-disk mode)\n"
+                    "    -o scrub=N         check the data blocks against their checksums every N seconds in the\n"
+                    "                       background (default 0: never, on-disk mode)\n"
+                    "    -o image=FILE      keep the files in a snapshot image across mounts (in-memory mode)\n"
+                    "    -o relatime=N      reads update the access time if it is older than the last change or N\n"
+                    "                       seconds (default 86400)\n"
+                    "    -o strictatime     every read updates the access time\n"
+                    "    -o noatime         reads do not update the access time\n");
             exit(1);
 
         case KEY_VERSION:
@@ -68,6 +148,55 @@ static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args
     return 1;
 }
 
+// FUSE changes to "/" when it runs in the background, so relative paths are made absolute first
+static char *absolutePath(const char *name) {
+    if(name[0] == '/')
+        return strdup(name);
+
+    char cwd[PATH_MAX];
+    if(getcwd(cwd, sizeof(cwd)) == NULL)
+        return NULL;
+    char *path= malloc(strlen(cwd) + strlen(name) + 2);
+    if(path != NULL)
+        sprintf(path, "%s/%s", cwd, name);
+    return path;
+}
+
+// Resolve the path of a container file, it may not exist yet, but its directory must be writable.
+static char *containerPath(const char *name) {
+    char *containerFileName= realpath(name, NULL);
+
+    if(containerFileName == NULL) {
+        // container file does not exist, check if path is writable
+        char *containerFileNameCpy= malloc(strlen(name)+1);
+        strcpy(containerFileNameCpy, name);
+        char *dirName= dirname(containerFileNameCpy);
+        char *containerPathName= realpath(dirName, NULL);
+        // free(dirName);
+        if (containerPathName == NULL || access(containerPathName, R_OK | W_OK) != 0 ) {
+            fprintf(stderr, "Error: Cannot access container directory %s\n", containerPathName == NULL ? "" : containerPathName);
+            exit(EXIT_FAILURE);
+        }
+        containerFileName= (char *) malloc(PATH_MAX);
+        strcpy(containerFileNameCpy, name);
+        char *containerBaseName= basename(containerFileNameCpy);
+        strcpy(containerFileName, containerPathName);
+        strcat(containerFileName, "/");
+        strcat(containerFileName, containerBaseName);
+        // free(containerBaseName);
+        free(containerPathName);
+        free(containerFileNameCpy);
+    } else {
+        // container file does exit, check if it is writable
+        if (containerFileName == NULL || access(containerFileName, R_OK | W_OK) != 0 ) {
+            fprintf(stderr, "Error: Cannot access container file %s\n", containerFileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return containerFileName;
+}
+
 int main(int argc, char *argv[]) {
     int fuse_stat;
 
@@ -88,6 +217,10 @@ int main(int argc, char *argv[]) {
     myfs_oper.open = wrap_open;
     myfs_oper.read = wrap_read;
     myfs_oper.write = wrap_write;
+#if FUSE_VERSION >= 29
+    myfs_oper.read_buf = wrap_read_buf;
+    myfs_oper.write_buf = wrap_write_buf;
+#endif
     myfs_oper.statfs = wrap_statfs;
     myfs_oper.flush = wrap_flush;
     myfs_oper.release = wrap_release;
@@ -102,53 +235,44 @@ int main(int argc, char *argv[]) {
     myfs_oper.fsyncdir = wrap_fsyncdir;
     myfs_oper.init = wrap_init;
     myfs_oper.ftruncate = wrap_ftruncate;
+    myfs_oper.create = wrap_create;
     myfs_oper.destroy = wrap_destroy;
 
+    char** containerFileNames= NULL;
     char* containerFileName= NULL;
     char* logFileName= NULL;
+    char* imageFileName= NULL;
 
     // parse arguments
     struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
     struct myfs_config conf;
 
     memset(&conf, 0, sizeof(conf));
+    conf.logLevel= 3;
 
     fuse_opt_parse(&args, &conf, myfs_opts, myfs_opt_proc);
 
     // FsInfo will be used to pass information to fuse functions
     struct MyFsInfo *FsInfo;
     FsInfo= malloc(sizeof(struct MyFsInfo));
-    // check if container file is accessible
-    if(conf.containerFileName != NULL) {
-        containerFileName= realpath(conf.containerFileName, NULL);
-
-        if(containerFileName == NULL) {
-            // container file does not exist, check if path is writable
-            char *containerFileNameCpy= malloc(strlen(conf.containerFileName)+1);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *dirName= dirname(containerFileNameCpy);
-            char *containerPathName= realpath(dirName, NULL);
-            // free(dirName);
-            if (containerPathName == NULL || access(containerPathName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container directory %s\n", containerPathName == NULL ? "" : containerPathName);
-                exit(EXIT_FAILURE);
-            }
-            containerFileName= (char *) malloc(PATH_MAX);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *containerBaseName= basename(containerFileNameCpy);
-            strcpy(containerFileName, containerPathName);
-            strcat(containerFileName, "/");
-            strcat(containerFileName, containerBaseName);
-            // free(containerBaseName);
-            free(containerPathName);
-            free(containerFileNameCpy);
-        } else {
-            // container file does exit, check if it is writable
-            if (containerFileName == NULL || access(containerFileName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container file %s\n", containerFileName);
-                exit(EXIT_FAILURE);
+    // check if the container files are accessible
+    if(conf.numContainerFiles > 0) {
+        containerFileNames= malloc(conf.numContainerFiles * sizeof(char *));
+        for(unsigned int c= 0; c < conf.numContainerFiles; c++) {
+            containerFileNames[c]= containerPath(conf.containerFileNames[c]);
+            for(unsigned int d= 0; d < c; d++) {
+                if(strcmp(containerFileNames[c], containerFileNames[d]) == 0) {
+                    fprintf(stderr, "Error: Container file %s is given twice\n", containerFileNames[c]);
+                    exit(EXIT_FAILURE);
+                }
             }
         }
+        containerFileName= containerFileNames[0];
+
+        if(conf.stripeChunk % 512 != 0) {
+            fprintf(stderr, "Error: Stripe chunk size must be a multiple of 512\n");
+            exit(EXIT_FAILURE);
+        }
 
         // container file is used, so we are not in memory!
         setInstance(1);
@@ -156,6 +280,13 @@ int main(int argc, char *argv[]) {
         setInstance(0);
     }
 
+    // same limits as MIN_BLOCK_SIZE and MAX_BLOCK_SIZE of the on-disk layout
+    if(conf.blockSize != 0 &&
+       (conf.blockSize < 512 || conf.blockSize > 65536 || (conf.blockSize & (conf.blockSize - 1)) != 0)) {
+        fprintf(stderr, "Error: Block size must be a power of two from 512 to 65536\n");
+        exit(EXIT_FAILURE);
+    }
+
     // check if logfile can be accessed
     if(conf.logFileName != NULL) {
         FILE *logFile = fopen(conf.logFileName, "w+");
@@ -171,13 +302,44 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    // the image may not exist yet, it is written at unmount
+    if(conf.imageFileName != NULL) {
+        if(containerFileName != NULL)
+            fprintf(stderr, "Warning: Snapshot images are only used in in-memory mode\n");
+        else if((imageFileName= absolutePath(conf.imageFileName)) == NULL) {
+            fprintf(stderr, "Error: Cannot access image file %s\n", conf.imageFileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // everything ok, lets go
     // container & log file name will be passed to fuse functions
     FsInfo->contFile= containerFileName;
+    FsInfo->contFiles= containerFileNames;
+    FsInfo->numContFiles= conf.numContainerFiles;
+    FsInfo->stripeChunk= conf.stripeChunk;
     FsInfo->logFile= logFileName;
+    FsInfo->cacheBlocks= conf.cacheBlocks;
+    FsInfo->multithreaded= conf.multithreaded;
+    FsInfo->mapped= conf.mapped;
+    FsInfo->logLevel= conf.logLevel;
+    FsInfo->maxOpenFiles= conf.maxOpenFiles;
+    FsInfo->blockSize= conf.blockSize;
+    FsInfo->compress= conf.compress;
+    FsInfo->commitInterval= conf.commitInterval;
+    FsInfo->uring= conf.uring;
+    FsInfo->direct= conf.direct;
+    FsInfo->splice= conf.splice;
+    FsInfo->imageFile= imageFileName;
+    FsInfo->noatime= conf.noatime;
+    FsInfo->strictatime= conf.strictatime;
+    FsInfo->relatime= conf.relatime;
+    FsInfo->checksum= conf.checksum;
+    FsInfo->scrubInterval= conf.scrubInterval;
 
-    // add additoinal "-s"
-    fuse_opt_add_arg(&args, "-s");
+    // add additoinal "-s", unless multithreaded mode is requested
+    if(!conf.multithreaded)
+        fuse_opt_add_arg(&args, "-s");
 
     // call fuse initialization method
     fuse_stat = fuse_main(args.argc, args.argv, &myfs_oper, FsInfo);
@@ -186,8 +348,14 @@ int main(int argc, char *argv[]) {
 
     // cleanup
     free(FsInfo);
-    free(containerFileName);
+    for(unsigned int c= 0; c < conf.numContainerFiles; c++) {
+        free(containerFileNames[c]);
+        free(conf.containerFileNames[c]);
+    }
+    free(containerFileNames);
+    free(conf.containerFileNames);
     free(logFileName);
+    free(imageFileName);
 
     return fuse_stat;
 }
@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <cstdlib>
 
 #include "macros.h"
@@ -30,10 +31,187 @@
 
 // TODO: [PART 2] You may move some helper messages here
 
+/// @brief Check that a path names a file below the root directory, i.e., has the form "/name" or "/dir/.../name".
+/// \param [in] path Path to check.
+/// \return 0 if the path is valid, -ENOENT for invalid paths, -ENAMETOOLONG for names exceeding NAME_LENGTH.
+int MyFS::checkPath(const char *path) {
+    if(path[0] != '/' || path[1] == '\0')
+        return -ENOENT;
+    for(const char *p= path; *p != '\0';) {
+        const char *name= p + 1;
+        p= name;
+        while(*p != '\0' && *p != '/')
+            p++;
+        if(p == name)
+            return -ENOENT;
+        if(p - name > NAME_LENGTH)
+            return -ENAMETOOLONG;
+    }
+    return 0;
+}
+
+/// @brief Find the inode of a file, a directory or the root directory.
+///
+/// Must be called with the directory lock held, see resolvePrefix().
+/// \param [in] path Path of the file, starting with "/".
+/// \param [out] ino Inode number.
+/// \return 0 on success, -ENOENT if the file does not exist, -ENOTDIR if a component of the path is a file, -ERRNO on
+/// other failures.
+int MyFS::resolvePath(const char *path, uint32_t *ino) {
+    if(strcmp(path, "/") == 0) {
+        *ino= ROOT_INODE;
+        return 0;
+    }
+
+    int ret= checkPath(path);
+    if(ret < 0)
+        return ret;
+
+    return resolvePrefix(path, strlen(path), ino);
+}
+
+/// @brief Find the directory holding the entry for a path.
+///
+/// Must be called with the directory lock held, see resolvePrefix().
+/// \param [in] path Path of the file, starting with "/".
+/// \param [out] parent Inode number of the directory.
+/// \param [out] name Name of the entry within the directory, points into path.
+/// \return 0 on success, -ENOENT if the directory does not exist, -ENOTDIR if it is a file, -ERRNO on other failures.
+int MyFS::resolveParent(const char *path, uint32_t *parent, const char **name) {
+    int ret= checkPath(path);
+    if(ret < 0)
+        return ret;
+
+    const char *slash= strrchr(path, '/');
+    *name= slash + 1;
+    *parent= ROOT_INODE;
+    if(slash != path)
+        ret= resolvePrefix(path, slash - path, parent);
+    if(ret >= 0 && !isDirectory(*parent))
+        ret= -ENOTDIR;
+
+    return ret;
+}
+
+/// @brief Find the inode of the first bytes of a valid path, e.g. "/a/b" of "/a/b/c".
+///
+/// The longest prefix found in the dentry cache is taken as the starting point, only the components behind it are
+/// looked up in their directories. Each resolved prefix is cached, a missing component as a negative entry. Must be
+/// called with the directory lock held, for reading or writing, so the directories do not change meanwhile.
+/// \param [in] path Valid path, see checkPath().
+/// \param [in] length Length of the prefix, it ends in front of a '/' or at the end of the path.
+/// \param [out] ino Inode number.
+/// \return 0 on success, -ENOENT if the prefix does not exist, -ENOTDIR if a component is a file, -ERRNO on other
+/// failures.
+int MyFS::resolvePrefix(const char *path, size_t length, uint32_t *ino) {
+    uint32_t dir= ROOT_INODE;
+    size_t end= length;
+    while(end > 0) {
+        uint32_t cached;
+        if(this->dentries.lookup(path, end, &cached)) {
+            if(cached == DC_NEGATIVE)
+                return -ENOENT;
+            dir= cached;
+            break;
+        }
+        do
+            end--;
+        while(end > 0 && path[end] != '/');
+    }
+
+    char name[NAME_LENGTH + 1];
+    while(end < length) {
+        size_t start= end + 1;
+        end= start;
+        while(end < length && path[end] != '/')
+            end++;
+        memcpy(name, path + start, end - start);
+        name[end - start]= '\0';
+
+        uint32_t child;
+        int ret= lookupEntry(dir, name, &child);
+        if(ret == -ENOENT)
+            this->dentries.insert(path, end, DC_NEGATIVE);
+        if(ret < 0)
+            return ret;
+        this->dentries.insert(path, end, child);
+        dir= child;
+    }
+
+    *ino= dir;
+    return 0;
+}
+
+/// @brief Look up a name in a single directory, without the dentry cache.
+/// \param [in] dir Inode number of the directory.
+/// \param [in] name Name of the entry.
+/// \param [out] ino Inode number of the entry.
+/// \return 0 on success, -ENOENT if there is no such entry, -ENOTDIR if dir is not a directory, -ERRNO on other
+/// failures.
+int MyFS::lookupEntry(uint32_t dir, const char *name, uint32_t *ino) {
+    return -ENOENT;
+}
+
+/// @brief Check if an inode that was resolved before is a directory.
+bool MyFS::isDirectory(uint32_t ino) {
+    return ino == ROOT_INODE;
+}
+
+/// @brief Choose when reads update the access time, see -o noatime, -o strictatime and -o relatime.
+/// \param [in] info Mount options.
+void MyFS::initAtime(const MyFsInfo *info) {
+    if(info->noatime)
+        this->atimeInterval= ATIME_NEVER;
+    else if(info->strictatime)
+        this->atimeInterval= 0;
+    else
+        this->atimeInterval= info->relatime > 0 ? info->relatime : RELATIME_INTERVAL;
+
+    if(this->atimeInterval == ATIME_NEVER)
+        LOG("Reads do not update the access time");
+    else
+        LOGF("Reads update the access time after %lld seconds", (long long) this->atimeInterval);
+}
+
+/// @brief Check if a read has to update the access time of a file (relatime).
+///
+/// The access time is updated if it is older than the last modification or change of the file, so programs can tell
+/// if a file was read since it changed, or if it is older than atimeInterval seconds. Most reads leave it alone, so
+/// they do not change the meta data of the file.
+/// \param [in] atime Access time of the file.
+/// \param [in] mtime Modification time of the file.
+/// \param [in] ctime Change time of the file.
+/// \param [in] now Current time.
+/// \return true if the access time should be set to now.
+bool MyFS::isAtimeStale(int64_t atime, int64_t mtime, int64_t ctime, int64_t now) const {
+    if(this->atimeInterval == ATIME_NEVER || atime == now)
+        return false;
+    return atime < mtime || atime < ctime || now - atime >= this->atimeInterval;
+}
+
+/// @brief Append the statistics of the file system to a report.
+///
+/// The report is the value of the extended attribute MYFS_STATS_XATTR of the root directory.
+/// \param [out] out Report to append to.
+void MyFS::reportStats(std::string &out) {
+    this->stats.report(out);
+
+    char line[128];
+    snprintf(line, sizeof(line), "open_files %u max_open_files %u\n", this->openFiles.getNumOpen(),
+             this->openFiles.getCapacity());
+    out+= line;
+    snprintf(line, sizeof(line), "dentry_cache entries %u hits %llu negative_hits %llu misses %llu\n",
+             this->dentries.getNumEntries(), (unsigned long long) this->dentries.getHits(),
+             (unsigned long long) this->dentries.getNegativeHits(), (unsigned long long) this->dentries.getMisses());
+    out+= line;
+}
+
 // DO NOT EDIT ANYTHING BELOW THIS LINE!!!
 
-MyFS::MyFS() {
-    this->logFile= stderr;
+MyFS::MyFS() : inodeLocks(NUM_INODE_LOCKS), openFiles(NUM_OPEN_FILES) {
+    // log everything to stderr until the log file is opened
+    this->logger.setLevel(LOG_LEVEL_RETURNS);
+    this->atimeInterval= RELATIME_INTERVAL;
 }
 
 MyFS::~MyFS() {
@@ -100,6 +278,68 @@ int MyFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset
     RETURN(0);
 }
 
+#if FUSE_VERSION >= 29
+/// @brief Read from a file into buffers allocated by the file system.
+///
+/// The default reads into a single memory buffer with fuseRead(). FUSE frees the memory of all buffers and the buffer
+/// vector with free().
+/// \param [in] path Name of the file, starting with "/".
+/// \param [out] bufp The buffer vector holding the data read, allocated with malloc().
+/// \param [in] size Number of bytes to read.
+/// \param [in] offset Position of the first byte to read.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyFS::fuseReadBuf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
+    struct fuse_bufvec *bufv= (struct fuse_bufvec *) malloc(sizeof(struct fuse_bufvec));
+    if(bufv == NULL)
+        return -ENOMEM;
+    *bufv= FUSE_BUFVEC_INIT(size);
+    bufv->buf[0].mem= malloc(size > 0 ? size : 1);
+    if(bufv->buf[0].mem == NULL) {
+        free(bufv);
+        return -ENOMEM;
+    }
+
+    int ret= fuseRead(path, (char *) bufv->buf[0].mem, size, offset, fileInfo);
+    if(ret < 0) {
+        free(bufv->buf[0].mem);
+        free(bufv);
+        return ret;
+    }
+
+    bufv->buf[0].size= (size_t) ret;
+    *bufp= bufv;
+    return 0;
+}
+
+/// @brief Write to a file from buffers provided by FUSE.
+///
+/// A single memory buffer is passed to fuseWrite() as it is, any other data, e.g. in a pipe spliced from the FUSE
+/// device, is copied into one memory buffer first.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] buf The buffer vector holding the data to write.
+/// \param [in] offset Position of the first byte to write.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return Number of bytes written on success, -ERRNO on failure.
+int MyFS::fuseWriteBuf(const char *path, struct fuse_bufvec *buf, off_t offset, struct fuse_file_info *fileInfo) {
+    size_t size= fuse_buf_size(buf);
+
+    if(buf->count == 1 && buf->idx == 0 && buf->off == 0 && !(buf->buf[0].flags & FUSE_BUF_IS_FD))
+        return fuseWrite(path, (const char *) buf->buf[0].mem, size, offset, fileInfo);
+
+    char *mem= (char *) malloc(size > 0 ? size : 1);
+    if(mem == NULL)
+        return -ENOMEM;
+    struct fuse_bufvec dst= FUSE_BUFVEC_INIT(size);
+    dst.buf[0].mem= mem;
+
+    ssize_t copied= fuse_buf_copy(&dst, buf, (enum fuse_buf_copy_flags) 0);
+    int ret= copied < 0 ? (int) copied : fuseWrite(path, mem, (size_t) copied, offset, fileInfo);
+    free(mem);
+    return ret;
+}
+#endif
+
 int MyFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
     RETURN(0);
@@ -161,7 +401,18 @@ int MyFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fi) {
 
 int MyFS::fuseListxattr(const char *path, char *list, size_t size) {
     LOGM();
-    RETURN(0);
+
+    // the root directory has the statistics attribute only
+    int ret= 0;
+    if(strcmp(path, "/") == 0) {
+        ret= (int) sizeof(MYFS_STATS_XATTR);
+        if(size > 0 && size < sizeof(MYFS_STATS_XATTR))
+            ret= -ERANGE;
+        else if(size > 0)
+            memcpy(list, MYFS_STATS_XATTR, sizeof(MYFS_STATS_XATTR));
+    }
+
+    RETURN(ret);
 }
 
 int MyFS::fuseRemovexattr(const char *path, const char *name) {
@@ -189,9 +440,24 @@ int MyFS::fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fi
     RETURN(0);
 }
 
+/// @brief Create and open a file.
+///
+/// Saves FUSE the separate mknod and open requests when a file is created with open(O_CREAT). The file handle is
+/// allocated by fuseOpen(), like for any other open.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] mode Type and permissions of the file.
+/// \param [out] fileInfo Receives the file handle.
+/// \return 0 on success, -ERRNO on failure.
 int MyFS::fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo) {
     LOGM();
-    RETURN(0);
+
+    int ret= fuseMknod(path, mode, 0);
+    if(ret == -EEXIST && !(fileInfo->flags & O_EXCL))
+        ret= 0;
+    if(ret >= 0)
+        ret= fuseOpen(path, fileInfo);
+
+    RETURN(ret);
 }
 
 void MyFS::fuseDestroy() {
@@ -213,7 +479,24 @@ int MyFS::fuseGetxattr(const char *path, const char *name, char *value, size_t s
 int MyFS::fuseGetxattr(const char *path, const char *name, char *value, size_t size) {
 #endif
     LOGM();
-    RETURN(0);
+
+#ifdef ENOATTR
+    int ret= -ENOATTR;
+#else
+    int ret= -ENODATA;
+#endif
+    if(strcmp(path, "/") == 0 && strcmp(name, MYFS_STATS_XATTR) == 0) {
+        std::string report;
+        reportStats(report);
+
+        ret= (int) report.size();
+        if(size > 0 && size < report.size())
+            ret= -ERANGE;
+        else if(size > 0)
+            memcpy(value, report.data(), report.size());
+    }
+
+    RETURN(ret);
 }
         
 
@@ -32,6 +32,12 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_set>
 
 #include "macros.h"
 #include "myfs.h"
@@ -41,49 +47,129 @@
 /// @brief Constructor of the in-memory file system class.
 ///
 /// You may add your own constructor code here.
-MyInMemoryFS::MyInMemoryFS() : MyFS() {
-
+MyInMemoryFS::MyInMemoryFS() : MyFS(), arena(MEM_CHUNK_SIZE) {
     // TODO: [PART 1] Add your constructor code here
-
+    this->imageMap= NULL;
+    this->imageSize= 0;
+    this->numImageChunks= 0;
+    this->numUsedChunks= 0;
+    this->numFiles= 0;
+
+    // the first inode is the root directory
+    uint32_t ino= allocFile();
+    MyFsMemFile *root= this->files[ino];
+    root->mode= S_IFDIR | 0755;
+    root->nlink= 2;
+    root->uid= getuid();
+    root->gid= getgid();
 }
 
 /// @brief Destructor of the in-memory file system class.
 ///
 /// You may add your own destructor code here.
 MyInMemoryFS::~MyInMemoryFS() {
-
     // TODO: [PART 1] Add your cleanup code here
-
+    for(size_t ino= 0; ino < this->files.size(); ino++) {
+        // the chunks go away with the arena and the mapping of the image
+        delete this->files[ino];
+    }
+    if(this->imageMap != NULL)
+        munmap(this->imageMap, this->imageSize);
 }
 
 /// @brief Create a new file.
 ///
 /// Create a new file with given name and permissions.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
 /// \param [in] mode Permissions for file access.
 /// \param [in] dev Can be ignored.
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    WriteGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    int ret= createFile(path, mode, 1);
+
+    RETURN(ret);
+}
+
+/// @brief Create a new directory.
+///
+/// \param [in] path Path of the directory, starting with "/".
+/// \param [in] mode Permissions for directory access.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseMkdir(const char *path, mode_t mode) {
+    LOGM();
+
+    WriteGuard dirGuard(this->dirLock);
+
+    int ret= createFile(path, S_IFDIR | (mode & ~S_IFMT), 2);
+
+    RETURN(ret);
 }
 
 /// @brief Delete a file.
 ///
 /// Delete a file with given name from the file system.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseUnlink(const char *path) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    WriteGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t parent;
+    const char *name;
+    int ret= resolveParent(path, &parent, &name);
+    int entry= -1;
+    if(ret >= 0) {
+        entry= this->dirIndex.find(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+    if(ret >= 0 && isDirectory(this->dirIndex.getInode(entry)))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        removeEntry(entry);
+        this->dentries.invalidate(path, false);
+    }
+
+    RETURN(ret);
+}
+
+/// @brief Delete an empty directory.
+///
+/// \param [in] path Path of the directory, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseRmdir(const char *path) {
+    LOGM();
+
+    WriteGuard dirGuard(this->dirLock);
+
+    uint32_t parent;
+    const char *name;
+    int ret= strcmp(path, "/") == 0 ? -EBUSY : resolveParent(path, &parent, &name);
+    int entry= -1;
+    if(ret >= 0) {
+        entry= this->dirIndex.find(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+    if(ret >= 0 && !isDirectory(this->dirIndex.getInode(entry)))
+        ret= -ENOTDIR;
+    if(ret >= 0 && this->dirIndex.hasChildren(this->dirIndex.getInode(entry)))
+        ret= -ENOTEMPTY;
+
+    if(ret >= 0) {
+        removeEntry(entry);
+        this->dentries.invalidate(path, true);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Rename a file.
@@ -91,16 +177,69 @@ int MyInMemoryFS::fuseUnlink(const char *path) {
 /// Rename the file with with a given name to a new name.
 /// Note that if a file with the new name already exists it is replaced (i.e., removed
 /// before renaming the file.
+/// A directory may only replace an empty directory and may not be moved below itself.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
-/// \param [in] newpath  New name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
+/// \param [in] newpath  New path of the file, starting with "/".
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseRename(const char *path, const char *newpath) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    WriteGuard dirGuard(this->dirLock);
 
-    return 0;
+    uint32_t parent, newParent;
+    const char *name, *newName;
+    int ret= resolveParent(path, &parent, &name);
+    if(ret >= 0)
+        ret= resolveParent(newpath, &newParent, &newName);
+
+    int entry= -1;
+    if(ret >= 0) {
+        entry= this->dirIndex.find(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+
+    uint32_t ino= entry >= 0 ? this->dirIndex.getInode(entry) : 0;
+    bool isDir= entry >= 0 && isDirectory(ino);
+    size_t length= strlen(path);
+    if(ret >= 0 && isDir && strncmp(newpath, path, length) == 0 && newpath[length] == '/')
+        ret= -EINVAL;
+
+    if(ret >= 0 && strcmp(path, newpath) != 0) {
+        // replace an existing file with the new name
+        int target= this->dirIndex.find(newParent, newName);
+        if(target >= 0) {
+            uint32_t targetIno= this->dirIndex.getInode(target);
+            if(isDir && !isDirectory(targetIno))
+                ret= -ENOTDIR;
+            else if(!isDir && isDirectory(targetIno))
+                ret= -EISDIR;
+            else if(this->dirIndex.hasChildren(targetIno))
+                ret= -ENOTEMPTY;
+            else
+                removeEntry(target);
+        }
+    }
+
+    if(ret >= 0 && strcmp(path, newpath) != 0) {
+        this->dirIndex.rename(entry, newParent, newName);
+        if(isDir && parent != newParent) {
+            touchDir(parent, -1);
+            touchDir(newParent, 1);
+        } else {
+            touchDir(parent, 0);
+            if(parent != newParent)
+                touchDir(newParent, 0);
+        }
+        this->dentries.invalidate(path, isDir);
+        this->dentries.invalidate(newpath, isDir);
+
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        this->files[ino]->ctime= time(NULL);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Get file meta data.
@@ -112,9 +251,7 @@ int MyInMemoryFS::fuseRename(const char *path, const char *newpath) {
 int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
-
-    LOGF( "\tAttributes of %s requested\n", path );
+    LOGF("\tAttributes of %s requested", path);
 
     // GNU's definitions of the attributes (http://www.gnu.org/software/libc/manual/html_node/Attribute-Meanings.html):
     // 		st_uid: 	The user ID of the file’s owner.
@@ -131,26 +268,27 @@ int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
     //		            isn’t usually meaningful. For symbolic links this specifies the length of the file name the link
     //		            refers to.
 
-    statbuf->st_uid = getuid(); // The owner of the file/directory is the user who mounted the filesystem
-    statbuf->st_gid = getgid(); // The group of the file/directory is the same as the group of the user who mounted the filesystem
-    statbuf->st_atime = time( NULL ); // The last "a"ccess of the file/directory is right now
-    statbuf->st_mtime = time( NULL ); // The last "m"odification of the file/directory is right now
-
-    int ret= 0;
-
-    if ( strcmp( path, "/" ) == 0 )
-    {
-        statbuf->st_mode = S_IFDIR | 0755;
-        statbuf->st_nlink = 2; // Why "two" hardlinks instead of "one"? The answer is here: http://unix.stackexchange.com/a/101536
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsMemFile *file= this->files[ino];
+        statbuf->st_ino= ino;
+        statbuf->st_mode= file->mode;
+        statbuf->st_nlink= file->nlink;
+        statbuf->st_uid= file->uid;
+        statbuf->st_gid= file->gid;
+        statbuf->st_size= file->size;
+        statbuf->st_blksize= DEFAULT_BLOCK_SIZE;
+        statbuf->st_blocks= (blkcnt_t) file->numChunks * (MEM_CHUNK_SIZE / 512);
+        statbuf->st_atime= file->atime;
+        statbuf->st_mtime= file->mtime;
+        statbuf->st_ctime= file->ctime;
     }
-    else if ( strcmp( path, "/file54" ) == 0 || ( strcmp( path, "/file349" ) == 0 ) )
-    {
-        statbuf->st_mode = S_IFREG | 0644;
-        statbuf->st_nlink = 1;
-        statbuf->st_size = 1024;
-    }
-    else
-        ret= -ENOENT;
 
     RETURN(ret);
 }
@@ -165,9 +303,20 @@ int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
 int MyInMemoryFS::fuseChmod(const char *path, mode_t mode) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsMemFile *file= this->files[ino];
+        file->mode= (file->mode & S_IFMT) | (mode & ~S_IFMT);
+        file->ctime= time(NULL);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Change the owner of a file.
@@ -181,25 +330,81 @@ int MyInMemoryFS::fuseChmod(const char *path, mode_t mode) {
 int MyInMemoryFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsMemFile *file= this->files[ino];
+        if(uid != (uid_t) -1)
+            file->uid= uid;
+        if(gid != (gid_t) -1)
+            file->gid= gid;
+        file->ctime= time(NULL);
+    }
+
+    RETURN(ret);
+}
+
+/// @brief Change the access and modification time of a file.
+///
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] ubuf New access and modification time, NULL for the current time.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseUtime(const char *path, struct utimbuf *ubuf) {
+    LOGM();
+
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsMemFile *file= this->files[ino];
+        time_t now= time(NULL);
+        file->atime= ubuf != NULL ? ubuf->actime : now;
+        file->mtime= ubuf != NULL ? ubuf->modtime : now;
+        file->ctime= now;
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Open a file.
 ///
-/// Open a file for reading or writing. This includes checking the permissions of the current user and incrementing the
-/// open file count.
+/// Open a file for reading or writing. This includes checking the permissions of the current user and allocating a
+/// handle in the table of open files.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
 /// \param [in] path Name of the file, starting with "/".
-/// \param [out] fileInfo Can be ignored in Part 1
+/// \param [out] fileInfo Receives the handle of the open file in fh, see FileTable.
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+    if(ret >= 0 && isDirectory(ino))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        MyFsHandle *handle= this->openFiles.open(ino, this->files[ino]);
+        if(handle == NULL) {
+            ret= -EMFILE;
+        } else {
+            WriteGuard inodeGuard(this->inodeLocks.get(ino));
+            this->files[ino]->openCount++;
+            fileInfo->fh= (uint64_t) handle;
+        }
+    }
 
-    RETURN(0);
+    RETURN(ret);
 }
 
 /// @brief Read from a file.
@@ -222,28 +427,30 @@ int MyInMemoryFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
 int MyInMemoryFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
-
-    LOGF( "--> Trying to read %s, %lu, %lu\n", path, (unsigned long) offset, size );
+    LOGF("--> Trying to read %s, %lu, %lu", path, (unsigned long) offset, size);
 
-    char file54Text[] = "Hello World From File54!\n";
-    char file349Text[] = "Hello World From File349!\n";
-    char *selectedText = NULL;
-
-    // ... //
-
-    if ( strcmp( path, "/file54" ) == 0 )
-        selectedText = file54Text;
-    else if ( strcmp( path, "/file349" ) == 0 )
-        selectedText = file349Text;
-    else
-        return -ENOENT;
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    MyFsMemFile *file= (MyFsMemFile *) handle->file;
+    int ret;
+    bool stale;
+    int64_t now= time(NULL);
+    {
+        ReadGuard inodeGuard(this->inodeLocks.get(file->ino));
 
-    // ... //
+        ret= readFile(file, buf, size, offset);
+        if(ret >= 0)
+            handle->nextOffset.store(offset + ret, std::memory_order_relaxed);
+        stale= isAtimeStale(file->atime, file->mtime, file->ctime, now);
+    }
 
-    memcpy( buf, selectedText + offset, size );
+    // most reads leave the access time alone, so they do not need the lock for writing
+    if(ret >= 0 && stale) {
+        WriteGuard inodeGuard(this->inodeLocks.get(file->ino));
+        if(isAtimeStale(file->atime, file->mtime, file->ctime, now))
+            file->atime= now;
+    }
 
-    RETURN((int) (strlen( selectedText ) - offset));
+    RETURN(ret);
 }
 
 /// @brief Write to a file.
@@ -264,21 +471,48 @@ int MyInMemoryFS::fuseRead(const char *path, char *buf, size_t size, off_t offse
 int MyInMemoryFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    LOGF("--> Trying to write %s, %lu, %lu", path, (unsigned long) offset, size);
 
-    RETURN(0);
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    MyFsMemFile *file= (MyFsMemFile *) handle->file;
+    WriteGuard inodeGuard(this->inodeLocks.get(file->ino));
+
+    int ret= writeFile(file, buf, size, offset);
+    if(ret >= 0) {
+        file->mtime= file->ctime= time(NULL);
+        handle->nextOffset.store(offset + size, std::memory_order_relaxed);
+        ret= (int) size;
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Close a file.
 ///
-/// In Part 1 this includes decrementing the open file count.
+/// Releases the handle allocated by fuseOpen(). A removed file is freed with its last handle.
 /// \param [in] path Name of the file, starting with "/".
 /// \param [in] fileInfo Can be ignored in Part 1 .
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    MyFsMemFile *file= (MyFsMemFile *) handle->file;
+    uint32_t ino= file->ino;
+    bool orphan;
+    {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        file->openCount--;
+        orphan= file->nlink == 0 && file->openCount == 0;
+    }
+
+    // last close of a removed file, nobody else can reach it any more
+    if(orphan) {
+        WriteGuard dirGuard(this->dirLock);
+        freeFile(ino);
+    }
+
+    this->openFiles.release(handle);
 
     RETURN(0);
 }
@@ -294,9 +528,19 @@ int MyInMemoryFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo)
 int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    ReadGuard dirGuard(this->dirLock);
 
-    return 0;
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+    if(ret >= 0 && isDirectory(ino))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= resizeFile(this->files[ino], newSize);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Truncate a file.
@@ -312,16 +556,19 @@ int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize) {
 int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    MyFsMemFile *file= (MyFsMemFile *) ((MyFsHandle *) fileInfo->fh)->file;
+    WriteGuard inodeGuard(this->inodeLocks.get(file->ino));
 
-    RETURN(0);
+    int ret= resizeFile(file, newSize);
+
+    RETURN(ret);
 }
 
 /// @brief Read a directory.
 ///
-/// Read the content of the (only) directory.
+/// Read the content of a directory.
 /// You do not have to check file permissions, but can assume that it is always ok to access the directory.
-/// \param [in] path Path of the directory. Should be "/" in our case.
+/// \param [in] path Path of the directory, starting with "/".
 /// \param [out] buf A buffer for storing the directory entries.
 /// \param [in] filler A function for putting entries into the buffer.
 /// \param [in] offset Can be ignored.
@@ -330,20 +577,24 @@ int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file
 int MyInMemoryFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 1] Implement this!
+    LOGF("--> Getting The List of Files of %s", path);
 
-    LOGF( "--> Getting The List of Files of %s\n", path );
+    ReadGuard dirGuard(this->dirLock);
 
-    filler( buf, ".", NULL, 0 ); // Current Directory
-    filler( buf, "..", NULL, 0 ); // Parent Directory
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+    if(ret >= 0 && !isDirectory(ino))
+        ret= -ENOTDIR;
 
-    if ( strcmp( path, "/" ) == 0 ) // If the user is trying to show the files/directories of the root directory show the following
-    {
-        filler( buf, "file54", NULL, 0 );
-        filler( buf, "file349", NULL, 0 );
+    if(ret >= 0) {
+        filler(buf, ".", NULL, 0); // Current Directory
+        filler(buf, "..", NULL, 0); // Parent Directory
+
+        for(int e= this->dirIndex.firstChild(ino); e >= 0; e= this->dirIndex.nextChild(e))
+            filler(buf, this->dirIndex.getName(e), NULL, 0);
     }
 
-    RETURN(0);
+    RETURN(ret);
 }
 
 /// Initialize a file system.
@@ -353,23 +604,104 @@ int MyInMemoryFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t fille
 /// \return 0.
 void* MyInMemoryFS::fuseInit(struct fuse_conn_info *conn) {
     // Open logfile
-    this->logFile= fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
-    if(this->logFile == NULL) {
+    this->logger.setLevel(((MyFsInfo *) fuse_get_context()->private_data)->logLevel);
+    if(this->logger.open(((MyFsInfo *) fuse_get_context()->private_data)->logFile) < 0) {
         fprintf(stderr, "ERROR: Cannot open logfile %s\n", ((MyFsInfo *) fuse_get_context()->private_data)->logFile);
     } else {
-        // turn of logfile buffering
-        setvbuf(this->logFile, NULL, _IOLBF, 0);
+        // messages are written by the background thread of the logger
 
         LOG("Starting logging...\n");
 
         LOG("Using in-memory mode");
 
+        if(((MyFsInfo *) fuse_get_context()->private_data)->multithreaded)
+            LOG("Using multithreaded mode");
+
+        uint32_t maxOpenFiles= ((MyFsInfo *) fuse_get_context()->private_data)->maxOpenFiles;
+        this->openFiles.setCapacity(maxOpenFiles > 0 ? maxOpenFiles : NUM_OPEN_FILES);
+        LOGF("Up to %u open files", this->openFiles.getCapacity());
+
+        initAtime((MyFsInfo *) fuse_get_context()->private_data);
+
         // TODO: [PART 1] Implement your initialization methods here
+        const char *imageFile= ((MyFsInfo *) fuse_get_context()->private_data)->imageFile;
+        if(imageFile != NULL) {
+            this->imageFile= imageFile;
+            int ret= loadImage(imageFile);
+            if(ret >= 0)
+                LOGF("Mapped %u files from image %s", this->dirIndex.size(), imageFile);
+            else if(ret == -ENOENT)
+                LOGF("Image %s does not exist yet, starting empty", imageFile);
+            else
+                LOGF("WARNING: Cannot load image %s (error %d), starting empty", imageFile, ret);
+        }
     }
 
     RETURN(0);
 }
 
+/// @brief Set an extended attribute.
+///
+/// Setting MYFS_SNAPSHOT_XATTR of the root directory writes the snapshot image given by -o image right away, the value
+/// is ignored. Other attributes are left to MyFS.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] name Name of the attribute.
+/// \param [in] value Value of the attribute.
+/// \param [in] size Size of the value.
+/// \param [in] flags XATTR_CREATE or XATTR_REPLACE.
+/// \return 0 on success, -EINVAL if no image is configured, -ERRNO on other failures.
+#ifdef __APPLE__
+int MyInMemoryFS::fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags, uint32_t x) {
+#else
+int MyInMemoryFS::fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
+#endif
+    LOGM();
+
+    if(strcmp(path, "/") != 0 || strcmp(name, MYFS_SNAPSHOT_XATTR) != 0) {
+#ifdef __APPLE__
+        return MyFS::fuseSetxattr(path, name, value, size, flags, x);
+#else
+        return MyFS::fuseSetxattr(path, name, value, size, flags);
+#endif
+    }
+
+    int ret= this->imageFile.empty() ? -EINVAL : saveImage(this->imageFile.c_str());
+    if(ret >= 0)
+        LOGF("Wrote image %s", this->imageFile.c_str());
+
+    RETURN(ret);
+}
+
+/// @brief Get file system statistics.
+///
+/// The file system may grow to the physical memory of the host, the free space is what the files do not use of it.
+/// Chunks and inodes are counted as they are allocated and released, so no lock is taken.
+/// \param [in] path Any path within the file system, ignored.
+/// \param [out] statInfo Statistics of the file system.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseStatfs(const char *path, struct statvfs *statInfo) {
+    LOGM();
+
+    uint64_t memory= (uint64_t) sysconf(_SC_PHYS_PAGES) * (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t numChunks= memory / MEM_CHUNK_SIZE;
+    uint64_t used= this->numUsedChunks.load(std::memory_order_relaxed);
+    uint32_t numFiles= this->numFiles.load(std::memory_order_relaxed);
+
+    memset(statInfo, 0, sizeof(struct statvfs));
+    statInfo->f_bsize= MEM_CHUNK_SIZE;
+    statInfo->f_frsize= MEM_CHUNK_SIZE;
+    statInfo->f_blocks= numChunks;
+    statInfo->f_bfree= numChunks > used ? numChunks - used : 0;
+    statInfo->f_bavail= statInfo->f_bfree;
+    // inode numbers are the only limit for the number of files
+    statInfo->f_files= UINT32_MAX;
+    statInfo->f_ffree= UINT32_MAX - numFiles;
+    statInfo->f_favail= statInfo->f_ffree;
+    statInfo->f_namemax= NAME_LENGTH;
+
+    RETURN(0);
+}
+
 /// @brief Clean up a file system.
 ///
 /// This function is called when the file system is unmounted. You may add some cleanup code here.
@@ -377,11 +709,561 @@ void MyInMemoryFS::fuseDestroy() {
     LOGM();
 
     // TODO: [PART 1] Implement this!
+    LOGF("Unmounting with %u files", this->dirIndex.size());
+
+    if(!this->imageFile.empty()) {
+        int ret= saveImage(this->imageFile.c_str());
+        if(ret < 0)
+            LOGF("ERROR: Cannot write image %s, error %d", this->imageFile.c_str(), ret);
+        else
+            LOGF("Wrote image %s", this->imageFile.c_str());
+    }
 
+    this->logger.close();
+}
+
+/// @brief Append the statistics of the file system to a report.
+/// \param [out] out Report to append to.
+void MyInMemoryFS::reportStats(std::string &out) {
+    MyFS::reportStats(out);
+
+    char line[256];
+    ReadGuard dirGuard(this->dirLock);
+    snprintf(line, sizeof(line), "files %u chunks %llu free_chunks %llu chunk_size %llu\n", this->dirIndex.size(),
+             (unsigned long long) this->arena.getNumChunks(), (unsigned long long) this->arena.getNumFree(),
+             (unsigned long long) this->arena.getChunkSize());
+    out+= line;
+    if(this->imageMap != NULL) {
+        snprintf(line, sizeof(line), "image mapped_chunks %llu size %llu\n",
+                 (unsigned long long) this->numImageChunks, (unsigned long long) this->imageSize);
+        out+= line;
+    }
 }
 
 // TODO: [PART 1] You may add your own additional methods here!
 
+/// @brief Look up a name in a single directory, see MyFS::resolvePrefix().
+/// \param [in] dir Inode number of the directory.
+/// \param [in] name Name of the entry.
+/// \param [out] ino Inode number of the entry.
+/// \return 0 on success, -ENOENT if there is no such entry, -ENOTDIR if dir is not a directory.
+int MyInMemoryFS::lookupEntry(uint32_t dir, const char *name, uint32_t *ino) {
+    if(!isDirectory(dir))
+        return -ENOTDIR;
+
+    int entry= this->dirIndex.find(dir, name);
+    if(entry < 0)
+        return -ENOENT;
+
+    *ino= this->dirIndex.getInode(entry);
+    return 0;
+}
+
+/// @brief Check if an inode that was resolved before is a directory.
+bool MyInMemoryFS::isDirectory(uint32_t ino) {
+    ReadGuard inodeGuard(this->inodeLocks.get(ino));
+    return S_ISDIR(this->files[ino]->mode);
+}
+
+/// @brief Create a file or a directory.
+///
+/// Must be called with the directory lock held for writing.
+/// \param [in] path Path of the new file, starting with "/".
+/// \param [in] mode Type and permissions of the file.
+/// \param [in] nlink Initial link count, 2 for directories.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::createFile(const char *path, mode_t mode, nlink_t nlink) {
+    uint32_t parent;
+    const char *name;
+    int ret= resolveParent(path, &parent, &name);
+    if(ret >= 0 && this->dirIndex.find(parent, name) >= 0)
+        ret= -EEXIST;
+
+    if(ret >= 0) {
+        uint32_t ino= allocFile();
+        MyFsMemFile *file= this->files[ino];
+        file->mode= mode;
+        file->nlink= nlink;
+        file->uid= fuse_get_context()->uid;
+        file->gid= fuse_get_context()->gid;
+
+        this->dirIndex.insert(parent, name, ino);
+        touchDir(parent, S_ISDIR(mode) ? 1 : 0);
+        this->dentries.invalidate(path, false);
+        LOGF("Created %s with inode %u", path, ino);
+    }
+
+    return ret;
+}
+
+/// @brief Remove a directory entry and drop the link of its file.
+///
+/// Must be called with the directory lock held for writing. A directory must be empty.
+/// \param [in] entry Identifier of the entry in the directory index.
+void MyInMemoryFS::removeEntry(int entry) {
+    uint32_t ino= this->dirIndex.getInode(entry);
+    uint32_t parent= this->dirIndex.getParent(entry);
+    touchDir(parent, isDirectory(ino) ? -1 : 0);
+    this->dirIndex.remove(entry);
+    unlinkFile(ino);
+}
+
+/// @brief Record a change of the entries of a directory.
+/// \param [in] dir Inode number of the directory.
+/// \param [in] nlinkDelta Change of the link count, +1 or -1 when a subdirectory is added or removed.
+void MyInMemoryFS::touchDir(uint32_t dir, int nlinkDelta) {
+    WriteGuard inodeGuard(this->inodeLocks.get(dir));
+    MyFsMemFile *file= this->files[dir];
+    file->nlink+= nlinkDelta;
+    file->mtime= file->ctime= time(NULL);
+}
+
+/// @brief Create an empty file with the next free inode number.
+///
+/// Must be called with the directory lock held for writing.
+/// \return Inode number of the new file.
+uint32_t MyInMemoryFS::allocFile() {
+    uint32_t ino;
+    if(!this->freeInodes.empty()) {
+        ino= this->freeInodes.back();
+        this->freeInodes.pop_back();
+    } else {
+        ino= (uint32_t) this->files.size();
+        this->files.push_back(NULL);
+    }
+
+    MyFsMemFile *file= new MyFsMemFile();
+    file->ino= ino;
+    file->atime= file->mtime= file->ctime= time(NULL);
+    this->files[ino]= file;
+    this->numFiles++;
+
+    return ino;
+}
+
+/// @brief Free a file and its inode number.
+///
+/// Must be called with the directory lock held for writing.
+/// \param [in] ino Inode number.
+void MyInMemoryFS::freeFile(uint32_t ino) {
+    releaseChunks(this->files[ino], 0);
+    delete this->files[ino];
+    this->files[ino]= NULL;
+    this->freeInodes.push_back(ino);
+    this->numFiles--;
+}
+
+/// @brief Drop the directory link of a file.
+///
+/// The file is freed right away unless it is still open, then the last fuseRelease() frees it. Must be called with
+/// the directory lock held for writing.
+/// \param [in] ino Inode number.
+void MyInMemoryFS::unlinkFile(uint32_t ino) {
+    bool orphan;
+    {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        MyFsMemFile *file= this->files[ino];
+        file->nlink= 0;
+        file->ctime= time(NULL);
+        orphan= file->openCount == 0;
+    }
+    if(orphan)
+        freeFile(ino);
+}
+
+/// @brief Read from a file.
+///
+/// Only the chunks covering the range are accessed, unallocated chunks read as zeros.
+/// \param [in] file The file.
+/// \param [out] buf Buffer for storing the data.
+/// \param [in] size Number of bytes to read.
+/// \param [in] offset Position of the first byte within the file.
+/// \return Number of bytes read.
+int MyInMemoryFS::readFile(MyFsMemFile *file, char *buf, size_t size, off_t offset) {
+    if(offset >= (off_t) file->size)
+        return 0;
+    size= std::min(size, file->size - (size_t) offset);
+
+    size_t done= 0;
+    while(done < size) {
+        size_t pos= (size_t) offset + done;
+        size_t c= pos / MEM_CHUNK_SIZE;
+        size_t in= pos % MEM_CHUNK_SIZE;
+        size_t n= std::min(size - done, MEM_CHUNK_SIZE - in);
+
+        char *chunk= c < file->chunks.size() ? file->chunks[c] : NULL;
+        if(chunk != NULL)
+            memcpy(buf + done, chunk + in, n);
+        else
+            memset(buf + done, 0, n);
+        done+= n;
+    }
+
+    return (int) size;
+}
+
+/// @brief Write to a file.
+///
+/// Only the chunks covering the range are accessed. Missing chunks are taken from the arena, the parts of a new chunk
+/// that are not written are zeroed. Extends the file if the range ends behind the end of the file.
+/// \param [in] file The file.
+/// \param [in] buf Content to write.
+/// \param [in] size Number of bytes to write.
+/// \param [in] offset Position of the first byte within the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::writeFile(MyFsMemFile *file, const char *buf, size_t size, off_t offset) {
+    if(offset < 0)
+        return -EINVAL;
+
+    size_t end= (size_t) offset + size;
+    size_t numChunks= (end + MEM_CHUNK_SIZE - 1) / MEM_CHUNK_SIZE;
+    if(numChunks > file->chunks.size())
+        file->chunks.resize(numChunks, NULL);
+
+    size_t done= 0;
+    while(done < size) {
+        size_t pos= (size_t) offset + done;
+        size_t c= pos / MEM_CHUNK_SIZE;
+        size_t in= pos % MEM_CHUNK_SIZE;
+        size_t n= std::min(size - done, MEM_CHUNK_SIZE - in);
+
+        char *chunk= file->chunks[c];
+        if(chunk == NULL) {
+            chunk= this->arena.alloc();
+            if(chunk == NULL)
+                return -ENOSPC;
+            memset(chunk, 0, in);
+            memset(chunk + in + n, 0, MEM_CHUNK_SIZE - in - n);
+            file->chunks[c]= chunk;
+            file->numChunks++;
+            this->numUsedChunks++;
+        }
+        memcpy(chunk + in, buf + done, n);
+        done+= n;
+    }
+
+    if(end > file->size)
+        file->size= end;
+
+    return 0;
+}
+
+/// @brief Change the size of a file.
+///
+/// Chunks behind the new end of the file go back to the arena. Growing a file allocates nothing, the new bytes
+/// read as zeros.
+/// \param [in] file The file.
+/// \param [in] newSize New size of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::resizeFile(MyFsMemFile *file, off_t newSize) {
+    if(newSize < 0)
+        return -EINVAL;
+
+    size_t size= (size_t) newSize;
+    if(size < file->size) {
+        size_t keep= (size + MEM_CHUNK_SIZE - 1) / MEM_CHUNK_SIZE;
+        releaseChunks(file, keep);
+
+        // keep the bytes behind the end of the file zero
+        size_t in= size % MEM_CHUNK_SIZE;
+        if(in != 0 && keep <= file->chunks.size() && file->chunks[keep - 1] != NULL)
+            memset(file->chunks[keep - 1] + in, 0, MEM_CHUNK_SIZE - in);
+    }
+
+    file->size= size;
+    file->mtime= file->ctime= time(NULL);
+
+    return 0;
+}
+
+/// @brief Return the chunks of a file from chunk number from on to the arena.
+/// \param [in] file The file.
+/// \param [in] from Number of the first chunk to release.
+void MyInMemoryFS::releaseChunks(MyFsMemFile *file, size_t from) {
+    for(size_t c= from; c < file->chunks.size(); c++) {
+        if(file->chunks[c] != NULL) {
+            releaseChunk(file->chunks[c]);
+            file->numChunks--;
+        }
+    }
+    if(from < file->chunks.size())
+        file->chunks.resize(from);
+}
+
+/// @brief Return a chunk to the arena, or drop a chunk of the image.
+///
+/// A chunk of the image stays mapped until the file system is destroyed, only its written pages, which are private
+/// copies, are freed.
+/// \param [in] chunk The chunk.
+void MyInMemoryFS::releaseChunk(char *chunk) {
+    if(isImageChunk(chunk)) {
+        madvise(chunk, this->arena.getChunkSize(), MADV_DONTNEED);
+        this->numImageChunks--;
+    } else {
+        this->arena.release(chunk);
+    }
+    this->numUsedChunks--;
+}
+
+/// @brief Check if a chunk lies in the mapping of the image.
+bool MyInMemoryFS::isImageChunk(const char *chunk) const {
+    return this->imageMap != NULL && chunk >= this->imageMap && chunk < this->imageMap + this->imageSize;
+}
+
+// this function returns 0 if successful, -errno otherwise
+static int writeAt(int fd, const void *buf, size_t size, off_t pos) {
+    const char *p= (const char *) buf;
+    while(size > 0) {
+        ssize_t n= pwrite(fd, p, size, pos);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return n < 0 ? -errno : -EIO;
+        p+= n;
+        size-= (size_t) n;
+        pos+= n;
+    }
+    return 0;
+}
+
+/// @brief Store all files in a snapshot image.
+///
+/// The image is written to a new file that replaces the old image when it is complete, so a crash never leaves a
+/// broken image behind and a mapping of the old image stays valid. Files that are changed while the image is written
+/// are stored as they were when their turn came. Names cannot change in the meantime, the directory lock is held.
+/// \param [in] path Path of the image.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::saveImage(const char *path) {
+    WriteGuard dirGuard(this->dirLock);
+
+    std::string tmpPath= std::string(path) + ".tmp";
+    int fd= ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return -errno;
+
+    std::vector<int> entries(this->files.size(), -1);
+    for(int id= 0; id < this->dirIndex.end(); id++) {
+        if(this->dirIndex.isUsed(id))
+            entries[this->dirIndex.getInode(id)]= id;
+    }
+
+    MyFsImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic= MYFS_IMAGE_MAGIC;
+    header.version= MYFS_IMAGE_VERSION;
+    header.chunkSize= this->arena.getChunkSize();
+    header.numInodes= (uint32_t) this->files.size();
+    header.chunkOffset= IMAGE_ALIGN;
+
+    std::vector<MyFsImageInode> inodes(this->files.size());
+    std::vector<uint32_t> map;
+    std::string names;
+    memset(inodes.data(), 0, inodes.size() * sizeof(MyFsImageInode));
+
+    // the chunks of each file are written while its inode lock is held, its record is taken at the same time
+    int ret= 0;
+    for(uint32_t ino= 0; ret >= 0 && ino < this->files.size(); ino++) {
+        MyFsMemFile *file= this->files[ino];
+        if(file == NULL || (ino != ROOT_INODE && entries[ino] < 0))
+            continue;
+
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+        MyFsImageInode *inode= &inodes[ino];
+        inode->mode= file->mode;
+        inode->nlink= file->nlink;
+        inode->uid= file->uid;
+        inode->gid= file->gid;
+        inode->size= file->size;
+        inode->atime= file->atime;
+        inode->mtime= file->mtime;
+        inode->ctime= file->ctime;
+        inode->firstEntry= map.size();
+        inode->numEntries= (uint32_t) file->chunks.size();
+        if(entries[ino] >= 0) {
+            const char *name= this->dirIndex.getName(entries[ino]);
+            inode->parent= this->dirIndex.getParent(entries[ino]);
+            inode->name= names.size();
+            inode->nameLength= (uint32_t) strlen(name);
+            names.append(name, inode->nameLength);
+        }
+
+        for(size_t c= 0; ret >= 0 && c < file->chunks.size(); c++) {
+            if(file->chunks[c] == NULL) {
+                map.push_back(IMAGE_NO_CHUNK);
+                continue;
+            }
+            map.push_back(header.numChunks);
+            ret= writeAt(fd, file->chunks[c], header.chunkSize,
+                         (off_t) (header.chunkOffset + (uint64_t) header.numChunks * header.chunkSize));
+            header.numChunks++;
+        }
+    }
+
+    header.numMapEntries= map.size();
+    header.inodeOffset= header.chunkOffset + (uint64_t) header.numChunks * header.chunkSize;
+    header.mapOffset= header.inodeOffset + inodes.size() * sizeof(MyFsImageInode);
+    header.nameOffset= header.mapOffset + map.size() * sizeof(uint32_t);
+    header.nameSize= names.size();
+    header.imageSize= header.nameOffset + names.size();
+
+    if(ret >= 0)
+        ret= writeAt(fd, inodes.data(), inodes.size() * sizeof(MyFsImageInode), (off_t) header.inodeOffset);
+    if(ret >= 0 && !map.empty())
+        ret= writeAt(fd, map.data(), map.size() * sizeof(uint32_t), (off_t) header.mapOffset);
+    if(ret >= 0 && !names.empty())
+        ret= writeAt(fd, names.data(), names.size(), (off_t) header.nameOffset);
+    if(ret >= 0 && ftruncate(fd, (off_t) header.imageSize) < 0)
+        ret= -errno;
+    if(ret >= 0)
+        ret= writeAt(fd, &header, sizeof(header), 0);
+    if(ret >= 0 && fsync(fd) < 0)
+        ret= -errno;
+    if(::close(fd) < 0 && ret >= 0)
+        ret= -errno;
+    if(ret >= 0 && rename(tmpPath.c_str(), path) < 0)
+        ret= -errno;
+    if(ret < 0)
+        unlink(tmpPath.c_str());
+
+    return ret;
+}
+
+// check that count items of the given size at offset lie within an image of size bytes
+static bool inImage(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t size) {
+    return offset <= size && count <= (size - offset) / itemSize;
+}
+
+/// @brief Take over all files from a snapshot image.
+///
+/// The image is mapped privately. The chunks of the files point into the mapping, so their content is read from the
+/// image when it is accessed first; written pages become private copies, the image itself is never changed. Only the
+/// inode records and the names are read right away. Must be called before the file system is used, it replaces all
+/// files.
+/// \param [in] path Path of the image.
+/// \return 0 on success, -ENOENT if there is no image, -EINVAL if the image is invalid, -ERRNO on other failures.
+int MyInMemoryFS::loadImage(const char *path) {
+    int fd= ::open(path, O_RDONLY);
+    if(fd < 0)
+        return -errno;
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        int ret= -errno;
+        ::close(fd);
+        return ret;
+    }
+    size_t size= (size_t) st.st_size;
+    if(size < sizeof(MyFsImageHeader)) {
+        ::close(fd);
+        return -EINVAL;
+    }
+
+    int flags= MAP_PRIVATE;
+#ifdef MAP_NORESERVE
+    flags|= MAP_NORESERVE;
+#endif
+    void *p= mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    ::close(fd);
+    if(p == MAP_FAILED)
+        return -errno;
+    char *map= (char *) p;
+
+    const MyFsImageHeader *header= (const MyFsImageHeader *) map;
+    bool valid= header->magic == MYFS_IMAGE_MAGIC && header->version == MYFS_IMAGE_VERSION &&
+                header->imageSize == size && header->chunkSize == this->arena.getChunkSize() &&
+                header->numInodes > 0 && header->chunkOffset % IMAGE_ALIGN == 0 &&
+                header->inodeOffset % sizeof(uint64_t) == 0 && header->mapOffset % sizeof(uint32_t) == 0 &&
+                inImage(header->chunkOffset, header->numChunks, header->chunkSize, size) &&
+                inImage(header->inodeOffset, header->numInodes, sizeof(MyFsImageInode), size) &&
+                inImage(header->mapOffset, header->numMapEntries, sizeof(uint32_t), size) &&
+                inImage(header->nameOffset, header->nameSize, 1, size);
+
+    const MyFsImageInode *inodes= (const MyFsImageInode *) (map + header->inodeOffset);
+    const uint32_t *entries= (const uint32_t *) (map + header->mapOffset);
+    const char *names= map + header->nameOffset;
+    std::unordered_set<std::string> seen;
+    for(uint32_t ino= 0; valid && ino < header->numInodes; ino++) {
+        const MyFsImageInode *inode= &inodes[ino];
+        if(inode->mode == 0)
+            continue;
+        valid= inImage(inode->firstEntry, inode->numEntries, 1, header->numMapEntries) &&
+               inImage(inode->name, inode->nameLength, 1, header->nameSize) && inode->nameLength <= NAME_LENGTH &&
+               (ino == ROOT_INODE ? S_ISDIR(inode->mode) : inode->nameLength > 0);
+        if(valid && ino != ROOT_INODE) {
+            const char *name= names + inode->name;
+            char parent[16];
+            snprintf(parent, sizeof(parent), "%u/", inode->parent);
+            valid= inode->parent < header->numInodes && inode->parent != ino &&
+                   S_ISDIR(inodes[inode->parent].mode) && memchr(name, '/', inode->nameLength) == NULL &&
+                   memchr(name, '\0', inode->nameLength) == NULL &&
+                   seen.insert(parent + std::string(name, inode->nameLength)).second;
+        }
+        for(uint32_t c= 0; valid && c < inode->numEntries; c++) {
+            uint32_t chunk= entries[inode->firstEntry + c];
+            valid= chunk == IMAGE_NO_CHUNK || chunk < header->numChunks;
+        }
+    }
+    if(!valid || inodes[ROOT_INODE].mode == 0) {
+        munmap(map, size);
+        return -EINVAL;
+    }
+
+    for(size_t ino= 0; ino < this->files.size(); ino++) {
+        if(this->files[ino] != NULL)
+            releaseChunks(this->files[ino], 0);
+        delete this->files[ino];
+    }
+    this->files.assign(header->numInodes, NULL);
+    this->freeInodes.clear();
+    this->dirIndex.clear();
+    this->dentries.clear();
+    if(this->imageMap != NULL)
+        munmap(this->imageMap, this->imageSize);
+    this->imageMap= map;
+    this->imageSize= size;
+    this->numImageChunks= 0;
+    this->numUsedChunks= 0;
+    this->numFiles= 0;
+
+    char *chunks= map + header->chunkOffset;
+    for(uint32_t ino= header->numInodes; ino-- > 0;) {
+        const MyFsImageInode *inode= &inodes[ino];
+        if(inode->mode == 0) {
+            this->freeInodes.push_back(ino);
+            continue;
+        }
+
+        MyFsMemFile *file= new MyFsMemFile();
+        file->ino= ino;
+        file->mode= inode->mode;
+        file->nlink= inode->nlink;
+        file->uid= inode->uid;
+        file->gid= inode->gid;
+        file->atime= (time_t) inode->atime;
+        file->mtime= (time_t) inode->mtime;
+        file->ctime= (time_t) inode->ctime;
+        file->openCount= 0;
+        file->size= (size_t) inode->size;
+        file->numChunks= 0;
+        file->chunks.resize(inode->numEntries, NULL);
+        for(uint32_t c= 0; c < inode->numEntries; c++) {
+            uint32_t chunk= entries[inode->firstEntry + c];
+            if(chunk != IMAGE_NO_CHUNK) {
+                file->chunks[c]= chunks + (size_t) chunk * header->chunkSize;
+                file->numChunks++;
+            }
+        }
+        this->numImageChunks+= file->numChunks;
+        this->numUsedChunks+= file->numChunks;
+        this->files[ino]= file;
+        this->numFiles++;
+
+        if(ino != ROOT_INODE)
+            this->dirIndex.insert(inode->parent, std::string(names + inode->name, inode->nameLength).c_str(), ino);
+    }
+
+    return 0;
+}
+
 // DO NOT EDIT ANYTHING BELOW THIS LINE!!!
 
 /// @brief Set the static instance of the file system.
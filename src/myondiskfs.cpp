@@ -15,22 +15,64 @@
 #define DEBUG_RETURN_VALUES
 
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
 
 #include "macros.h"
 #include "myfs.h"
 #include "myfs-info.h"
 #include "blockdevice.h"
+#include "lz4codec.h"
+#include "crc32c.h"
 
 /// @brief Constructor of the on-disk file system class.
 ///
 /// You may add your own constructor code here.
 MyOnDiskFS::MyOnDiskFS() : MyFS() {
-    // create a block device object
-    this->blockDevice= new BlockDevice(BLOCK_SIZE);
+    // create a block device object, its block size is set when the container file is attached
+    this->blockSize= DEFAULT_BLOCK_SIZE;
+    this->blockDevice= new BlockDevice(this->blockSize);
+    // block cache is created when the block size is known
+    this->blockCache= NULL;
+    this->cacheBlocks= BC_DEFAULT_NUM_BLOCKS;
 
     // TODO: [PART 2] Add your constructor code here
+    memset(&this->superBlock, 0, sizeof(this->superBlock));
+    this->inodes= NULL;
+    this->inodeInfo= NULL;
+    this->inodeLoaded= NULL;
+    this->allocHint= 0;
+    this->numDirtyBlocks= 0;
+    this->numFreeBlocks= 0;
+    this->numFreed= 0;
+    this->numPinned= 0;
+    this->numFreeInodes= 0;
+    this->compress= false;
+    this->clusterBlocks= 1;
+    this->clusterCache.resize(CLUSTER_CACHE_SIZE);
+    for(size_t c= 0; c < this->clusterCache.size(); c++)
+        this->clusterCache[c].start= 0;
+    this->clusterClock= 0;
+    this->journal= NULL;
+    this->commitInterval= JOURNAL_COMMIT_INTERVAL;
+    this->commitStop= false;
+    this->splice= false;
+    this->numLazyUpdates= 0;
+    this->bytesSpliced= 0;
+    this->bytesCopied= 0;
+    this->useChecksums= false;
+    this->checksums= NULL;
+    this->numVerified= 0;
+    this->numAdopted= 0;
+    this->numChecksumErrors= 0;
+    this->scrubInterval= 0;
+    this->scrubStop= false;
+    this->numScrubbed= 0;
+    this->numScrubs= 0;
 
 }
 
@@ -38,10 +80,19 @@ MyOnDiskFS::MyOnDiskFS() : MyFS() {
 ///
 /// You may add your own destructor code here.
 MyOnDiskFS::~MyOnDiskFS() {
-    // free block device object
+    stopCommits();
+    stopScrubs();
+
+    // free block cache and block device object
+    delete this->journal;
+    delete this->blockCache;
     delete this->blockDevice;
 
     // TODO: [PART 2] Add your cleanup code here
+    delete [] this->inodes;
+    delete [] this->inodeInfo;
+    delete [] this->inodeLoaded;
+    delete [] this->checksums;
 
 }
 
@@ -49,30 +100,99 @@ MyOnDiskFS::~MyOnDiskFS() {
 ///
 /// Create a new file with given name and permissions.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
 /// \param [in] mode Permissions for file access.
 /// \param [in] dev Can be ignored.
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    int ret= createFile(path, mode, 1);
+
+    RETURN(ret);
+}
+
+/// @brief Create a new directory.
+///
+/// \param [in] path Path of the directory, starting with "/".
+/// \param [in] mode Permissions for directory access.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseMkdir(const char *path, mode_t mode) {
+    LOGM();
+
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard dirGuard(this->dirLock);
+
+    int ret= createFile(path, S_IFDIR | (mode & ~S_IFMT), 2);
+
+    RETURN(ret);
 }
 
 /// @brief Delete a file.
 ///
 /// Delete a file with given name from the file system.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseUnlink(const char *path) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard dirGuard(this->dirLock);
+
+    uint32_t parent;
+    const char *name;
+    int ret= resolveParent(path, &parent, &name);
+    int entry= -1;
+    if(ret >= 0) {
+        entry= findDirEntry(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+    if(ret >= 0 && isDirectory(this->dirIndex.getInode(entry)))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        this->dentries.invalidate(path, false);
+        ret= removeEntry(entry);
+    }
+
+    RETURN(ret);
+}
 
-    RETURN(0);
+/// @brief Delete an empty directory.
+///
+/// \param [in] path Path of the directory, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseRmdir(const char *path) {
+    LOGM();
+
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard dirGuard(this->dirLock);
+
+    uint32_t parent;
+    const char *name;
+    int ret= strcmp(path, "/") == 0 ? -EBUSY : resolveParent(path, &parent, &name);
+    int entry= -1;
+    if(ret >= 0) {
+        entry= findDirEntry(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+    if(ret >= 0 && !isDirectory(this->dirIndex.getInode(entry)))
+        ret= -ENOTDIR;
+    if(ret >= 0 && this->dirIndex.hasChildren(this->dirIndex.getInode(entry)))
+        ret= -ENOTEMPTY;
+
+    if(ret >= 0) {
+        this->dentries.invalidate(path, true);
+        ret= removeEntry(entry);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Rename a file.
@@ -80,16 +200,81 @@ int MyOnDiskFS::fuseUnlink(const char *path) {
 /// Rename the file with with a given name to a new name.
 /// Note that if a file with the new name already exists it is replaced (i.e., removed
 /// before renaming the file.
+/// A directory may only replace an empty directory and may not be moved below itself.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
-/// \param [in] newpath  New name of the file, starting with "/".
+/// \param [in] path Path of the file, starting with "/".
+/// \param [in] newpath  New path of the file, starting with "/".
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard dirGuard(this->dirLock);
+
+    uint32_t parent, newParent;
+    const char *name, *newName;
+    int ret= resolveParent(path, &parent, &name);
+    if(ret >= 0)
+        ret= resolveParent(newpath, &newParent, &newName);
+
+    int entry= -1;
+    if(ret >= 0) {
+        entry= findDirEntry(parent, name);
+        if(entry < 0)
+            ret= -ENOENT;
+    }
+
+    uint32_t ino= entry >= 0 ? this->dirIndex.getInode(entry) : 0;
+    bool isDir= entry >= 0 && isDirectory(ino);
+    size_t length= strlen(path);
+    if(ret >= 0 && isDir && strncmp(newpath, path, length) == 0 && newpath[length] == '/')
+        ret= -EINVAL;
+
+    if(ret >= 0 && strcmp(path, newpath) != 0) {
+        this->dentries.invalidate(path, isDir);
+        this->dentries.invalidate(newpath, isDir);
+
+        // replace an existing file with the new name
+        int target= findDirEntry(newParent, newName);
+        if(target >= 0) {
+            uint32_t targetIno= this->dirIndex.getInode(target);
+            if(isDir && !isDirectory(targetIno))
+                ret= -ENOTDIR;
+            else if(!isDir && isDirectory(targetIno))
+                ret= -EISDIR;
+            else if(this->dirIndex.hasChildren(targetIno))
+                ret= -ENOTEMPTY;
+            else
+                ret= removeEntry(target);
+        }
 
-    RETURN(0);
+        // the new entry may go to another bucket, so add it before the old one is removed
+        if(ret >= 0)
+            ret= addDirEntry(newParent, newName, ino);
+        if(ret >= 0)
+            ret= removeDirEntry(entry);
+
+        if(ret >= 0 && isDir && parent != newParent) {
+            ret= touchDir(parent, -1);
+            if(ret >= 0)
+                ret= touchDir(newParent, 1);
+        } else if(ret >= 0) {
+            ret= touchDir(parent, 0);
+            if(ret >= 0 && parent != newParent)
+                ret= touchDir(newParent, 0);
+        }
+
+        if(ret >= 0) {
+            WriteGuard inodeGuard(this->inodeLocks.get(ino));
+            ret= loadInode(ino);
+            if(ret >= 0) {
+                this->inodes[ino].ctime= time(NULL);
+                ret= writeInode(ino);
+            }
+        }
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Get file meta data.
@@ -101,9 +286,34 @@ int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
 int MyOnDiskFS::fuseGetattr(const char *path, struct stat *statbuf) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
-
-    RETURN(0);
+    LOGF("\tAttributes of %s requested", path);
+
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsInode *inode= &this->inodes[ino];
+        statbuf->st_ino= ino;
+        statbuf->st_mode= inode->mode;
+        statbuf->st_nlink= inode->nlink;
+        statbuf->st_uid= inode->uid;
+        statbuf->st_gid= inode->gid;
+        statbuf->st_size= inode->size;
+        statbuf->st_blksize= this->blockSize;
+        // holes do not count, buffered blocks count as allocated
+        MyFsInodeInfo *info= &this->inodeInfo[ino];
+        uint32_t numBlocks= info->usedBlocks + info->dirtyCount - countBlocks(ino, info->dirtyFirst, info->dirtyCount);
+        statbuf->st_blocks= (blkcnt_t) numBlocks * (this->blockSize / 512);
+        statbuf->st_atime= inode->atime;
+        statbuf->st_mtime= inode->mtime;
+        statbuf->st_ctime= inode->ctime;
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Change file permissions.
@@ -116,9 +326,22 @@ int MyOnDiskFS::fuseGetattr(const char *path, struct stat *statbuf) {
 int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsInode *inode= &this->inodes[ino];
+        inode->mode= (inode->mode & S_IFMT) | (mode & ~S_IFMT);
+        inode->ctime= time(NULL);
+        ret= writeInode(ino);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Change the owner of a file.
@@ -132,25 +355,83 @@ int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
 int MyOnDiskFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsInode *inode= &this->inodes[ino];
+        if(uid != (uid_t) -1)
+            inode->uid= uid;
+        if(gid != (gid_t) -1)
+            inode->gid= gid;
+        inode->ctime= time(NULL);
+        ret= writeInode(ino);
+    }
+
+    RETURN(ret);
+}
+
+/// @brief Change the access and modification time of a file.
+///
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] ubuf New access and modification time, NULL for the current time.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseUtime(const char *path, struct utimbuf *ubuf) {
+    LOGM();
+
+    ReadGuard journalGuard(this->journalLock);
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsInode *inode= &this->inodes[ino];
+        int64_t now= time(NULL);
+        inode->atime= ubuf != NULL ? ubuf->actime : now;
+        inode->mtime= ubuf != NULL ? ubuf->modtime : now;
+        inode->ctime= now;
+        ret= writeInode(ino);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Open a file.
 ///
-/// Open a file for reading or writing. This includes checking the permissions of the current user and incrementing the
-/// open file count.
+/// Open a file for reading or writing. This includes checking the permissions of the current user and allocating a
+/// handle in the table of open files.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
 /// \param [in] path Name of the file, starting with "/".
-/// \param [out] fileInfo Can be ignored in Part 1
+/// \param [out] fileInfo Receives the handle of the open file in fh, see FileTable.
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0 && isDirectory(ino))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        MyFsHandle *handle= this->openFiles.open(ino);
+        if(handle == NULL)
+            ret= -EMFILE;
+        else
+            fileInfo->fh= (uint64_t) handle;
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Read from a file.
@@ -173,9 +454,23 @@ int MyOnDiskFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
 int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    LOGF("--> Trying to read %s, %lu, %lu", path, (unsigned long) offset, size);
 
-    RETURN(0);
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    int ret;
+    {
+        ReadGuard inodeGuard(this->inodeLocks.get(handle->ino));
+
+        ret= readFile(handle->ino, buf, size, offset, &handle->extentCursor);
+        if(ret > 0 && !this->blockDevice->isMapped())
+            readAhead(handle, offset, ret);
+        if(ret >= 0)
+            handle->nextOffset.store(offset + ret, std::memory_order_relaxed);
+    }
+    if(ret >= 0)
+        accessFile(handle->ino);
+
+    RETURN(ret);
 }
 
 /// @brief Write to a file.
@@ -196,9 +491,138 @@ int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset,
 int MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    LOGF("--> Trying to write %s, %lu, %lu", path, (unsigned long) offset, size);
+
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    uint32_t ino= handle->ino;
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+    int ret= 0;
+    if(size > 0)
+        ret= writeInline(ino, buf, size, offset);
+    if(ret == 0 && size > 0) {
+        ret= bufferWrite(ino, buf, size, offset);
+        if(ret == 0) {
+            // the write does not fit to the buffered blocks, write them and try again with an empty buffer
+            ret= flushFile(ino);
+            if(ret >= 0)
+                ret= bufferWrite(ino, buf, size, offset);
+        }
+    }
 
-    RETURN(0);
+    // writes that cannot be buffered go to the container directly
+    if(ret == 0)
+        ret= writeDirect(ino, buf, size, offset, &handle->extentCursor);
+
+    if(ret >= 0) {
+        handle->nextOffset.store(offset + size, std::memory_order_relaxed);
+        ret= (int) size;
+    }
+
+    RETURN(ret);
+}
+
+#if FUSE_VERSION >= 29
+/// @brief Read from a file into buffers handed to FUSE.
+///
+/// With -o splice, whole blocks stored on the container are returned as file descriptor buffers of the container, so
+/// FUSE can splice them to the kernel without copying them through user space, see spliceFile(). Other reads, and all
+/// reads in direct mode, where the container cannot be spliced, or with block checksums, which are verified as the
+/// blocks are read into memory, go through fuseRead().
+///
+/// The spliced blocks are read by FUSE after this method returned and the inode lock is released. So the first spliced
+/// read of a handle pins the file: blocks a concurrent truncate or unlink frees stay out of the allocator until the
+/// last splicing handle of the file is released, see unpinBlocks(). FUSE always finishes a reply before the release of
+/// its handle.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [out] bufp The buffer vector holding the data read, allocated with malloc().
+/// \param [in] size Number of bytes to read.
+/// \param [in] offset Position of the first byte to read.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseReadBuf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
+    LOGM();
+
+    int ret= 0;
+    if(this->splice && !this->blockDevice->isDirect() && this->checksums == NULL) {
+        LOGF("--> Trying to splice %s, %lu, %lu", path, (unsigned long) offset, size);
+
+        MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+        {
+            ReadGuard inodeGuard(this->inodeLocks.get(handle->ino));
+
+            ret= spliceFile(handle->ino, size, offset, bufp, &handle->extentCursor);
+            if(ret > 0)
+                handle->nextOffset.store(offset + fuse_buf_size(*bufp), std::memory_order_relaxed);
+
+            // pin the blocks before a truncate can free them, see freeBlocks()
+            if(ret > 0 && !handle->spliced.exchange(true)) {
+                std::lock_guard<std::mutex> guard(this->allocLock);
+                this->inodeInfo[handle->ino].spliceRefs++;
+            }
+        }
+        if(ret > 0)
+            accessFile(handle->ino);
+    }
+
+    if(ret == 0)
+        ret= MyFS::fuseReadBuf(path, bufp, size, offset, fileInfo);
+
+    RETURN(ret < 0 ? ret : 0);
+}
+#endif
+
+/// @brief Flush a file.
+///
+/// This function is called on each close() of a file descriptor. The buffered blocks of the file and all dirty blocks
+/// of the block cache are written to the container file.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFlush(const char *path, struct fuse_file_info *fileInfo) {
+    LOGM();
+
+    uint32_t ino= ((MyFsHandle *) fileInfo->fh)->ino;
+    int ret;
+    {
+        ReadGuard journalGuard(this->journalLock);
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= flushFile(ino);
+    }
+    if(ret >= 0)
+        ret= this->blockCache->flush();
+
+    RETURN(ret);
+}
+
+/// @brief Synchronize a file.
+///
+/// Write the buffered blocks of the file and commit the journal, which forces the file data to the disk together with
+/// the changed meta data. If no meta data has changed, the dirty blocks of the block cache are written and the
+/// container file is forced to the disk.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] datasync Can be ignored.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+
+    uint32_t ino= ((MyFsHandle *) fileInfo->fh)->ino;
+    int ret;
+    {
+        ReadGuard journalGuard(this->journalLock);
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= flushFile(ino);
+    }
+    if(ret >= 0)
+        ret= commitJournal();
+    if(ret == 0)
+        ret= this->blockCache->flush();
+    if(ret == 0)
+        ret= this->blockDevice->sync();
+
+    RETURN(ret < 0 ? ret : 0);
 }
 
 /// @brief Close a file.
@@ -209,9 +633,22 @@ int MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t
 int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
-
-    RETURN(0);
+    MyFsHandle *handle= (MyFsHandle *) fileInfo->fh;
+    uint32_t ino= handle->ino;
+    int ret;
+    {
+        // the buffer is only needed while the file is open
+        ReadGuard journalGuard(this->journalLock);
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= flushFile(ino);
+        dropBuffer(ino);
+    }
+    if(handle->spliced)
+        unpinBlocks(ino);
+
+    this->openFiles.release(handle);
+
+    RETURN(ret);
 }
 
 /// @brief Truncate a file.
@@ -225,9 +662,20 @@ int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
 int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    ReadGuard journalGuard(this->journalLock);
+    ReadGuard dirGuard(this->dirLock);
 
-    RETURN(0);
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+    if(ret >= 0 && isDirectory(ino))
+        ret= -EISDIR;
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= resizeFile(ino, newSize);
+    }
+
+    RETURN(ret);
 }
 
 /// @brief Truncate a file.
@@ -243,16 +691,20 @@ int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize) {
 int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    uint32_t ino= ((MyFsHandle *) fileInfo->fh)->ino;
+    ReadGuard journalGuard(this->journalLock);
+    WriteGuard inodeGuard(this->inodeLocks.get(ino));
 
-    RETURN(0);
+    int ret= resizeFile(ino, newSize);
+
+    RETURN(ret);
 }
 
 /// @brief Read a directory.
 ///
-/// Read the content of the (only) directory.
+/// Read the content of a directory.
 /// You do not have to check file permissions, but can assume that it is always ok to access the directory.
-/// \param [in] path Path of the directory. Should be "/" in our case.
+/// \param [in] path Path of the directory, starting with "/".
 /// \param [out] buf A buffer for storing the directory entries.
 /// \param [in] filler A function for putting entries into the buffer.
 /// \param [in] offset Can be ignored.
@@ -261,9 +713,24 @@ int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_i
 int MyOnDiskFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    LOGF("--> Getting The List of Files of %s", path);
 
-    RETURN(0);
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+    if(ret >= 0 && !isDirectory(ino))
+        ret= -ENOTDIR;
+
+    if(ret >= 0) {
+        filler(buf, ".", NULL, 0); // Current Directory
+        filler(buf, "..", NULL, 0); // Parent Directory
+
+        for(int e= this->dirIndex.firstChild(ino); e >= 0; e= this->dirIndex.nextChild(e))
+            filler(buf, this->dirIndex.getName(e), NULL, 0);
+    }
+
+    RETURN(ret);
 }
 
 /// Initialize a file system.
@@ -273,25 +740,95 @@ int MyOnDiskFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler,
 /// \return 0.
 void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
     // Open logfile
-    this->logFile= fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
-    if(this->logFile == NULL) {
+    this->logger.setLevel(((MyFsInfo *) fuse_get_context()->private_data)->logLevel);
+    if(this->logger.open(((MyFsInfo *) fuse_get_context()->private_data)->logFile) < 0) {
         fprintf(stderr, "ERROR: Cannot open logfile %s\n", ((MyFsInfo *) fuse_get_context()->private_data)->logFile);
     } else {
-        // turn of logfile buffering
-        setvbuf(this->logFile, NULL, _IOLBF, 0);
+        // messages are written by the background thread of the logger
 
         LOG("Starting logging...\n");
 
         LOG("Using on-disk mode");
 
+        if(((MyFsInfo *) fuse_get_context()->private_data)->multithreaded)
+            LOG("Using multithreaded mode");
+
         LOGF("Container file name: %s", ((MyFsInfo *) fuse_get_context()->private_data)->contFile);
 
+        uint32_t cacheBlocks= ((MyFsInfo *) fuse_get_context()->private_data)->cacheBlocks;
+        this->cacheBlocks= cacheBlocks > 0 ? cacheBlocks : BC_DEFAULT_NUM_BLOCKS;
+
+        // only used if a new file system is created, an existing one keeps its block size
+        uint32_t blockSize= ((MyFsInfo *) fuse_get_context()->private_data)->blockSize;
+        if(blockSize == 0) {
+            blockSize= DEFAULT_BLOCK_SIZE;
+        } else if(!isValidBlockSize(blockSize)) {
+            LOGF("WARNING: Invalid block size %u, using %u", blockSize, DEFAULT_BLOCK_SIZE);
+            blockSize= DEFAULT_BLOCK_SIZE;
+        }
+        this->blockSize= blockSize;
+
+        uint32_t maxOpenFiles= ((MyFsInfo *) fuse_get_context()->private_data)->maxOpenFiles;
+        this->openFiles.setCapacity(maxOpenFiles > 0 ? maxOpenFiles : NUM_OPEN_FILES);
+        LOGF("Up to %u open files", this->openFiles.getCapacity());
+
+        uint32_t commitInterval= ((MyFsInfo *) fuse_get_context()->private_data)->commitInterval;
+        this->commitInterval= commitInterval > 0 ? commitInterval : JOURNAL_COMMIT_INTERVAL;
+        LOGF("Committing the journal every %u seconds", this->commitInterval);
+
+        initAtime((MyFsInfo *) fuse_get_context()->private_data);
+
+        if(((MyFsInfo *) fuse_get_context()->private_data)->compress) {
+            LOG("Compressing written clusters");
+            this->compress= true;
+        }
+
+        // like the block size, only used if a new file system is created
+        this->useChecksums= ((MyFsInfo *) fuse_get_context()->private_data)->checksum != 0;
+        this->scrubInterval= ((MyFsInfo *) fuse_get_context()->private_data)->scrubInterval;
+
+        // a striped container is neither mapped nor accessed through io_uring, its members have worker threads
+        MyFsInfo *info= (MyFsInfo *) fuse_get_context()->private_data;
+        bool striped= info->numContFiles > 1;
+        if(striped) {
+            LOGF("Striping the container over %u files", info->numContFiles);
+            this->blockDevice->setStripes(info->contFiles + 1, info->numContFiles - 1, info->stripeChunk);
+        }
+
+        if(((MyFsInfo *) fuse_get_context()->private_data)->mapped && !striped) {
+            LOG("Using memory-mapped container file");
+            this->blockDevice->setMapped(true);
+        } else if(((MyFsInfo *) fuse_get_context()->private_data)->uring && !striped) {
+            LOG("Accessing the container file through io_uring");
+            this->blockDevice->setIoRing(true);
+        }
+        if(((MyFsInfo *) fuse_get_context()->private_data)->direct && !this->blockDevice->isMapped()) {
+            LOG("Opening the container file with O_DIRECT");
+            this->blockDevice->setDirect(true);
+        }
+#if FUSE_VERSION >= 29
+        if(((MyFsInfo *) fuse_get_context()->private_data)->splice && !striped) {
+            // without splicing, FUSE still reads the file descriptor buffers, with a copy through user space
+            LOG("Splicing reads from the container file");
+            this->splice= true;
+            if(conn != NULL && (conn->capable & FUSE_CAP_SPLICE_WRITE)) {
+                conn->want|= FUSE_CAP_SPLICE_WRITE;
+                if(conn->capable & FUSE_CAP_SPLICE_MOVE)
+                    conn->want|= FUSE_CAP_SPLICE_MOVE;
+            }
+        }
+#endif
+
         int ret= this->blockDevice->open(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
 
         if(ret >= 0) {
             LOG("Container file does exist, reading");
 
-            // TODO: [PART 2] Read existing structures form file
+            ret= load();
+            if(ret == -EINVAL) {
+                LOG("WARNING: No valid file system found in container file, creating a new one");
+                ret= format(blockSize, (uint32_t) (DEFAULT_CONTAINER_SIZE / blockSize));
+            }
 
         } else if(ret == -ENOENT) {
             LOG("Container file does not exist, creating a new one");
@@ -299,9 +836,22 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
             ret = this->blockDevice->create(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
 
             if (ret >= 0) {
+                ret= format(blockSize, (uint32_t) (DEFAULT_CONTAINER_SIZE / blockSize));
+            }
+        }
 
-                // TODO: [PART 2] Create empty structures in file
-
+        if(ret >= 0) {
+            LOGF("Container has %u blocks of %u bytes, %u inodes, data starts at block %u", this->superBlock.numBlocks,
+                 this->blockSize, this->superBlock.numInodes, this->superBlock.dataStart);
+            LOGF("Block cache holds %u blocks", this->blockCache->getNumBlocks());
+            LOGF("Directory holds %u entries in %u buckets", this->dirIndex.size(), this->superBlock.dirBuckets);
+            startCommits();
+            if(this->checksums != NULL) {
+                LOGF("Verifying block checksums, %s CRC32 instructions", Crc32c::isHardware() ? "with" : "without");
+                if(this->scrubInterval > 0) {
+                    LOGF("Scrubbing the data blocks every %u seconds", this->scrubInterval);
+                    startScrubs();
+                }
             }
         }
 
@@ -313,18 +863,3152 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
     return 0;
 }
 
+/// @brief Get an extended attribute.
+///
+/// Files have the MYFS_COMPRESSION_XATTR attribute with their compression ratio and their logical and stored blocks.
+/// Buffered blocks are not included, they are compressed when the file is flushed. Other attributes are left to MyFS.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] name Name of the attribute.
+/// \param [out] value Buffer for the value.
+/// \param [in] size Size of the buffer, 0 to ask for the size of the value.
+/// \return Size of the value on success, -ERRNO on failure.
+#ifdef __APPLE__
+int MyOnDiskFS::fuseGetxattr(const char *path, const char *name, char *value, size_t size, uint x) {
+#else
+int MyOnDiskFS::fuseGetxattr(const char *path, const char *name, char *value, size_t size) {
+#endif
+    LOGM();
+
+    if(strcmp(path, "/") == 0 || strcmp(name, MYFS_COMPRESSION_XATTR) != 0) {
+#ifdef __APPLE__
+        return MyFS::fuseGetxattr(path, name, value, size, x);
+#else
+        return MyFS::fuseGetxattr(path, name, value, size);
+#endif
+    }
+
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+
+        uint64_t logical= 0, stored= 0;
+        for(const MyFsExtent &extent : this->inodeInfo[ino].extents) {
+            logical+= extent.length;
+            stored+= storedBlocks(&extent);
+        }
+        char report[96];
+        snprintf(report, sizeof(report), "ratio %.2f logical %llu stored %llu\n",
+                 stored > 0 ? (double) logical / stored : 1.0, (unsigned long long) logical,
+                 (unsigned long long) stored);
+
+        size_t n= strlen(report);
+        ret= (int) n;
+        if(size > 0 && size < n)
+            ret= -ERANGE;
+        else if(size > 0)
+            memcpy(value, report, n);
+    }
+
+    RETURN(ret);
+}
+
+/// @brief List the extended attributes of a file.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [out] list Buffer for the names, each terminated by a zero byte.
+/// \param [in] size Size of the buffer, 0 to ask for the size of the list.
+/// \return Size of the list on success, -ERRNO on failure.
+int MyOnDiskFS::fuseListxattr(const char *path, char *list, size_t size) {
+    LOGM();
+
+    if(strcmp(path, "/") == 0)
+        return MyFS::fuseListxattr(path, list, size);
+
+    ReadGuard dirGuard(this->dirLock);
+
+    uint32_t ino;
+    int ret= resolvePath(path, &ino);
+
+    if(ret >= 0) {
+        ret= (int) sizeof(MYFS_COMPRESSION_XATTR);
+        if(size > 0 && size < sizeof(MYFS_COMPRESSION_XATTR))
+            ret= -ERANGE;
+        else if(size > 0)
+            memcpy(list, MYFS_COMPRESSION_XATTR, sizeof(MYFS_COMPRESSION_XATTR));
+    }
+
+    RETURN(ret);
+}
+
+/// @brief Get file system statistics.
+///
+/// The free counts are kept up to date by the allocator, so no lock is taken and nothing is scanned. Blocks buffered
+/// for files get their blocks allocated when they are written, they are not counted as free.
+/// \param [in] path Any path within the file system, ignored.
+/// \param [out] statInfo Statistics of the file system.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseStatfs(const char *path, struct statvfs *statInfo) {
+    LOGM();
+
+    const MyFsSuperBlock *sb= &this->superBlock;
+    uint32_t numFree= this->numFreeBlocks.load(std::memory_order_relaxed);
+    uint32_t buffered= this->numDirtyBlocks.load(std::memory_order_relaxed);
+
+    memset(statInfo, 0, sizeof(struct statvfs));
+    statInfo->f_bsize= this->blockSize;
+    statInfo->f_frsize= this->blockSize;
+    statInfo->f_blocks= sb->numBlocks - sb->dataStart;
+    statInfo->f_bfree= numFree > buffered ? numFree - buffered : 0;
+    statInfo->f_bavail= statInfo->f_bfree;
+    statInfo->f_files= sb->numInodes;
+    statInfo->f_ffree= this->numFreeInodes.load(std::memory_order_relaxed);
+    statInfo->f_favail= statInfo->f_ffree;
+    statInfo->f_namemax= NAME_LENGTH;
+
+    RETURN(0);
+}
+
 /// @brief Clean up a file system.
 ///
 /// This function is called when the file system is unmounted. You may add some cleanup code here.
 void MyOnDiskFS::fuseDestroy() {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    if(this->bitmap.getNumBits() != 0) {
+        stopCommits();
+        stopScrubs();
+        this->blockCache->stopPrefetch();
+
+        for(uint32_t ino= 0; ino < this->superBlock.numInodes; ino++) {
+            if(this->inodeInfo[ino].dirtyCount > 0 && flushFile(ino) < 0)
+                LOGF("ERROR: Writing buffered blocks of inode %u failed", ino);
+        }
+
+        if(writeLazyInodes() < 0)
+            LOG("ERROR: Writing the times of inodes failed");
+
+        // the clean state is only recorded once the checkpoint has been committed
+        int ret= writeCheckpoint();
+        if(ret < 0)
+            LOGF("ERROR: Writing the checkpoint failed with error %d", ret);
+        if(ret >= 0 && this->checksums != NULL && (ret= writeChecksums()) < 0)
+            LOGF("ERROR: Writing the block checksums failed with error %d", ret);
+        if(ret >= 0 && commitTransaction() >= 0) {
+            this->superBlock.numFreeBlocks= this->numFreeBlocks;
+            this->superBlock.numFreeInodes= this->numFreeInodes;
+            this->superBlock.state= MYFS_STATE_CLEAN;
+            writeSuperBlock();
+            ret= commitTransaction();
+            if(ret < 0)
+                LOGF("ERROR: Committing the journal failed with error %d", ret);
+        }
+
+        // everything goes in place, the next mount has nothing to replay
+        ret= this->journal->checkpoint();
+        if(ret < 0)
+            LOGF("ERROR: Writing back block cache failed with error %d", ret);
+        LOGF("Journal: %lu commits, %lu logged blocks", (unsigned long) this->journal->getNumCommits(),
+             (unsigned long) this->journal->getNumLogged());
+        LOGF("Block cache: %lu hits, %lu misses, %lu write backs", (unsigned long) this->blockCache->getHits(),
+             (unsigned long) this->blockCache->getMisses(), (unsigned long) this->blockCache->getWriteBacks());
 
+        this->blockDevice->close();
+    }
+
+    this->logger.close();
+}
+
+/// @brief Append the statistics of the file system to a report.
+///
+/// Besides the calls of the FUSE operations the report holds the counters of the block cache and the block device.
+/// \param [out] out Report to append to.
+void MyOnDiskFS::reportStats(std::string &out) {
+    MyFS::reportStats(out);
+
+    char line[256];
+    if(this->blockCache != NULL) {
+        snprintf(line, sizeof(line), "cache hits %llu misses %llu write_backs %llu dirty %u blocks %u\n",
+                 (unsigned long long) this->blockCache->getHits(), (unsigned long long) this->blockCache->getMisses(),
+                 (unsigned long long) this->blockCache->getWriteBacks(), this->blockCache->getNumDirty(),
+                 this->blockCache->getNumBlocks());
+        out+= line;
+        snprintf(line, sizeof(line), "readahead blocks %llu hits %llu wasted %llu\n",
+                 (unsigned long long) this->blockCache->getPrefetchedBlocks(),
+                 (unsigned long long) this->blockCache->getPrefetchHits(),
+                 (unsigned long long) this->blockCache->getPrefetchWasted());
+        out+= line;
+    }
+    snprintf(line, sizeof(line), "device reads %llu writes %llu bytes_read %llu bytes_written %llu\n",
+             (unsigned long long) this->blockDevice->getNumReads(), (unsigned long long) this->blockDevice->getNumWrites(),
+             (unsigned long long) this->blockDevice->getBytesRead(),
+             (unsigned long long) this->blockDevice->getBytesWritten());
+    out+= line;
+    if(this->blockDevice->getNumStripes() > 0) {
+        snprintf(line, sizeof(line), "stripes members %u chunk %u split %llu\n", this->blockDevice->getNumStripes(),
+                 this->blockDevice->getStripeChunk(), (unsigned long long) this->blockDevice->getNumStriped());
+        out+= line;
+    }
+    if(this->blockDevice->isDirect()) {
+        snprintf(line, sizeof(line), "direct bounced %llu pool_allocated %llu pool_reused %llu\n",
+                 (unsigned long long) this->blockDevice->getNumBounced(),
+                 (unsigned long long) this->blockDevice->getBufferPool()->getNumAllocated(),
+                 (unsigned long long) this->blockDevice->getBufferPool()->getNumReused());
+        out+= line;
+    }
+    if(this->blockDevice->isIoRing()) {
+        IoRing *ring= this->blockDevice->getIoRing();
+        snprintf(line, sizeof(line), "uring batches %llu requests %llu fixed %llu\n",
+                 (unsigned long long) ring->getNumCalls(), (unsigned long long) ring->getNumRequests(),
+                 (unsigned long long) ring->getNumFixed());
+        out+= line;
+    }
+    if(this->splice) {
+        snprintf(line, sizeof(line), "splice bytes_spliced %llu bytes_copied %llu\n",
+                 (unsigned long long) this->bytesSpliced, (unsigned long long) this->bytesCopied);
+        out+= line;
+    }
+    if(this->checksums != NULL) {
+        snprintf(line, sizeof(line), "checksums verified %llu adopted %llu errors %llu scrubbed %llu scrubs %llu "
+                 "hardware %d\n", (unsigned long long) this->numVerified, (unsigned long long) this->numAdopted,
+                 (unsigned long long) this->numChecksumErrors, (unsigned long long) this->numScrubbed,
+                 (unsigned long long) this->numScrubs, Crc32c::isHardware() ? 1 : 0);
+        out+= line;
+    }
+    snprintf(line, sizeof(line), "buffered_blocks %u\n", (uint32_t) this->numDirtyBlocks);
+    out+= line;
+    snprintf(line, sizeof(line), "lazy_times updates %llu\n", (unsigned long long) this->numLazyUpdates);
+    out+= line;
+    if(this->journal != NULL) {
+        snprintf(line, sizeof(line), "journal commits %llu logged_blocks %llu pending %u\n",
+                 (unsigned long long) this->journal->getNumCommits(),
+                 (unsigned long long) this->journal->getNumLogged(), this->journal->getNumPending());
+        out+= line;
+    }
 }
 
 // TODO: [PART 2] You may add your own additional methods here!
 
+/// @brief Allocate the in-memory copies of the meta data.
+///
+/// The superblock must be set up before. The copies are padded to full blocks, so whole regions can be read and
+/// written at once.
+void MyOnDiskFS::allocTables() {
+    delete [] this->inodes;
+    delete [] this->inodeInfo;
+    delete [] this->inodeLoaded;
+    delete [] this->checksums;
+
+    this->bitmap.resize(this->superBlock.numBlocks, (size_t) this->superBlock.bitmapBlocks * this->blockSize);
+    this->freedMap.assign(this->bitmap.getDataSize() / sizeof(uint64_t), 0);
+    this->freedRuns.clear();
+    this->numFreed= 0;
+    this->numPinned= 0;
+    this->inodes= new MyFsInode[(size_t) this->superBlock.inodeBlocks * this->blockSize / sizeof(MyFsInode)]();
+    this->inodeInfo= new MyFsInodeInfo[this->superBlock.numInodes]();
+    this->inodeLoaded= new std::atomic<bool>[this->superBlock.inodeBlocks];
+    for(uint32_t b= 0; b < this->superBlock.inodeBlocks; b++)
+        this->inodeLoaded[b].store(false, std::memory_order_relaxed);
+    this->inodeMap.resize(this->superBlock.numInodes, 0);
+    this->dirIndex.clear();
+    this->dentries.clear();
+
+    this->checksums= NULL;
+    if(this->superBlock.checksumBlocks > 0) {
+        this->checksums= new std::atomic<uint64_t>[this->superBlock.numBlocks];
+        for(uint32_t b= 0; b < this->superBlock.numBlocks; b++)
+            this->checksums[b].store(0, std::memory_order_relaxed);
+    }
+}
+
+/// @brief Check a block size.
+/// \param [in] blockSize Block size in bytes.
+/// \return True for a power of two from MIN_BLOCK_SIZE to MAX_BLOCK_SIZE.
+bool MyOnDiskFS::isValidBlockSize(uint32_t blockSize) {
+    return blockSize >= MIN_BLOCK_SIZE && blockSize <= MAX_BLOCK_SIZE && (blockSize & (blockSize - 1)) == 0;
+}
+
+/// @brief Publish the free counts of the free block map and the used inode map for fuseStatfs().
+///
+/// The maps count their free bits as they change, so this is constant time. Must be called with the allocation lock
+/// held after each change of the maps.
+void MyOnDiskFS::updateFreeCounts() {
+    this->numFreeBlocks.store(this->bitmap.getNumFree(), std::memory_order_relaxed);
+    this->numFreeInodes.store(this->inodeMap.getNumFree(), std::memory_order_relaxed);
+}
+
+/// @brief Select the block size of the container.
+///
+/// The block device is switched to the new block size and a new, empty block cache is set up for it.
+/// \param [in] blockSize Block size, see isValidBlockSize().
+void MyOnDiskFS::setBlockSize(uint32_t blockSize) {
+    this->blockSize= blockSize;
+    this->blockDevice->setBlockSize(blockSize);
+
+    delete this->blockCache;
+    this->blockCache= new BlockCache(this->blockDevice, this->cacheBlocks);
+    this->clusterBlocks= std::max(COMPRESS_CLUSTER_SIZE / blockSize, (uint32_t) 1);
+}
+
+// Bytes of the block checksums of a container, see the on-disk layout in myfs-structs.h.
+static size_t checksumBytes(uint32_t numBlocks) {
+    return (size_t) numBlocks * sizeof(uint32_t) + (numBlocks + 7) / 8;
+}
+
+/// @brief Create an empty file system in the container file.
+///
+/// The inode table is sized by the size of the container, the directory starts with DIR_INITIAL_BUCKETS buckets. With
+/// useChecksums the journal is followed by the block checksums, all unknown until the first clean unmount.
+/// \param [in] blockSize Block size, see isValidBlockSize().
+/// \param [in] numBlocks Size of the container in blocks.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::format(uint32_t blockSize, uint32_t numBlocks) {
+    LOGM();
+
+    setBlockSize(blockSize);
+
+    MyFsSuperBlock *sb= &this->superBlock;
+    memset(sb, 0, sizeof(MyFsSuperBlock));
+    sb->magic= MYFS_MAGIC;
+    sb->version= MYFS_VERSION;
+    sb->blockSize= this->blockSize;
+    sb->numBlocks= numBlocks;
+    sb->numInodes= std::max((uint32_t) MIN_NUM_INODES,
+                            (uint32_t) ((uint64_t) numBlocks * blockSize / BYTES_PER_INODE));
+
+    sb->bitmapStart= 1;
+    sb->bitmapBlocks= ((numBlocks + 7) / 8 + this->blockSize - 1) / this->blockSize;
+    sb->inodeStart= sb->bitmapStart + sb->bitmapBlocks;
+    sb->inodeBlocks= (uint32_t) (((size_t) sb->numInodes * sizeof(MyFsInode) + this->blockSize - 1) / this->blockSize);
+    sb->journalStart= sb->inodeStart + sb->inodeBlocks;
+    sb->journalBlocks= std::min(std::max(numBlocks / 128, (uint32_t) JOURNAL_MIN_BLOCKS), (uint32_t) JOURNAL_MAX_BLOCKS);
+    sb->dataStart= sb->journalStart + sb->journalBlocks;
+    if(this->useChecksums) {
+        sb->checksumStart= sb->dataStart;
+        sb->checksumBlocks= (uint32_t) ((checksumBytes(numBlocks) + this->blockSize - 1) / this->blockSize);
+        sb->dataStart+= sb->checksumBlocks;
+    }
+
+    allocTables();
+    delete this->journal;
+    this->journal= new Journal(this->blockDevice, this->blockCache, sb->journalStart, sb->journalBlocks);
+
+    // blocks holding meta data are always used, bits beyond the end of the container are set by the bitmap
+    this->bitmap.set(0, sb->dataStart);
+
+    memset(this->inodes, 0, (size_t) sb->inodeBlocks * this->blockSize);
+    for(uint32_t b= 0; b < sb->inodeBlocks; b++)
+        this->inodeLoaded[b].store(true, std::memory_order_relaxed);
+
+    MyFsInode *root= &this->inodes[ROOT_INODE];
+    root->mode= S_IFDIR | 0755;
+    root->nlink= 2;
+    root->uid= getuid();
+    root->gid= getgid();
+    root->atime= root->mtime= root->ctime= time(NULL);
+    this->inodeMap.set(ROOT_INODE, 1);
+
+    for(uint32_t ino= 0; ino < sb->numInodes; ino++) {
+        this->inodeInfo[ino].numBlocks= 0;
+        this->inodeInfo[ino].usedBlocks= 0;
+        this->inodeInfo[ino].numCompressed= 0;
+        this->inodeInfo[ino].allocHint= 0;
+        this->inodeInfo[ino].dirtyCount= 0;
+    }
+    this->allocHint= sb->dataStart;
+    this->numDirtyBlocks= 0;
+
+    int ret= this->journal->format();
+    if(ret >= 0)
+        ret= writeSuperBlock();
+    if(ret >= 0)
+        ret= this->blockCache->writeBlocks(sb->bitmapStart, sb->bitmapBlocks, (char *) this->bitmap.getData());
+    if(ret >= 0)
+        ret= this->blockCache->writeBlocks(sb->inodeStart, sb->inodeBlocks, (char *) this->inodes);
+    if(ret >= 0)
+        ret= rehashDir(DIR_INITIAL_BUCKETS);
+    if(ret >= 0)
+        ret= this->journal->commit();
+    updateFreeCounts();
+
+    RETURN(ret < 0 ? ret : 0);
+}
+
+/// @brief Read the file system structures from the container file.
+///
+/// The committed transactions of the journal are replayed first. After a clean unmount only the free block map, the
+/// block checksums and the checkpoint are read, see loadCheckpoint(). Otherwise the inode table and the directory are
+/// scanned, and the block checksums, which are only written by a clean unmount, start out unknown. The superblock is
+/// marked as in use before the file system is changed.
+/// \return 0 on success, -EINVAL if the container does not hold a valid file system, -ERRNO on other failures.
+int MyOnDiskFS::load() {
+    LOGM();
+
+    // the superblock is read before the block size is known, it fits into the smallest block
+    char block[MIN_BLOCK_SIZE];
+    this->blockDevice->setBlockSize(MIN_BLOCK_SIZE);
+    int ret= this->blockDevice->read(0, block);
+    if(ret < 0) {
+        RETURN(ret);
+    }
+
+    MyFsSuperBlock *sb= &this->superBlock;
+    memcpy(sb, block, sizeof(MyFsSuperBlock));
+    if(sb->magic != MYFS_MAGIC || sb->version != MYFS_VERSION || !isValidBlockSize(sb->blockSize) ||
+       sb->numInodes == 0 || sb->dataStart > sb->numBlocks || sb->dirBuckets == 0 ||
+       sb->journalBlocks < JOURNAL_MIN_BLOCKS || sb->journalStart + sb->journalBlocks > sb->dataStart ||
+       (sb->checksumBlocks > 0 && (sb->checksumStart < sb->journalStart + sb->journalBlocks ||
+                                   sb->checksumStart + sb->checksumBlocks > sb->dataStart ||
+                                   (size_t) sb->checksumBlocks * sb->blockSize < checksumBytes(sb->numBlocks)))) {
+        RETURN(-EINVAL);
+    }
+
+    setBlockSize(sb->blockSize);
+    delete this->journal;
+    this->journal= new Journal(this->blockDevice, this->blockCache, sb->journalStart, sb->journalBlocks);
+
+    uint32_t numReplayed;
+    ret= this->journal->replay(&numReplayed);
+    if(ret == -EINVAL) {
+        // never format a container that holds a file system
+        LOG("ERROR: Journal is corrupt");
+        ret= -EIO;
+    }
+    if(ret >= 0 && numReplayed > 0) {
+        LOGF("Replayed %u transactions of the journal", numReplayed);
+        std::vector<char> buffer(this->blockSize);
+        ret= this->blockDevice->read(0, buffer.data());
+        memcpy(sb, buffer.data(), sizeof(MyFsSuperBlock));
+    }
+    if(ret < 0) {
+        RETURN(ret);
+    }
+
+    allocTables();
+
+    ret= this->blockCache->readBlocks(sb->bitmapStart, sb->bitmapBlocks, (char *) this->bitmap.getData());
+    this->bitmap.rebuild();
+
+    this->allocHint= sb->dataStart;
+    this->numDirtyBlocks= 0;
+
+    bool scan= true;
+    if(ret >= 0 && sb->state == MYFS_STATE_CLEAN) {
+        // the checkpoint is already read with its checksums
+        if(this->checksums != NULL)
+            ret= loadChecksums();
+        if(ret >= 0)
+            ret= loadCheckpoint();
+        if(ret >= 0) {
+            LOGF("Loaded checkpoint with %u directory entries", this->dirIndex.size());
+            scan= false;
+        } else if(ret == -EINVAL) {
+            LOG("WARNING: Checkpoint is invalid, scanning all inodes");
+            ret= 0;
+        }
+    } else if(ret >= 0) {
+        LOG("WARNING: File system was not unmounted cleanly, scanning all inodes");
+        if(this->checksums != NULL)
+            LOG("WARNING: Block checksums are out of date, they are taken from the blocks as they are read");
+    }
+    if(ret >= 0 && scan)
+        ret= scanInodes();
+    updateFreeCounts();
+
+    // the checkpoint is stale as soon as anything changes
+    if(ret >= 0) {
+        sb->state= 0;
+        ret= writeSuperBlock();
+    }
+    if(ret >= 0)
+        ret= this->journal->commit();
+
+    RETURN(ret < 0 ? ret : 0);
+}
+
+/// @brief Read the whole inode table and the directory.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::scanInodes() {
+    MyFsSuperBlock *sb= &this->superBlock;
+
+    this->inodeMap.resize(sb->numInodes, 0);
+    this->dirIndex.clear();
+
+    int ret= this->blockCache->readBlocks(sb->inodeStart, sb->inodeBlocks, (char *) this->inodes);
+    for(uint32_t b= 0; ret >= 0 && b < sb->inodeBlocks; b++)
+        this->inodeLoaded[b].store(true, std::memory_order_relaxed);
+
+    for(uint32_t ino= 0; ret >= 0 && ino < sb->numInodes; ino++) {
+        if(this->inodes[ino].mode != 0)
+            this->inodeMap.set(ino, 1);
+        ret= loadExtents(ino);
+    }
+
+    if(ret >= 0)
+        ret= loadDir();
+
+    return ret;
+}
+
+/// @brief Make sure an inode has been read from the inode table.
+///
+/// The whole block of the inode table holding the inode is read, together with the extents of its inodes. Each block
+/// is read only once, all inodes are available after a scan of the inode table or a format.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::loadInode(uint32_t ino) {
+    uint32_t perBlock= this->blockSize / sizeof(MyFsInode);
+    uint32_t b= ino / perBlock;
+    if(this->inodeLoaded[b].load(std::memory_order_acquire))
+        return 0;
+
+    std::lock_guard<std::mutex> guard(this->loadLock);
+    if(this->inodeLoaded[b].load(std::memory_order_relaxed))
+        return 0;
+
+    int ret= this->blockCache->read(this->superBlock.inodeStart + b, (char *) &this->inodes[b * perBlock]);
+    for(uint32_t i= b * perBlock; ret >= 0 && i < (b + 1) * perBlock && i < this->superBlock.numInodes; i++)
+        ret= loadExtents(i);
+
+    if(ret >= 0)
+        this->inodeLoaded[b].store(true, std::memory_order_release);
+    return ret;
+}
+
+/// @brief Read the checkpoint written by the last clean unmount.
+///
+/// The checkpoint replaces the used inode map and the directory index, which would otherwise be built by
+/// scanInodes(). Only the root directory and the checkpoint inodes are read from the inode table.
+/// \return 0 on success, -EINVAL if the checkpoint does not match the container, -ERRNO on other failures.
+int MyOnDiskFS::loadCheckpoint() {
+    MyFsSuperBlock *sb= &this->superBlock;
+    uint32_t ino= sb->checkpointInode;
+    if(ino == ROOT_INODE || ino >= sb->numInodes)
+        return -EINVAL;
+
+    int ret= loadInode(ROOT_INODE);
+    if(ret >= 0)
+        ret= loadInode(ino);
+    if(ret < 0)
+        return ret;
+
+    MyFsInode *inode= &this->inodes[ino];
+    if(!S_ISREG(inode->mode) || inode->size < sizeof(MyFsCheckpoint) || inode->size > ((uint64_t) 1 << 31))
+        return -EINVAL;
+    std::vector<char> data(inode->size);
+    ret= readFile(ino, data.data(), data.size(), 0);
+    if(ret < 0)
+        return ret;
+
+    const MyFsCheckpoint *header= (const MyFsCheckpoint *) data.data();
+    if(header->magic != MYFS_CHECKPOINT_MAGIC || header->numInodes != sb->numInodes ||
+       header->mapSize != this->inodeMap.getDataSize() || sizeof(MyFsCheckpoint) + header->mapSize > data.size() ||
+       header->numFree != this->bitmap.getNumFree() || header->allocHint < sb->dataStart ||
+       header->allocHint >= sb->numBlocks)
+        return -EINVAL;
+
+    memcpy(this->inodeMap.getData(), data.data() + sizeof(MyFsCheckpoint), header->mapSize);
+    this->inodeMap.rebuild();
+    // containers of older versions record no free counts, they are scanned once
+    if(sb->numFreeBlocks != this->bitmap.getNumFree() || sb->numFreeInodes != this->inodeMap.getNumFree())
+        return -EINVAL;
+
+    size_t pos= sizeof(MyFsCheckpoint) + header->mapSize;
+    char name[NAME_LENGTH + 1];
+    for(uint32_t e= 0; e < header->numEntries; e++) {
+        const MyFsCheckpointEntry *entry= (const MyFsCheckpointEntry *) (data.data() + pos);
+        if(pos + sizeof(MyFsCheckpointEntry) > data.size() || entry->nameLength == 0 ||
+           entry->nameLength > NAME_LENGTH || entry->length < CHECKPOINT_ENTRY_SIZE(entry->nameLength) ||
+           pos + entry->length > data.size() || entry->inode == ROOT_INODE || entry->inode >= sb->numInodes ||
+           !this->inodeMap.isUsed(entry->inode) || entry->parent == entry->inode || entry->parent >= sb->numInodes ||
+           !this->inodeMap.isUsed(entry->parent) || entry->dirBlock >= this->inodeInfo[ROOT_INODE].numBlocks) {
+            this->dirIndex.clear();
+            return -EINVAL;
+        }
+
+        memcpy(name, data.data() + pos + sizeof(MyFsCheckpointEntry), entry->nameLength);
+        name[entry->nameLength]= '\0';
+        if(this->dirIndex.find(entry->parent, name) >= 0) {
+            this->dirIndex.clear();
+            return -EINVAL;
+        }
+        this->dirIndex.insert(entry->parent, name, entry->inode, entry->dirBlock);
+        pos+= entry->length;
+    }
+
+    this->allocHint= header->allocHint;
+
+    return 0;
+}
+
+/// @brief Store the used inode map and the directory entries for the next mount.
+///
+/// The checkpoint file is created with the first clean unmount and rewritten by each later one. Its blocks are
+/// allocated before the content is filled in, so the free block count in the checkpoint includes them. The caller
+/// marks the superblock as clean once the checkpoint has reached the container.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeCheckpoint() {
+    MyFsSuperBlock *sb= &this->superBlock;
+    int ret= 0;
+
+    if(sb->checkpointInode == 0) {
+        ret= allocInode();
+        if(ret < 0)
+            return ret;
+        uint32_t ino= (uint32_t) ret;
+
+        MyFsInode *inode= &this->inodes[ino];
+        memset(inode, 0, sizeof(MyFsInode));
+        inode->mode= S_IFREG | 0600;
+        inode->nlink= 1;
+        inode->uid= getuid();
+        inode->gid= getgid();
+        inode->atime= inode->mtime= inode->ctime= time(NULL);
+        ret= writeInode(ino);
+        if(ret < 0)
+            return ret;
+        sb->checkpointInode= ino;
+    }
+    uint32_t ino= sb->checkpointInode;
+
+    size_t size= sizeof(MyFsCheckpoint) + this->inodeMap.getDataSize();
+    for(int e= 0; e < this->dirIndex.end(); e++) {
+        if(this->dirIndex.isUsed(e))
+            size+= CHECKPOINT_ENTRY_SIZE(strlen(this->dirIndex.getName(e)));
+    }
+
+    ret= resizeFile(ino, 0);
+    if(ret >= 0)
+        ret= growBlocks(ino, (uint32_t) ((size + this->blockSize - 1) / this->blockSize));
+    if(ret < 0)
+        return ret;
+
+    std::vector<char> data(size, 0);
+    MyFsCheckpoint *header= (MyFsCheckpoint *) data.data();
+    header->magic= MYFS_CHECKPOINT_MAGIC;
+    header->numInodes= sb->numInodes;
+    header->mapSize= (uint32_t) this->inodeMap.getDataSize();
+    header->numEntries= this->dirIndex.size();
+    // the blocks freed by the running transaction and the pinned ones are free in the map stored by its commit
+    header->numFree= this->bitmap.getNumFree() + this->numFreed + this->numPinned;
+    header->allocHint= this->allocHint;
+    memcpy(data.data() + sizeof(MyFsCheckpoint), this->inodeMap.getData(), header->mapSize);
+
+    size_t pos= sizeof(MyFsCheckpoint) + header->mapSize;
+    for(int e= 0; e < this->dirIndex.end(); e++) {
+        if(!this->dirIndex.isUsed(e))
+            continue;
+        MyFsCheckpointEntry *entry= (MyFsCheckpointEntry *) (data.data() + pos);
+        const char *name= this->dirIndex.getName(e);
+        entry->inode= this->dirIndex.getInode(e);
+        entry->parent= this->dirIndex.getParent(e);
+        entry->dirBlock= this->dirIndex.getAux(e);
+        entry->nameLength= (uint16_t) strlen(name);
+        entry->length= (uint16_t) CHECKPOINT_ENTRY_SIZE(entry->nameLength);
+        memcpy(data.data() + pos + sizeof(MyFsCheckpointEntry), name, entry->nameLength);
+        pos+= entry->length;
+    }
+
+    ret= writeFile(ino, data.data(), size, 0);
+    if(ret >= 0) {
+        MyFsInode *inode= &this->inodes[ino];
+        inode->size= size;
+        inode->mtime= inode->ctime= time(NULL);
+        ret= writeInode(ino);
+    }
+
+    return ret;
+}
+
+/// @brief Read the block checksums written by the last clean unmount.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::loadChecksums() {
+    MyFsSuperBlock *sb= &this->superBlock;
+
+    std::vector<char> region((size_t) sb->checksumBlocks * this->blockSize);
+    int ret= this->blockCache->readBlocks(sb->checksumStart, sb->checksumBlocks, region.data());
+    if(ret < 0)
+        return ret;
+
+    const uint8_t *known= (const uint8_t *) region.data() + (size_t) sb->numBlocks * sizeof(uint32_t);
+    for(uint32_t b= 0; b < sb->numBlocks; b++) {
+        uint32_t crc;
+        memcpy(&crc, region.data() + (size_t) b * sizeof(uint32_t), sizeof(crc));
+        bool valid= (known[b / 8] >> (b % 8)) & 1;
+        this->checksums[b].store(valid ? CHECKSUM_VALID | crc : 0, std::memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+/// @brief Write the block checksums.
+///
+/// The checksums are written as a whole, past the journal, when the file system is unmounted. They only match the
+/// blocks if the unmount completes, so the next mount only reads them in MYFS_STATE_CLEAN.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeChecksums() {
+    MyFsSuperBlock *sb= &this->superBlock;
+
+    // directory blocks are never checksummed, see loadDir(), so no value taken by an older version is stored again
+    const std::vector<MyFsExtent> &dirExtents= this->inodeInfo[ROOT_INODE].extents;
+    for(size_t e= 0; e < dirExtents.size(); e++) {
+        for(uint32_t b= 0; b < dirExtents[e].length; b++)
+            this->checksums[dirExtents[e].start + b].store(0, std::memory_order_relaxed);
+    }
+
+    std::vector<char> region((size_t) sb->checksumBlocks * this->blockSize, 0);
+    uint8_t *known= (uint8_t *) region.data() + (size_t) sb->numBlocks * sizeof(uint32_t);
+    for(uint32_t b= 0; b < sb->numBlocks; b++) {
+        uint64_t entry= this->checksums[b].load(std::memory_order_relaxed);
+        if(entry & CHECKSUM_VALID) {
+            uint32_t crc= (uint32_t) entry;
+            memcpy(region.data() + (size_t) b * sizeof(uint32_t), &crc, sizeof(crc));
+            known[b / 8]|= (uint8_t) (1 << (b % 8));
+        }
+    }
+
+    return this->blockCache->writeBlocks(sb->checksumStart, sb->checksumBlocks, region.data());
+}
+
+/// @brief Record the checksums of blocks that have been written.
+///
+/// Nothing is done for a container without checksums.
+/// \param [in] blockNo Number of the first block.
+/// \param [in] count Number of blocks.
+/// \param [in] data Content of the blocks, count blocks.
+void MyOnDiskFS::setChecksums(uint32_t blockNo, uint32_t count, const char *data) {
+    if(this->checksums == NULL)
+        return;
+
+    uint32_t crcs[CHECKSUM_BATCH_BLOCKS];
+    for(uint32_t b= 0; b < count; b+= CHECKSUM_BATCH_BLOCKS) {
+        uint32_t n= std::min(count - b, (uint32_t) CHECKSUM_BATCH_BLOCKS);
+        Crc32c::computeBlocks(data + (size_t) b * this->blockSize, this->blockSize, n, crcs);
+        for(uint32_t i= 0; i < n; i++)
+            this->checksums[blockNo + b + i].store(CHECKSUM_VALID | crcs[i], std::memory_order_relaxed);
+    }
+}
+
+/// @brief Check blocks that have been read against their checksums.
+///
+/// The checksums are computed in batches of CHECKSUM_BATCH_BLOCKS blocks, see Crc32c::computeBlocks(). A block whose
+/// checksum is unknown, e.g. after an unclean unmount, takes the checksum of its content. Nothing is checked for a
+/// container without checksums.
+/// \param [in] blockNo Number of the first block.
+/// \param [in] count Number of blocks.
+/// \param [in] data Content of the blocks, count blocks.
+/// \return Number of blocks that do not match their checksum, each of them is logged.
+uint32_t MyOnDiskFS::verifyChecksums(uint32_t blockNo, uint32_t count, const char *data) {
+    if(this->checksums == NULL)
+        return 0;
+
+    uint32_t crcs[CHECKSUM_BATCH_BLOCKS];
+    uint32_t numBad= 0, numAdopted= 0;
+    for(uint32_t b= 0; b < count; b+= CHECKSUM_BATCH_BLOCKS) {
+        uint32_t n= std::min(count - b, (uint32_t) CHECKSUM_BATCH_BLOCKS);
+        Crc32c::computeBlocks(data + (size_t) b * this->blockSize, this->blockSize, n, crcs);
+        for(uint32_t i= 0; i < n; i++) {
+            std::atomic<uint64_t> *checksum= &this->checksums[blockNo + b + i];
+            uint64_t entry= checksum->load(std::memory_order_relaxed);
+            if(!(entry & CHECKSUM_VALID)) {
+                checksum->store(CHECKSUM_VALID | crcs[i], std::memory_order_relaxed);
+                numAdopted++;
+            } else if((uint32_t) entry != crcs[i]) {
+                LOGF("ERROR: Block %u does not match its checksum", blockNo + b + i);
+                numBad++;
+            }
+        }
+    }
+
+    this->numVerified+= count - numAdopted;
+    if(numAdopted > 0)
+        this->numAdopted+= numAdopted;
+    if(numBad > 0)
+        this->numChecksumErrors+= numBad;
+    return numBad;
+}
+
+/// @brief Check the stored blocks of all regular files against their checksums.
+///
+/// The blocks are read from the container file, bypassing the block cache, so the copy on the device is checked. Blocks
+/// with a dirty copy in the cache are skipped, their checksum is already the one of the newer content. Directories and
+/// extent blocks are meta data, which is protected by the journal instead. stopScrubs() ends a running scrub early.
+/// \return Number of blocks that do not match their checksum, -ERRNO on failure.
+int MyOnDiskFS::scrub() {
+    if(this->checksums == NULL)
+        return 0;
+
+    std::vector<char> buffer;
+    int numBad= 0;
+    for(uint32_t ino= 0; ino < this->superBlock.numInodes && !this->scrubStop; ino++) {
+        {
+            std::lock_guard<std::mutex> guard(this->allocLock);
+            if(!this->inodeMap.isUsed(ino))
+                continue;
+        }
+
+        int ret= scrubFile(ino, buffer);
+        if(ret < 0)
+            return ret;
+        numBad+= ret;
+    }
+    if(!this->scrubStop)
+        this->numScrubs++;
+
+    return numBad;
+}
+
+/// @brief Check the stored blocks of a file against their checksums.
+///
+/// The file is checked in steps of up to SCRUB_BATCH_BLOCKS blocks or one compressed cluster. The inode lock is only
+/// held shared for a step, so the file can be written between the steps.
+/// \param [in] ino Inode number.
+/// \param [in,out] buffer Buffer for the blocks of a step.
+/// \return Number of blocks that do not match their checksum, -ERRNO on failure.
+int MyOnDiskFS::scrubFile(uint32_t ino, std::vector<char> &buffer) {
+    int numBad= 0;
+    uint32_t next= 0;
+    while(!this->scrubStop) {
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+
+        int ret= loadInode(ino);
+        if(ret < 0)
+            return ret;
+        const MyFsInode *inode= &this->inodes[ino];
+        if(!S_ISREG(inode->mode) || (inode->flags & INODE_INLINE))
+            break;
+
+        const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+        size_t e= findExtent(ino, next);
+        if(e == extents.size())
+            break;
+
+        const MyFsExtent *extent= &extents[e];
+        uint32_t start= extent->start, count;
+        if(extent->compressed != 0) {
+            count= storedBlocks(extent);
+            next= extent->logical + extent->length;
+        } else {
+            uint32_t skip= next > extent->logical ? next - extent->logical : 0;
+            start+= skip;
+            count= std::min(extent->length - skip, (uint32_t) SCRUB_BATCH_BLOCKS);
+            next= extent->logical + skip + count;
+        }
+
+        ret= scrubBlocks(start, count, buffer);
+        if(ret < 0)
+            return ret;
+        numBad+= ret;
+    }
+
+    return numBad;
+}
+
+/// @brief Read a run of blocks from the device and check them against their checksums.
+/// \param [in] blockNo Number of the first block.
+/// \param [in] count Number of blocks.
+/// \param [in,out] buffer Buffer for the blocks, resized as needed.
+/// \return Number of blocks that do not match their checksum, -ERRNO on failure.
+int MyOnDiskFS::scrubBlocks(uint32_t blockNo, uint32_t count, std::vector<char> &buffer) {
+    if(buffer.size() < (size_t) count * this->blockSize)
+        buffer.resize((size_t) count * this->blockSize);
+
+    int numBad= 0;
+    uint32_t b= 0;
+    while(b < count) {
+        uint32_t clean= this->blockCache->countClean(blockNo + b, count - b);
+        if(clean == 0) {
+            b++;
+            continue;
+        }
+
+        int ret= this->blockDevice->readBlocks(blockNo + b, clean, buffer.data());
+        if(ret < 0)
+            return ret;
+        numBad+= (int) verifyChecksums(blockNo + b, clean, buffer.data());
+        this->numScrubbed+= clean;
+        b+= clean;
+    }
+
+    return numBad;
+}
+
+/// @brief Start the thread scrubbing the data blocks every scrubInterval seconds.
+void MyOnDiskFS::startScrubs() {
+    std::lock_guard<std::mutex> guard(this->scrubMutex);
+    if(this->scrubThread.joinable())
+        return;
+
+    this->scrubStop= false;
+    this->scrubThread= std::thread(&MyOnDiskFS::scrubLoop, this);
+}
+
+/// @brief Stop the scrub thread, a running scrub ends after its current step.
+void MyOnDiskFS::stopScrubs() {
+    {
+        std::lock_guard<std::mutex> guard(this->scrubMutex);
+        this->scrubStop= true;
+    }
+    this->scrubCond.notify_all();
+    if(this->scrubThread.joinable())
+        this->scrubThread.join();
+}
+
+/// @brief Main loop of the scrub thread.
+void MyOnDiskFS::scrubLoop() {
+    std::unique_lock<std::mutex> guard(this->scrubMutex);
+    while(!this->scrubStop) {
+        this->scrubCond.wait_for(guard, std::chrono::seconds(this->scrubInterval));
+        if(this->scrubStop)
+            break;
+
+        guard.unlock();
+        uint64_t scrubbed= this->numScrubbed;
+        int ret= scrub();
+        if(ret < 0)
+            LOGF("ERROR: Scrubbing failed with error %d", ret);
+        else if(ret > 0)
+            LOGF("ERROR: Scrub found %d of %lu blocks not matching their checksums", ret,
+                 (unsigned long) (this->numScrubbed - scrubbed));
+        guard.lock();
+    }
+}
+
+/// @brief Read a meta data block.
+///
+/// A block changed by the running transaction of the journal is taken from the journal.
+/// \param [in] blockNo Number of the block.
+/// \param [out] block Buffer for the block.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readMetaBlock(uint32_t blockNo, char *block) {
+    if(this->journal->read(blockNo, block))
+        return 0;
+    return this->blockCache->read(blockNo, block);
+}
+
+/// @brief Write a meta data block.
+///
+/// The block is logged by the running transaction of the journal and goes in place after the commit. The commit
+/// thread is woken up early once the transaction holds JOURNAL_BATCH_BLOCKS blocks.
+/// \param [in] blockNo Number of the block.
+/// \param [in] block Content of the block.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeMetaBlock(uint32_t blockNo, char *block) {
+    this->journal->write(blockNo, block);
+    if(this->journal->getNumPending() >= JOURNAL_BATCH_BLOCKS)
+        this->commitCond.notify_one();
+    return 0;
+}
+
+/// @brief Commit the running transaction of the journal.
+///
+/// Waits until the operations changing meta data that are under way are done, so a transaction never holds half of
+/// an operation.
+/// \return 1 if a transaction was committed, 0 if nothing has changed, -ERRNO on failure.
+int MyOnDiskFS::commitJournal() {
+    WriteGuard journalGuard(this->journalLock);
+    int ret= writeLazyInodes();
+    return ret < 0 ? ret : commitTransaction();
+}
+
+/// @brief Commit the running transaction and give the blocks it freed to the allocator.
+///
+/// No operation may change meta data meanwhile, e.g. the journal lock is held for writing.
+/// \return 1 if a transaction was committed, 0 if nothing has changed, -ERRNO on failure.
+int MyOnDiskFS::commitTransaction() {
+    int ret= this->journal->commit();
+    if(ret >= 0)
+        releaseFreed();
+    return ret;
+}
+
+/// @brief Start the thread committing the journal every commitInterval seconds.
+void MyOnDiskFS::startCommits() {
+    std::lock_guard<std::mutex> guard(this->commitMutex);
+    if(this->commitThread.joinable())
+        return;
+
+    this->commitStop= false;
+    this->commitThread= std::thread(&MyOnDiskFS::commitLoop, this);
+}
+
+/// @brief Stop the commit thread, the running transaction is not committed.
+void MyOnDiskFS::stopCommits() {
+    {
+        std::lock_guard<std::mutex> guard(this->commitMutex);
+        this->commitStop= true;
+    }
+    this->commitCond.notify_all();
+    if(this->commitThread.joinable())
+        this->commitThread.join();
+}
+
+/// @brief Main loop of the commit thread.
+void MyOnDiskFS::commitLoop() {
+    std::unique_lock<std::mutex> guard(this->commitMutex);
+    while(!this->commitStop) {
+        this->commitCond.wait_for(guard, std::chrono::seconds(this->commitInterval));
+        if(this->commitStop)
+            break;
+
+        guard.unlock();
+        int ret= commitJournal();
+        if(ret < 0)
+            LOGF("ERROR: Committing the journal failed with error %d", ret);
+        guard.lock();
+    }
+}
+
+/// @brief Write a part of a meta data region.
+///
+/// Copy size bytes from src to byte position offset of the region starting at block regionStart. Only the blocks
+/// covering the range are updated, they are logged by the journal.
+/// \param [in] regionStart First block of the region.
+/// \param [in] offset Byte offset within the region.
+/// \param [in] src Content to write.
+/// \param [in] size Number of bytes to write.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeMeta(uint32_t regionStart, size_t offset, const void *src, size_t size) {
+    std::lock_guard<std::mutex> guard(this->metaLock);
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    size_t done= 0;
+    while(done < size) {
+        uint32_t blockNo= regionStart + (uint32_t) ((offset + done) / this->blockSize);
+        size_t pos= (offset + done) % this->blockSize;
+        size_t n= std::min(size - done, (size_t) this->blockSize - pos);
+
+        int ret= 0;
+        if(n < this->blockSize)
+            ret= readMetaBlock(blockNo, block);
+        if(ret < 0)
+            return ret;
+        memcpy(block + pos, (const char *) src + done, n);
+        ret= writeMetaBlock(blockNo, block);
+        if(ret < 0)
+            return ret;
+
+        done+= n;
+    }
+
+    return 0;
+}
+
+/// @brief Write an inode to the inode table.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeInode(uint32_t ino) {
+    return writeMeta(this->superBlock.inodeStart, (size_t) ino * sizeof(MyFsInode), &this->inodes[ino],
+                     sizeof(MyFsInode));
+}
+
+/// @brief Write an inode after a change that may have only touched its times.
+///
+/// Writes to blocks that are already allocated change nothing but the modification and change times. These inodes
+/// are not logged right away, the times of consecutive writes are kept in memory and written by the next commit of
+/// the journal, see writeLazyInodes(). Must be called with the inode lock held for writing.
+/// \param [in] ino Inode number.
+/// \param [in] before Copy of the inode taken before the change.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::updateInode(uint32_t ino, const MyFsInode *before) {
+    MyFsInode timesOnly;
+    memcpy(&timesOnly, before, sizeof(MyFsInode));
+    timesOnly.atime= this->inodes[ino].atime;
+    timesOnly.mtime= this->inodes[ino].mtime;
+    timesOnly.ctime= this->inodes[ino].ctime;
+    if(memcmp(&timesOnly, &this->inodes[ino], sizeof(MyFsInode)) != 0)
+        return writeInode(ino);
+
+    markLazy(ino);
+    this->numLazyUpdates++;
+    return 0;
+}
+
+/// @brief Remember an inode whose times changed in memory only, the inode lock must be held for writing.
+void MyOnDiskFS::markLazy(uint32_t ino) {
+    if(this->inodeInfo[ino].lazyTimes)
+        return;
+
+    this->inodeInfo[ino].lazyTimes= true;
+    std::lock_guard<std::mutex> guard(this->lazyLock);
+    this->lazyInodes.push_back(ino);
+}
+
+/// @brief Write the inodes whose times changed in memory only.
+///
+/// Called before the journal is committed, with the journal lock held for writing, so the times go to the container
+/// together with the other changes of the transaction.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeLazyInodes() {
+    std::vector<uint32_t> inodes;
+    {
+        std::lock_guard<std::mutex> guard(this->lazyLock);
+        inodes.swap(this->lazyInodes);
+    }
+
+    int ret= 0;
+    for(size_t i= 0; i < inodes.size(); i++) {
+        uint32_t ino= inodes[i];
+        // read access keeps readers out, which change atime with the lock held for writing
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+        this->inodeInfo[ino].lazyTimes= false;
+        int r= writeInode(ino);
+        if(ret >= 0 && r < 0)
+            ret= r;
+    }
+
+    return ret;
+}
+
+/// @brief Update the access time of a file after a read, see MyFS::isAtimeStale().
+///
+/// The new access time is kept in memory until the next commit, like the times of writes, see updateInode(). The inode
+/// lock must not be held.
+/// \param [in] ino Inode number.
+void MyOnDiskFS::accessFile(uint32_t ino) {
+    int64_t now= time(NULL);
+    MyFsInode *inode= &this->inodes[ino];
+    {
+        ReadGuard inodeGuard(this->inodeLocks.get(ino));
+        if(!isAtimeStale(inode->atime, inode->mtime, inode->ctime, now))
+            return;
+    }
+
+    WriteGuard inodeGuard(this->inodeLocks.get(ino));
+    if(isAtimeStale(inode->atime, inode->mtime, inode->ctime, now) && inode->mode != 0) {
+        inode->atime= now;
+        markLazy(ino);
+    }
+}
+
+/// @brief Write the superblock.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeSuperBlock() {
+    return writeMeta(0, 0, &this->superBlock, sizeof(MyFsSuperBlock));
+}
+
+/// @brief Read a block of the directory.
+/// \param [in] dirBlock Number of the block within the directory.
+/// \param [out] block Buffer for the block.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readDirBlock(uint32_t dirBlock, char *block) {
+    uint32_t blockNo;
+    int ret= mapBlocks(ROOT_INODE, dirBlock, 1, &blockNo);
+    if(ret >= 0 && blockNo == 0)
+        ret= -EIO;
+    if(ret >= 0)
+        ret= readMetaBlock(blockNo, block);
+    return ret;
+}
+
+/// @brief Write a block of the directory.
+/// \param [in] dirBlock Number of the block within the directory.
+/// \param [in] block Content of the block.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeDirBlock(uint32_t dirBlock, char *block) {
+    uint32_t blockNo;
+    int ret= mapBlocks(ROOT_INODE, dirBlock, 1, &blockNo);
+    if(ret >= 0 && blockNo == 0)
+        ret= -EIO;
+    if(ret >= 0)
+        ret= writeMetaBlock(blockNo, block);
+    return ret;
+}
+
+/// @brief Read the entries of all directories into the directory index.
+///
+/// Must be called after all inodes have been read, the directory of each entry is checked. Like all meta data, the
+/// directory blocks are written through the journal, which keeps no block checksums. They are read as meta data
+/// blocks, so their checksums stay unknown instead of being taken from content that changes with the next entry.
+/// \return 0 on success, -EIO if the directory is corrupt, -ERRNO on other failures.
+int MyOnDiskFS::loadDir() {
+    this->dirIndex.clear();
+
+    MyFsInode *root= &this->inodes[ROOT_INODE];
+    uint32_t numBlocks= this->inodeInfo[ROOT_INODE].numBlocks;
+    if(!S_ISDIR(root->mode) || numBlocks < this->superBlock.dirBuckets ||
+       root->size != (uint64_t) numBlocks * this->blockSize) {
+        LOG("ERROR: Root directory is corrupt");
+        return -EIO;
+    }
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    MyFsDirBlockHeader *header= (MyFsDirBlockHeader *) block;
+    char name[NAME_LENGTH + 1];
+    for(uint32_t b= 0; b < numBlocks; b++) {
+        int ret= readDirBlock(b, block);
+        if(ret < 0)
+            return ret;
+
+        size_t pos= sizeof(MyFsDirBlockHeader);
+        while(pos < header->used) {
+            MyFsDirRecord *record= (MyFsDirRecord *) (block + pos);
+            if(header->used > this->blockSize || pos + sizeof(MyFsDirRecord) > header->used ||
+               record->nameLength == 0 || record->nameLength > NAME_LENGTH ||
+               record->length < DIR_RECORD_SIZE(record->nameLength) || pos + record->length > header->used ||
+               record->inode == ROOT_INODE || record->inode >= this->superBlock.numInodes ||
+               record->parent == record->inode || record->parent >= this->superBlock.numInodes ||
+               !S_ISDIR(this->inodes[record->parent].mode)) {
+                LOGF("ERROR: Directory block %u is corrupt", b);
+                return -EIO;
+            }
+
+            memcpy(name, block + pos + sizeof(MyFsDirRecord), record->nameLength);
+            name[record->nameLength]= '\0';
+            if(this->dirIndex.find(record->parent, name) >= 0) {
+                LOGF("ERROR: Duplicate directory entry %u/%s", record->parent, name);
+                return -EIO;
+            }
+            this->dirIndex.insert(record->parent, name, record->inode, b);
+
+            pos+= record->length;
+        }
+    }
+
+    return 0;
+}
+
+/// @brief Rebuild the directory with a new number of buckets.
+///
+/// All entries are laid out in memory, overflow blocks are appended behind the buckets as needed. The directory is
+/// then resized and written block by block, the blocks are logged by the journal.
+/// \param [in] numBuckets New number of buckets.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::rehashDir(uint32_t numBuckets) {
+    std::vector<char> image((size_t) numBuckets * this->blockSize, 0);
+    std::vector<uint32_t> last(numBuckets);     // last block of the chain of each bucket
+    for(uint32_t b= 0; b < numBuckets; b++) {
+        last[b]= b;
+        ((MyFsDirBlockHeader *) &image[(size_t) b * this->blockSize])->used= sizeof(MyFsDirBlockHeader);
+    }
+
+    for(int e= 0; e < this->dirIndex.end(); e++) {
+        if(!this->dirIndex.isUsed(e))
+            continue;
+
+        const char *name= this->dirIndex.getName(e);
+        size_t nameLength= strlen(name);
+        size_t length= DIR_RECORD_SIZE(nameLength);
+        uint32_t bucket= this->dirIndex.getHash(e) % numBuckets;
+
+        MyFsDirBlockHeader *header= (MyFsDirBlockHeader *) &image[(size_t) last[bucket] * this->blockSize];
+        if(header->used + length > DIR_BLOCK_SPACE(this->blockSize)) {
+            uint32_t next= (uint32_t) (image.size() / this->blockSize);
+            header->next= next;
+            image.resize(image.size() + this->blockSize, 0);
+            last[bucket]= next;
+            header= (MyFsDirBlockHeader *) &image[(size_t) next * this->blockSize];
+            header->used= sizeof(MyFsDirBlockHeader);
+        }
+
+        MyFsDirRecord *record= (MyFsDirRecord *) ((char *) header + header->used);
+        record->inode= this->dirIndex.getInode(e);
+        record->parent= this->dirIndex.getParent(e);
+        record->hash= this->dirIndex.getHash(e);
+        record->length= (uint16_t) length;
+        record->nameLength= (uint16_t) nameLength;
+        memcpy((char *) record + sizeof(MyFsDirRecord), name, nameLength);
+        header->used+= (uint16_t) length;
+
+        this->dirIndex.setAux(e, last[bucket]);
+    }
+
+    uint32_t numBlocks= (uint32_t) (image.size() / this->blockSize);
+    uint32_t oldBlocks= this->inodeInfo[ROOT_INODE].numBlocks;
+    int ret= 0;
+    if(numBlocks > oldBlocks)
+        ret= growBlocks(ROOT_INODE, numBlocks);
+    else if(numBlocks < oldBlocks)
+        ret= shrinkBlocks(ROOT_INODE, numBlocks);
+    for(uint32_t b= 0; ret >= 0 && b < numBlocks; b++)
+        ret= writeDirBlock(b, &image[(size_t) b * this->blockSize]);
+
+    if(ret >= 0) {
+        MyFsInode *root= &this->inodes[ROOT_INODE];
+        root->size= image.size();
+        root->mtime= root->ctime= time(NULL);
+        ret= writeInode(ROOT_INODE);
+    }
+
+    if(ret >= 0) {
+        LOGF("Directory rehashed into %u buckets and %u overflow blocks", numBuckets, numBlocks - numBuckets);
+        this->superBlock.dirBuckets= numBuckets;
+        ret= writeSuperBlock();
+    }
+
+    return ret;
+}
+
+/// @brief Add an entry to the directory.
+///
+/// The entry goes to the first block of the chain of its bucket with enough space, a new overflow block is appended
+/// to the chain if there is none. The directory is rehashed into twice the number of buckets before the average
+/// number of entries per bucket exceeds DIR_BUCKET_LOAD, so chains stay short. The times of the directory holding
+/// the entry are left to the caller, see touchDir().
+/// \param [in] parent Inode number of the directory holding the entry.
+/// \param [in] name Name of the file.
+/// \param [in] ino Inode number of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::addDirEntry(uint32_t parent, const char *name, uint32_t ino) {
+    WriteGuard rootGuard(this->inodeLocks.get(ROOT_INODE));
+    MyFsInode *root= &this->inodes[ROOT_INODE];
+
+    int ret= 0;
+    if((uint64_t) this->dirIndex.size() + 1 > (uint64_t) this->superBlock.dirBuckets * DIR_BUCKET_LOAD)
+        ret= rehashDir(this->superBlock.dirBuckets * 2);
+
+    uint32_t hash= DirIndex::hash(parent, name);
+    size_t nameLength= strlen(name);
+    size_t length= DIR_RECORD_SIZE(nameLength);
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    MyFsDirBlockHeader *header= (MyFsDirBlockHeader *) block;
+    uint32_t dirBlock= hash % this->superBlock.dirBuckets;
+    bool grown= false;
+    while(ret >= 0) {
+        ret= readDirBlock(dirBlock, block);
+        if(ret < 0 || header->used + length <= DIR_BLOCK_SPACE(this->blockSize))
+            break;
+        if(header->next != 0) {
+            dirBlock= header->next;
+            continue;
+        }
+
+        // append an overflow block to the chain
+        uint32_t next= this->inodeInfo[ROOT_INODE].numBlocks;
+        ret= growBlocks(ROOT_INODE, next + 1);
+        if(ret >= 0) {
+            header->next= next;
+            ret= writeDirBlock(dirBlock, block);
+        }
+        root->size= (uint64_t) this->inodeInfo[ROOT_INODE].numBlocks * this->blockSize;
+        grown= true;
+
+        memset(block, 0, this->blockSize);
+        header->used= sizeof(MyFsDirBlockHeader);
+        dirBlock= next;
+        break;
+    }
+
+    if(ret >= 0) {
+        MyFsDirRecord *record= (MyFsDirRecord *) (block + header->used);
+        record->inode= ino;
+        record->parent= parent;
+        record->hash= hash;
+        record->length= (uint16_t) length;
+        record->nameLength= (uint16_t) nameLength;
+        memcpy((char *) record + sizeof(MyFsDirRecord), name, nameLength);
+        header->used+= (uint16_t) length;
+        ret= writeDirBlock(dirBlock, block);
+    }
+
+    if(ret >= 0) {
+        this->dirIndex.insert(parent, name, ino, dirBlock);
+        if(grown)
+            ret= writeInode(ROOT_INODE);
+    }
+
+    return ret;
+}
+
+/// @brief Remove an entry from the directory.
+///
+/// The following records of the directory block are moved up, so the position of other entries does not change.
+/// The times of the directory holding the entry are left to the caller, see touchDir().
+/// \param [in] entry Identifier of the entry in the directory index.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::removeDirEntry(int entry) {
+    WriteGuard rootGuard(this->inodeLocks.get(ROOT_INODE));
+
+    uint32_t dirBlock= this->dirIndex.getAux(entry);
+    uint32_t parent= this->dirIndex.getParent(entry);
+    const char *name= this->dirIndex.getName(entry);
+    size_t nameLength= strlen(name);
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    MyFsDirBlockHeader *header= (MyFsDirBlockHeader *) block;
+    int ret= readDirBlock(dirBlock, block);
+    if(ret < 0)
+        return ret;
+
+    size_t pos= sizeof(MyFsDirBlockHeader);
+    while(pos + sizeof(MyFsDirRecord) <= header->used) {
+        MyFsDirRecord *record= (MyFsDirRecord *) (block + pos);
+        size_t length= record->length;
+        if(length < sizeof(MyFsDirRecord) || pos + length > header->used)
+            break;
+
+        if(record->parent == parent && record->nameLength == nameLength &&
+           memcmp(block + pos + sizeof(MyFsDirRecord), name, nameLength) == 0) {
+            memmove(block + pos, block + pos + length, header->used - pos - length);
+            header->used-= (uint16_t) length;
+            memset(block + header->used, 0, this->blockSize - header->used);
+
+            ret= writeDirBlock(dirBlock, block);
+            if(ret >= 0)
+                this->dirIndex.remove(entry);
+            return ret;
+        }
+        pos+= length;
+    }
+
+    LOGF("ERROR: Entry %u/%s not found in directory block %u", parent, name, dirBlock);
+    return -EIO;
+}
+
+/// @brief Find a directory entry by name.
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the file.
+/// \return Identifier of the entry in the directory index, -1 if there is no file with this name.
+int MyOnDiskFS::findDirEntry(uint32_t parent, const char *name) {
+    return this->dirIndex.find(parent, name);
+}
+
+/// @brief Look up a name in a single directory, see MyFS::resolvePrefix().
+///
+/// The inode of the entry is read from the inode table if this has not happened yet.
+/// \param [in] dir Inode number of the directory.
+/// \param [in] name Name of the entry.
+/// \param [out] ino Inode number of the entry.
+/// \return 0 on success, -ENOENT if there is no such entry, -ENOTDIR if dir is not a directory, -ERRNO on other
+/// failures.
+int MyOnDiskFS::lookupEntry(uint32_t dir, const char *name, uint32_t *ino) {
+    if(!isDirectory(dir))
+        return -ENOTDIR;
+
+    int entry= findDirEntry(dir, name);
+    if(entry < 0)
+        return -ENOENT;
+
+    *ino= this->dirIndex.getInode(entry);
+    return loadInode(*ino);
+}
+
+/// @brief Check if an inode is a directory.
+///
+/// After a mount from the checkpoint the inode may not have been read yet, an inode that cannot be read is taken for
+/// a file.
+bool MyOnDiskFS::isDirectory(uint32_t ino) {
+    if(loadInode(ino) < 0)
+        return false;
+
+    ReadGuard inodeGuard(this->inodeLocks.get(ino));
+    return S_ISDIR(this->inodes[ino].mode);
+}
+
+/// @brief Create a file or a directory.
+///
+/// Must be called with the journal lock held for reading and the directory lock held for writing.
+/// \param [in] path Path of the new file, starting with "/".
+/// \param [in] mode Type and permissions of the file.
+/// \param [in] nlink Initial link count, 2 for directories.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::createFile(const char *path, mode_t mode, uint32_t nlink) {
+    uint32_t parent;
+    const char *name;
+    int ret= resolveParent(path, &parent, &name);
+    if(ret >= 0 && findDirEntry(parent, name) >= 0)
+        ret= -EEXIST;
+
+    int ino= -1;
+    if(ret >= 0) {
+        ino= allocInode();
+        if(ino < 0)
+            ret= ino;
+    }
+
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+
+        MyFsInode *inode= &this->inodes[ino];
+        int64_t now= time(NULL);
+        memset(inode, 0, sizeof(MyFsInode));
+        inode->mode= mode;
+        inode->nlink= nlink;
+        inode->uid= fuse_get_context()->uid;
+        inode->gid= fuse_get_context()->gid;
+        inode->atime= inode->mtime= inode->ctime= now;
+
+        this->inodeInfo[ino].extents.clear();
+        this->inodeInfo[ino].extentBlocks.clear();
+        this->inodeInfo[ino].numBlocks= 0;
+        this->inodeInfo[ino].usedBlocks= 0;
+        this->inodeInfo[ino].numCompressed= 0;
+        this->inodeInfo[ino].allocHint= 0;
+
+        ret= writeInode(ino);
+    }
+
+    if(ret >= 0) {
+        ret= addDirEntry(parent, name, ino);
+        if(ret >= 0) {
+            this->dentries.invalidate(path, false);
+            LOGF("Created %s with inode %d", path, ino);
+            ret= touchDir(parent, S_ISDIR(mode) ? 1 : 0);
+        } else {
+            // do not leak the inode if the directory is full
+            WriteGuard inodeGuard(this->inodeLocks.get(ino));
+            removeFile(ino);
+        }
+    } else if(ino >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        removeFile(ino);
+    }
+
+    return ret;
+}
+
+/// @brief Remove a directory entry together with its file.
+///
+/// Must be called with the journal lock held for reading and the directory lock held for writing. A directory must be
+/// empty.
+/// \param [in] entry Identifier of the entry in the directory index.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::removeEntry(int entry) {
+    uint32_t ino= this->dirIndex.getInode(entry);
+    uint32_t parent= this->dirIndex.getParent(entry);
+    bool isDir= isDirectory(ino);
+
+    int ret= removeDirEntry(entry);
+    if(ret >= 0)
+        ret= touchDir(parent, isDir ? -1 : 0);
+    if(ret >= 0) {
+        WriteGuard inodeGuard(this->inodeLocks.get(ino));
+        ret= removeFile(ino);
+    }
+
+    return ret;
+}
+
+/// @brief Record a change of the entries of a directory.
+/// \param [in] dir Inode number of the directory.
+/// \param [in] nlinkDelta Change of the link count, +1 or -1 when a subdirectory is added or removed.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::touchDir(uint32_t dir, int nlinkDelta) {
+    WriteGuard inodeGuard(this->inodeLocks.get(dir));
+
+    int ret= loadInode(dir);
+    if(ret >= 0) {
+        MyFsInode *inode= &this->inodes[dir];
+        inode->nlink+= nlinkDelta;
+        inode->mtime= inode->ctime= time(NULL);
+        ret= writeInode(dir);
+    }
+
+    return ret;
+}
+
+/// @brief Allocate a free inode.
+/// \return Inode number, -ENOSPC if all inodes are in use.
+int MyOnDiskFS::allocInode() {
+    uint32_t ino, count;
+    {
+        std::lock_guard<std::mutex> guard(this->allocLock);
+        if(!this->inodeMap.allocate(ROOT_INODE + 1, 1, &ino, &count))
+            return -ENOSPC;
+        updateFreeCounts();
+    }
+
+    // the other inodes of the block must not be overwritten when it is read later
+    int ret= loadInode(ino);
+    if(ret < 0) {
+        std::lock_guard<std::mutex> guard(this->allocLock);
+        this->inodeMap.release(ino, 1);
+        updateFreeCounts();
+        return ret;
+    }
+    return (int) ino;
+}
+
+/// @brief Allocate a run of free blocks.
+///
+/// Up to want consecutive free blocks are taken from the free block map, searching from hint (see
+/// BlockBitmap::allocate()). Only the words of the map holding the allocated bits are written back. The checksums of
+/// the blocks become unknown until they are written. Blocks freed by the running transaction are not taken, see
+/// freeBlocks(); if they are all that is left, the commit thread is woken up to give them back early.
+/// \param [in] hint Preferred first block, e.g. the block following the last block of a file. 0 for no preference.
+/// \param [in] want Number of blocks wanted.
+/// \param [out] start First allocated block.
+/// \param [out] count Number of allocated blocks, 1 <= count <= want.
+/// \return 0 on success, -ENOSPC if there is no free block, -ERRNO on other failures.
+int MyOnDiskFS::allocateBlocks(uint32_t hint, uint32_t want, uint32_t *start, uint32_t *count) {
+    std::lock_guard<std::mutex> guard(this->allocLock);
+
+    if(hint < this->superBlock.dataStart || hint >= this->superBlock.numBlocks)
+        hint= this->allocHint;
+
+    if(!this->bitmap.allocate(hint, want, start, count)) {
+        if(this->numFreed > 0)
+            this->commitCond.notify_one();
+        return -ENOSPC;
+    }
+    updateFreeCounts();
+
+    uint32_t end= *start + *count;
+    this->allocHint= end < this->superBlock.numBlocks ? end : this->superBlock.dataStart;
+    if(this->checksums != NULL) {
+        for(uint32_t b= *start; b < end; b++)
+            this->checksums[b].store(0, std::memory_order_relaxed);
+    }
+
+    return writeBitmap(*start, *count);
+}
+
+/// @brief Free a run of blocks.
+///
+/// The blocks are free in the map logged by the running transaction, but the allocator only gets them back once that
+/// transaction has committed, see releaseFreed(). Otherwise another file could store data in them before the free
+/// reaches the journal, and after a crash both files would share the blocks.
+/// Data blocks of a file with spliced reads in flight are pinned until its last splicing handle is released, see
+/// unpinBlocks(), because FUSE may still read them from the container.
+/// \param [in] start First block.
+/// \param [in] count Number of blocks.
+/// \param [in] owner In-memory info of the file whose data blocks are freed, NULL for other blocks.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::freeBlocks(uint32_t start, uint32_t count, MyFsInodeInfo *owner) {
+    if(count == 0)
+        return 0;
+
+    std::lock_guard<std::mutex> guard(this->allocLock);
+
+    for(uint32_t b= start; b < start + count; b++)
+        this->freedMap[b / 64]|= (uint64_t) 1 << (b % 64);
+    if(owner != NULL && owner->spliceRefs > 0) {
+        owner->pinnedRuns.push_back(std::make_pair(start, count));
+        this->numPinned+= count;
+    } else {
+        this->freedRuns.push_back(std::make_pair(start, count));
+        this->numFreed+= count;
+    }
+    this->journal->revoke(start, count);
+
+    return writeBitmap(start, count);
+}
+
+/// @brief Log the bytes of the free block map covering a run of blocks.
+///
+/// The blocks freed by the running transaction are written as free, although the in-memory map still has them used.
+/// Must be called with the allocation lock held.
+/// \param [in] start First block of the run.
+/// \param [in] count Number of blocks.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeBitmap(uint32_t start, uint32_t count) {
+    size_t first= start / 8;
+    size_t size= (start + count - 1) / 8 - first + 1;
+    const uint8_t *used= this->bitmap.getData() + first;
+    const uint8_t *freed= (const uint8_t *) this->freedMap.data() + first;
+
+    std::vector<uint8_t> bytes(size);
+    for(size_t i= 0; i < size; i++)
+        bytes[i]= used[i] & ~freed[i];
+
+    return writeMeta(this->superBlock.bitmapStart, first, bytes.data(), size);
+}
+
+/// @brief Give the blocks freed by a committed transaction to the allocator.
+///
+/// The map in the container has them free already, only the in-memory map and the free counts change.
+void MyOnDiskFS::releaseFreed() {
+    std::lock_guard<std::mutex> guard(this->allocLock);
+
+    for(size_t r= 0; r < this->freedRuns.size(); r++) {
+        uint32_t start= this->freedRuns[r].first, count= this->freedRuns[r].second;
+        this->bitmap.release(start, count);
+        for(uint32_t b= start; b < start + count; b++)
+            this->freedMap[b / 64]&= ~((uint64_t) 1 << (b % 64));
+    }
+    this->freedRuns.clear();
+    this->numFreed= 0;
+    updateFreeCounts();
+}
+
+/// @brief Drop the splice reference of a released handle of a file.
+///
+/// Once the last handle that spliced from the file is gone, no read of FUSE refers to the blocks freed meanwhile. They
+/// join the blocks freed by the running transaction and go to the allocator with its commit.
+/// \param [in] ino Inode number.
+void MyOnDiskFS::unpinBlocks(uint32_t ino) {
+    std::lock_guard<std::mutex> guard(this->allocLock);
+
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    if(--info->spliceRefs > 0)
+        return;
+    for(size_t r= 0; r < info->pinnedRuns.size(); r++) {
+        this->freedRuns.push_back(info->pinnedRuns[r]);
+        this->numFreed+= info->pinnedRuns[r].second;
+        this->numPinned-= info->pinnedRuns[r].second;
+    }
+    info->pinnedRuns.clear();
+}
+
+/// @brief Read the extent list of an inode.
+///
+/// The extents stored in the inode and in its chain of extent blocks are collected in the in-memory inode info.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::loadExtents(uint32_t ino) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    info->extents.clear();
+    info->extentBlocks.clear();
+    info->numBlocks= 0;
+    info->usedBlocks= 0;
+    info->numCompressed= 0;
+    info->allocHint= 0;
+    info->dirtyCount= 0;
+    if(inode->mode == 0)
+        return 0;
+
+    uint32_t n= std::min(inode->numExtents, (uint32_t) INODE_NUM_EXTENTS);
+    info->extents.assign(inode->extents, inode->extents + n);
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    MyFsExtentBlock *extentBlock= (MyFsExtentBlock *) block;
+    uint32_t blockNo= inode->extentBlock;
+    while(blockNo != 0 && info->extents.size() < inode->numExtents) {
+        int ret= readMetaBlock(blockNo, block);
+        if(ret < 0)
+            return ret;
+        if(extentBlock->count > EXTENTS_PER_BLOCK(this->blockSize))
+            break;
+        info->extentBlocks.push_back(blockNo);
+        info->extents.insert(info->extents.end(), extentBlock->extents, extentBlock->extents + extentBlock->count);
+        blockNo= extentBlock->next;
+    }
+
+    if(info->extents.size() != inode->numExtents) {
+        LOGF("ERROR: Extent list of inode %u is corrupt", ino);
+        return -EIO;
+    }
+
+    for(size_t e= 0; e < info->extents.size(); e++) {
+        info->usedBlocks+= storedBlocks(&info->extents[e]);
+        if(info->extents[e].compressed != 0)
+            info->numCompressed++;
+    }
+    updateBlockEnd(ino);
+
+    return 0;
+}
+
+/// @brief Store the extent list of an inode.
+///
+/// The first extents are copied into the inode, the remaining ones into its chain of extent blocks. The chain is
+/// extended or shortened as needed, only blocks holding extents from index from on are rewritten. The inode itself
+/// is not written.
+/// \param [in] ino Inode number.
+/// \param [in] from Index of the first changed extent.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::saveExtents(uint32_t ino, uint32_t from) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    std::vector<MyFsExtent> &extents= info->extents;
+    int ret= 0;
+
+    uint32_t n= (uint32_t) extents.size();
+    inode->numExtents= n;
+    memset(inode->extents, 0, sizeof(inode->extents));
+    memcpy(inode->extents, extents.data(), std::min(n, (uint32_t) INODE_NUM_EXTENTS) * sizeof(MyFsExtent));
+
+    uint32_t perBlock= (uint32_t) EXTENTS_PER_BLOCK(this->blockSize);
+    uint32_t numChain= n > INODE_NUM_EXTENTS ? (n - INODE_NUM_EXTENTS + perBlock - 1) / perBlock : 0;
+    uint32_t firstChanged= from > INODE_NUM_EXTENTS ? (from - INODE_NUM_EXTENTS) / perBlock : 0;
+
+    // the next pointer of the last block changes if the chain grows or shrinks
+    uint32_t oldChain= (uint32_t) info->extentBlocks.size();
+    if(oldChain != numChain && oldChain > 0 && numChain > 0)
+        firstChanged= std::min(firstChanged, std::min(oldChain, numChain) - 1);
+
+    while(info->extentBlocks.size() < numChain) {
+        uint32_t hint= info->extentBlocks.empty() ? 0 : info->extentBlocks.back() + 1;
+        uint32_t blockNo, count;
+        ret= allocateBlocks(hint, 1, &blockNo, &count);
+        if(ret < 0)
+            return ret;
+        info->extentBlocks.push_back(blockNo);
+    }
+    while(info->extentBlocks.size() > numChain) {
+        ret= freeBlocks(info->extentBlocks.back(), 1);
+        if(ret < 0)
+            return ret;
+        info->extentBlocks.pop_back();
+    }
+    inode->extentBlock= numChain > 0 ? info->extentBlocks[0] : 0;
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    MyFsExtentBlock *extentBlock= (MyFsExtentBlock *) block;
+    for(uint32_t c= firstChanged; c < numChain; c++) {
+        uint32_t first= INODE_NUM_EXTENTS + c * perBlock;
+        memset(block, 0, this->blockSize);
+        extentBlock->next= c + 1 < numChain ? info->extentBlocks[c + 1] : 0;
+        extentBlock->count= std::min(n - first, perBlock);
+        memcpy(extentBlock->extents, &extents[first], extentBlock->count * sizeof(MyFsExtent));
+        ret= writeMetaBlock(info->extentBlocks[c], block);
+        if(ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/// @brief Find the first extent of a file that ends behind a file block.
+///
+/// The extent list is searched binary, so the cost does not grow with the offset within the file.
+/// \param [in] ino Inode number.
+/// \param [in] block File block.
+/// \return Index of the extent holding the block or, if the block lies in a hole, of the extent behind the hole. The
+/// number of extents if there is none.
+size_t MyOnDiskFS::findExtent(uint32_t ino, uint32_t block) const {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    size_t lo= 0, hi= extents.size();
+    while(lo < hi) {
+        size_t mid= (lo + hi) / 2;
+        if(extents[mid].logical + extents[mid].length <= block)
+            lo= mid + 1;
+        else
+            hi= mid;
+    }
+
+    return lo;
+}
+
+/// @brief Map file blocks to container blocks.
+///
+/// The extent holding the first block is found by findExtent(). Sequential transfers through an open file skip the
+/// search: the cursor of the file handle remembers the extent of the last transfer, which is tried first together
+/// with the extent behind it. Blocks in holes of the file, i.e. blocks that have never been written, are mapped to
+/// block 0, which holds the superblock and never belongs to a file. Blocks of compressed clusters have no container
+/// block of their own, see readCluster().
+/// \param [in] ino Inode number.
+/// \param [in] first First file block.
+/// \param [in] count Number of file blocks.
+/// \param [out] blocks Array of count container block numbers, 0 for holes.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 0 on success, -EIO if a block lies in a compressed cluster.
+int MyOnDiskFS::mapBlocks(uint32_t ino, uint32_t first, uint32_t count, uint32_t *blocks,
+                          std::atomic<uint32_t> *cursor) {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    // the cursor is only a hint, the extents may have changed since it was stored
+    size_t lo= cursor != NULL ? cursor->load(std::memory_order_relaxed) : extents.size();
+    if(lo < extents.size() && extents[lo].logical + extents[lo].length <= first)
+        lo++;
+    if(lo >= extents.size() || first < extents[lo].logical || first >= extents[lo].logical + extents[lo].length)
+        lo= findExtent(ino, first);
+
+    for(uint32_t i= 0; i < count; i++) {
+        uint32_t logical= first + i;
+        while(lo < extents.size() && logical >= extents[lo].logical + extents[lo].length)
+            lo++;
+        if(lo == extents.size() || logical < extents[lo].logical)
+            blocks[i]= 0;
+        else if(extents[lo].compressed != 0)
+            return -EIO;
+        else
+            blocks[i]= extents[lo].start + (logical - extents[lo].logical);
+    }
+    if(cursor != NULL)
+        cursor->store((uint32_t) lo, std::memory_order_relaxed);
+
+    return 0;
+}
+
+/// @brief Count the allocated blocks in a range of file blocks.
+/// \param [in] ino Inode number.
+/// \param [in] first First file block.
+/// \param [in] count Number of file blocks.
+/// \return Number of blocks of the range that do not lie in a hole.
+uint32_t MyOnDiskFS::countBlocks(uint32_t ino, uint32_t first, uint32_t count) const {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    uint32_t end= first + count;
+    uint32_t used= 0;
+    for(size_t e= findExtent(ino, first); e < extents.size() && extents[e].logical < end; e++)
+        used+= std::min(end, extents[e].logical + extents[e].length) - std::max(first, extents[e].logical);
+
+    return used;
+}
+
+/// @brief Allocate the blocks of the holes in a range of a file.
+///
+/// The blocks filling a hole are placed at the distance from the extent in front of the hole they have within the
+/// file if possible, so the extent in front just grows and, if the hole is filled completely, merges with the extent
+/// behind it. Holes at the start of a file use the next-fit hint of the file, files without blocks start at the
+/// global next-fit position. Blocks of the range that are allocated already are left alone.
+/// \param [in] ino Inode number.
+/// \param [in] first First file block.
+/// \param [in] end File block behind the range.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fillBlocks(uint32_t ino, uint32_t first, uint32_t end) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    std::vector<MyFsExtent> &extents= info->extents;
+
+    uint32_t from= (uint32_t) extents.size();
+    size_t e= findExtent(ino, first);
+    uint32_t pos= first;
+    int ret= 0;
+
+    while(pos < end) {
+        if(e < extents.size() && extents[e].logical <= pos) {
+            pos= extents[e].logical + extents[e].length;
+            e++;
+            continue;
+        }
+
+        uint32_t holeEnd= e < extents.size() ? std::min(end, extents[e].logical) : end;
+        uint32_t hint= info->allocHint;
+        if(e > 0)
+            hint= extents[e - 1].compressed != 0 ? extents[e - 1].start + storedBlocks(&extents[e - 1]) :
+                  extents[e - 1].start + (pos - extents[e - 1].logical);
+        uint32_t start, count;
+        ret= allocateBlocks(hint, holeEnd - pos, &start, &count);
+        if(ret < 0)
+            break;
+
+        if(e > 0 && extents[e - 1].compressed == 0 && extents[e - 1].logical + extents[e - 1].length == pos &&
+           extents[e - 1].start + extents[e - 1].length == start) {
+            extents[e - 1].length+= count;
+            from= std::min(from, (uint32_t) e - 1);
+        } else {
+            MyFsExtent extent= { pos, start, count, 0 };
+            extents.insert(extents.begin() + e, extent);
+            from= std::min(from, (uint32_t) e);
+            e++;
+        }
+        info->usedBlocks+= count;
+        pos+= count;
+
+        // the extent behind may be contiguous now
+        MyFsExtent *last= &extents[e - 1];
+        if(e < extents.size() && extents[e].compressed == 0 && last->logical + last->length == extents[e].logical &&
+           last->start + last->length == extents[e].start) {
+            last->length+= extents[e].length;
+            extents.erase(extents.begin() + e);
+        }
+    }
+
+    updateBlockEnd(ino);
+
+    int r= saveExtents(ino, from);
+    return ret < 0 ? ret : r;
+}
+
+/// @brief Allocate blocks at the end of a file.
+///
+/// New blocks are placed at the next-fit hint of the file, i.e. right behind its last block if possible, so the last
+/// extent just grows.
+/// \param [in] ino Inode number.
+/// \param [in] numBlocks New number of blocks of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::growBlocks(uint32_t ino, uint32_t numBlocks) {
+    return fillBlocks(ino, this->inodeInfo[ino].numBlocks, numBlocks);
+}
+
+/// @brief Free the blocks at the end of a file.
+///
+/// A compressed cluster that is cut in the middle is stored raw first.
+/// \param [in] ino Inode number.
+/// \param [in] numBlocks New number of blocks of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::shrinkBlocks(uint32_t ino, uint32_t numBlocks) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    std::vector<MyFsExtent> &extents= info->extents;
+
+    int ret= 0;
+    if(info->numCompressed > 0) {
+        size_t e= findExtent(ino, numBlocks);
+        if(e < extents.size() && extents[e].compressed != 0 && extents[e].logical < numBlocks)
+            ret= expandCluster(ino, e);
+    }
+
+    uint32_t from= (uint32_t) extents.size();
+    while(ret >= 0 && !extents.empty() && extents.back().logical + extents.back().length > numBlocks) {
+        MyFsExtent *last= &extents.back();
+        if(last->compressed != 0) {
+            ret= releaseCluster(ino, extents.size() - 1);
+            from= std::min(from, (uint32_t) extents.size());
+            continue;
+        }
+        uint32_t cut= std::min(last->length, last->logical + last->length - numBlocks);
+
+        ret= freeBlocks(last->start + last->length - cut, cut, info);
+        last->length-= cut;
+        info->usedBlocks-= cut;
+        if(last->length == 0) {
+            extents.pop_back();
+            from= std::min(from, (uint32_t) extents.size());
+        } else {
+            from= std::min(from, (uint32_t) extents.size() - 1);
+        }
+    }
+    updateBlockEnd(ino);
+
+    int r= saveExtents(ino, from);
+    return ret < 0 ? ret : r;
+}
+
+/// @brief Number of container blocks of an extent.
+/// \param [in] extent The extent.
+/// \return Blocks holding the compressed data of a compressed cluster, the length of other extents.
+uint32_t MyOnDiskFS::storedBlocks(const MyFsExtent *extent) const {
+    return extent->compressed != 0 ? (extent->compressed + this->blockSize - 1) / this->blockSize : extent->length;
+}
+
+/// @brief Recompute the end of the block map and the next-fit hint of a file from its last extent.
+/// \param [in] ino Inode number.
+void MyOnDiskFS::updateBlockEnd(uint32_t ino) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    if(info->extents.empty()) {
+        info->numBlocks= 0;
+        info->allocHint= 0;
+    } else {
+        const MyFsExtent *last= &info->extents.back();
+        info->numBlocks= last->logical + last->length;
+        info->allocHint= last->start + storedBlocks(last);
+    }
+}
+
+/// @brief Free a compressed cluster of a file, its blocks become a hole.
+///
+/// The extent list is not saved.
+/// \param [in] ino Inode number.
+/// \param [in] e Index of the extent holding the cluster.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::releaseCluster(uint32_t ino, size_t e) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    MyFsExtent extent= info->extents[e];
+    uint32_t count= storedBlocks(&extent);
+    dropCluster(extent.start);
+    info->extents.erase(info->extents.begin() + e);
+    info->usedBlocks-= count;
+    info->numCompressed--;
+
+    return freeBlocks(extent.start, count, info);
+}
+
+/// @brief Read from a compressed cluster.
+///
+/// Clusters are decompressed as a whole. The last CLUSTER_CACHE_SIZE decompressed clusters are kept in the cluster
+/// cache, so reading a cluster piece by piece decompresses it only once.
+/// \param [in] extent Extent holding the cluster.
+/// \param [out] buf Buffer for storing the data.
+/// \param [in] offset Position of the first byte within the cluster.
+/// \param [in] size Number of bytes to read.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readCluster(const MyFsExtent *extent, char *buf, size_t offset, size_t size) {
+    {
+        std::lock_guard<std::mutex> guard(this->clusterLock);
+        for(size_t c= 0; c < this->clusterCache.size(); c++) {
+            MyFsCachedCluster *cached= &this->clusterCache[c];
+            if(cached->start == extent->start) {
+                cached->lastUse= ++this->clusterClock;
+                memcpy(buf, cached->data.data() + offset, size);
+                return 0;
+            }
+        }
+    }
+
+    uint32_t count= storedBlocks(extent);
+    std::vector<char> packed((size_t) count * this->blockSize);
+    int ret= this->blockCache->readBlocks(extent->start, count, packed.data());
+    if(ret < 0)
+        return ret;
+    if(verifyChecksums(extent->start, count, packed.data()) > 0)
+        return -EIO;
+
+    std::vector<char> data((size_t) extent->length * this->blockSize);
+    if(extent->compressed > packed.size() ||
+       Lz4Codec::decompress(packed.data(), extent->compressed, data.data(), data.size()) != (int) data.size()) {
+        LOGF("ERROR: Compressed cluster at block %u is corrupt", extent->start);
+        return -EIO;
+    }
+    memcpy(buf, data.data() + offset, size);
+
+    // replace the least recently used cluster, unless another reader has been faster
+    std::lock_guard<std::mutex> guard(this->clusterLock);
+    MyFsCachedCluster *victim= &this->clusterCache[0];
+    for(size_t c= 0; c < this->clusterCache.size(); c++) {
+        MyFsCachedCluster *cached= &this->clusterCache[c];
+        if(cached->start == extent->start)
+            return 0;
+        if(cached->lastUse < victim->lastUse)
+            victim= cached;
+    }
+    victim->start= extent->start;
+    victim->lastUse= ++this->clusterClock;
+    victim->data.swap(data);
+
+    return 0;
+}
+
+/// @brief Remove a cluster from the cluster cache once its blocks are freed.
+/// \param [in] start First container block of the cluster.
+void MyOnDiskFS::dropCluster(uint32_t start) {
+    std::lock_guard<std::mutex> guard(this->clusterLock);
+
+    for(size_t c= 0; c < this->clusterCache.size(); c++) {
+        MyFsCachedCluster *cached= &this->clusterCache[c];
+        if(cached->start == start) {
+            cached->start= 0;
+            cached->lastUse= 0;
+            std::vector<char>().swap(cached->data);
+        }
+    }
+}
+
+/// @brief Store a compressed cluster of a file raw.
+///
+/// Needed before parts of the cluster are written or the cluster is cut. The raw blocks are allocated and written
+/// while the compressed blocks still hold the data, these are only freed afterwards. If not enough blocks are free,
+/// the raw ones are given back and the cluster stays as it is.
+/// \param [in] ino Inode number.
+/// \param [in] e Index of the extent holding the cluster.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::expandCluster(uint32_t ino, size_t e) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    std::vector<MyFsExtent> &extents= info->extents;
+    MyFsExtent extent= extents[e];
+
+    std::vector<char> data((size_t) extent.length * this->blockSize);
+    int ret= readCluster(&extent, data.data(), 0, data.size());
+    if(ret < 0)
+        return ret;
+
+    // like fillBlocks(), the raw blocks follow the extent in front if possible
+    std::vector<MyFsExtent> runs;
+    std::vector<uint32_t> blocks(extent.length);
+    uint32_t hint= info->allocHint;
+    if(e > 0)
+        hint= extents[e - 1].compressed != 0 ? extents[e - 1].start + storedBlocks(&extents[e - 1]) :
+              extents[e - 1].start + (extent.logical - extents[e - 1].logical);
+    uint32_t pos= 0;
+    while(ret >= 0 && pos < extent.length) {
+        uint32_t start, count;
+        ret= allocateBlocks(hint, extent.length - pos, &start, &count);
+        if(ret < 0)
+            break;
+        MyFsExtent run= { extent.logical + pos, start, count, 0 };
+        runs.push_back(run);
+        for(uint32_t i= 0; i < count; i++)
+            blocks[pos + i]= start + i;
+        pos+= count;
+        hint= start + count;
+    }
+    if(ret >= 0)
+        ret= writeDataBlocks(blocks.data(), extent.length, data.data());
+    if(ret < 0) {
+        for(size_t r= 0; r < runs.size(); r++)
+            freeBlocks(runs[r].start, runs[r].length);
+        return ret;
+    }
+
+    ret= releaseCluster(ino, e);
+    extents.insert(extents.begin() + e, runs.begin(), runs.end());
+    info->usedBlocks+= extent.length;
+
+    // the runs may continue the extents around them
+    size_t last= e + runs.size() - 1;
+    if(last + 1 < extents.size() && extents[last + 1].compressed == 0 &&
+       extents[last].start + extents[last].length == extents[last + 1].start &&
+       extents[last].logical + extents[last].length == extents[last + 1].logical) {
+        extents[last].length+= extents[last + 1].length;
+        extents.erase(extents.begin() + last + 1);
+    }
+    if(e > 0 && extents[e - 1].compressed == 0 && extents[e - 1].start + extents[e - 1].length == extents[e].start &&
+       extents[e - 1].logical + extents[e - 1].length == extents[e].logical) {
+        extents[e - 1].length+= extents[e].length;
+        extents.erase(extents.begin() + e);
+        e--;
+    }
+    updateBlockEnd(ino);
+
+    int r= saveExtents(ino, (uint32_t) e);
+    return ret < 0 ? ret : r;
+}
+
+/// @brief Store the compressed clusters of a range of a file raw.
+/// \param [in] ino Inode number.
+/// \param [in] first First file block of the range.
+/// \param [in] end File block behind the range.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::expandClusters(uint32_t ino, uint32_t first, uint32_t end) {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    if(this->inodeInfo[ino].numCompressed == 0)
+        return 0;
+
+    size_t e= findExtent(ino, first);
+    while(e < extents.size() && extents[e].logical < end) {
+        if(extents[e].compressed == 0) {
+            e++;
+            continue;
+        }
+        int ret= expandCluster(ino, e);
+        if(ret < 0)
+            return ret;
+        e= findExtent(ino, first);
+    }
+
+    return 0;
+}
+
+/// @brief Take the compressed clusters overlapping the buffered blocks of a file into the buffer.
+///
+/// The buffered run grows to cover these clusters completely and their blocks are freed, so flushFile() compresses
+/// them again together with the new data.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::absorbClusters(uint32_t ino) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+    std::vector<MyFsExtent> &extents= info->extents;
+
+    if(info->numCompressed == 0 || info->dirtyCount == 0)
+        return 0;
+
+    uint32_t from= (uint32_t) extents.size();
+    size_t e= findExtent(ino, info->dirtyFirst);
+    int ret= 0;
+    while(e < extents.size() && extents[e].logical < info->dirtyFirst + info->dirtyCount) {
+        if(extents[e].compressed == 0) {
+            e++;
+            continue;
+        }
+
+        MyFsExtent extent= extents[e];
+        std::vector<char> data((size_t) extent.length * this->blockSize);
+        ret= readCluster(&extent, data.data(), 0, data.size());
+        if(ret < 0)
+            break;
+
+        // the parts of the cluster in front of and behind the run join it, the buffered content wins elsewhere
+        uint32_t dirtyEnd= info->dirtyFirst + info->dirtyCount;
+        uint32_t extentEnd= extent.logical + extent.length;
+        uint32_t newFirst= std::min(info->dirtyFirst, extent.logical);
+        uint32_t newEnd= std::max(dirtyEnd, extentEnd);
+        std::vector<char> &dirty= info->dirty;
+        dirty.insert(dirty.begin(), (size_t) (info->dirtyFirst - newFirst) * this->blockSize, 0);
+        dirty.resize((size_t) (newEnd - newFirst) * this->blockSize, 0);
+        if(extent.logical < info->dirtyFirst)
+            memcpy(dirty.data(), data.data(), (size_t) (info->dirtyFirst - extent.logical) * this->blockSize);
+        if(extentEnd > dirtyEnd)
+            memcpy(dirty.data() + (size_t) (dirtyEnd - newFirst) * this->blockSize,
+                   data.data() + (size_t) (dirtyEnd - extent.logical) * this->blockSize,
+                   (size_t) (extentEnd - dirtyEnd) * this->blockSize);
+        this->numDirtyBlocks+= newEnd - newFirst - info->dirtyCount;
+        info->dirtyFirst= newFirst;
+        info->dirtyCount= newEnd - newFirst;
+
+        ret= releaseCluster(ino, e);
+        from= std::min(from, (uint32_t) e);
+        if(ret < 0)
+            break;
+    }
+    if(from == extents.size() && ret >= 0)
+        return 0;
+
+    updateBlockEnd(ino);
+    int r= saveExtents(ino, from);
+    return ret < 0 ? ret : r;
+}
+
+/// @brief Store a cluster of a file compressed.
+///
+/// The cluster is compressed with LZ4 and written to as few contiguous blocks as needed. Clusters that do not save at
+/// least one block or for which no contiguous run of blocks is free are left to the caller, to be stored raw. The
+/// blocks of the cluster must be holes.
+/// \param [in] ino Inode number.
+/// \param [in] first First file block of the cluster.
+/// \param [in] count Number of file blocks of the cluster.
+/// \param [in] data Content of the cluster, count blocks.
+/// \return 1 if the cluster was stored compressed, 0 if not, -ERRNO on failure.
+int MyOnDiskFS::storeCluster(uint32_t ino, uint32_t first, uint32_t count, const char *data) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    if(count < 2)
+        return 0;
+
+    size_t size= (size_t) count * this->blockSize;
+    std::vector<char> packed(size - this->blockSize);
+    size_t n= Lz4Codec::compress(data, size, packed.data(), packed.size());
+    if(n == 0)
+        return 0;
+
+    uint32_t want= (uint32_t) ((n + this->blockSize - 1) / this->blockSize);
+    uint32_t start, got;
+    int ret= allocateBlocks(info->allocHint, want, &start, &got);
+    if(ret < 0)
+        return ret;
+    if(got < want) {
+        ret= freeBlocks(start, got);
+        return ret < 0 ? ret : 0;
+    }
+
+    memset(packed.data() + n, 0, (size_t) want * this->blockSize - n);
+    ret= this->blockCache->writeBlocks(start, want, packed.data());
+    if(ret < 0) {
+        freeBlocks(start, want);
+        return ret;
+    }
+    setChecksums(start, want, packed.data());
+
+    MyFsExtent extent= { first, start, count, (uint32_t) n };
+    size_t e= findExtent(ino, first);
+    info->extents.insert(info->extents.begin() + e, extent);
+    info->usedBlocks+= want;
+    info->numCompressed++;
+    updateBlockEnd(ino);
+
+    ret= saveExtents(ino, (uint32_t) e);
+    return ret < 0 ? ret : 1;
+}
+
+/// @brief Read from a file.
+///
+/// Buffered blocks that have not been written yet are taken from the buffer of the file.
+/// \param [in] ino Inode number.
+/// \param [out] buf Buffer for storing the data.
+/// \param [in] size Number of bytes to read.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return Number of bytes read, -ERRNO on failure.
+int MyOnDiskFS::readFile(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    if(offset >= (off_t) inode->size)
+        return 0;
+    if(offset + (off_t) size > (off_t) inode->size)
+        size= inode->size - offset;
+    if(size == 0)
+        return 0;
+
+    if(inode->flags & INODE_INLINE) {
+        memcpy(buf, inode->data + offset, size);
+        return (int) size;
+    }
+
+    off_t end= offset + size;
+    off_t dirtyStart= (off_t) info->dirtyFirst * this->blockSize;
+    off_t dirtyEnd= dirtyStart + (off_t) info->dirtyCount * this->blockSize;
+    int ret= 0;
+
+    if(info->dirtyCount == 0 || end <= dirtyStart || offset >= dirtyEnd) {
+        ret= readStored(ino, buf, size, offset, cursor);
+    } else {
+        // stored part in front of the buffered blocks, buffered part, stored part behind
+        if(offset < dirtyStart)
+            ret= readStored(ino, buf, dirtyStart - offset, offset, cursor);
+        off_t from= std::max(offset, dirtyStart);
+        off_t to= std::min(end, dirtyEnd);
+        memcpy(buf + (from - offset), info->dirty.data() + (from - dirtyStart), to - from);
+        if(ret >= 0 && end > dirtyEnd)
+            ret= readStored(ino, buf + (dirtyEnd - offset), end - dirtyEnd, dirtyEnd, cursor);
+    }
+
+    return ret < 0 ? ret : (int) size;
+}
+
+/// @brief Read ahead behind a read of an open file.
+///
+/// A read that starts where the last one of the handle ended counts as sequential. The read-ahead window starts with
+/// RA_MIN_BLOCKS blocks and doubles with each sequential read, up to RA_MAX_BLOCKS or a quarter of the block cache. The
+/// blocks of the window that have not been requested yet are read into the block cache in the background. Any other
+/// read closes the window again. Blocks that are only buffered, lie in holes or in compressed clusters are not read
+/// ahead.
+/// The caller must hold the inode lock.
+/// \param [in] handle Handle of the open file.
+/// \param [in] offset Position of the first byte read.
+/// \param [in] size Number of bytes read, at least 1.
+void MyOnDiskFS::readAhead(MyFsHandle *handle, off_t offset, size_t size) {
+    if((uint64_t) offset != handle->nextOffset.load(std::memory_order_relaxed)) {
+        handle->raWindow.store(0, std::memory_order_relaxed);
+        handle->raEnd.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t maxWindow= std::min((uint32_t) RA_MAX_BLOCKS, this->blockCache->getNumBlocks() / 4);
+    uint32_t window= handle->raWindow.load(std::memory_order_relaxed);
+    window= window == 0 ? std::min((uint32_t) RA_MIN_BLOCKS, maxWindow) : std::min(2 * window, maxWindow);
+    handle->raWindow.store(window, std::memory_order_relaxed);
+    if(window == 0)
+        return;
+
+    // only whole blocks that are allocated within the file size
+    MyFsInodeInfo *info= &this->inodeInfo[handle->ino];
+    uint32_t fileBlocks= (uint32_t) ((this->inodes[handle->ino].size + this->blockSize - 1) / this->blockSize);
+    uint32_t stored= std::min(fileBlocks, info->numBlocks);
+
+    uint32_t next= (uint32_t) ((offset + size) / this->blockSize);
+    uint32_t from= std::max(next, handle->raEnd.load(std::memory_order_relaxed));
+    uint32_t to= std::min(next + window, stored);
+    if(from >= to || from - next > window / 2)
+        return;
+
+    std::vector<uint32_t> blocks(to - from);
+    if(mapBlocks(handle->ino, from, to - from, blocks.data()) < 0)
+        return;
+
+    uint32_t b= 0;
+    while(b < blocks.size()) {
+        uint32_t run= 1;
+        while(b + run < blocks.size() && blocks[b + run] == blocks[b] + run)
+            run++;
+        if(blocks[b] != 0)
+            this->blockCache->prefetchAsync(blocks[b], run);
+        b+= run;
+    }
+    handle->raEnd.store(to, std::memory_order_relaxed);
+}
+
+/// @brief Read from the stored blocks of a file.
+///
+/// The range is split into compressed clusters, read by readCluster(), and the raw runs between them.
+/// \param [in] ino Inode number.
+/// \param [out] buf Buffer for storing the data.
+/// \param [in] size Number of bytes to read, at least 1.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readStored(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor) {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    if(this->inodeInfo[ino].numCompressed == 0)
+        return readRaw(ino, buf, size, offset, cursor);
+
+    off_t end= offset + size;
+    off_t pos= offset;
+    size_t e= findExtent(ino, (uint32_t) (offset / this->blockSize));
+    int ret= 0;
+    while(ret >= 0 && pos < end) {
+        off_t next= end;
+        if(e < extents.size() && extents[e].compressed != 0 && (off_t) extents[e].logical * this->blockSize <= pos) {
+            off_t clusterStart= (off_t) extents[e].logical * this->blockSize;
+            next= std::min(end, clusterStart + (off_t) extents[e].length * this->blockSize);
+            ret= readCluster(&extents[e], buf + (pos - offset), pos - clusterStart, next - pos);
+            e++;
+        } else {
+            // raw extents and holes up to the next compressed cluster
+            while(e < extents.size() && extents[e].compressed == 0)
+                e++;
+            if(e < extents.size())
+                next= std::min(end, (off_t) extents[e].logical * this->blockSize);
+            ret= readRaw(ino, buf + (pos - offset), next - pos, pos, cursor);
+        }
+        pos= next;
+    }
+
+    return ret;
+}
+
+/// @brief Read from stored blocks of a file outside of compressed clusters.
+///
+/// Holes read as zeros without accessing the container.
+/// \param [in] ino Inode number.
+/// \param [out] buf Buffer for storing the data.
+/// \param [in] size Number of bytes to read, at least 1.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readRaw(uint32_t ino, char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor) {
+    uint32_t first= (uint32_t) (offset / this->blockSize);
+    uint32_t count= (uint32_t) ((offset + size - 1) / this->blockSize) - first + 1;
+    std::vector<uint32_t> blocks(count);
+    int ret= mapBlocks(ino, first, count, blocks.data(), cursor);
+    if(ret < 0)
+        return ret;
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    size_t pos= offset % this->blockSize;
+    size_t done= 0;
+    uint32_t b= 0;
+
+    // partial first block
+    if(pos != 0 || size < this->blockSize) {
+        ret= readDataBlocks(&blocks[b], 1, block);
+        if(ret < 0)
+            return ret;
+        done= std::min(size, this->blockSize - pos);
+        memcpy(buf, block + pos, done);
+        b++;
+    }
+
+    // full blocks go directly into the buffer
+    uint32_t full= (uint32_t) ((size - done) / this->blockSize);
+    if(full > 0) {
+        ret= readDataBlocks(&blocks[b], full, buf + done);
+        if(ret < 0)
+            return ret;
+        done+= (size_t) full * this->blockSize;
+        b+= full;
+    }
+
+    // partial last block
+    if(done < size) {
+        ret= readDataBlocks(&blocks[b], 1, block);
+        if(ret < 0)
+            return ret;
+        memcpy(buf + done, block, size - done);
+    }
+
+    return 0;
+}
+
+#if FUSE_VERSION >= 29
+// A buffer of size bytes, read from position pos of the file descriptor, or a memory buffer without memory for fd -1.
+static struct fuse_buf makeBuf(size_t size, int fd, off_t pos) {
+    struct fuse_buf buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.size= size;
+    buf.flags= fd >= 0 ? (enum fuse_buf_flags) (FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK) : (enum fuse_buf_flags) 0;
+    buf.fd= fd;
+    buf.pos= pos;
+    return buf;
+}
+
+/// @brief Build the buffers of a read that FUSE splices from the container.
+///
+/// Each run of whole, physically contiguous blocks of the range becomes a file descriptor buffer of the container.
+/// Partial blocks at the ends, holes and blocks whose current content is not on the container yet, i.e. buffered
+/// blocks of the file and dirty blocks of the block cache, are read into memory buffers by readFile(). Allocated blocks
+/// have always been written once, so spliced blocks never lie beyond the end of the container.
+/// The caller must hold the inode lock.
+/// \param [in] ino Inode number.
+/// \param [in] size Number of bytes to read.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [out] bufp The buffer vector, allocated with malloc() like the memory of its buffers.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 1 on success, 0 if the read is not worth splicing, -ERRNO on failure.
+int MyOnDiskFS::spliceFile(uint32_t ino, size_t size, off_t offset, struct fuse_bufvec **bufp,
+                           std::atomic<uint32_t> *cursor) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    if(offset >= (off_t) inode->size || (inode->flags & INODE_INLINE) || info->numCompressed > 0)
+        return 0;
+    if(offset + (off_t) size > (off_t) inode->size)
+        size= inode->size - offset;
+
+    // whole blocks of the range
+    uint32_t first= (uint32_t) ((offset + this->blockSize - 1) / this->blockSize);
+    uint32_t end= (uint32_t) ((offset + size) / this->blockSize);
+    if(first >= end)
+        return 0;
+
+    std::vector<uint32_t> blocks(end - first);
+    int ret= mapBlocks(ino, first, end - first, blocks.data(), cursor);
+    if(ret < 0)
+        return ret;
+
+    uint32_t dirtyFirst= info->dirtyCount > 0 ? info->dirtyFirst : 0;
+    uint32_t dirtyEnd= dirtyFirst + info->dirtyCount;
+
+    // runs read from the container, the bytes between them are copied, their buffers keep the position in the file
+    std::vector<struct fuse_buf> bufs;
+    off_t pos= offset;
+    off_t blockPos= (off_t) first * this->blockSize;
+    int fd= this->blockDevice->getFileDescriptor();
+    uint32_t b= 0;
+    while(b < blocks.size()) {
+        uint32_t run= 1;
+        while(b + run < blocks.size() && blocks[b + run] == blocks[b] + run)
+            run++;
+
+        // runs end where the buffered blocks start or end, blocks dirty in the block cache are copied one by one
+        uint32_t logical= first + b;
+        if(logical < dirtyFirst)
+            run= std::min(run, dirtyFirst - logical);
+        else if(logical < dirtyEnd)
+            run= std::min(run, dirtyEnd - logical);
+        bool stored= blocks[b] != 0 && (logical < dirtyFirst || logical >= dirtyEnd);
+        if(stored) {
+            uint32_t clean= this->blockCache->countClean(blocks[b], run);
+            stored= clean > 0;
+            run= clean > 0 ? clean : 1;
+        }
+        if(stored) {
+            if(blockPos > pos)
+                bufs.push_back(makeBuf((size_t) (blockPos - pos), -1, pos));
+            bufs.push_back(makeBuf((size_t) run * this->blockSize, fd, (off_t) blocks[b] * this->blockSize));
+            pos= blockPos + (off_t) run * this->blockSize;
+        }
+        blockPos+= (off_t) run * this->blockSize;
+        b+= run;
+    }
+    if(offset + (off_t) size > pos)
+        bufs.push_back(makeBuf((size_t) (offset + size - pos), -1, pos));
+
+    struct fuse_bufvec *bufv= (struct fuse_bufvec *) malloc(sizeof(struct fuse_bufvec) +
+                                                            (bufs.size() - 1) * sizeof(struct fuse_buf));
+    if(bufv == NULL)
+        return -ENOMEM;
+    *bufv= FUSE_BUFVEC_INIT(0);
+    bufv->count= bufs.size();
+    memcpy(bufv->buf, bufs.data(), bufs.size() * sizeof(struct fuse_buf));
+
+    for(size_t i= 0; ret >= 0 && i < bufv->count; i++) {
+        struct fuse_buf *buf= &bufv->buf[i];
+        if(buf->flags & FUSE_BUF_IS_FD) {
+            this->bytesSpliced+= buf->size;
+            continue;
+        }
+        buf->mem= malloc(buf->size);
+        if(buf->mem == NULL)
+            ret= -ENOMEM;
+        else
+            ret= readFile(ino, (char *) buf->mem, buf->size, buf->pos, cursor);
+        buf->pos= 0;
+        this->bytesCopied+= buf->size;
+    }
+    if(ret < 0) {
+        for(size_t i= 0; i < bufv->count; i++)
+            free(bufv->buf[i].mem);
+        free(bufv);
+        return ret;
+    }
+
+    *bufp= bufv;
+
+    return 1;
+}
+#endif
+
+/// @brief Write to a file without buffering.
+///
+/// Only the blocks covering the range are allocated, right away, the inode is written, see updateInode(). A gap between
+/// the end of the file and offset stays a hole. The file must not have buffered blocks.
+/// \param [in] ino Inode number.
+/// \param [in] buf Content to write.
+/// \param [in] size Number of bytes to write.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeDirect(uint32_t ino, const char *buf, size_t size, off_t offset,
+                            std::atomic<uint32_t> *cursor) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInode before;
+    memcpy(&before, inode, sizeof(MyFsInode));
+    off_t end= offset + size;
+    int ret= 0;
+
+    // stored bytes between end of file and offset must read as zeros
+    if(offset > (off_t) inode->size)
+        ret= zeroFile(ino, inode->size, offset);
+    if(ret >= 0 && size > 0)
+        ret= writeFile(ino, buf, size, offset, cursor);
+
+    if(ret >= 0) {
+        if(end > (off_t) inode->size)
+            inode->size= end;
+        inode->mtime= inode->ctime= time(NULL);
+        ret= updateInode(ino, &before);
+    }
+
+    return ret;
+}
+
+/// @brief Buffer a write to a file (delayed allocation).
+///
+/// Each file buffers one run of consecutive blocks. A write is added to the run if it overlaps the run or is adjacent
+/// to it. A gap between the end of the file and the write is filled with zeros within the block holding the end of
+/// the file, whole blocks of the gap are left as a hole. Neither blocks are allocated nor the inode is written, this
+/// is done by flushFile() for the whole run at once, so small sequential writes end up in large extents written with
+/// a single call.
+/// \param [in] ino Inode number.
+/// \param [in] buf Content to write.
+/// \param [in] size Number of bytes to write, at least 1.
+/// \param [in] offset Position of the first byte within the file.
+/// \return 1 if the write was buffered, 0 if it does not fit to the run of buffered blocks, the buffers are full or a
+/// partial last block in front of a hole needs zeros, -ERRNO on failure.
+int MyOnDiskFS::bufferWrite(uint32_t ino, const char *buf, size_t size, off_t offset) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    off_t end= offset + size;
+    off_t from= offset;
+    if(offset > (off_t) inode->size) {
+        // writeDirect() zeros the rest of a partial last block that is not part of the write
+        off_t blockStart= offset - offset % this->blockSize;
+        if(inode->size % this->blockSize != 0 && (off_t) inode->size < blockStart)
+            return 0;
+        from= std::max((off_t) inode->size, blockStart);
+    }
+    uint32_t maxBlocks= DIRTY_MAX_SIZE / this->blockSize;
+    if((end - 1) / this->blockSize - from / this->blockSize >= maxBlocks)
+        return 0;
+
+    uint32_t first= (uint32_t) (from / this->blockSize);
+    uint32_t last= (uint32_t) ((end - 1) / this->blockSize);
+    uint32_t newFirst= first;
+    uint32_t newEnd= last + 1;
+    if(info->dirtyCount > 0) {
+        uint32_t dirtyEnd= info->dirtyFirst + info->dirtyCount;
+        if(newEnd < info->dirtyFirst || first > dirtyEnd)
+            return 0;
+        newFirst= std::min(newFirst, info->dirtyFirst);
+        newEnd= std::max(newEnd, dirtyEnd);
+    }
+    uint32_t added= newEnd - newFirst - info->dirtyCount;
+    if(newEnd - newFirst > maxBlocks || this->numDirtyBlocks + added > DIRTY_TOTAL_SIZE / this->blockSize)
+        return 0;
+
+    // stored blocks joining the run keep the content that is not overwritten
+    std::vector<char> buffer(2 * (size_t) this->blockSize);
+    char *head= buffer.data();
+    char *tail= head + this->blockSize;
+    bool loadHead= first < info->numBlocks && !(info->dirtyCount > 0 && first >= info->dirtyFirst) &&
+                   (from % this->blockSize != 0 || (first == last && end % this->blockSize != 0));
+    bool loadTail= last != first && last < info->numBlocks && !(info->dirtyCount > 0 && last < info->dirtyFirst +
+                   info->dirtyCount) && end % this->blockSize != 0;
+    int ret= 0;
+    if(loadHead)
+        ret= readStored(ino, head, this->blockSize, (off_t) first * this->blockSize);
+    if(ret >= 0 && loadTail)
+        ret= readStored(ino, tail, this->blockSize, (off_t) last * this->blockSize);
+    if(ret < 0)
+        return ret;
+
+    std::vector<char> &dirty= info->dirty;
+    if(info->dirtyCount == 0)
+        info->dirtyFirst= newFirst;
+    dirty.insert(dirty.begin(), (size_t) (info->dirtyFirst - newFirst) * this->blockSize, 0);
+    dirty.resize((size_t) (newEnd - newFirst) * this->blockSize, 0);
+    info->dirtyFirst= newFirst;
+    info->dirtyCount= newEnd - newFirst;
+    this->numDirtyBlocks+= added;
+
+    off_t start= (off_t) newFirst * this->blockSize;
+    if(loadHead)
+        memcpy(dirty.data() + ((off_t) first * this->blockSize - start), head, this->blockSize);
+    if(loadTail)
+        memcpy(dirty.data() + ((off_t) last * this->blockSize - start), tail, this->blockSize);
+    memset(dirty.data() + (from - start), 0, offset - from);
+    memcpy(dirty.data() + (offset - start), buf, size);
+
+    if(end > (off_t) inode->size) {
+        inode->size= end;
+        info->sizeChanged= true;
+    }
+    inode->mtime= inode->ctime= time(NULL);
+
+    return 1;
+}
+
+/// @brief Write to a small file stored in its inode.
+///
+/// Empty files without blocks and files stored in the inode take writes that end within INODE_INLINE_SIZE bytes, the
+/// inode is written. A write behind that limit moves the content of the inode out to a data block first.
+/// \param [in] ino Inode number.
+/// \param [in] buf Content to write.
+/// \param [in] size Number of bytes to write, at least 1.
+/// \param [in] offset Position of the first byte within the file.
+/// \return 1 if the write went into the inode, 0 if the file is not stored in its inode (anymore), -ERRNO on failure.
+int MyOnDiskFS::writeInline(uint32_t ino, const char *buf, size_t size, off_t offset) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    bool empty= inode->size == 0 && info->usedBlocks == 0 && info->dirtyCount == 0;
+    if(!(inode->flags & INODE_INLINE) && !empty)
+        return 0;
+    if(offset + size > INODE_INLINE_SIZE) {
+        int ret= moveInline(ino);
+        return ret < 0 ? ret : 0;
+    }
+
+    if(!(inode->flags & INODE_INLINE)) {
+        memset(inode->data, 0, INODE_INLINE_SIZE);
+        inode->flags|= INODE_INLINE;
+    }
+    memcpy(inode->data + offset, buf, size);
+    if(offset + size > inode->size)
+        inode->size= offset + size;
+    inode->mtime= inode->ctime= time(NULL);
+
+    int ret= writeInode(ino);
+    return ret < 0 ? ret : 1;
+}
+
+/// @brief Move the content of a file stored in its inode to a data block.
+///
+/// The content goes through the buffer of the file like any other write, so a small file that keeps growing gets its
+/// blocks allocated together. Files not stored in their inode are left alone.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::moveInline(uint32_t ino) {
+    MyFsInode *inode= &this->inodes[ino];
+
+    if(!(inode->flags & INODE_INLINE))
+        return 0;
+
+    char data[INODE_INLINE_SIZE];
+    size_t size= (size_t) inode->size;
+    memcpy(data, inode->data, size);
+    memset(inode->data, 0, INODE_INLINE_SIZE);
+    inode->flags&= ~INODE_INLINE;
+    inode->size= 0;
+
+    int ret= 0;
+    if(size > 0) {
+        ret= bufferWrite(ino, data, size, 0);
+        if(ret == 0)
+            ret= writeDirect(ino, data, size, 0);
+    }
+    if(ret < 0) {
+        // keep the content in the inode, blocks allocated so far are freed again
+        shrinkBlocks(ino, 0);
+        memcpy(inode->data, data, size);
+        inode->flags|= INODE_INLINE;
+        inode->size= size;
+        return ret;
+    }
+
+    return writeInode(ino);
+}
+
+/// @brief Write the buffered blocks of a file.
+///
+/// Missing blocks, behind the end of the file or in holes, are allocated at once, so they form as few extents as
+/// possible, and the run of buffered blocks is written with one call per extent. The inode is written afterwards, unless
+/// only its times changed, see updateInode(). If not all blocks can be allocated, the file is cut behind its last
+/// allocated block.
+///
+/// Compressed clusters the run overlaps are taken into the run first. With compression on, the run is written cluster
+/// by cluster: whole clusters, and the last cluster of the file, that are holes are stored compressed by
+/// storeCluster(), the others raw.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::flushFile(uint32_t ino) {
+    MyFsInode *inode= &this->inodes[ino];
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    if(info->dirtyCount == 0)
+        return 0;
+
+    MyFsInode before;
+    memcpy(&before, inode, sizeof(MyFsInode));
+
+    int ret= absorbClusters(ino);
+    uint32_t first= info->dirtyFirst;
+    uint32_t end= first + info->dirtyCount;
+    uint32_t fileBlocks= (uint32_t) ((inode->size + this->blockSize - 1) / this->blockSize);
+
+    uint32_t pos= first;
+    while(pos < end) {
+        uint32_t pieceEnd= this->compress ? std::min(end, (pos / this->clusterBlocks + 1) * this->clusterBlocks) : end;
+        uint32_t count= pieceEnd - pos;
+        char *data= info->dirty.data() + (size_t) (pos - first) * this->blockSize;
+
+        int r= 0;
+        if(this->compress && pos % this->clusterBlocks == 0 &&
+           (count == this->clusterBlocks || pieceEnd >= fileBlocks) && countBlocks(ino, pos, count) == 0)
+            r= storeCluster(ino, pos, count, data);
+
+        if(r == 0) {
+            // write what could be allocated, even if not all holes could be filled
+            r= fillBlocks(ino, pos, pieceEnd);
+            std::vector<uint32_t> blocks(count);
+            int w= mapBlocks(ino, pos, count, blocks.data());
+            if(w >= 0)
+                w= writeDataBlocks(blocks.data(), count, data);
+            if(r >= 0)
+                r= w;
+        }
+        if(ret >= 0 && r < 0)
+            ret= r;
+        pos= pieceEnd;
+    }
+
+    if(ret < 0 && inode->size > (uint64_t) info->numBlocks * this->blockSize) {
+        LOGF("ERROR: Writing buffered blocks of inode %u failed with error %d", ino, ret);
+        inode->size= (uint64_t) info->numBlocks * this->blockSize;
+    }
+
+    this->numDirtyBlocks-= info->dirtyCount;
+    info->dirty.clear();
+    info->dirtyCount= 0;
+
+    // bufferWrite() changed the size in memory only
+    int r= info->sizeChanged ? writeInode(ino) : updateInode(ino, &before);
+    info->sizeChanged= false;
+    return ret < 0 ? ret : r;
+}
+
+/// @brief Discard the buffered blocks of a file and free the buffer.
+/// \param [in] ino Inode number.
+void MyOnDiskFS::dropBuffer(uint32_t ino) {
+    MyFsInodeInfo *info= &this->inodeInfo[ino];
+
+    this->numDirtyBlocks-= info->dirtyCount;
+    std::vector<char>().swap(info->dirty);
+    info->dirtyCount= 0;
+    info->sizeChanged= false;
+}
+
+/// @brief Write to the stored blocks of a file.
+///
+/// Blocks of the range that lie in holes or behind the last block are allocated first. Partially written blocks are
+/// read, modified and written back, unless they have just been allocated. Compressed clusters of the range are stored
+/// raw first.
+/// \param [in] ino Inode number.
+/// \param [in] buf Content to write.
+/// \param [in] size Number of bytes to write, at least 1.
+/// \param [in] offset Position of the first byte within the file.
+/// \param [in,out] cursor Extent cursor of a file handle, NULL for none.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeFile(uint32_t ino, const char *buf, size_t size, off_t offset, std::atomic<uint32_t> *cursor) {
+    uint32_t first= (uint32_t) (offset / this->blockSize);
+    uint32_t count= (uint32_t) ((offset + size - 1) / this->blockSize) - first + 1;
+    std::vector<uint32_t> blocks(count);
+    int ret= expandClusters(ino, first, first + count);
+    if(ret >= 0)
+        ret= mapBlocks(ino, first, count, blocks.data(), cursor);
+    if(ret < 0)
+        return ret;
+
+    // only the first and the last block may be written partially
+    bool freshHead= blocks[0] == 0;
+    bool freshTail= blocks[count - 1] == 0;
+    if(countBlocks(ino, first, count) < count) {
+        ret= fillBlocks(ino, first, first + count);
+        if(ret >= 0)
+            ret= mapBlocks(ino, first, count, blocks.data(), cursor);
+        if(ret < 0)
+            return ret;
+    }
+
+    std::vector<char> buffer(this->blockSize);
+    char *block= buffer.data();
+    size_t pos= offset % this->blockSize;
+    size_t done= 0;
+    uint32_t b= 0;
+
+    // partial first block
+    if(pos != 0 || size < this->blockSize) {
+        if(freshHead)
+            memset(block, 0, this->blockSize);
+        else if((ret= this->blockCache->read(blocks[b], block)) < 0)
+            return ret;
+        else if(verifyChecksums(blocks[b], 1, block) > 0)
+            return -EIO;
+        done= std::min(size, this->blockSize - pos);
+        memcpy(block + pos, buf, done);
+        ret= this->blockCache->write(blocks[b], block);
+        if(ret < 0)
+            return ret;
+        setChecksums(blocks[b], 1, block);
+        b++;
+    }
+
+    // full blocks are written directly from the buffer
+    uint32_t full= (uint32_t) ((size - done) / this->blockSize);
+    if(full > 0) {
+        ret= writeDataBlocks(&blocks[b], full, (char *) buf + done);
+        if(ret < 0)
+            return ret;
+        done+= (size_t) full * this->blockSize;
+        b+= full;
+    }
+
+    // partial last block
+    if(done < size) {
+        if(freshTail)
+            memset(block, 0, this->blockSize);
+        else if((ret= this->blockCache->read(blocks[b], block)) < 0)
+            return ret;
+        else if(verifyChecksums(blocks[b], 1, block) > 0)
+            return -EIO;
+        memcpy(block, buf + done, size - done);
+        ret= this->blockCache->write(blocks[b], block);
+        if(ret < 0)
+            return ret;
+        setChecksums(blocks[b], 1, block);
+    }
+
+    return 0;
+}
+
+/// @brief Fill a range of a file with zeros.
+///
+/// Only the allocated blocks of the range are written, holes read as zeros anyway. Usually this is just the rest of
+/// the last block behind the end of the file.
+/// \param [in] ino Inode number.
+/// \param [in] from Position of the first byte.
+/// \param [in] to Position behind the last byte.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::zeroFile(uint32_t ino, off_t from, off_t to) {
+    const std::vector<MyFsExtent> &extents= this->inodeInfo[ino].extents;
+
+    to= std::min(to, (off_t) this->inodeInfo[ino].numBlocks * this->blockSize);
+    if(from >= to)
+        return 0;
+
+    int ret= expandClusters(ino, (uint32_t) (from / this->blockSize), (uint32_t) ((to - 1) / this->blockSize) + 1);
+    if(ret < 0)
+        return ret;
+
+    std::vector<char> zeros((size_t) std::min(to - from, (off_t) 64 * this->blockSize), 0);
+    for(size_t e= findExtent(ino, (uint32_t) (from / this->blockSize)); e < extents.size(); e++) {
+        off_t pos= std::max(from, (off_t) extents[e].logical * this->blockSize);
+        off_t end= std::min(to, (off_t) (extents[e].logical + extents[e].length) * this->blockSize);
+        if(pos >= to)
+            break;
+        while(pos < end) {
+            size_t n= (size_t) std::min(end - pos, (off_t) zeros.size());
+            ret= writeFile(ino, zeros.data(), n, pos);
+            if(ret < 0)
+                return ret;
+            pos+= n;
+        }
+    }
+
+    return 0;
+}
+
+/// @brief Change the size of a file.
+///
+/// Blocks behind the new end are freed. Growing a file allocates no blocks, the new bytes are a hole that reads as
+/// zeros. A file stored in its inode stays there as long as it fits.
+/// \param [in] ino Inode number.
+/// \param [in] newSize New size of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::resizeFile(uint32_t ino, off_t newSize) {
+    if(newSize < 0)
+        return -EINVAL;
+
+    MyFsInode *inode= &this->inodes[ino];
+    if((inode->flags & INODE_INLINE) && newSize <= INODE_INLINE_SIZE) {
+        if(newSize < (off_t) inode->size)
+            memset(inode->data + newSize, 0, inode->size - newSize);
+        inode->size= newSize;
+        inode->mtime= inode->ctime= time(NULL);
+        return writeInode(ino);
+    }
+
+    int ret= moveInline(ino);
+    if(ret >= 0)
+        ret= flushFile(ino);
+    if(ret < 0)
+        return ret;
+
+    uint32_t numBlocks= (uint32_t) ((newSize + this->blockSize - 1) / this->blockSize);
+
+    if(numBlocks < this->inodeInfo[ino].numBlocks)
+        ret= shrinkBlocks(ino, numBlocks);
+
+    if(ret >= 0 && newSize > (off_t) inode->size)
+        ret= zeroFile(ino, inode->size, newSize);
+
+    if(ret >= 0) {
+        inode->size= newSize;
+        inode->mtime= inode->ctime= time(NULL);
+        ret= writeInode(ino);
+    }
+
+    return ret;
+}
+
+/// @brief Free all blocks and the inode of a file.
+/// \param [in] ino Inode number.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::removeFile(uint32_t ino) {
+    int ret= loadInode(ino);
+    if(ret < 0)
+        return ret;
+
+    dropBuffer(ino);
+
+    ret= shrinkBlocks(ino, 0);
+
+    if(ret >= 0) {
+        memset(&this->inodes[ino], 0, sizeof(MyFsInode));
+        ret= writeInode(ino);
+    }
+
+    if(ret >= 0) {
+        std::lock_guard<std::mutex> guard(this->allocLock);
+        this->inodeMap.release(ino, 1);
+        updateFreeCounts();
+    }
+
+    return ret;
+}
+
+/// @brief Read a list of data blocks.
+///
+/// Read the blocks blocks[0], ..., blocks[count-1] into consecutive parts of the buffer. Runs of physically
+/// contiguous blocks are merged into a single multi-block read, whose blocks are then verified against their checksums
+/// in one batch. Holes, i.e. block number 0, read as zeros.
+/// \param [in] blocks Numbers of the blocks to read.
+/// \param [in] count Number of blocks.
+/// \param [out] buffer Buffer for storing the blocks, at least count blocks in size.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::readDataBlocks(const uint32_t *blocks, uint32_t count, char *buffer) {
+    uint32_t b= 0;
+    while(b < count) {
+        uint32_t run= 1;
+        while(b + run < count && blocks[b + run] == blocks[b] + run)
+            run++;
+
+        int ret= 0;
+        if(blocks[b] == 0) {
+            memset(buffer + (size_t) b * this->blockSize, 0, this->blockSize);
+            run= 1;
+        } else {
+            ret= this->blockCache->readBlocks(blocks[b], run, buffer + (size_t) b * this->blockSize);
+            if(ret >= 0 && verifyChecksums(blocks[b], run, buffer + (size_t) b * this->blockSize) > 0)
+                ret= -EIO;
+        }
+        if(ret < 0)
+            return ret;
+        b+= run;
+    }
+
+    return 0;
+}
+
+/// @brief Write a list of data blocks.
+///
+/// Write consecutive parts of the buffer to the blocks blocks[0], ..., blocks[count-1]. Runs of physically
+/// contiguous blocks are merged into a single multi-block write. Holes, i.e. block number 0, are skipped.
+/// \param [in] blocks Numbers of the blocks to write.
+/// \param [in] count Number of blocks.
+/// \param [in] buffer Buffer storing the content to write, at least count blocks in size.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeDataBlocks(const uint32_t *blocks, uint32_t count, char *buffer) {
+    uint32_t b= 0;
+    while(b < count) {
+        uint32_t run= 1;
+        while(b + run < count && blocks[b + run] == blocks[b] + run)
+            run++;
+
+        int ret= 0;
+        if(blocks[b] == 0) {
+            run= 1;
+        } else {
+            ret= this->blockCache->writeBlocks(blocks[b], run, buffer + (size_t) b * this->blockSize);
+            if(ret >= 0)
+                setChecksums(blocks[b], run, buffer + (size_t) b * this->blockSize);
+        }
+        if(ret < 0)
+            return ret;
+        b+= run;
+    }
+
+    return 0;
+}
+
 // DO NOT EDIT ANYTHING BELOW THIS LINE!!!
 
 /// @brief Set the static instance of the file system.
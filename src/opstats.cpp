@@ -0,0 +1,170 @@
+//
+//  opstats.cpp
+//  myfs
+//
+
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+
+#include "opstats.h"
+
+static const char *opNames[NUM_OPS]= {
+    "getattr", "readlink", "mknod", "mkdir", "unlink", "rmdir", "symlink", "rename", "link", "chmod",
+    "chown", "truncate", "utime", "open", "read", "write", "statfs", "flush", "release", "fsync",
+    "setxattr", "getxattr", "listxattr", "removexattr", "opendir", "readdir", "releasedir", "fsyncdir",
+    "ftruncate", "create"
+};
+
+static std::atomic<uint64_t> nextId(1);
+
+// counters of the instance the calling thread used last
+static thread_local uint64_t localId= 0;
+static thread_local void *localStats= NULL;
+
+// Counters are only changed by the thread owning them, so a plain load and store is enough. The atomics just keep
+// readers merging the counters well-defined.
+static inline void add(std::atomic<uint64_t> &counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+OpStats::OpStats() {
+    this->id= nextId++;
+}
+
+OpStats::~OpStats() {
+    for(size_t t= 0; t < this->threads.size(); t++)
+        delete this->threads[t];
+}
+
+uint64_t OpStats::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint32_t OpStats::bucket(uint64_t ns) {
+    if(ns < (1 << OS_SUB_BITS))
+        return (uint32_t) ns;
+
+    // the highest bit selects the power of two, the OS_SUB_BITS bits below it the bucket within
+    int e= 63 - __builtin_clzll(ns);
+    uint32_t b= ((uint32_t) (e - OS_SUB_BITS + 1) << OS_SUB_BITS) +
+                (uint32_t) ((ns >> (e - OS_SUB_BITS)) & ((1 << OS_SUB_BITS) - 1));
+
+    return b < OS_NUM_BUCKETS ? b : OS_NUM_BUCKETS - 1;
+}
+
+uint64_t OpStats::bucketStart(uint32_t bucket) {
+    if(bucket < (1 << OS_SUB_BITS))
+        return bucket;
+
+    int e= (int) (bucket >> OS_SUB_BITS) + OS_SUB_BITS - 1;
+    uint64_t sub= bucket & ((1 << OS_SUB_BITS) - 1);
+
+    return (((uint64_t) 1 << OS_SUB_BITS) + sub) << (e - OS_SUB_BITS);
+}
+
+const char *OpStats::getName(int op) {
+    return op >= 0 && op < NUM_OPS ? opNames[op] : "unknown";
+}
+
+OpStats::ThreadStats *OpStats::local() {
+    if(localId == this->id)
+        return (ThreadStats *) localStats;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    // the thread may have used this instance before, in between another one
+    ThreadStats *stats= NULL;
+    for(size_t t= 0; t < this->threads.size() && stats == NULL; t++) {
+        if(this->threads[t]->owner == std::this_thread::get_id())
+            stats= this->threads[t];
+    }
+    if(stats == NULL) {
+        stats= new ThreadStats();
+        stats->owner= std::this_thread::get_id();
+        this->threads.push_back(stats);
+    }
+
+    localId= this->id;
+    localStats= stats;
+    return stats;
+}
+
+void OpStats::record(int op, uint64_t start, int ret) {
+    uint64_t ns= now() - start;
+    OpCounters *c= &local()->ops[op];
+
+    add(c->count, 1);
+    if(ret < 0)
+        add(c->errors, 1);
+    else if(op == OP_READ || op == OP_WRITE)
+        add(c->bytes, (uint64_t) ret);
+    add(c->totalNs, ns);
+    if(ns > c->maxNs.load(std::memory_order_relaxed))
+        c->maxNs.store(ns, std::memory_order_relaxed);
+    add(c->buckets[bucket(ns)], 1);
+}
+
+void OpStats::getSummary(int op, OpSummary *summary) const {
+    memset(summary, 0, sizeof(OpSummary));
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(size_t t= 0; t < this->threads.size(); t++) {
+        const OpCounters *c= &this->threads[t]->ops[op];
+        summary->count+= c->count.load(std::memory_order_relaxed);
+        summary->errors+= c->errors.load(std::memory_order_relaxed);
+        summary->bytes+= c->bytes.load(std::memory_order_relaxed);
+        summary->totalNs+= c->totalNs.load(std::memory_order_relaxed);
+        uint64_t maxNs= c->maxNs.load(std::memory_order_relaxed);
+        if(maxNs > summary->maxNs)
+            summary->maxNs= maxNs;
+        for(uint32_t b= 0; b < OS_NUM_BUCKETS; b++)
+            summary->buckets[b]+= c->buckets[b].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t OpStats::percentile(const OpSummary *summary, double fraction) {
+    // the bucket counts may be a little ahead of count while other threads record calls
+    uint64_t total= 0;
+    for(uint32_t b= 0; b < OS_NUM_BUCKETS; b++)
+        total+= summary->buckets[b];
+    if(total == 0)
+        return 0;
+
+    uint64_t rank= (uint64_t) (fraction * total + 0.5);
+    if(rank == 0)
+        rank= 1;
+
+    uint64_t seen= 0;
+    uint32_t b= 0;
+    while(b < OS_NUM_BUCKETS - 1 && (seen+= summary->buckets[b]) < rank)
+        b++;
+
+    uint64_t end= b < OS_NUM_BUCKETS - 1 ? bucketStart(b + 1) - 1 : summary->maxNs;
+    return end < summary->maxNs ? end : summary->maxNs;
+}
+
+void OpStats::report(std::string &out) const {
+    char line[256];
+
+    snprintf(line, sizeof(line), "%-12s %10s %8s %14s %10s %10s %10s %10s %10s\n", "op", "count", "errors", "bytes",
+             "avg_us", "p50_us", "p90_us", "p99_us", "max_us");
+    out+= line;
+
+    OpSummary *s= new OpSummary;
+    for(int op= 0; op < NUM_OPS; op++) {
+        getSummary(op, s);
+        if(s->count == 0)
+            continue;
+
+        snprintf(line, sizeof(line), "%-12s %10llu %8llu %14llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", getName(op),
+                 (unsigned long long) s->count, (unsigned long long) s->errors, (unsigned long long) s->bytes,
+                 s->totalNs / 1000.0 / s->count, percentile(s, 0.5) / 1000.0, percentile(s, 0.9) / 1000.0,
+                 percentile(s, 0.99) / 1000.0, s->maxNs / 1000.0);
+        out+= line;
+    }
+    delete s;
+}
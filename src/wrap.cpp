@@ -14,6 +14,15 @@
 #include "myfs.h"
 #include "myinmemoryfs.h"
 #include "myondiskfs.h"
+#include "opstats.h"
+
+// Call a method of the file system and count the call in the statistics of the file system.
+#define TIMED_CALL(op, call) \
+    MyFS *fs= MyFS::Instance(); \
+    uint64_t start= OpStats::now(); \
+    int ret= fs->call; \
+    fs->stats.record(op, start, ret); \
+    return ret
 
 void setInstance(int onDisk) {
     if(onDisk) {
@@ -24,108 +33,121 @@ void setInstance(int onDisk) {
 }
 
 int wrap_getattr(const char *path, struct stat *statbuf) {
-    return MyFS::Instance()->fuseGetattr(path, statbuf);
+    TIMED_CALL(OP_GETATTR, fuseGetattr(path, statbuf));
 }
 
 int wrap_readlink(const char *path, char *link, size_t size) {
-    return MyFS::Instance()->fuseReadlink(path, link, size);
+    TIMED_CALL(OP_READLINK, fuseReadlink(path, link, size));
 }
 
 int wrap_mknod(const char *path, mode_t mode, dev_t dev) {
-    return MyFS::Instance()->fuseMknod(path, mode, dev);
+    TIMED_CALL(OP_MKNOD, fuseMknod(path, mode, dev));
 }
 int wrap_mkdir(const char *path, mode_t mode) {
-    return MyFS::Instance()->fuseMkdir(path, mode);
+    TIMED_CALL(OP_MKDIR, fuseMkdir(path, mode));
 }
 int wrap_unlink(const char *path) {
-    return MyFS::Instance()->fuseUnlink(path);
+    TIMED_CALL(OP_UNLINK, fuseUnlink(path));
 }
 int wrap_rmdir(const char *path) {
-    return MyFS::Instance()->fuseRmdir(path);
+    TIMED_CALL(OP_RMDIR, fuseRmdir(path));
 }
 int wrap_symlink(const char *path, const char *link) {
-    return MyFS::Instance()->fuseSymlink(path, link);
+    TIMED_CALL(OP_SYMLINK, fuseSymlink(path, link));
 }
 int wrap_rename(const char *path, const char *newpath) {
-    return MyFS::Instance()->fuseRename(path, newpath);
+    TIMED_CALL(OP_RENAME, fuseRename(path, newpath));
 }
 int wrap_link(const char *path, const char *newpath) {
-    return MyFS::Instance()->fuseLink(path, newpath);
+    TIMED_CALL(OP_LINK, fuseLink(path, newpath));
 }
 int wrap_chmod(const char *path, mode_t mode) {
-    return MyFS::Instance()->fuseChmod(path, mode);
+    TIMED_CALL(OP_CHMOD, fuseChmod(path, mode));
 }
 int wrap_chown(const char *path, uid_t uid, gid_t gid) {
-    return MyFS::Instance()->fuseChown(path, uid, gid);
+    TIMED_CALL(OP_CHOWN, fuseChown(path, uid, gid));
 }
 int wrap_truncate(const char *path, off_t newSize) {
-    return MyFS::Instance()->fuseTruncate(path, newSize);
+    TIMED_CALL(OP_TRUNCATE, fuseTruncate(path, newSize));
 }
 int wrap_utime(const char *path, struct utimbuf *ubuf) {
-    return MyFS::Instance()->fuseUtime(path, ubuf);
+    TIMED_CALL(OP_UTIME, fuseUtime(path, ubuf));
 }
 int wrap_open(const char *path, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseOpen(path, fileInfo);
+    TIMED_CALL(OP_OPEN, fuseOpen(path, fileInfo));
 }
 int wrap_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseRead(path, buf, size, offset, fileInfo);
+    TIMED_CALL(OP_READ, fuseRead(path, buf, size, offset, fileInfo));
 }
 int wrap_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseWrite(path, buf, size, offset, fileInfo);
+    TIMED_CALL(OP_WRITE, fuseWrite(path, buf, size, offset, fileInfo));
+}
+#if FUSE_VERSION >= 29
+int wrap_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
+    MyFS *fs= MyFS::Instance();
+    uint64_t start= OpStats::now();
+    int ret= fs->fuseReadBuf(path, bufp, size, offset, fileInfo);
+    // counted like a read, with the number of bytes in the buffers
+    fs->stats.record(OP_READ, start, ret < 0 ? ret : (int) fuse_buf_size(*bufp));
+    return ret;
 }
+int wrap_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset, struct fuse_file_info *fileInfo) {
+    TIMED_CALL(OP_WRITE, fuseWriteBuf(path, buf, offset, fileInfo));
+}
+#endif
 int wrap_statfs(const char *path, struct statvfs *statInfo) {
-    return MyFS::Instance()->fuseStatfs(path, statInfo);
+    TIMED_CALL(OP_STATFS, fuseStatfs(path, statInfo));
 }
 int wrap_flush(const char *path, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseFlush(path, fileInfo);
+    TIMED_CALL(OP_FLUSH, fuseFlush(path, fileInfo));
 }
 int wrap_release(const char *path, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseRelease(path, fileInfo);
+    TIMED_CALL(OP_RELEASE, fuseRelease(path, fileInfo));
 }
 int wrap_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
-    return MyFS::Instance()->fuseFsync(path, datasync, fi);
+    TIMED_CALL(OP_FSYNC, fuseFsync(path, datasync, fi));
 }
 #ifdef __APPLE__
 int wrap_setxattr(const char *path, const char *name, const char *value, size_t size, int flags, uint32_t x) {
-    return MyFS::Instance()->fuseSetxattr(path, name, value, size, flags, x);
+    TIMED_CALL(OP_SETXATTR, fuseSetxattr(path, name, value, size, flags, x));
 }
 int wrap_getxattr(const char *path, const char *name, char *value, size_t size, uint x) {
-    return MyFS::Instance()->fuseGetxattr(path, name, value, size, x);
+    TIMED_CALL(OP_GETXATTR, fuseGetxattr(path, name, value, size, x));
 }
 #else
 int wrap_setxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
-    return MyFS::Instance()->fuseSetxattr(path, name, value, size, flags);
+    TIMED_CALL(OP_SETXATTR, fuseSetxattr(path, name, value, size, flags));
 }
 int wrap_getxattr(const char *path, const char *name, char *value, size_t size) {
-    return MyFS::Instance()->fuseGetxattr(path, name, value, size);
+    TIMED_CALL(OP_GETXATTR, fuseGetxattr(path, name, value, size));
 }
 #endif
 void* wrap_init(struct fuse_conn_info *conn) {
     return MyFS::Instance()->fuseInit(conn);
 }
 int wrap_listxattr(const char *path, char *list, size_t size) {
-    return MyFS::Instance()->fuseListxattr(path, list, size);
+    TIMED_CALL(OP_LISTXATTR, fuseListxattr(path, list, size));
 }
 int wrap_removexattr(const char *path, const char *name) {
-    return MyFS::Instance()->fuseRemovexattr(path, name);
+    TIMED_CALL(OP_REMOVEXATTR, fuseRemovexattr(path, name));
 }
 int wrap_opendir(const char *path, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseOpendir(path, fileInfo);
+    TIMED_CALL(OP_OPENDIR, fuseOpendir(path, fileInfo));
 }
 int wrap_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseReaddir(path, buf, filler, offset, fileInfo);
+    TIMED_CALL(OP_READDIR, fuseReaddir(path, buf, filler, offset, fileInfo));
 }
 int wrap_releasedir(const char *path, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseReleasedir(path, fileInfo);
+    TIMED_CALL(OP_RELEASEDIR, fuseReleasedir(path, fileInfo));
 }
 int wrap_fsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseFsyncdir(path, datasync, fileInfo);
+    TIMED_CALL(OP_FSYNCDIR, fuseFsyncdir(path, datasync, fileInfo));
 }
 int wrap_ftruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo) {
-    return MyFS::Instance()->fuseTruncate(path, offset, fileInfo);
+    TIMED_CALL(OP_FTRUNCATE, fuseTruncate(path, offset, fileInfo));
 }
 int wrap_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
-    return MyFS::Instance()->fuseCreate(path, mode, fi);
+    TIMED_CALL(OP_CREATE, fuseCreate(path, mode, fi));
 }
 void wrap_destroy(void *userdata) {
     MyFS::Instance()->fuseDestroy();
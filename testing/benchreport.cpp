@@ -0,0 +1,101 @@
+//
+//  benchreport.cpp
+//  testing
+//
+
+#include <algorithm>
+#include <time.h>
+
+#include "benchreport.hpp"
+
+uint64_t benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+LatencyLog::LatencyLog(int threads) : samples(threads), ops(threads, 0) {
+    this->start= benchNow();
+}
+
+BenchResult LatencyLog::finish(const std::string &name, uint64_t bytes) {
+    double seconds= (benchNow() - this->start) / 1e9;
+
+    std::vector<uint64_t> all;
+    uint64_t numOps= 0;
+    for(size_t t= 0; t < this->samples.size(); t++) {
+        all.insert(all.end(), this->samples[t].begin(), this->samples[t].end());
+        numOps+= this->ops[t];
+    }
+    std::sort(all.begin(), all.end());
+
+    BenchResult r;
+    r.name= name;
+    r.threads= (int) this->samples.size();
+    r.ops= numOps;
+    r.bytes= bytes;
+    r.seconds= seconds;
+    r.p50Ns= all.empty() ? 0 : all[(all.size() - 1) / 2];
+    r.p99Ns= all.empty() ? 0 : all[(all.size() - 1) * 99 / 100];
+    r.maxNs= all.empty() ? 0 : all.back();
+
+    fprintf(stderr, "%-24s done\n", name.c_str());
+    return r;
+}
+
+static double opsPerSec(const BenchResult &r) {
+    return r.seconds > 0 ? r.ops / r.seconds : 0;
+}
+
+static double mibPerSec(const BenchResult &r) {
+    return r.seconds > 0 ? r.bytes / r.seconds / (1 << 20) : 0;
+}
+
+void printResults(FILE *out, const std::vector<BenchResult> &results) {
+    fprintf(out, "%-24s %7s %10s %12s %10s %10s %10s %10s\n", "workload", "threads", "ops", "ops/s", "MiB/s",
+            "p50_us", "p99_us", "max_us");
+    for(size_t i= 0; i < results.size(); i++) {
+        const BenchResult &r= results[i];
+        fprintf(out, "%-24s %7d %10llu %12.1f %10.2f %10.3f %10.3f %10.3f\n", r.name.c_str(), r.threads,
+                (unsigned long long) r.ops, opsPerSec(r), mibPerSec(r), r.p50Ns / 1000.0, r.p99Ns / 1000.0,
+                r.maxNs / 1000.0);
+    }
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out= "\"";
+    for(size_t i= 0; i < s.size(); i++) {
+        char c= s[i];
+        if(c == '"' || c == '\\') {
+            out+= '\\';
+            out+= c;
+        } else if((unsigned char) c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out+= esc;
+        } else {
+            out+= c;
+        }
+    }
+    return out + "\"";
+}
+
+void writeResults(FILE *out, const char *benchmark, const std::string &label, const BenchSettings &settings,
+                  const std::vector<BenchResult> &results) {
+    fprintf(out, "{\n  \"benchmark\": %s,\n  \"format\": 1,\n  \"label\": %s,\n", jsonString(benchmark).c_str(),
+            jsonString(label).c_str());
+    for(size_t i= 0; i < settings.size(); i++)
+        fprintf(out, "  %s: %s,\n", jsonString(settings[i].first).c_str(), settings[i].second.c_str());
+
+    fprintf(out, "  \"results\": [\n");
+    for(size_t i= 0; i < results.size(); i++) {
+        const BenchResult &r= results[i];
+        fprintf(out, "    {\"name\": %s, \"threads\": %d, \"ops\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+                     "\"ops_per_sec\": %.1f, \"mib_per_sec\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+                     "\"max_us\": %.3f}%s\n",
+                jsonString(r.name).c_str(), r.threads, (unsigned long long) r.ops, (unsigned long long) r.bytes,
+                r.seconds, opsPerSec(r), mibPerSec(r), r.p50Ns / 1000.0, r.p99Ns / 1000.0, r.maxNs / 1000.0,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
@@ -0,0 +1,78 @@
+//
+//  benchreport.hpp
+//  testing
+//
+//  Measurements and result output shared by the benchmark programs.
+//
+
+#ifndef benchreport_hpp
+#define benchreport_hpp
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Measurements of one workload.
+struct BenchResult {
+    std::string name;
+    int threads;
+    uint64_t ops;
+    uint64_t bytes;
+    double seconds;
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint64_t maxNs;
+};
+
+/// @brief Settings stored with the results, the values are JSON values, e.g. numbers or quoted strings.
+typedef std::vector<std::pair<std::string, std::string> > BenchSettings;
+
+/// @brief Current time in nanoseconds (CLOCK_MONOTONIC).
+uint64_t benchNow();
+
+/// @brief Latencies of the operations of one workload, collected by one thread each.
+///
+/// The clock of the workload starts when the log is created.
+class LatencyLog {
+private:
+    std::vector<std::vector<uint64_t> > samples;
+    std::vector<uint64_t> ops;
+    uint64_t start;
+
+public:
+    explicit LatencyLog(int threads= 1);
+
+    /// @brief Record the latency of a batch of operations.
+    ///
+    /// Operations too short to be timed one by one are timed in batches, each batch counts as ops samples of its
+    /// average latency.
+    /// \param [in] thread Index of the calling thread, each thread must use an index of its own.
+    /// \param [in] ns Time the batch took.
+    /// \param [in] ops Number of operations of the batch.
+    void record(int thread, uint64_t ns, uint64_t ops= 1) {
+        this->samples[thread].push_back(ns / ops);
+        this->ops[thread]+= ops;
+    }
+
+    /// @brief Stop the clock and compute the result of the workload.
+    /// \param [in] name Name of the workload.
+    /// \param [in] bytes Bytes read or written by all operations.
+    BenchResult finish(const std::string &name, uint64_t bytes);
+};
+
+/// @brief Print the results as a table.
+void printResults(FILE *out, const std::vector<BenchResult> &results);
+
+/// @brief Write the results as a JSON document.
+/// \param [in] benchmark Name of the benchmark program.
+/// \param [in] label Label of the run, e.g. the version under test.
+/// \param [in] settings Further settings of the run.
+void writeResults(FILE *out, const char *benchmark, const std::string &label, const BenchSettings &settings,
+                  const std::vector<BenchResult> &results);
+
+/// @brief Quote a string for JSON.
+std::string jsonString(const std::string &s);
+
+#endif /* benchreport_hpp */
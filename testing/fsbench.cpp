@@ -0,0 +1,349 @@
+//
+//  fsbench.cpp
+//  testing
+//
+//  Benchmark workloads run against a mounted file system. Results are printed as a table and can be written as JSON
+//  to compare versions, e.g.:
+//
+//      bin/mount.myfs -c container.bin -l log.txt mount
+//      bin/fsbench -l $(git describe --always) -j results.json mount
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "benchreport.hpp"
+
+#define DEFAULT_FILE_MB 64
+#define DEFAULT_NUM_FILES 2000
+#define DEFAULT_NUM_RANDOM 20000
+#define DEFAULT_NUM_THREADS 4
+#define RANDOM_SIZE 4096
+#define READDIR_ROUNDS 10
+#define MIXED_READ_PERCENT 70
+
+/// @brief Settings given on the command line.
+struct BenchConfig {
+    std::string dir;
+    std::string label;
+    std::string json;
+    std::string workloads;
+    uint64_t fileSize;
+    int numFiles;
+    int numRandom;
+    int numThreads;
+};
+
+static BenchConfig config;
+static std::vector<BenchResult> results;
+
+static void fail(const char *what, const std::string &path) {
+    fprintf(stderr, "fsbench: %s %s: %s\n", what, path.c_str(), strerror(errno));
+    exit(1);
+}
+
+static std::string benchPath(const char *name) {
+    return config.dir + "/" + name;
+}
+
+static std::string benchPath(const char *prefix, int n) {
+    return config.dir + "/" + prefix + std::to_string(n);
+}
+
+static bool selected(const char *workload) {
+    if(config.workloads.empty())
+        return true;
+    std::string list= "," + config.workloads + ",";
+    return list.find("," + std::string(workload) + ",") != std::string::npos;
+}
+
+// xorshift64*, each thread uses a generator of its own
+static uint64_t nextRandom(uint64_t &state) {
+    state^= state >> 12;
+    state^= state << 25;
+    state^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+static void fillFile(const std::string &path, uint64_t size) {
+    int fd= open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+        fail("cannot create", path);
+
+    std::vector<char> buf(1 << 20, 'x');
+    for(uint64_t off= 0; off < size; off+= buf.size()) {
+        size_t n= (size_t) std::min<uint64_t>(buf.size(), size - off);
+        if(write(fd, buf.data(), n) != (ssize_t) n)
+            fail("cannot write", path);
+    }
+    close(fd);
+}
+
+// ***
+// *** Workloads
+// ***
+
+static void benchSequential(size_t requestSize, const char *suffix) {
+    std::string path= benchPath("fsbench.seq");
+    std::vector<char> buf(requestSize, 's');
+    uint64_t numRequests= config.fileSize / requestSize;
+
+    std::string name= std::string("seq_write_") + suffix;
+    LatencyLog writes(1);
+    int fd= open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+        fail("cannot create", path);
+    for(uint64_t i= 0; i < numRequests; i++) {
+        uint64_t t= benchNow();
+        if(write(fd, buf.data(), requestSize) != (ssize_t) requestSize)
+            fail("cannot write", path);
+        writes.record(0, benchNow() - t);
+    }
+    if(fsync(fd) < 0)
+        fail("cannot sync", path);
+    close(fd);
+    results.push_back(writes.finish(name, numRequests * requestSize));
+
+    name= std::string("seq_read_") + suffix;
+    LatencyLog reads(1);
+    fd= open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        fail("cannot open", path);
+    for(uint64_t i= 0; i < numRequests; i++) {
+        uint64_t t= benchNow();
+        if(read(fd, buf.data(), requestSize) != (ssize_t) requestSize)
+            fail("cannot read", path);
+        reads.record(0, benchNow() - t);
+    }
+    close(fd);
+    results.push_back(reads.finish(name, numRequests * requestSize));
+
+    unlink(path.c_str());
+}
+
+// Read or write random blocks of RANDOM_SIZE bytes, the percentage of reads is given by readPercent.
+static void randomIO(const std::string &path, uint64_t size, int numOps, int readPercent, uint64_t seed,
+                     LatencyLog *log, int thread) {
+    int fd= open(path.c_str(), O_RDWR);
+    if(fd < 0)
+        fail("cannot open", path);
+
+    char buf[RANDOM_SIZE];
+    memset(buf, 'r', sizeof(buf));
+    uint64_t numBlocks= size / RANDOM_SIZE;
+    uint64_t state= seed | 1;
+
+    for(int i= 0; i < numOps; i++) {
+        off_t off= (off_t) (nextRandom(state) % numBlocks) * RANDOM_SIZE;
+        bool isRead= (int) (nextRandom(state) % 100) < readPercent;
+        uint64_t t= benchNow();
+        ssize_t n= isRead ? pread(fd, buf, RANDOM_SIZE, off) : pwrite(fd, buf, RANDOM_SIZE, off);
+        if(n != RANDOM_SIZE)
+            fail(isRead ? "cannot read" : "cannot write", path);
+        log->record(thread, benchNow() - t);
+    }
+    close(fd);
+}
+
+static void benchRandom() {
+    std::string path= benchPath("fsbench.rand");
+    fillFile(path, config.fileSize);
+
+    LatencyLog reads(1);
+    randomIO(path, config.fileSize, config.numRandom, 100, 1, &reads, 0);
+    results.push_back(reads.finish("rand_read_4k", (uint64_t) config.numRandom * RANDOM_SIZE));
+
+    LatencyLog writes(1);
+    randomIO(path, config.fileSize, config.numRandom, 0, 2, &writes, 0);
+    results.push_back(writes.finish("rand_write_4k", (uint64_t) config.numRandom * RANDOM_SIZE));
+
+    unlink(path.c_str());
+}
+
+static void benchMetadata() {
+    LatencyLog creates(1);
+    for(int i= 0; i < config.numFiles; i++) {
+        std::string path= benchPath("fsbench.m", i);
+        uint64_t t= benchNow();
+        int fd= open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(fd < 0)
+            fail("cannot create", path);
+        close(fd);
+        creates.record(0, benchNow() - t);
+    }
+    results.push_back(creates.finish("create", 0));
+
+    LatencyLog stats(1);
+    for(int i= 0; i < config.numFiles; i++) {
+        std::string path= benchPath("fsbench.m", i);
+        struct stat st;
+        uint64_t t= benchNow();
+        if(stat(path.c_str(), &st) < 0)
+            fail("cannot stat", path);
+        stats.record(0, benchNow() - t);
+    }
+    results.push_back(stats.finish("stat", 0));
+
+    LatencyLog unlinks(1);
+    for(int i= 0; i < config.numFiles; i++) {
+        std::string path= benchPath("fsbench.m", i);
+        uint64_t t= benchNow();
+        if(unlink(path.c_str()) < 0)
+            fail("cannot remove", path);
+        unlinks.record(0, benchNow() - t);
+    }
+    results.push_back(unlinks.finish("unlink", 0));
+}
+
+// Each operation lists the whole directory, its latency is the time of one complete listing.
+static void benchReaddir() {
+    for(int i= 0; i < config.numFiles; i++) {
+        std::string path= benchPath("fsbench.d", i);
+        int fd= open(path.c_str(), O_WRONLY | O_CREAT, 0666);
+        if(fd < 0)
+            fail("cannot create", path);
+        close(fd);
+    }
+
+    LatencyLog listings(1);
+    for(int round= 0; round < READDIR_ROUNDS; round++) {
+        uint64_t t= benchNow();
+        DIR *dir= opendir(config.dir.c_str());
+        if(dir == NULL)
+            fail("cannot open directory", config.dir);
+        int entries= 0;
+        while(readdir(dir) != NULL)
+            entries++;
+        closedir(dir);
+        listings.record(0, benchNow() - t);
+
+        if(entries < config.numFiles) {
+            fprintf(stderr, "fsbench: readdir returned %d of %d files\n", entries, config.numFiles);
+            exit(1);
+        }
+    }
+    std::string name= "readdir_" + std::to_string(config.numFiles);
+    results.push_back(listings.finish(name, 0));
+
+    for(int i= 0; i < config.numFiles; i++)
+        unlink(benchPath("fsbench.d", i).c_str());
+}
+
+// Every thread reads and writes random blocks of a file of its own.
+static void benchMixed() {
+    int threads= config.numThreads;
+    uint64_t size= config.fileSize / threads;
+    size-= size % RANDOM_SIZE;
+    if(size < RANDOM_SIZE)
+        size= RANDOM_SIZE;
+
+    for(int t= 0; t < threads; t++)
+        fillFile(benchPath("fsbench.mix", t), size);
+
+    LatencyLog mixed(threads);
+    std::vector<std::thread> workers;
+    for(int t= 0; t < threads; t++) {
+        workers.push_back(std::thread(randomIO, benchPath("fsbench.mix", t), size, config.numRandom,
+                                      MIXED_READ_PERCENT, (uint64_t) t + 3, &mixed, t));
+    }
+    for(size_t t= 0; t < workers.size(); t++)
+        workers[t].join();
+    std::string name= "mixed_4k_" + std::to_string(threads) + "t";
+    results.push_back(mixed.finish(name, (uint64_t) threads * config.numRandom * RANDOM_SIZE));
+
+    for(int t= 0; t < threads; t++)
+        unlink(benchPath("fsbench.mix", t).c_str());
+}
+
+// ***
+// *** Output
+// ***
+
+static void usage() {
+    fprintf(stderr,
+            "usage: fsbench [options] DIR\n"
+            "\n"
+            "Runs benchmark workloads in DIR, usually the mount point of MyFS.\n"
+            "\n"
+            "    -w LIST      workloads to run, comma separated: seq,rand,meta,readdir,mixed (default all)\n"
+            "    -s MB        size of the test files in MiB (default %d)\n"
+            "    -n N         number of files of the metadata and readdir workloads (default %d)\n"
+            "    -r N         number of random requests per thread (default %d)\n"
+            "    -t N         number of threads of the mixed workload (default %d)\n"
+            "    -l LABEL     label stored with the results, e.g. the version under test\n"
+            "    -j FILE      write the results as JSON to FILE, '-' for stdout\n",
+            DEFAULT_FILE_MB, DEFAULT_NUM_FILES, DEFAULT_NUM_RANDOM, DEFAULT_NUM_THREADS);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    config.fileSize= (uint64_t) DEFAULT_FILE_MB << 20;
+    config.numFiles= DEFAULT_NUM_FILES;
+    config.numRandom= DEFAULT_NUM_RANDOM;
+    config.numThreads= DEFAULT_NUM_THREADS;
+
+    int c;
+    while((c= getopt(argc, argv, "w:s:n:r:t:l:j:h")) != -1) {
+        switch(c) {
+            case 'w': config.workloads= optarg; break;
+            case 's': config.fileSize= strtoull(optarg, NULL, 10) << 20; break;
+            case 'n': config.numFiles= atoi(optarg); break;
+            case 'r': config.numRandom= atoi(optarg); break;
+            case 't': config.numThreads= atoi(optarg); break;
+            case 'l': config.label= optarg; break;
+            case 'j': config.json= optarg; break;
+            default: usage();
+        }
+    }
+    if(optind != argc - 1 || config.fileSize < (1 << 20) || config.numFiles < 1 || config.numRandom < 1 ||
+       config.numThreads < 1)
+        usage();
+    config.dir= argv[optind];
+
+    if(selected("seq")) {
+        benchSequential(4096, "4k");
+        benchSequential(64 * 1024, "64k");
+        benchSequential(1024 * 1024, "1m");
+    }
+    if(selected("rand"))
+        benchRandom();
+    if(selected("meta"))
+        benchMetadata();
+    if(selected("readdir"))
+        benchReaddir();
+    if(selected("mixed"))
+        benchMixed();
+
+    // keep stdout machine-readable if the JSON goes there
+    printResults(config.json == "-" ? stderr : stdout, results);
+
+    BenchSettings settings;
+    settings.push_back(std::make_pair("dir", jsonString(config.dir)));
+    settings.push_back(std::make_pair("file_size", std::to_string(config.fileSize)));
+    settings.push_back(std::make_pair("num_files", std::to_string(config.numFiles)));
+    settings.push_back(std::make_pair("num_random", std::to_string(config.numRandom)));
+
+    if(config.json == "-") {
+        writeResults(stdout, "fsbench", config.label, settings, results);
+    } else if(!config.json.empty()) {
+        FILE *out= fopen(config.json.c_str(), "w");
+        if(out == NULL)
+            fail("cannot write", config.json);
+        writeResults(out, "fsbench", config.label, settings, results);
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,470 @@
+//
+//  microbench.cpp
+//  testing
+//
+//  In-process benchmarks of the building blocks and of the fuse* methods of the file systems. The file systems are
+//  called directly, like in the unit tests, so the results contain no FUSE or kernel overhead and the program can be
+//  profiled with perf, e.g.:
+//
+//      perf record -g bin/microbench ondisk_
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "benchreport.hpp"
+#include "tools.hpp"
+#include "macros.h"
+#include "blockdevice.h"
+#include "blockbitmap.h"
+#include "crc32c.h"
+#include "dirindex.h"
+#include "myfs.h"
+#include "myondiskfs.h"
+#include "myinmemoryfs.h"
+
+#define BENCH_CONT_PATH "/tmp/myfs-microbench.bin"
+#define BENCH_LOG_PATH "/tmp/myfs-microbench.log"
+
+#define BD_NUM_BLOCKS 16384             // 8 MiB of blocks for the block device benchmarks
+#define BM_NUM_BLOCKS (1 << 20)         // bits of the free block map benchmarks
+#define BATCH_SIZE 64                   // operations timed together by the micro-benchmarks
+#define CRC_BLOCK_SIZE 4096             // block size of the checksum benchmarks
+#define NUM_NAMES 10000                 // directory entries of the lookup benchmarks
+#define FS_FILE_SIZE (16 * 1024 * 1024)
+#define FS_REQUEST_SIZE 4096
+
+static int scale= 1;
+static std::vector<BenchResult> results;
+
+// xorshift64*
+static uint64_t nextRandom(uint64_t &state) {
+    state^= state >> 12;
+    state^= state << 25;
+    state^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+static void check(int ret, const char *what) {
+    if(ret < 0) {
+        fprintf(stderr, "microbench: %s failed: %s\n", what, strerror(-ret));
+        exit(1);
+    }
+}
+
+static std::string fileName(int n) {
+    return "/file" + std::to_string(n);
+}
+
+// ***
+// *** BlockDevice
+// ***
+
+static void benchBlockDevice(bool mapped) {
+    const char *suffix= mapped ? "_mmap" : "";
+    int numOps= BATCH_SIZE * 2048 * scale;
+    char buf[64 * BD_BLOCK_SIZE];
+    memset(buf, 'b', sizeof(buf));
+
+    remove(BENCH_CONT_PATH);
+    BlockDevice bd(BD_BLOCK_SIZE);
+    bd.setMapped(mapped);
+    check(bd.create(BENCH_CONT_PATH), "BlockDevice::create");
+    check(bd.writeBlocks(BD_NUM_BLOCKS - 64, 64, buf), "BlockDevice::writeBlocks");
+
+    uint64_t state= 1;
+    LatencyLog writes;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            check(bd.write((uint32_t) (nextRandom(state) % BD_NUM_BLOCKS), buf), "BlockDevice::write");
+        writes.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(writes.finish(std::string("bd_write") + suffix, (uint64_t) numOps * BD_BLOCK_SIZE));
+
+    LatencyLog reads;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            check(bd.read((uint32_t) (nextRandom(state) % BD_NUM_BLOCKS), buf), "BlockDevice::read");
+        reads.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(reads.finish(std::string("bd_read") + suffix, (uint64_t) numOps * BD_BLOCK_SIZE));
+
+    // runs of 64 blocks, like the transfers of the on-disk file system
+    int numRuns= numOps / 64;
+    LatencyLog runs;
+    for(int i= 0; i < numRuns; i++) {
+        uint32_t start= (uint32_t) (nextRandom(state) % (BD_NUM_BLOCKS / 64)) * 64;
+        uint64_t t= benchNow();
+        check(bd.readBlocks(start, 64, buf), "BlockDevice::readBlocks");
+        runs.record(0, benchNow() - t);
+    }
+    results.push_back(runs.finish(std::string("bd_read_blocks_64") + suffix, (uint64_t) numRuns * sizeof(buf)));
+
+    bd.close();
+    remove(BENCH_CONT_PATH);
+}
+
+// ***
+// *** BlockBitmap
+// ***
+
+// Fill a map of BM_NUM_BLOCKS blocks with runs of 8 blocks, then free every second run and allocate single
+// blocks, so the allocator has to find the holes.
+static void benchAllocation() {
+    BlockBitmap bm;
+    bm.resize(BM_NUM_BLOCKS, BM_NUM_BLOCKS / 8);
+
+    uint32_t start, count;
+    uint32_t hint= 0;
+    int numRuns= BM_NUM_BLOCKS / 8;
+    LatencyLog runs;
+    for(int i= 0; i < numRuns; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++) {
+            if(!bm.allocate(hint, 8, &start, &count)) {
+                fprintf(stderr, "microbench: the bitmap is full\n");
+                exit(1);
+            }
+            hint= start + count;
+        }
+        runs.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(runs.finish("bitmap_alloc_run_8", 0));
+
+    for(uint32_t b= 0; b < BM_NUM_BLOCKS; b+= 16)
+        bm.release(b, 8);
+
+    int numBlocks= BM_NUM_BLOCKS / 2;
+    hint= 0;
+    LatencyLog blocks;
+    for(int i= 0; i < numBlocks; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++) {
+            if(!bm.allocate(hint, 1, &start, &count)) {
+                fprintf(stderr, "microbench: the bitmap is full\n");
+                exit(1);
+            }
+            hint= start + 1;
+        }
+        blocks.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(blocks.finish("bitmap_alloc_fragmented", 0));
+}
+
+// ***
+// *** Crc32c
+// ***
+
+// Checksums of single blocks with the lookup tables and with the instructions of the processor, and of batches of
+// BATCH_SIZE blocks, like the verification of a multi-block read.
+static void benchChecksums() {
+    int numBlocks= BATCH_SIZE * 1024 * scale;
+    std::vector<char> data((size_t) BATCH_SIZE * CRC_BLOCK_SIZE);
+    uint64_t state= 1;
+    for(size_t i= 0; i < data.size(); i+= sizeof(uint64_t)) {
+        uint64_t v= nextRandom(state);
+        memcpy(&data[i], &v, sizeof(v));
+    }
+
+    uint32_t sum= 0;
+    LatencyLog table;
+    for(int i= 0; i < numBlocks; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            sum^= Crc32c::computeTable(&data[(size_t) b * CRC_BLOCK_SIZE], CRC_BLOCK_SIZE);
+        table.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(table.finish("crc_table_4k", (uint64_t) numBlocks * CRC_BLOCK_SIZE));
+
+    std::string suffix= Crc32c::isHardware() ? "" : "_nohw";
+    LatencyLog single;
+    for(int i= 0; i < numBlocks; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            sum^= Crc32c::compute(&data[(size_t) b * CRC_BLOCK_SIZE], CRC_BLOCK_SIZE);
+        single.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(single.finish("crc_4k" + suffix, (uint64_t) numBlocks * CRC_BLOCK_SIZE));
+
+    uint32_t crcs[BATCH_SIZE];
+    LatencyLog batches;
+    for(int i= 0; i < numBlocks; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        Crc32c::computeBlocks(data.data(), CRC_BLOCK_SIZE, BATCH_SIZE, crcs);
+        batches.record(0, benchNow() - t, BATCH_SIZE);
+        sum^= crcs[0];
+    }
+    results.push_back(batches.finish("crc_blocks_64" + suffix, (uint64_t) numBlocks * CRC_BLOCK_SIZE));
+
+    // keeps the compiler from dropping the loops
+    if(sum == 0x12345678)
+        fprintf(stderr, "microbench: unlikely checksum\n");
+}
+
+// ***
+// *** DirIndex
+// ***
+
+static void benchDirIndex() {
+    std::vector<std::string> names;
+    for(int n= 0; n < NUM_NAMES; n++)
+        names.push_back("file" + std::to_string(n));
+
+    DirIndex index;
+    LatencyLog inserts;
+    for(int n= 0; n < NUM_NAMES; n+= BATCH_SIZE) {
+        int batch= std::min(BATCH_SIZE, NUM_NAMES - n);
+        uint64_t t= benchNow();
+        for(int b= 0; b < batch; b++)
+            index.insert(ROOT_INODE, names[n + b].c_str(), (uint32_t) (n + b));
+        inserts.record(0, benchNow() - t, batch);
+    }
+    results.push_back(inserts.finish("dir_insert", 0));
+
+    int numOps= BATCH_SIZE * 16384 * scale;
+    uint64_t state= 1;
+    int found= 0;
+    LatencyLog lookups;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            found+= index.find(ROOT_INODE, names[nextRandom(state) % NUM_NAMES].c_str()) >= 0;
+        lookups.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(lookups.finish("dir_lookup", 0));
+
+    LatencyLog misses;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            found+= index.find(ROOT_INODE, "missing") >= 0;
+        misses.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(misses.finish("dir_lookup_missing", 0));
+
+    if(found != numOps) {
+        fprintf(stderr, "microbench: %d of %d lookups succeeded\n", found, numOps);
+        exit(1);
+    }
+}
+
+// ***
+// *** File systems, called through MyFS::Instance() like the FUSE wrappers do
+// ***
+
+static void mount(bool onDisk, MyFsInfo *info, bool checksum) {
+    memset(info, 0, sizeof(MyFsInfo));
+    info->checksum= checksum;
+    info->contFile= (char *) BENCH_CONT_PATH;
+    info->logFile= (char *) BENCH_LOG_PATH;
+    info->logLevel= LOG_LEVEL_NONE;
+    setFuseContext(info);
+
+    remove(BENCH_CONT_PATH);
+    if(onDisk)
+        MyOnDiskFS::SetInstance();
+    else
+        MyInMemoryFS::SetInstance();
+    MyFS::Instance()->fuseInit(NULL);
+}
+
+static void unmount() {
+    MyFS::Instance()->fuseDestroy();
+    delete MyFS::Instance();
+    remove(BENCH_CONT_PATH);
+    remove(BENCH_LOG_PATH);
+}
+
+// With checksum, the on-disk file system verifies the block checksums of all reads, the difference to the results
+// without is the cost of the verification.
+static void benchFileSystem(bool onDisk, bool checksum) {
+    std::string prefix= onDisk ? (checksum ? "ondisk_csum_" : "ondisk_") : "inmemory_";
+    int numFiles= 1000 * scale;
+    int numOps= BATCH_SIZE * 2048 * scale;
+
+    MyFsInfo info;
+    mount(onDisk, &info, checksum);
+    MyFS *fs= MyFS::Instance();
+
+    LatencyLog creates;
+    for(int n= 0; n < numFiles; n++) {
+        std::string path= fileName(n);
+        uint64_t t= benchNow();
+        check(fs->fuseMknod(path.c_str(), S_IFREG | 0644, 0), "fuseMknod");
+        creates.record(0, benchNow() - t);
+    }
+    results.push_back(creates.finish(prefix + "mknod", 0));
+
+    // path resolution of existing and missing files
+    std::vector<std::string> paths;
+    for(int n= 0; n < numFiles; n++)
+        paths.push_back(fileName(n));
+    struct stat st;
+    uint64_t state= 1;
+    LatencyLog getattrs;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++)
+            check(fs->fuseGetattr(paths[nextRandom(state) % numFiles].c_str(), &st), "fuseGetattr");
+        getattrs.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(getattrs.finish(prefix + "getattr", 0));
+
+    LatencyLog misses;
+    for(int i= 0; i < numOps; i+= BATCH_SIZE) {
+        uint64_t t= benchNow();
+        for(int b= 0; b < BATCH_SIZE; b++) {
+            if(fs->fuseGetattr("/missing", &st) != -ENOENT)
+                check(-EINVAL, "fuseGetattr");
+        }
+        misses.record(0, benchNow() - t, BATCH_SIZE);
+    }
+    results.push_back(misses.finish(prefix + "getattr_missing", 0));
+
+    // sequential and random data transfers through an open file
+    std::vector<char> buf(FS_REQUEST_SIZE, 'f');
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    check(fs->fuseOpen("/file0", &fileInfo), "fuseOpen");
+
+    int numRequests= FS_FILE_SIZE / FS_REQUEST_SIZE;
+    LatencyLog writes;
+    for(int i= 0; i < numRequests; i++) {
+        uint64_t t= benchNow();
+        check(fs->fuseWrite("/file0", buf.data(), FS_REQUEST_SIZE, (off_t) i * FS_REQUEST_SIZE, &fileInfo),
+              "fuseWrite");
+        writes.record(0, benchNow() - t);
+    }
+    check(fs->fuseFlush("/file0", &fileInfo), "fuseFlush");
+    results.push_back(writes.finish(prefix + "write_seq_4k", FS_FILE_SIZE));
+
+    LatencyLog reads;
+    for(int i= 0; i < numRequests; i++) {
+        uint64_t t= benchNow();
+        check(fs->fuseRead("/file0", buf.data(), FS_REQUEST_SIZE, (off_t) i * FS_REQUEST_SIZE, &fileInfo),
+              "fuseRead");
+        reads.record(0, benchNow() - t);
+    }
+    results.push_back(reads.finish(prefix + "read_seq_4k", FS_FILE_SIZE));
+
+    LatencyLog randomReads;
+    for(int i= 0; i < numOps; i++) {
+        off_t off= (off_t) (nextRandom(state) % numRequests) * FS_REQUEST_SIZE;
+        uint64_t t= benchNow();
+        check(fs->fuseRead("/file0", buf.data(), FS_REQUEST_SIZE, off, &fileInfo), "fuseRead");
+        randomReads.record(0, benchNow() - t);
+    }
+    results.push_back(randomReads.finish(prefix + "read_rand_4k", (uint64_t) numOps * FS_REQUEST_SIZE));
+
+    LatencyLog randomWrites;
+    for(int i= 0; i < numOps; i++) {
+        off_t off= (off_t) (nextRandom(state) % numRequests) * FS_REQUEST_SIZE;
+        uint64_t t= benchNow();
+        check(fs->fuseWrite("/file0", buf.data(), FS_REQUEST_SIZE, off, &fileInfo), "fuseWrite");
+        randomWrites.record(0, benchNow() - t);
+    }
+    check(fs->fuseFlush("/file0", &fileInfo), "fuseFlush");
+    results.push_back(randomWrites.finish(prefix + "write_rand_4k", (uint64_t) numOps * FS_REQUEST_SIZE));
+    check(fs->fuseRelease("/file0", &fileInfo), "fuseRelease");
+
+    LatencyLog unlinks;
+    for(int n= 0; n < numFiles; n++) {
+        uint64_t t= benchNow();
+        check(fs->fuseUnlink(paths[n].c_str()), "fuseUnlink");
+        unlinks.record(0, benchNow() - t);
+    }
+    results.push_back(unlinks.finish(prefix + "unlink", 0));
+
+    unmount();
+}
+
+// ***
+// *** Main program
+// ***
+
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static void runBlockDevice() { benchBlockDevice(false); }
+static void runBlockDeviceMapped() { benchBlockDevice(true); }
+static void runOnDisk() { benchFileSystem(true, false); }
+static void runOnDiskChecksums() { benchFileSystem(true, true); }
+static void runInMemory() { benchFileSystem(false, false); }
+
+static const Benchmark benchmarks[]= {
+    { "bd_", runBlockDevice },
+    { "bd_mmap_", runBlockDeviceMapped },
+    { "bitmap_", benchAllocation },
+    { "crc_", benchChecksums },
+    { "dir_", benchDirIndex },
+    { "ondisk_", runOnDisk },
+    { "ondisk_csum_", runOnDiskChecksums },
+    { "inmemory_", runInMemory },
+};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: microbench [options] [GROUP...]\n"
+            "\n"
+            "Runs in-process benchmarks, GROUP selects the groups to run:\n"
+            "    bd_ bd_mmap_ bitmap_ crc_ dir_ ondisk_ ondisk_csum_ inmemory_ (default all)\n"
+            "\n"
+            "    -x N         multiply the number of operations by N\n"
+            "    -l LABEL     label stored with the results, e.g. the version under test\n"
+            "    -j FILE      write the results as JSON to FILE, '-' for stdout\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    std::string label, json;
+
+    int c;
+    while((c= getopt(argc, argv, "x:l:j:h")) != -1) {
+        switch(c) {
+            case 'x': scale= atoi(optarg); break;
+            case 'l': label= optarg; break;
+            case 'j': json= optarg; break;
+            default: usage();
+        }
+    }
+    if(scale < 1)
+        usage();
+
+    for(size_t b= 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        bool selected= optind == argc;
+        for(int a= optind; a < argc; a++)
+            selected|= strcmp(argv[a], benchmarks[b].name) == 0;
+        if(selected)
+            benchmarks[b].run();
+    }
+
+    printResults(json == "-" ? stderr : stdout, results);
+
+    BenchSettings settings;
+    settings.push_back(std::make_pair("scale", std::to_string(scale)));
+
+    if(json == "-") {
+        writeResults(stdout, "microbench", label, settings, results);
+    } else if(!json.empty()) {
+        FILE *out= fopen(json.c_str(), "w");
+        if(out == NULL) {
+            fprintf(stderr, "microbench: cannot write %s: %s\n", json.c_str(), strerror(errno));
+            return 1;
+        }
+        writeResults(out, "microbench", label, settings, results);
+        fclose(out);
+    }
+
+    return 0;
+}
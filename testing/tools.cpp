@@ -5,6 +5,7 @@
 
 #include <cstdlib>
 #include <string.h>
+#include <unistd.h>
 
 #include "../catch/catch.hpp"
 
@@ -22,3 +23,18 @@ void gen_random(char *s, const int len) {
 }
 
 // TODO: Implement you helper functions here
+
+// FUSE context returned to the file system classes when they are called directly, i.e., without mounting them
+static struct fuse_context fuseContext;
+
+struct fuse_context *fuse_get_context(void) {
+    return &fuseContext;
+}
+
+void setFuseContext(struct MyFsInfo *info) {
+    memset(&fuseContext, 0, sizeof(fuseContext));
+    fuseContext.uid= getuid();
+    fuseContext.gid= getgid();
+    fuseContext.pid= getpid();
+    fuseContext.private_data= info;
+}
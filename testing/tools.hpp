@@ -9,8 +9,12 @@
 #ifndef helper_hpp
 #define helper_hpp
 
+#include <fuse.h>
+
 #include "blockdevice.h"
+#include "myfs-info.h"
 
 void gen_random(char *s, const int len);
+void setFuseContext(struct MyFsInfo *info);
 
 #endif /* helper_hpp */
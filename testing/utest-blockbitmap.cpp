@@ -0,0 +1,124 @@
+//
+//  utest-blockbitmap.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "blockbitmap.h"
+
+#define NUM_TESTBITS 100000
+
+TEST_CASE( "BB_ALLOCATE_RELEASE", "[blockbitmap]" ) {
+
+    BlockBitmap bm;
+    bm.resize(NUM_TESTBITS, NUM_TESTBITS / 8 + 100);
+    REQUIRE(bm.getNumFree() == NUM_TESTBITS);
+
+    uint32_t start, count;
+
+    SECTION("runs span word boundaries") {
+        bm.set(0, 60);
+        REQUIRE(bm.allocate(0, 100, &start, &count));
+        REQUIRE(start == 60);
+        REQUIRE(count == 100);
+        REQUIRE(bm.getNumFree() == NUM_TESTBITS - 160);
+        for(uint32_t b= 0; b < 200; b++) {
+            REQUIRE(bm.isUsed(b) == (b < 160));
+        }
+
+        bm.release(70, 10);
+        REQUIRE(bm.getNumFree() == NUM_TESTBITS - 150);
+        REQUIRE(!bm.isUsed(70));
+        REQUIRE(bm.isUsed(80));
+    }
+
+    SECTION("free run at the hint is taken even if short") {
+        bm.set(0, 1000);
+        bm.release(500, 3);
+        REQUIRE(bm.allocate(500, 10, &start, &count));
+        REQUIRE(start == 500);
+        REQUIRE(count == 3);
+    }
+
+    SECTION("short holes do not split large allocations") {
+        // a few single free blocks between used ones, followed by free space
+        bm.set(0, 1000);
+        for(uint32_t b= 100; b < 1000; b+= 100)
+            bm.release(b, 1);
+        REQUIRE(bm.allocate(0, 16, &start, &count) == true);
+        REQUIRE(count == 16);
+        REQUIRE(start >= 1000);
+    }
+
+    SECTION("search wraps around and never returns padding bits") {
+        bm.set(0, NUM_TESTBITS);
+        REQUIRE(bm.getNumFree() == 0);
+        REQUIRE(bm.allocate(0, 1, &start, &count) == false);
+
+        bm.release(17, 1);
+        REQUIRE(bm.allocate(NUM_TESTBITS - 5, 8, &start, &count));
+        REQUIRE(start == 17);
+        REQUIRE(count == 1);
+        REQUIRE(bm.allocate(0, 1, &start, &count) == false);
+    }
+
+    SECTION("summary is rebuilt from raw data") {
+        // mark everything but one block as used through the raw data, like after reading the map from disk
+        memset(bm.getData(), 0xff, bm.getDataSize());
+        bm.getData()[54321 / 8] &= ~(1 << (54321 % 8));
+        bm.rebuild();
+        REQUIRE(bm.getNumFree() == 1);
+        REQUIRE(bm.allocate(0, 1, &start, &count));
+        REQUIRE(start == 54321);
+    }
+}
+
+TEST_CASE( "BB_RANDOM", "[blockbitmap]" ) {
+
+    // compare against a plain byte array under random allocations and releases
+    BlockBitmap bm;
+    bm.resize(NUM_TESTBITS, NUM_TESTBITS / 8);
+    char *used= new char[NUM_TESTBITS];
+    memset(used, 0, NUM_TESTBITS);
+    uint32_t numUsed= 0;
+
+    srand(42);
+    for(int i= 0; i < 20000; i++) {
+        uint32_t start, count;
+        if(rand() % 3 != 0) {
+            uint32_t hint= rand() % NUM_TESTBITS;
+            uint32_t want= 1 + rand() % 200;
+            if(!bm.allocate(hint, want, &start, &count)) {
+                REQUIRE(numUsed == NUM_TESTBITS);
+                continue;
+            }
+            REQUIRE(count >= 1);
+            REQUIRE(count <= want);
+            REQUIRE(start + count <= NUM_TESTBITS);
+            for(uint32_t b= start; b < start + count; b++) {
+                REQUIRE(used[b] == 0);
+                used[b]= 1;
+            }
+            numUsed+= count;
+        } else {
+            start= rand() % NUM_TESTBITS;
+            count= std::min((uint32_t) (1 + rand() % 300), NUM_TESTBITS - start);
+            for(uint32_t b= start; b < start + count; b++) {
+                numUsed-= used[b];
+                used[b]= 0;
+            }
+            bm.release(start, count);
+        }
+        REQUIRE(bm.getNumFree() == NUM_TESTBITS - numUsed);
+    }
+
+    for(uint32_t b= 0; b < NUM_TESTBITS; b++) {
+        REQUIRE(bm.isUsed(b) == (used[b] != 0));
+    }
+
+    delete [] used;
+}
@@ -0,0 +1,342 @@
+//
+//  utest-blockcache.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "tools.hpp"
+
+#include "blockdevice.h"
+#include "blockcache.h"
+
+#define BD_PATH "/tmp/bd.bin"
+#define NUM_TESTBLOCKS 256
+#define NUM_CACHEBLOCKS 16
+#define BLOCK_SIZE 512
+
+TEST_CASE( "BC_WRITE_READ", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    SECTION("read back through the cache") {
+        BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+        // more blocks than the cache holds, so dirty blocks get evicted
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bc.write(b, w + b*BD_BLOCK_SIZE) == 0);
+        }
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bc.read(b, r + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        REQUIRE(bc.getNumDirty() <= NUM_CACHEBLOCKS);
+    }
+
+    SECTION("read back from the device after flush") {
+        BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bc.write(b, w + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(bc.flush() == 0);
+        REQUIRE(bc.getNumDirty() == 0);
+
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bd.read(b, r + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BC_HITS_MISSES", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+    char buf[BD_BLOCK_SIZE];
+    gen_random(buf, BD_BLOCK_SIZE);
+
+    SECTION("hot blocks stay in the cache") {
+        for(int i= 0; i < 100; i++) {
+            for(int b= 0; b < NUM_CACHEBLOCKS; b++) {
+                REQUIRE(bc.read(b, buf) == 0);
+            }
+        }
+        REQUIRE(bc.getMisses() == NUM_CACHEBLOCKS);
+        REQUIRE(bc.getHits() == 99 * NUM_CACHEBLOCKS);
+    }
+
+    SECTION("writes do not reach the device before flush") {
+        for(int i= 0; i < 100; i++) {
+            REQUIRE(bc.write(0, buf) == 0);
+        }
+        REQUIRE(bc.getWriteBacks() == 0);
+        REQUIRE(bc.flush() == 0);
+        REQUIRE(bc.getWriteBacks() == 1);
+    }
+
+    SECTION("least recently used block is evicted") {
+        for(int b= 0; b < NUM_CACHEBLOCKS; b++) {
+            REQUIRE(bc.read(b, buf) == 0);
+        }
+        // touch block 0, so block 1 becomes the victim
+        REQUIRE(bc.read(0, buf) == 0);
+        REQUIRE(bc.read(NUM_CACHEBLOCKS, buf) == 0);
+
+        uint64_t misses= bc.getMisses();
+        REQUIRE(bc.read(0, buf) == 0);
+        REQUIRE(bc.getMisses() == misses);
+        REQUIRE(bc.read(1, buf) == 0);
+        REQUIRE(bc.getMisses() == misses + 1);
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BC_MULTI_BLOCK_WRITE_READ", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    REQUIRE(bc.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+
+    SECTION("dirty cached blocks win over the device") {
+        // overwrite some blocks in the cache only
+        gen_random(w + 3 * BD_BLOCK_SIZE, BD_BLOCK_SIZE);
+        gen_random(w + 7 * BD_BLOCK_SIZE, BD_BLOCK_SIZE);
+        REQUIRE(bc.write(3, w + 3 * BD_BLOCK_SIZE) == 0);
+        REQUIRE(bc.write(7, w + 7 * BD_BLOCK_SIZE) == 0);
+
+        REQUIRE(bc.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        REQUIRE(bc.getHits() == 2);
+        REQUIRE(bc.getWriteBacks() == 0);
+    }
+
+    SECTION("written through blocks update cached copies") {
+        REQUIRE(bc.read(5, r) == 0);
+        gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+        REQUIRE(bc.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+
+        REQUIRE(bc.read(5, r) == 0);
+        REQUIRE(memcmp(w + 5 * BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+        REQUIRE(bc.getNumDirty() == 0);
+    }
+
+    SECTION("flush writes consecutive dirty blocks") {
+        for(int b= 0; b < NUM_CACHEBLOCKS; b++) {
+            REQUIRE(bc.write(b, w + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(bc.flush() == 0);
+        REQUIRE(bc.getWriteBacks() == NUM_CACHEBLOCKS);
+
+        for(int b= 0; b < NUM_CACHEBLOCKS; b++) {
+            REQUIRE(bd.read(b, r) == 0);
+            REQUIRE(memcmp(w + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+        }
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BC_FAILED_WRITE_THROUGH", "[blockcache]" ) {
+
+    // every write to /dev/full fails with ENOSPC, reads return zeros
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.open("/dev/full") == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+    char* r= new char[BD_BLOCK_SIZE * 4];
+    char* w= new char[BD_BLOCK_SIZE * 4];
+    gen_random(w, BD_BLOCK_SIZE * 4);
+
+    REQUIRE(bc.read(1, r) == 0);
+    REQUIRE(bc.read(2, r) == 0);
+    REQUIRE(bc.getNumDirty() == 0);
+
+    // the cached copies keep the new content and stay dirty, so it is not lost when they are evicted
+    REQUIRE(bc.writeBlocks(0, 4, w) < 0);
+    REQUIRE(bc.getNumDirty() == 2);
+    REQUIRE(bc.read(1, r) == 0);
+    REQUIRE(memcmp(w + BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+    REQUIRE(bc.flush() < 0);
+
+    delete [] r;
+    delete [] w;
+
+    bd.close();
+}
+
+TEST_CASE( "BC_CONCURRENT_ACCESS", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+    // each thread owns a disjoint range of blocks, the ranges together are larger than the cache
+    const int numThreads= 4;
+    const int blocksPerThread= NUM_TESTBLOCKS / numThreads;
+    std::vector<std::thread> threads;
+    std::vector<int> failed(numThreads, 0);
+
+    for(int t= 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&bc, &failed, t, blocksPerThread]() {
+            char w[BD_BLOCK_SIZE];
+            char r[BD_BLOCK_SIZE];
+            for(int i= 0; i < 20; i++) {
+                for(int b= t * blocksPerThread; b < (t + 1) * blocksPerThread; b++) {
+                    memset(w, (char) (b + i), BD_BLOCK_SIZE);
+                    if(bc.write(b, w) < 0 || bc.read(b, r) < 0 || memcmp(w, r, BD_BLOCK_SIZE) != 0)
+                        failed[t]++;
+                }
+            }
+        }));
+    }
+    for(size_t t= 0; t < threads.size(); t++)
+        threads[t].join();
+
+    for(int t= 0; t < numThreads; t++) {
+        REQUIRE(failed[t] == 0);
+    }
+
+    REQUIRE(bc.flush() == 0);
+    char r[BD_BLOCK_SIZE];
+    for(int b= 0; b < numThreads * blocksPerThread; b++) {
+        REQUIRE(bd.read(b, r) == 0);
+        REQUIRE(r[0] == (char) (b + 19));
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BC_PREFETCH", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+
+    SECTION("read-ahead blocks are hits") {
+        REQUIRE(bc.prefetch(4, 8) == 0);
+        REQUIRE(bc.getPrefetchedBlocks() == 8);
+        REQUIRE(bc.getMisses() == 0);
+
+        REQUIRE(bc.readBlocks(4, 8, r) == 0);
+        REQUIRE(memcmp(w + 4 * BD_BLOCK_SIZE, r, 8 * BD_BLOCK_SIZE) == 0);
+        REQUIRE(bc.getHits() == 8);
+        REQUIRE(bc.getPrefetchHits() == 8);
+
+        // blocks count as read-ahead hits only once
+        REQUIRE(bc.read(5, r) == 0);
+        REQUIRE(bc.getPrefetchHits() == 8);
+        REQUIRE(bc.getPrefetchWasted() == 0);
+    }
+
+    SECTION("cached blocks are not read again") {
+        REQUIRE(bc.read(2, r) == 0);
+        REQUIRE(bc.prefetch(0, 4) == 0);
+        REQUIRE(bc.getPrefetchedBlocks() == 3);
+        REQUIRE(bc.prefetch(0, 4) == 0);
+        REQUIRE(bc.getPrefetchedBlocks() == 3);
+
+        // at most half the cache at once
+        REQUIRE(bc.prefetch(100, NUM_TESTBLOCKS) == 0);
+        REQUIRE(bc.getPrefetchedBlocks() == 3 + NUM_CACHEBLOCKS / 2);
+    }
+
+    SECTION("unused read-ahead blocks are wasted") {
+        REQUIRE(bc.prefetch(0, 4) == 0);
+        REQUIRE(bc.write(1, w) == 0);
+        REQUIRE(bc.getPrefetchWasted() == 1);
+        for(int b= 0; b < NUM_CACHEBLOCKS; b++) {
+            REQUIRE(bc.read(100 + b, r) == 0);
+        }
+        REQUIRE(bc.getPrefetchWasted() == 4);
+        REQUIRE(bc.getPrefetchHits() == 0);
+    }
+
+    SECTION("read ahead in the background") {
+        bc.prefetchAsync(10, 4);
+        bc.prefetchAsync(20, 4);
+        bc.waitPrefetch();
+        REQUIRE(bc.getPrefetchedBlocks() == 8);
+
+        REQUIRE(bc.readBlocks(20, 4, r) == 0);
+        REQUIRE(memcmp(w + 20 * BD_BLOCK_SIZE, r, 4 * BD_BLOCK_SIZE) == 0);
+        REQUIRE(bc.getPrefetchHits() == 4);
+
+        // the thread is started again after being stopped
+        bc.stopPrefetch();
+        bc.prefetchAsync(30, 4);
+        bc.waitPrefetch();
+        REQUIRE(bc.getPrefetchedBlocks() == 12);
+    }
+
+    SECTION("written blocks are never read ahead stale") {
+        REQUIRE(bc.prefetch(0, 4) == 0);
+        gen_random(w, 4 * BD_BLOCK_SIZE);
+        REQUIRE(bc.writeBlocks(0, 4, w) == 0);
+        REQUIRE(bc.getPrefetchWasted() == 4);
+
+        REQUIRE(bc.prefetch(0, 4) == 0);
+        REQUIRE(bc.readBlocks(0, 4, r) == 0);
+        REQUIRE(memcmp(w, r, 4 * BD_BLOCK_SIZE) == 0);
+    }
+
+    bc.stopPrefetch();
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
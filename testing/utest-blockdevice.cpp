@@ -10,17 +10,27 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <vector>
 
 #include "tools.hpp"
 
 #include "blockdevice.h"
+#include "blockcache.h"
 
 #define BD_PATH "/tmp/bd.bin"
+#define BD_STRIPE_PATH_1 "/tmp/bd-1.bin"
+#define BD_STRIPE_PATH_2 "/tmp/bd-2.bin"
 #define NUM_TESTBLOCKS 1024
 #define BLOCK_SIZE 512
+#define NUM_BENCHBLOCKS 16384
+#define NUM_BENCHROUNDS 8
 
 // Declarations of helper functions
 void bdWriteRead(BlockDevice *bd, int noBlocks= 1);
+double bdBenchmark(bool mapped, char *w, char *r);
+void bdReadFile(const char *path, long pos, size_t size, char *buffer);
 
 TEST_CASE( "BD_CREATE_WRITE_READ_NEW_FILE", "[blockdevice]" ) {
     
@@ -82,6 +92,387 @@ TEST_CASE( "BD_OPEN_NON-EXISTING_FILE", "[blockdevice]" ) {
     REQUIRE(bd.open(BD_PATH) < 0);
 }
 
+TEST_CASE( "BD_MULTI_BLOCK_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    SECTION("contiguous buffer") {
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+
+        // single block access sees the same data
+        REQUIRE(bd.read(NUM_TESTBLOCKS / 2, r) == 0);
+        REQUIRE(memcmp(w + (NUM_TESTBLOCKS / 2) * BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+    }
+
+    SECTION("scatter & gather") {
+        char* wv[NUM_TESTBLOCKS];
+        char* rv[NUM_TESTBLOCKS];
+        // reverse order of the buffers, so the data is not contiguous in memory
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            wv[b]= w + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE;
+            rv[b]= r + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE;
+        }
+        REQUIRE(bd.writeBlocksv(0, NUM_TESTBLOCKS, wv) == 0);
+        REQUIRE(bd.readBlocksv(0, NUM_TESTBLOCKS, rv) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+
+        REQUIRE(bd.read(0, r) == 0);
+        REQUIRE(memcmp(wv[0], r, BD_BLOCK_SIZE) == 0);
+    }
+
+    SECTION("read beyond end of container") {
+        REQUIRE(bd.writeBlocks(0, 2, w) == 0);
+        memset(r, 1, 4 * BD_BLOCK_SIZE);
+        REQUIRE(bd.readBlocks(0, 4, r) == 0);
+        REQUIRE(memcmp(w, r, 2 * BD_BLOCK_SIZE) == 0);
+        for(int i= 2 * BD_BLOCK_SIZE; i < 4 * BD_BLOCK_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_IORING_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    bd.setIoRing(true);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    if(!bd.isIoRing()) {
+        WARN("io_uring is not available, the block device uses positioned system calls");
+    }
+
+    SECTION("write single block") {
+        bdWriteRead(&bd);
+    }
+
+    SECTION("write multiple blocks") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+    }
+
+    SECTION("batch of transfers") {
+        char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+        gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+        // every other block, the last one gathered from separate buffers
+        char *wv[2]= { w + (NUM_TESTBLOCKS - 1) * BD_BLOCK_SIZE, w + (NUM_TESTBLOCKS - 2) * BD_BLOCK_SIZE };
+        std::vector<BlockTransfer> transfers;
+        for(int b= 0; b < NUM_TESTBLOCKS - 2; b+= 2) {
+            BlockTransfer transfer= { true, (uint32_t) b, 1, w + b * BD_BLOCK_SIZE, NULL, 0 };
+            transfers.push_back(transfer);
+        }
+        BlockTransfer gather= { true, NUM_TESTBLOCKS - 2, 2, NULL, wv, 0 };
+        transfers.push_back(gather);
+        REQUIRE(bd.submit(transfers.data(), transfers.size()) == 0);
+        REQUIRE(bd.getNumWrites() == transfers.size());
+
+        // the read extends beyond the end of the container
+        char* big= new char[BD_BLOCK_SIZE * (NUM_TESTBLOCKS + 2)];
+        memset(big, 1, BD_BLOCK_SIZE * (NUM_TESTBLOCKS + 2));
+        BlockTransfer read= { false, 0, NUM_TESTBLOCKS + 2, big, NULL, 0 };
+        REQUIRE(bd.submit(&read, 1) == 0);
+        REQUIRE(read.result == 0);
+        for(int b= 0; b < NUM_TESTBLOCKS - 2; b++) {
+            char expected[BD_BLOCK_SIZE];
+            memset(expected, 0, BD_BLOCK_SIZE);
+            const char *e= b % 2 == 0 ? w + b * BD_BLOCK_SIZE : expected;
+            REQUIRE(memcmp(big + b * BD_BLOCK_SIZE, e, BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(memcmp(big + (NUM_TESTBLOCKS - 2) * BD_BLOCK_SIZE, wv[0], BD_BLOCK_SIZE) == 0);
+        REQUIRE(memcmp(big + (NUM_TESTBLOCKS - 1) * BD_BLOCK_SIZE, wv[1], BD_BLOCK_SIZE) == 0);
+        REQUIRE(big[NUM_TESTBLOCKS * BD_BLOCK_SIZE] == 0);
+
+        delete [] big;
+        delete [] w;
+    }
+
+    SECTION("the cache buffer is registered") {
+        BlockCache bc(&bd, 16);
+        char w[BD_BLOCK_SIZE];
+        char r[BD_BLOCK_SIZE];
+        gen_random(w, BD_BLOCK_SIZE);
+        for(uint32_t b= 0; b < 32; b++)
+            REQUIRE(bc.write(b, w) == 0);
+        REQUIRE(bc.flush() == 0);
+        REQUIRE(bd.read(31, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE) == 0);
+        if(bd.isIoRing()) {
+            // the evicted blocks were written from the registered buffer
+            REQUIRE(bd.getIoRing()->getNumFixed() >= 16);
+        }
+    }
+
+    REQUIRE(bd.close() == 0);
+    REQUIRE_FALSE(bd.isIoRing());
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_DIRECT_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    bd.setDirect(true);
+    bd.setIoRing(GENERATE(false, true));
+    REQUIRE(bd.create(BD_PATH) == 0);
+    if(!bd.isDirect()) {
+        WARN("O_DIRECT is not supported for " BD_PATH);
+    }
+
+    SECTION("write single block") {
+        bdWriteRead(&bd);
+    }
+
+    SECTION("write multiple blocks") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+    }
+
+    SECTION("unaligned buffers are bounced") {
+        // larger than a bounce buffer and starting at an odd address
+        const size_t size= BD_BLOCK_SIZE * NUM_TESTBLOCKS;
+        char* w= new char[size + 1];
+        char* r= new char[size + 1];
+        gen_random(w + 1, size);
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w + 1) == 0);
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r + 1) == 0);
+        REQUIRE(memcmp(w + 1, r + 1, size) == 0);
+
+        char* wv[3]= { w + 1, w + 1 + 2 * BD_BLOCK_SIZE, w + 1 + BD_BLOCK_SIZE };
+        char* rv[3]= { r + 1, r + 1 + BD_BLOCK_SIZE, r + 1 + 2 * BD_BLOCK_SIZE };
+        REQUIRE(bd.writeBlocksv(NUM_TESTBLOCKS, 3, wv) == 0);
+        REQUIRE(bd.readBlocksv(NUM_TESTBLOCKS, 3, rv) == 0);
+        for(int b= 0; b < 3; b++) {
+            REQUIRE(memcmp(wv[b], rv[b], BD_BLOCK_SIZE) == 0);
+        }
+        if(bd.isDirect()) {
+            REQUIRE(bd.getNumBounced() == 4);
+            REQUIRE(bd.getBufferPool()->getNumAllocated() >= 1);
+            REQUIRE(bd.getBufferPool()->getNumReused() >= 1);
+        }
+
+        delete [] r;
+        delete [] w;
+    }
+
+    SECTION("aligned buffers are not bounced") {
+        char* w= BufferPool::allocAligned(BD_BLOCK_SIZE * 8);
+        char* r= BufferPool::allocAligned(BD_BLOCK_SIZE * 8);
+        gen_random(w, BD_BLOCK_SIZE * 8);
+        BlockTransfer transfers[2]= { { true, 1, 4, w, NULL, 0 }, { true, 7, 4, w + 4 * BD_BLOCK_SIZE, NULL, 0 } };
+        REQUIRE(bd.submit(transfers, 2) == 0);
+        REQUIRE(bd.readBlocks(1, 4, r) == 0);
+        REQUIRE(bd.readBlocks(7, 4, r + 4 * BD_BLOCK_SIZE) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 8) == 0);
+        REQUIRE(bd.getNumBounced() == 0);
+        BufferPool::freeAligned(r);
+        BufferPool::freeAligned(w);
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_MAPPED_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    bd.setMapped(true);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    SECTION("write single block") {
+        bdWriteRead(&bd);
+    }
+
+    SECTION("write multiple blocks") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+    }
+
+    SECTION("direct access & growth") {
+        char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+        gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+        REQUIRE(bd.blockPtr(0) == NULL);
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        const char *p= bd.blockPtr(1);
+        REQUIRE(p != NULL);
+        REQUIRE(memcmp(p, w + BD_BLOCK_SIZE, BD_BLOCK_SIZE) == 0);
+
+        // growing the container far beyond the written part keeps the address of earlier blocks
+        const uint32_t far= 100 * NUM_TESTBLOCKS;
+        REQUIRE(bd.blockPtr(far) == NULL);
+        REQUIRE(bd.write(far, w) == 0);
+        REQUIRE(bd.blockPtr(1) == p);
+        REQUIRE(memcmp(bd.blockPtr(far), w, BD_BLOCK_SIZE) == 0);
+        REQUIRE(bd.blockPtr(far - 1) != NULL);
+        REQUIRE(bd.blockPtr(far - 1)[0] == 0);
+        REQUIRE(bd.sync() == 0);
+
+        // the syscall path sees the same content
+        REQUIRE(bd.close() == 0);
+        BlockDevice bd2(BLOCK_SIZE);
+        REQUIRE(bd2.open(BD_PATH) == 0);
+        char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+        REQUIRE(bd2.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        REQUIRE(bd2.read(far, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE) == 0);
+        REQUIRE(bd2.close() == 0);
+
+        // an existing container is mapped without changing its size
+        struct stat s;
+        REQUIRE(stat(BD_PATH, &s) == 0);
+        REQUIRE(bd.open(BD_PATH) == 0);
+        REQUIRE(bd.blockPtr((uint32_t) (s.st_size / BD_BLOCK_SIZE) - 1) != NULL);
+        REQUIRE(bd.blockPtr((uint32_t) (s.st_size / BD_BLOCK_SIZE)) == NULL);
+        off_t oldSize= s.st_size;
+        REQUIRE(stat(BD_PATH, &s) == 0);
+        REQUIRE(s.st_size == oldSize);
+
+        delete [] r;
+        delete [] w;
+    }
+
+    SECTION("read beyond end of container") {
+        char r[4 * BD_BLOCK_SIZE];
+        memset(r, 1, sizeof(r));
+        REQUIRE(bd.readBlocks(NUM_TESTBLOCKS, 4, r) == 0);
+        for(size_t i= 0; i < sizeof(r); i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_STRIPED_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+    remove(BD_STRIPE_PATH_1);
+    remove(BD_STRIPE_PATH_2);
+
+    // chunks of two blocks over three files
+    const char *paths[]= { BD_STRIPE_PATH_1, BD_STRIPE_PATH_2 };
+    BlockDevice bd(BLOCK_SIZE);
+    bd.setStripes(paths, 2, 2 * BD_BLOCK_SIZE);
+    bd.setMapped(true);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.getNumStripes() == 3);
+    REQUIRE_FALSE(bd.isMapped());
+    REQUIRE(bd.getFileDescriptor() < 0);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    SECTION("blocks are distributed round-robin") {
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        REQUIRE(bd.getNumStriped() == 1);
+        REQUIRE(bd.sync() == 0);
+
+        const char *files[]= { BD_PATH, BD_STRIPE_PATH_1, BD_STRIPE_PATH_2 };
+        char block[BD_BLOCK_SIZE];
+        for(uint32_t b= 0; b < NUM_TESTBLOCKS; b+= 7) {
+            uint32_t chunk= b / 2;
+            bdReadFile(files[chunk % 3], (long) ((chunk / 3) * 2 + b % 2) * BD_BLOCK_SIZE, BD_BLOCK_SIZE, block);
+            REQUIRE(memcmp(block, w + b * BD_BLOCK_SIZE, BD_BLOCK_SIZE) == 0);
+        }
+
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        // within a single chunk
+        REQUIRE(bd.read(5, r) == 0);
+        REQUIRE(memcmp(w + 5 * BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+        REQUIRE(bd.getNumStriped() == 2);
+    }
+
+    SECTION("scatter & gather across chunks") {
+        char* wv[NUM_TESTBLOCKS];
+        char* rv[NUM_TESTBLOCKS];
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            wv[b]= w + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE;
+            rv[b]= r + (NUM_TESTBLOCKS - 1 - b) * BD_BLOCK_SIZE;
+        }
+        REQUIRE(bd.writeBlocksv(3, NUM_TESTBLOCKS - 3, wv) == 0);
+        REQUIRE(bd.readBlocksv(3, NUM_TESTBLOCKS - 3, rv) == 0);
+        REQUIRE(memcmp(w + 3 * BD_BLOCK_SIZE, r + 3 * BD_BLOCK_SIZE, BD_BLOCK_SIZE * (NUM_TESTBLOCKS - 3)) == 0);
+    }
+
+    SECTION("reopen") {
+        REQUIRE(bd.writeBlocks(1, 9, w) == 0);
+        REQUIRE(bd.close() == 0);
+
+        BlockDevice bd2(BLOCK_SIZE);
+        bd2.setStripes(paths, 2, 2 * BD_BLOCK_SIZE);
+        REQUIRE(bd2.open(BD_PATH) == 0);
+        // beyond the end of the last member
+        memset(r, 1, 12 * BD_BLOCK_SIZE);
+        REQUIRE(bd2.readBlocks(1, 12, r) == 0);
+        REQUIRE(memcmp(w, r, 9 * BD_BLOCK_SIZE) == 0);
+        for(int i= 9 * BD_BLOCK_SIZE; i < 12 * BD_BLOCK_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(bd2.close() == 0);
+
+        // a missing member does not look like a missing container
+        remove(BD_STRIPE_PATH_2);
+        REQUIRE(bd2.open(BD_PATH) == -ENXIO);
+        REQUIRE(bd2.close() == 0);
+        REQUIRE(bd.create(BD_PATH) == 0);
+    }
+
+    SECTION("direct mode") {
+        REQUIRE(bd.close() == 0);
+        bd.setDirect(true);
+        REQUIRE(bd.open(BD_PATH) == 0);
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    delete [] r;
+    delete [] w;
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+    remove(BD_STRIPE_PATH_1);
+    remove(BD_STRIPE_PATH_2);
+}
+
+TEST_CASE( "BD_MAPPED_BENCHMARK", "[blockdevice][benchmark]" ) {
+
+    char* w= new char[BD_BLOCK_SIZE * NUM_BENCHBLOCKS];
+    char* r= new char[BD_BLOCK_SIZE * NUM_BENCHBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_BENCHBLOCKS);
+
+    double syscallTime= bdBenchmark(false, w, r);
+    double mappedTime= bdBenchmark(true, w, r);
+
+    fprintf(stderr, "BlockDevice: %d single block reads/writes of %d blocks, syscalls %.3f s, mapped %.3f s\n",
+            NUM_BENCHROUNDS, NUM_BENCHBLOCKS, syscallTime, mappedTime);
+
+    delete [] r;
+    delete [] w;
+    remove(BD_PATH);
+}
+
 // ***
 // *** Helper functions
 // ***
@@ -108,3 +499,38 @@ void bdWriteRead(BlockDevice *bd, int noBlocks) {
     delete [] r;
     delete [] w;
 }
+
+// Write all blocks once, then read and rewrite them block by block in several rounds. Returns the time in seconds.
+double bdBenchmark(bool mapped, char *w, char *r) {
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    bd.setMapped(mapped);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.writeBlocks(0, NUM_BENCHBLOCKS, w) == 0);
+
+    int ret= 0;
+    auto start= std::chrono::steady_clock::now();
+    for(int round= 0; round < NUM_BENCHROUNDS; round++) {
+        for(int b= 0; b < NUM_BENCHBLOCKS; b++)
+            ret|= bd.read(b, r + b*BD_BLOCK_SIZE);
+        for(int b= 0; b < NUM_BENCHBLOCKS; b++)
+            ret|= bd.write(b, w + b*BD_BLOCK_SIZE);
+    }
+    auto end= std::chrono::steady_clock::now();
+
+    REQUIRE(ret == 0);
+    REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_BENCHBLOCKS) == 0);
+    REQUIRE(bd.close() == 0);
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// Read size bytes at byte position pos of a file, bypassing the block device.
+void bdReadFile(const char *path, long pos, size_t size, char *buffer) {
+    FILE *file= fopen(path, "rb");
+    REQUIRE(file != NULL);
+    REQUIRE(fseek(file, pos, SEEK_SET) == 0);
+    REQUIRE(fread(buffer, 1, size, file) == size);
+    fclose(file);
+}
@@ -0,0 +1,56 @@
+//
+//  utest-bufferpool.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "bufferpool.h"
+
+TEST_CASE( "BP_GET_PUT", "[bufferpool]" ) {
+
+    BufferPool pool(10000, 2);
+    REQUIRE(pool.getBufferSize() == 3 * BP_ALIGNMENT);
+
+    SECTION("buffers are aligned and reused") {
+        char *a= pool.get();
+        REQUIRE(a != NULL);
+        REQUIRE((uintptr_t) a % BP_ALIGNMENT == 0);
+        memset(a, 1, pool.getBufferSize());
+        pool.put(a);
+
+        char *b= pool.get();
+        REQUIRE(b == a);
+        REQUIRE(pool.getNumAllocated() == 1);
+        REQUIRE(pool.getNumReused() == 1);
+        pool.put(b);
+    }
+
+    SECTION("only a few released buffers are kept") {
+        std::vector<char *> buffers;
+        for(int i= 0; i < 4; i++)
+            buffers.push_back(pool.get());
+        for(size_t i= 0; i < buffers.size(); i++)
+            pool.put(buffers[i]);
+        REQUIRE(pool.getNumAllocated() == 4);
+
+        // two come from the pool, the third one is allocated again
+        for(int i= 0; i < 3; i++)
+            buffers[i]= pool.get();
+        REQUIRE(pool.getNumReused() == 2);
+        REQUIRE(pool.getNumAllocated() == 5);
+        for(int i= 0; i < 3; i++)
+            pool.put(buffers[i]);
+    }
+
+    SECTION("aligned allocations") {
+        char *p= BufferPool::allocAligned(12345);
+        REQUIRE(p != NULL);
+        REQUIRE((uintptr_t) p % BP_ALIGNMENT == 0);
+        BufferPool::freeAligned(p);
+    }
+}
@@ -0,0 +1,89 @@
+//
+//  utest-chunkarena.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "chunkarena.h"
+
+#define CHUNK_SIZE 4096
+
+TEST_CASE( "CA_ALLOC_RELEASE", "[chunkarena]" ) {
+
+    ChunkArena arena(CHUNK_SIZE);
+    REQUIRE(arena.getNumChunks() == 0);
+
+    std::vector<char *> chunks;
+    for(int i= 0; i < 3 * CA_CHUNKS_PER_SLAB; i++) {
+        char *chunk= arena.alloc();
+        REQUIRE(chunk != NULL);
+        memset(chunk, (char) i, CHUNK_SIZE);
+        chunks.push_back(chunk);
+    }
+    REQUIRE(arena.getNumChunks() == 3 * CA_CHUNKS_PER_SLAB);
+    REQUIRE(arena.getNumFree() == 0);
+
+    SECTION("chunks do not overlap") {
+        for(size_t i= 0; i < chunks.size(); i++) {
+            for(int b= 0; b < CHUNK_SIZE; b+= 512) {
+                REQUIRE(chunks[i][b] == (char) i);
+            }
+        }
+    }
+
+    SECTION("released chunks are reused") {
+        std::set<char *> released;
+        for(size_t i= 0; i < chunks.size(); i+= 3) {
+            arena.release(chunks[i]);
+            released.insert(chunks[i]);
+        }
+        REQUIRE(arena.getNumFree() == released.size());
+
+        for(size_t i= 0; i < released.size(); i++) {
+            REQUIRE(released.count(arena.alloc()) == 1);
+        }
+        REQUIRE(arena.getNumFree() == 0);
+        REQUIRE(arena.getNumChunks() == 3 * CA_CHUNKS_PER_SLAB);
+    }
+}
+
+TEST_CASE( "CA_CONCURRENT_ACCESS", "[chunkarena]" ) {
+
+    ChunkArena arena(CHUNK_SIZE);
+
+    const int numThreads= 4;
+    std::vector<std::thread> threads;
+    std::vector<int> failed(numThreads, 0);
+
+    for(int t= 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&arena, &failed, t]() {
+            std::vector<char *> chunks;
+            for(int i= 0; i < 1000; i++) {
+                for(int c= 0; c < 10; c++) {
+                    char *chunk= arena.alloc();
+                    memset(chunk, t, CHUNK_SIZE);
+                    chunks.push_back(chunk);
+                }
+                for(size_t c= 0; c < chunks.size(); c++) {
+                    if(chunks[c][0] != t || chunks[c][CHUNK_SIZE - 1] != t)
+                        failed[t]++;
+                    arena.release(chunks[c]);
+                }
+                chunks.clear();
+            }
+        }));
+    }
+    for(size_t t= 0; t < threads.size(); t++)
+        threads[t].join();
+
+    for(int t= 0; t < numThreads; t++) {
+        REQUIRE(failed[t] == 0);
+    }
+    REQUIRE(arena.getNumFree() == arena.getNumChunks());
+}
@@ -0,0 +1,76 @@
+//
+//  utest-crc32c.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string.h>
+#include <vector>
+
+#include "tools.hpp"
+#include "crc32c.h"
+
+#define TEST_SIZE 65536
+
+TEST_CASE( "CRC32C_VECTORS", "[crc32c]" ) {
+
+    // check values of RFC 3720, appendix B.4, and of the CRC catalogue
+    unsigned char data[32];
+    REQUIRE(Crc32c::compute("123456789", 9) == 0xE3069283u);
+    REQUIRE(Crc32c::computeTable("123456789", 9) == 0xE3069283u);
+
+    memset(data, 0, sizeof(data));
+    REQUIRE(Crc32c::compute(data, sizeof(data)) == 0x8A9136AAu);
+    REQUIRE(Crc32c::computeTable(data, sizeof(data)) == 0x8A9136AAu);
+
+    memset(data, 0xFF, sizeof(data));
+    REQUIRE(Crc32c::compute(data, sizeof(data)) == 0x62A8AB43u);
+
+    for(int i= 0; i < 32; i++)
+        data[i]= (unsigned char) i;
+    REQUIRE(Crc32c::compute(data, sizeof(data)) == 0x46DD794Eu);
+
+    REQUIRE(Crc32c::compute(data, 0) == 0);
+}
+
+TEST_CASE( "CRC32C_CONSISTENCY", "[crc32c]" ) {
+
+    std::vector<char> data(TEST_SIZE + 8);
+    gen_random(data.data(), (int) data.size());
+
+    SECTION("instructions and tables agree at any alignment and size") {
+        for(size_t offset= 0; offset < 8; offset++) {
+            for(size_t size= 0; size < 100; size+= 7)
+                REQUIRE(Crc32c::compute(&data[offset], size) == Crc32c::computeTable(&data[offset], size));
+        }
+        REQUIRE(Crc32c::compute(data.data(), TEST_SIZE) == Crc32c::computeTable(data.data(), TEST_SIZE));
+    }
+
+    SECTION("a checksum is continued") {
+        uint32_t crc= Crc32c::compute(data.data(), 1000);
+        crc= Crc32c::compute(&data[1000], TEST_SIZE - 1000, crc);
+        REQUIRE(crc == Crc32c::compute(data.data(), TEST_SIZE));
+        REQUIRE(Crc32c::computeTable(&data[13], 999, Crc32c::computeTable(data.data(), 13)) ==
+                Crc32c::compute(data.data(), 1012));
+    }
+
+    SECTION("blocks are checksummed one by one") {
+        const size_t blockSize= 4096;
+        uint32_t crcs[16];
+        for(uint32_t count= 1; count <= 16; count++) {
+            memset(crcs, 0, sizeof(crcs));
+            Crc32c::computeBlocks(data.data(), blockSize, count, crcs);
+            for(uint32_t b= 0; b < count; b++)
+                REQUIRE(crcs[b] == Crc32c::computeTable(&data[b * blockSize], blockSize));
+        }
+
+        // a single changed byte is found in its block only
+        Crc32c::computeBlocks(data.data(), 512, 7, crcs);
+        data[3 * 512 + 100]^= 1;
+        uint32_t changed[7];
+        Crc32c::computeBlocks(data.data(), 512, 7, changed);
+        for(uint32_t b= 0; b < 7; b++)
+            REQUIRE((crcs[b] != changed[b]) == (b == 3));
+    }
+}
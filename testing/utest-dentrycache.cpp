@@ -0,0 +1,118 @@
+//
+//  utest-dentrycache.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dentrycache.h"
+
+TEST_CASE( "DENTRYCACHE_LOOKUP", "[dentrycache]" ) {
+
+    DentryCache cache(4);
+    uint32_t ino;
+
+    SECTION("paths and their prefixes") {
+        const char *path= "/a/b/c";
+        REQUIRE_FALSE(cache.lookup(path, strlen(path), &ino));
+        cache.insert(path, 2, 1);
+        cache.insert(path, 4, 2);
+
+        REQUIRE(cache.lookup("/a", 2, &ino));
+        REQUIRE(ino == 1);
+        REQUIRE(cache.lookup(path, 4, &ino));
+        REQUIRE(ino == 2);
+        REQUIRE_FALSE(cache.lookup(path, strlen(path), &ino));
+
+        // a cached path gets its new inode
+        cache.insert("/a", 2, 7);
+        REQUIRE(cache.lookup("/a", 2, &ino));
+        REQUIRE(ino == 7);
+        REQUIRE(cache.getNumEntries() == 2);
+
+        REQUIRE(cache.getHits() == 3);
+        REQUIRE(cache.getMisses() == 2);
+    }
+
+    SECTION("negative entries") {
+        cache.insert("/missing", 8, DC_NEGATIVE);
+        REQUIRE(cache.lookup("/missing", 8, &ino));
+        REQUIRE(ino == DC_NEGATIVE);
+        REQUIRE(cache.getNegativeHits() == 1);
+        REQUIRE(cache.getHits() == 0);
+    }
+
+    SECTION("least recently used entries are replaced") {
+        cache.insert("/1", 2, 1);
+        cache.insert("/2", 2, 2);
+        cache.insert("/3", 2, 3);
+        cache.insert("/4", 2, 4);
+        REQUIRE(cache.lookup("/1", 2, &ino));
+
+        cache.insert("/5", 2, 5);
+        REQUIRE(cache.getNumEntries() == 4);
+        REQUIRE_FALSE(cache.lookup("/2", 2, &ino));
+        REQUIRE(cache.lookup("/1", 2, &ino));
+        REQUIRE(ino == 1);
+        REQUIRE(cache.lookup("/5", 2, &ino));
+        REQUIRE(ino == 5);
+    }
+}
+
+TEST_CASE( "DENTRYCACHE_INVALIDATE", "[dentrycache]" ) {
+
+    DentryCache cache(8);
+    uint32_t ino;
+
+    cache.insert("/a", 2, 1);
+    cache.insert("/a/b", 4, 2);
+    cache.insert("/a/b/c", 6, 3);
+    cache.insert("/ab", 3, 4);
+
+    SECTION("a path and everything below it") {
+        cache.invalidate("/a/b", true);
+        REQUIRE(cache.lookup("/a", 2, &ino));
+        REQUIRE_FALSE(cache.lookup("/a/b", 4, &ino));
+        REQUIRE_FALSE(cache.lookup("/a/b/c", 6, &ino));
+
+        cache.invalidate("/a", true);
+        REQUIRE_FALSE(cache.lookup("/a", 2, &ino));
+        REQUIRE(cache.lookup("/ab", 3, &ino));
+        REQUIRE(ino == 4);
+        REQUIRE(cache.getNumEntries() == 1);
+    }
+
+    SECTION("only the path itself for a file") {
+        cache.invalidate("/ab", false);
+        REQUIRE_FALSE(cache.lookup("/ab", 3, &ino));
+        cache.invalidate("/a/x", false);
+        REQUIRE(cache.getNumEntries() == 3);
+
+        cache.invalidate("/a/b/c", false);
+        REQUIRE(cache.lookup("/a/b", 4, &ino));
+        REQUIRE(ino == 2);
+        REQUIRE(cache.getNumEntries() == 2);
+    }
+
+    SECTION("freed entries are reused") {
+        cache.invalidate("/", true);
+        REQUIRE(cache.getNumEntries() == 0);
+        for(uint32_t i= 0; i < 8; i++) {
+            char path[8];
+            snprintf(path, sizeof(path), "/%u", i);
+            cache.insert(path, strlen(path), i);
+        }
+        REQUIRE(cache.getNumEntries() == 8);
+        REQUIRE(cache.lookup("/0", 2, &ino));
+        REQUIRE(ino == 0);
+    }
+
+    SECTION("clear") {
+        cache.clear();
+        REQUIRE(cache.getNumEntries() == 0);
+        REQUIRE_FALSE(cache.lookup("/ab", 3, &ino));
+    }
+}
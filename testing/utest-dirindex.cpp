@@ -0,0 +1,115 @@
+//
+//  utest-dirindex.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <string>
+
+#include "dirindex.h"
+
+#define NUM_TESTNAMES 10000
+
+TEST_CASE( "DI_INSERT_FIND_REMOVE", "[dirindex]" ) {
+
+    DirIndex index;
+    char name[32];
+
+    for(int i= 0; i < NUM_TESTNAMES; i++) {
+        sprintf(name, "name-%d", i);
+        REQUIRE(index.find(0, name) == -1);
+        int id= index.insert(0, name, i, 2 * i);
+        REQUIRE(index.find(0, name) == id);
+    }
+    REQUIRE(index.size() == NUM_TESTNAMES);
+
+    SECTION("lookup") {
+        for(int i= 0; i < NUM_TESTNAMES; i++) {
+            sprintf(name, "name-%d", i);
+            int id= index.find(0, name);
+            REQUIRE(id >= 0);
+            REQUIRE(strcmp(index.getName(id), name) == 0);
+            REQUIRE(index.getInode(id) == (uint32_t) i);
+            REQUIRE(index.getAux(id) == (uint32_t) (2 * i));
+        }
+        REQUIRE(index.find(0, "name-") == -1);
+        REQUIRE(index.find(0, "") == -1);
+    }
+
+    SECTION("remove & reinsert") {
+        // many removals leave deleted slots behind, lookups must still terminate
+        for(int round= 0; round < 5; round++) {
+            for(int i= 0; i < NUM_TESTNAMES; i+= 2) {
+                sprintf(name, "name-%d", i);
+                index.remove(index.find(0, name));
+            }
+            REQUIRE(index.size() == NUM_TESTNAMES / 2);
+            for(int i= 0; i < NUM_TESTNAMES; i+= 2) {
+                sprintf(name, "name-%d", i);
+                REQUIRE(index.find(0, name) == -1);
+                index.insert(0, name, i);
+            }
+        }
+        REQUIRE(index.size() == NUM_TESTNAMES);
+
+        // identifiers of removed entries are reused, so iteration visits each name exactly once
+        std::set<std::string> names;
+        for(int id= 0; id < index.end(); id++) {
+            if(index.isUsed(id))
+                names.insert(index.getName(id));
+        }
+        REQUIRE(names.size() == NUM_TESTNAMES);
+        REQUIRE(index.end() == NUM_TESTNAMES);
+    }
+
+    SECTION("rename") {
+        int id= index.find(0, "name-7");
+        index.rename(id, 0, "renamed");
+        REQUIRE(index.find(0, "name-7") == -1);
+        REQUIRE(index.find(0, "renamed") == id);
+        REQUIRE(index.getInode(id) == 7);
+    }
+
+    SECTION("directories") {
+        // the same name in another directory is another entry
+        REQUIRE(index.find(1, "name-7") == -1);
+        int id= index.insert(1, "name-7", 20000);
+        REQUIRE(index.find(1, "name-7") == id);
+        REQUIRE(index.getInode(index.find(0, "name-7")) == 7);
+        REQUIRE(index.getParent(id) == 1);
+        REQUIRE(index.hasChildren(1));
+        REQUIRE_FALSE(index.hasChildren(2));
+        REQUIRE(index.firstChild(2) == -1);
+
+        int other= index.insert(1, "other", 20001);
+        std::set<std::string> names;
+        for(int c= index.firstChild(1); c >= 0; c= index.nextChild(c))
+            names.insert(index.getName(c));
+        REQUIRE(names.size() == 2);
+        REQUIRE(names.count("name-7") == 1);
+        REQUIRE(names.count("other") == 1);
+
+        int count= 0;
+        for(int c= index.firstChild(0); c >= 0; c= index.nextChild(c))
+            count++;
+        REQUIRE(count == NUM_TESTNAMES);
+
+        // entries move between directories
+        index.rename(other, 2, "moved");
+        REQUIRE(index.find(1, "other") == -1);
+        REQUIRE(index.find(2, "moved") == other);
+        REQUIRE(index.firstChild(2) == other);
+        REQUIRE(index.nextChild(other) == -1);
+        REQUIRE(index.firstChild(1) == id);
+
+        index.remove(id);
+        REQUIRE_FALSE(index.hasChildren(1));
+        index.remove(other);
+        REQUIRE_FALSE(index.hasChildren(2));
+        REQUIRE(index.size() == NUM_TESTNAMES);
+    }
+}
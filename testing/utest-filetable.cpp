@@ -0,0 +1,110 @@
+//
+//  utest-filetable.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "filetable.h"
+
+TEST_CASE( "FT_OPEN_RELEASE", "[filetable]" ) {
+
+    const uint32_t capacity= 3 * FT_HANDLES_PER_SLAB + 5;
+    FileTable table(capacity);
+    REQUIRE(table.getCapacity() == capacity);
+    REQUIRE(table.getNumOpen() == 0);
+
+    std::vector<MyFsHandle *> handles;
+    for(uint32_t i= 0; i < capacity; i++) {
+        MyFsHandle *handle= table.open(i, &handles);
+        REQUIRE(handle != NULL);
+        REQUIRE(handle->ino == i);
+        REQUIRE(handle->file == &handles);
+        REQUIRE(handle->extentCursor == 0);
+        REQUIRE(handle->nextOffset == 0);
+        handle->nextOffset= i;
+        handles.push_back(handle);
+    }
+    REQUIRE(table.getNumOpen() == capacity);
+    REQUIRE(table.open(0) == NULL);
+
+    SECTION("handles are distinct and stay in place") {
+        std::set<MyFsHandle *> distinct(handles.begin(), handles.end());
+        REQUIRE(distinct.size() == capacity);
+        for(uint32_t i= 0; i < capacity; i++) {
+            REQUIRE(handles[i]->ino == i);
+            REQUIRE(handles[i]->nextOffset == i);
+        }
+    }
+
+    SECTION("released handles are reused and reset") {
+        std::set<MyFsHandle *> released;
+        for(uint32_t i= 0; i < capacity; i+= 7) {
+            table.release(handles[i]);
+            released.insert(handles[i]);
+        }
+        REQUIRE(table.getNumOpen() == capacity - released.size());
+
+        for(size_t i= 0; i < released.size(); i++) {
+            MyFsHandle *handle= table.open(99);
+            REQUIRE(released.count(handle) == 1);
+            REQUIRE(handle->nextOffset == 0);
+        }
+        REQUIRE(table.open(0) == NULL);
+    }
+
+    SECTION("the capacity can change while files are open") {
+        table.setCapacity(10);
+        REQUIRE(table.open(0) == NULL);
+        for(uint32_t i= 0; i < capacity - 9; i++)
+            table.release(handles[i]);
+        REQUIRE(table.open(0) != NULL);
+        REQUIRE(table.open(0) == NULL);
+
+        table.setCapacity(FT_MAX_HANDLES + 1);
+        REQUIRE(table.getCapacity() == FT_MAX_HANDLES);
+    }
+}
+
+TEST_CASE( "FT_CONCURRENT_ACCESS", "[filetable]" ) {
+
+    const int numThreads= 4;
+    const int numRounds= 20000;
+    FileTable table(numThreads * 16);
+
+    std::vector<std::thread> threads;
+    std::vector<int> failed(numThreads, 0);
+
+    for(int t= 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&table, &failed, t]() {
+            std::vector<MyFsHandle *> open;
+            for(int i= 0; i < numRounds; i++) {
+                if(open.size() < 16 && (i % 3) != 2) {
+                    MyFsHandle *handle= table.open((uint32_t) t);
+                    if(handle != NULL)
+                        open.push_back(handle);
+                } else if(!open.empty()) {
+                    table.release(open.back());
+                    open.pop_back();
+                }
+                for(size_t h= 0; h < open.size(); h++) {
+                    if(open[h]->ino != (uint32_t) t)
+                        failed[t]++;
+                }
+            }
+            for(size_t h= 0; h < open.size(); h++)
+                table.release(open[h]);
+        }));
+    }
+    for(size_t t= 0; t < threads.size(); t++)
+        threads[t].join();
+
+    for(int t= 0; t < numThreads; t++) {
+        REQUIRE(failed[t] == 0);
+    }
+    REQUIRE(table.getNumOpen() == 0);
+}
@@ -0,0 +1,160 @@
+//
+//  utest-ioring.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+#include "tools.hpp"
+#include "ioring.h"
+
+#define RING_PATH "/tmp/ioring.bin"
+#define CHUNK_SIZE 4096
+#define NUM_CHUNKS 256
+
+TEST_CASE( "IORING_TRANSFER", "[ioring]" ) {
+
+    remove(RING_PATH);
+    int fd= open(RING_PATH, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    REQUIRE(fd >= 0);
+
+    IoRing ring;
+    int ret= ring.init(fd, 16);
+    if(ret == -ENOSYS || ret == -EPERM) {
+        WARN("io_uring is not available, skipping");
+        close(fd);
+        remove(RING_PATH);
+        return;
+    }
+    REQUIRE(ret == 0);
+    REQUIRE(ring.isActive());
+
+    std::vector<char> w((size_t) CHUNK_SIZE * NUM_CHUNKS);
+    std::vector<char> r(w.size(), 1);
+    gen_random(w.data(), w.size());
+
+    // more requests than the ring has entries, every second chunk first
+    std::vector<struct iovec> iov(NUM_CHUNKS);
+    std::vector<IoRequest> requests(NUM_CHUNKS);
+    for(int c= 0; c < NUM_CHUNKS; c++) {
+        int chunk= (c % 2) * (NUM_CHUNKS / 2) + c / 2;
+        iov[c].iov_base= &w[(size_t) chunk * CHUNK_SIZE];
+        iov[c].iov_len= CHUNK_SIZE;
+        requests[c].write= true;
+        requests[c].pos= (uint64_t) chunk * CHUNK_SIZE;
+        requests[c].iov= &iov[c];
+        requests[c].iovcnt= 1;
+    }
+    REQUIRE(ring.transfer(requests.data(), requests.size()) == 0);
+    REQUIRE(ring.getNumCalls() == 1);
+    REQUIRE(ring.getNumRequests() == NUM_CHUNKS);
+
+    SECTION("vectored read") {
+        std::vector<struct iovec> rv(NUM_CHUNKS);
+        for(int c= 0; c < NUM_CHUNKS; c++) {
+            rv[c].iov_base= &r[(size_t) c * CHUNK_SIZE];
+            rv[c].iov_len= CHUNK_SIZE;
+        }
+        IoRequest request;
+        request.write= false;
+        request.pos= 0;
+        request.iov= rv.data();
+        request.iovcnt= NUM_CHUNKS;
+        REQUIRE(ring.transfer(&request, 1) == 0);
+        REQUIRE(memcmp(w.data(), r.data(), w.size()) == 0);
+    }
+
+    SECTION("registered buffer") {
+        REQUIRE(ring.registerBuffer(r.data(), r.size()) == 0);
+        struct iovec one;
+        one.iov_base= &r[CHUNK_SIZE];
+        one.iov_len= 2 * CHUNK_SIZE;
+        IoRequest request;
+        request.write= false;
+        request.pos= 10 * CHUNK_SIZE;
+        request.iov= &one;
+        request.iovcnt= 1;
+        REQUIRE(ring.transfer(&request, 1) == 0);
+        REQUIRE(ring.getNumFixed() == 1);
+        REQUIRE(memcmp(&w[10 * CHUNK_SIZE], &r[CHUNK_SIZE], 2 * CHUNK_SIZE) == 0);
+        ring.unregisterBuffer();
+    }
+
+    SECTION("read beyond end of file") {
+        struct iovec one;
+        one.iov_base= r.data();
+        one.iov_len= 2 * CHUNK_SIZE;
+        IoRequest request;
+        request.write= false;
+        request.pos= (uint64_t) (NUM_CHUNKS - 1) * CHUNK_SIZE;
+        request.iov= &one;
+        request.iovcnt= 1;
+        REQUIRE(ring.transfer(&request, 1) == 0);
+        REQUIRE(memcmp(&w[(size_t) (NUM_CHUNKS - 1) * CHUNK_SIZE], r.data(), CHUNK_SIZE) == 0);
+        for(int i= CHUNK_SIZE; i < 2 * CHUNK_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    SECTION("concurrent callers") {
+        const int numThreads= 4;
+        std::vector<std::thread> threads;
+        std::vector<int> failed(numThreads, 0);
+        for(int t= 0; t < numThreads; t++) {
+            threads.push_back(std::thread([&ring, &w, &r, &failed, t]() {
+                for(int c= t; c < NUM_CHUNKS; c+= numThreads) {
+                    struct iovec one;
+                    one.iov_base= &r[(size_t) c * CHUNK_SIZE];
+                    one.iov_len= CHUNK_SIZE;
+                    IoRequest request;
+                    request.write= false;
+                    request.pos= (uint64_t) c * CHUNK_SIZE;
+                    request.iov= &one;
+                    request.iovcnt= 1;
+                    if(ring.transfer(&request, 1) != 0 ||
+                       memcmp(&w[(size_t) c * CHUNK_SIZE], &r[(size_t) c * CHUNK_SIZE], CHUNK_SIZE) != 0)
+                        failed[t]++;
+                }
+            }));
+        }
+        for(size_t t= 0; t < threads.size(); t++)
+            threads[t].join();
+        for(int t= 0; t < numThreads; t++) {
+            REQUIRE(failed[t] == 0);
+        }
+    }
+
+    SECTION("errors are reported per request") {
+        close(fd);
+        fd= open(RING_PATH, O_RDONLY);
+        REQUIRE(ring.init(fd, 16) == 0);
+        struct iovec two[2];
+        two[0].iov_base= r.data();
+        two[0].iov_len= CHUNK_SIZE;
+        two[1]= two[0];
+        IoRequest requests[2];
+        requests[0].write= false;
+        requests[0].pos= 0;
+        requests[0].iov= &two[0];
+        requests[0].iovcnt= 1;
+        requests[1].write= true;
+        requests[1].pos= 0;
+        requests[1].iov= &two[1];
+        requests[1].iovcnt= 1;
+        REQUIRE(ring.transfer(requests, 2) == -EBADF);
+        REQUIRE(requests[0].result == 0);
+        REQUIRE(requests[1].result == -EBADF);
+    }
+
+    ring.close();
+    close(fd);
+    remove(RING_PATH);
+}
@@ -0,0 +1,175 @@
+//
+//  utest-journal.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "tools.hpp"
+
+#include "blockdevice.h"
+#include "blockcache.h"
+#include "journal.h"
+#include "myfs-structs.h"
+
+#define BD_PATH "/tmp/bd.bin"
+#define NUM_TESTBLOCKS 256
+#define NUM_CACHEBLOCKS 16
+#define BLOCK_SIZE 512
+#define JOURNAL_START 192
+#define JOURNAL_SIZE 64
+
+// a crash loses the dirty blocks of the cache and the running transaction
+static uint32_t crashAndReplay(BlockDevice *bd, BlockCache **bc, Journal **journal) {
+    delete *journal;
+    delete *bc;
+    *bc= new BlockCache(bd, NUM_CACHEBLOCKS);
+    *journal= new Journal(bd, *bc, JOURNAL_START, JOURNAL_SIZE);
+
+    uint32_t numReplayed= 0;
+    REQUIRE((*journal)->replay(&numReplayed) == 0);
+    return numReplayed;
+}
+
+TEST_CASE( "JOURNAL_COMMIT_REPLAY", "[journal]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    std::vector<char> w(BLOCK_SIZE * NUM_TESTBLOCKS);
+    std::vector<char> r(BLOCK_SIZE);
+    std::vector<char> zeros(BLOCK_SIZE, 0);
+    gen_random(w.data(), w.size());
+
+    BlockCache *bc= new BlockCache(&bd, NUM_CACHEBLOCKS);
+    Journal *journal= new Journal(&bd, bc, JOURNAL_START, JOURNAL_SIZE);
+    REQUIRE(journal->format() == 0);
+
+    SECTION("committed blocks are replayed") {
+        journal->write(10, &w[10 * BLOCK_SIZE]);
+        journal->write(11, &w[11 * BLOCK_SIZE]);
+        REQUIRE(journal->getNumPending() == 2);
+        REQUIRE(journal->read(10, r.data()));
+        REQUIRE(memcmp(r.data(), &w[10 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+        REQUIRE_FALSE(journal->read(12, r.data()));
+
+        // nothing goes in place before the commit
+        REQUIRE(bc->flush() == 0);
+        REQUIRE(bd.read(10, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), zeros.data(), BLOCK_SIZE) == 0);
+
+        REQUIRE(journal->commit() == 1);
+        REQUIRE(journal->commit() == 0);
+        REQUIRE(journal->getNumPending() == 0);
+        REQUIRE(journal->getNumCommits() == 1);
+        REQUIRE(bc->read(11, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), &w[11 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 1);
+        REQUIRE(bd.read(10, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), &w[10 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+        REQUIRE(bd.read(11, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), &w[11 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+
+        // the journal is empty after a replay
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 0);
+    }
+
+    SECTION("uncommitted blocks are lost") {
+        journal->write(12, &w[12 * BLOCK_SIZE]);
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 0);
+        REQUIRE(bd.read(12, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), zeros.data(), BLOCK_SIZE) == 0);
+    }
+
+    SECTION("incomplete transactions are not replayed") {
+        journal->write(13, &w[13 * BLOCK_SIZE]);
+        REQUIRE(journal->commit() == 1);
+        journal->write(14, &w[14 * BLOCK_SIZE]);
+        REQUIRE(journal->commit() == 1);
+
+        // the image of the second transaction did not make it, it follows the header, the descriptor, image and
+        // commit block of the first transaction and its own descriptor
+        REQUIRE(bd.write(JOURNAL_START + 5, &w[0]) == 0);
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 1);
+        REQUIRE(bd.read(13, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), &w[13 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+        REQUIRE(bd.read(14, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), zeros.data(), BLOCK_SIZE) == 0);
+    }
+
+    SECTION("revoked blocks keep their new content") {
+        journal->write(20, &w[20 * BLOCK_SIZE]);
+        REQUIRE(journal->commit() == 1);
+
+        // block 20 is freed and reused for file data
+        journal->revoke(18, 4);
+        REQUIRE(journal->commit() == 1);
+        REQUIRE(bc->writeBlocks(20, 1, &w[100 * BLOCK_SIZE]) == 0);
+
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 2);
+        REQUIRE(bd.read(20, r.data()) == 0);
+        REQUIRE(memcmp(r.data(), &w[100 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+    }
+
+    SECTION("changes of freed blocks are dropped") {
+        journal->write(30, &w[30 * BLOCK_SIZE]);
+        journal->revoke(30, 1);
+        REQUIRE(journal->getNumPending() == 0);
+        REQUIRE(journal->commit() == 0);
+    }
+
+    SECTION("the journal wraps around") {
+        // 3 blocks per transaction, many more than fit into the journal
+        for(int t= 0; t < 3 * JOURNAL_SIZE; t++) {
+            journal->write(40 + t % 8, &w[t * BLOCK_SIZE]);
+            REQUIRE(journal->commit() == 1);
+        }
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) > 0);
+        for(int t= 3 * JOURNAL_SIZE - 8; t < 3 * JOURNAL_SIZE; t++) {
+            REQUIRE(bd.read(40 + t % 8, r.data()) == 0);
+            REQUIRE(memcmp(r.data(), &w[t * BLOCK_SIZE], BLOCK_SIZE) == 0);
+        }
+    }
+
+    SECTION("transactions larger than the journal go in place") {
+        for(int b= 0; b < JOURNAL_SIZE; b++)
+            journal->write(b, &w[b * BLOCK_SIZE]);
+        REQUIRE(journal->commit() == 1);
+        REQUIRE(crashAndReplay(&bd, &bc, &journal) == 0);
+        for(int b= 0; b < JOURNAL_SIZE; b++) {
+            REQUIRE(bd.read(b, r.data()) == 0);
+            REQUIRE(memcmp(r.data(), &w[b * BLOCK_SIZE], BLOCK_SIZE) == 0);
+        }
+    }
+
+    delete journal;
+    delete bc;
+    bd.close();
+    remove(BD_PATH);
+}
+
+TEST_CASE( "JOURNAL_NO_JOURNAL", "[journal]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    std::vector<char> zeros(BLOCK_SIZE, 0);
+    REQUIRE(bd.write(NUM_TESTBLOCKS - 1, zeros.data()) == 0);
+
+    BlockCache bc(&bd, NUM_CACHEBLOCKS);
+    Journal journal(&bd, &bc, JOURNAL_START, JOURNAL_SIZE);
+    uint32_t numReplayed;
+    REQUIRE(journal.replay(&numReplayed) == -EINVAL);
+
+    bd.close();
+    remove(BD_PATH);
+}
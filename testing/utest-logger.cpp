@@ -0,0 +1,135 @@
+//
+//  utest-logger.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "logger.h"
+
+#define LOGGER_PATH "/tmp/logger-utest.log"
+#define NUM_THREADS 8
+#define NUM_MESSAGES 5000
+
+// Declarations of helper functions
+std::vector<std::string> readLines(const char *path);
+
+TEST_CASE( "LOGGER_WRITE_FLUSH", "[logger]" ) {
+
+    remove(LOGGER_PATH);
+
+    Logger logger;
+    logger.setLevel(LOG_LEVEL_METHODS);
+    REQUIRE(logger.open(LOGGER_PATH) == 0);
+
+    SECTION("messages are written in order") {
+        for(int i= 0; i < 3 * LOGGER_NUM_RECORDS; i++) {
+            logger.write("message %d\n", i);
+        }
+        logger.flush();
+
+        std::vector<std::string> lines= readLines(LOGGER_PATH);
+        uint64_t dropped= logger.getNumDropped();
+        REQUIRE(lines.size() + dropped + (dropped > 0 ? 1 : 0) >= 3 * LOGGER_NUM_RECORDS);
+        if(dropped == 0) {
+            for(int i= 0; i < 3 * LOGGER_NUM_RECORDS; i++) {
+                REQUIRE(lines[i] == "message " + std::to_string(i));
+            }
+        }
+    }
+
+    SECTION("levels") {
+        REQUIRE(logger.isEnabled(LOG_LEVEL_INFO));
+        REQUIRE(logger.isEnabled(LOG_LEVEL_METHODS));
+        REQUIRE_FALSE(logger.isEnabled(LOG_LEVEL_RETURNS));
+        logger.setLevel(LOG_LEVEL_NONE);
+        REQUIRE_FALSE(logger.isEnabled(LOG_LEVEL_INFO));
+    }
+
+    SECTION("long messages are truncated") {
+        std::string text(2 * LOGGER_RECORD_SIZE, 'x');
+        logger.write("%s\n", text.c_str());
+        logger.write("next\n");
+        logger.close();
+
+        std::vector<std::string> lines= readLines(LOGGER_PATH);
+        REQUIRE(lines.size() == 2);
+        REQUIRE(lines[0].size() == LOGGER_RECORD_SIZE - 2);
+        REQUIRE(lines[1] == "next");
+    }
+
+    logger.close();
+    remove(LOGGER_PATH);
+}
+
+TEST_CASE( "LOGGER_THREADS", "[logger]" ) {
+
+    remove(LOGGER_PATH);
+
+    // a small ring buffer forces dropped messages
+    Logger logger(64);
+    logger.setLevel(LOG_LEVEL_RETURNS);
+    REQUIRE(logger.open(LOGGER_PATH) == 0);
+
+    std::vector<std::thread> threads;
+    for(int t= 0; t < NUM_THREADS; t++) {
+        threads.push_back(std::thread([&logger, t]() {
+            for(int i= 0; i < NUM_MESSAGES; i++)
+                logger.write("thread %d message %d\n", t, i);
+        }));
+    }
+    for(size_t t= 0; t < threads.size(); t++)
+        threads[t].join();
+    logger.close();
+
+    // every message is either written or counted as dropped, messages of a thread keep their order
+    std::vector<std::string> lines= readLines(LOGGER_PATH);
+    unsigned long long written= 0, dropped= 0;
+    int last[NUM_THREADS];
+    for(int t= 0; t < NUM_THREADS; t++)
+        last[t]= -1;
+    for(size_t l= 0; l < lines.size(); l++) {
+        int t, i;
+        unsigned long long n;
+        if(sscanf(lines[l].c_str(), "thread %d message %d", &t, &i) == 2) {
+            REQUIRE(i > last[t]);
+            last[t]= i;
+            written++;
+        } else {
+            REQUIRE(sscanf(lines[l].c_str(), "\t[%llu log messages dropped]", &n) == 1);
+            dropped+= n;
+        }
+    }
+    REQUIRE(written + dropped == NUM_THREADS * NUM_MESSAGES);
+    REQUIRE(dropped == logger.getNumDropped());
+
+    remove(LOGGER_PATH);
+}
+
+// ***
+// *** Helper functions
+// ***
+
+std::vector<std::string> readLines(const char *path) {
+    std::vector<std::string> lines;
+
+    FILE *file= fopen(path, "r");
+    REQUIRE(file != NULL);
+    char line[4 * LOGGER_RECORD_SIZE];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        size_t n= strlen(line);
+        if(n > 0 && line[n - 1] == '\n')
+            line[n - 1]= '\0';
+        lines.push_back(line);
+    }
+    fclose(file);
+
+    return lines;
+}
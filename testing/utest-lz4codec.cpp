@@ -0,0 +1,93 @@
+//
+//  utest-lz4codec.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "tools.hpp"
+#include "lz4codec.h"
+
+#define TEST_SIZE 65536
+
+TEST_CASE( "LZ4_ROUND_TRIP", "[lz4codec]" ) {
+
+    std::vector<char> data(TEST_SIZE);
+    std::vector<char> packed(TEST_SIZE + TEST_SIZE / 255 + 16);
+    std::vector<char> unpacked(TEST_SIZE);
+
+    SECTION("text compresses") {
+        std::string text;
+        for(int i= 0; text.size() < TEST_SIZE; i++) {
+            char line[96];
+            snprintf(line, sizeof(line), "{\"id\": %d, \"level\": \"info\", \"message\": \"request served\"}\n", i);
+            text+= line;
+        }
+        memcpy(data.data(), text.data(), TEST_SIZE);
+
+        size_t n= Lz4Codec::compress(data.data(), TEST_SIZE, packed.data(), packed.size());
+        REQUIRE(n > 0);
+        REQUIRE(n < TEST_SIZE / 4);
+        REQUIRE(Lz4Codec::decompress(packed.data(), n, unpacked.data(), unpacked.size()) == TEST_SIZE);
+        REQUIRE(memcmp(data.data(), unpacked.data(), TEST_SIZE) == 0);
+    }
+
+    SECTION("long runs and overlapping matches") {
+        memset(data.data(), 'x', TEST_SIZE);
+        memcpy(data.data() + 1000, "abc", 3);
+
+        size_t n= Lz4Codec::compress(data.data(), TEST_SIZE, packed.data(), packed.size());
+        REQUIRE(n > 0);
+        REQUIRE(n < 600);
+        REQUIRE(Lz4Codec::decompress(packed.data(), n, unpacked.data(), unpacked.size()) == TEST_SIZE);
+        REQUIRE(memcmp(data.data(), unpacked.data(), TEST_SIZE) == 0);
+    }
+
+    SECTION("random data does not fit") {
+        gen_random(data.data(), TEST_SIZE);
+        REQUIRE(Lz4Codec::compress(data.data(), TEST_SIZE, packed.data(), TEST_SIZE - 1) == 0);
+
+        // but still round-trips given the worst-case space
+        size_t n= Lz4Codec::compress(data.data(), TEST_SIZE, packed.data(), packed.size());
+        REQUIRE(n > 0);
+        REQUIRE(Lz4Codec::decompress(packed.data(), n, unpacked.data(), unpacked.size()) == TEST_SIZE);
+        REQUIRE(memcmp(data.data(), unpacked.data(), TEST_SIZE) == 0);
+    }
+
+    SECTION("short inputs") {
+        for(size_t size= 0; size < 20; size++) {
+            memset(data.data(), 'a', size);
+            size_t n= Lz4Codec::compress(data.data(), size, packed.data(), packed.size());
+            REQUIRE(n > 0);
+            REQUIRE(Lz4Codec::decompress(packed.data(), n, unpacked.data(), unpacked.size()) == (int) size);
+            REQUIRE(memcmp(data.data(), unpacked.data(), size) == 0);
+        }
+    }
+}
+
+TEST_CASE( "LZ4_DECOMPRESS", "[lz4codec]" ) {
+
+    char out[64];
+
+    SECTION("reference block") {
+        // 1 literal, match of 8 at offset 1, then 5 literals
+        const char block[]= { 0x14, 'a', 0x01, 0x00, 0x50, 'b', 'c', 'd', 'e', 'f' };
+        REQUIRE(Lz4Codec::decompress(block, sizeof(block), out, sizeof(out)) == 14);
+        REQUIRE(memcmp(out, "aaaaaaaaabcdef", 14) == 0);
+    }
+
+    SECTION("malformed blocks") {
+        const char badOffset[]= { 0x14, 'a', 0x02, 0x00, 0x00 };
+        REQUIRE(Lz4Codec::decompress(badOffset, sizeof(badOffset), out, sizeof(out)) == -EIO);
+        const char shortLiterals[]= { 0x50, 'a', 'b' };
+        REQUIRE(Lz4Codec::decompress(shortLiterals, sizeof(shortLiterals), out, sizeof(out)) == -EIO);
+        const char block[]= { 0x14, 'a', 0x01, 0x00, 0x50, 'b', 'c', 'd', 'e', 'f' };
+        REQUIRE(Lz4Codec::decompress(block, sizeof(block), out, 10) == -EIO);
+    }
+}
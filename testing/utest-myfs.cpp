@@ -8,7 +8,2081 @@
 
 #include "../catch/catch.hpp"
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "tools.hpp"
+#include "macros.h"
 #include "myfs.h"
+#include "myondiskfs.h"
+#include "myinmemoryfs.h"
+
+#define CONT_PATH "/tmp/myfs-utest.bin"
+#define LOG_PATH "/tmp/myfs-utest.log"
+#define IMAGE_PATH "/tmp/myfs-utest.img"
+#define STRIPE_PATH_1 "/tmp/myfs-utest-1.bin"
+#define STRIPE_PATH_2 "/tmp/myfs-utest-2.bin"
+
+// Declarations of helper functions
+MyFsInfo testInfo(const char *contFile);
+MyFS *mount(MyFsInfo *info);
+void unmount(MyFS *fs);
+int fillDir(void *buf, const char *name, const struct stat *stbuf, off_t off);
+int writeAll(MyFS *fs, const char *path, const char *buf, size_t size, off_t offset, size_t chunk);
+int readAll(MyFS *fs, const char *path, char *buf, size_t size, off_t offset);
+#if FUSE_VERSION >= 29
+int copyBufs(struct fuse_bufvec *bufv, char *buf);
+#endif
+
+TEST_CASE( "ONDISK_CREATE_WRITE_READ", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyFS *fs= mount(&info);
+
+    const size_t size= 10000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+    memset(r, 0, size);
+
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == -EEXIST);
+
+    SECTION("sequential write & read") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == 0);
+        REQUIRE(s.st_size == (off_t) size);
+        REQUIRE(S_ISREG(s.st_mode));
+    }
+
+    SECTION("unaligned writes") {
+        // odd chunk size, so writes start and end in the middle of blocks
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 333) == (int) size);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+
+        REQUIRE(readAll(fs, "/file", r, 100, 1234) == 100);
+        REQUIRE(memcmp(w + 1234, r, 100) == 0);
+    }
+
+    SECTION("write beyond end of file") {
+        REQUIRE(writeAll(fs, "/file", w, 100, 0, 100) == 100);
+        REQUIRE(writeAll(fs, "/file", w, 100, 3000, 100) == 100);
+        REQUIRE(readAll(fs, "/file", r, 3100, 0) == 3100);
+        REQUIRE(memcmp(w, r, 100) == 0);
+        for(int i= 100; i < 3000; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(w, r + 3000, 100) == 0);
+    }
+
+    SECTION("truncate") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+        REQUIRE(fs->fuseTruncate("/file", 1000) == 0);
+        REQUIRE(fs->fuseTruncate("/file", 2000) == 0);
+
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == 0);
+        REQUIRE(s.st_size == 2000);
+
+        REQUIRE(readAll(fs, "/file", r, size, 0) == 2000);
+        REQUIRE(memcmp(w, r, 1000) == 0);
+        for(int i= 1000; i < 2000; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    SECTION("rename & unlink") {
+        REQUIRE(fs->fuseMknod("/other", S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+        REQUIRE(fs->fuseRename("/file", "/other") == 0);
+
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == -ENOENT);
+        REQUIRE(fs->fuseGetattr("/other", &s) == 0);
+        REQUIRE(s.st_size == (off_t) size);
+
+        REQUIRE(fs->fuseUnlink("/other") == 0);
+        REQUIRE(fs->fuseGetattr("/other", &s) == -ENOENT);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    unmount(fs);
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_PERSISTENCE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 100000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+    memset(r, 0, size);
+
+    // the container is written in one access mode and read back in another one: system calls, mapped, io_uring,
+    // O_DIRECT
+    int mode= GENERATE(0, 1, 2, 3);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.mapped= mode == 1;
+    info.uring= mode == 2;
+    info.direct= mode == 3;
+    MyFS *fs= mount(&info);
+    REQUIRE(fs->fuseMknod("/a", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/b", S_IFREG | 0600, 0) == 0);
+    REQUIRE(writeAll(fs, "/a", w, size, 0, 4096) == (int) size);
+    REQUIRE(fs->fuseChmod("/b", 0640) == 0);
+    unmount(fs);
+
+    int next= (mode + 1) % 4;
+    info.mapped= next == 1;
+    info.uring= next == 2;
+    info.direct= next == 3;
+    fs= mount(&info);
+
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.size() == 4);
+    REQUIRE(names.count("a") == 1);
+    REQUIRE(names.count("b") == 1);
+
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/b", &s) == 0);
+    REQUIRE(s.st_mode == (S_IFREG | 0640));
+
+    REQUIRE(readAll(fs, "/a", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_BLOCK_SIZE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 300000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    uint32_t blockSize= GENERATE(MIN_BLOCK_SIZE, DEFAULT_BLOCK_SIZE, MAX_BLOCK_SIZE);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.blockSize= blockSize;
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->superBlock.blockSize == blockSize);
+    REQUIRE(fs->getBlockCache()->getNumBlocks() == BC_DEFAULT_NUM_BLOCKS);
+
+    // enough names to fill several directory blocks of the smallest size
+    char path[16];
+    for(int i= 0; i < 100; i++) {
+        sprintf(path, "/file%d", i);
+        REQUIRE(fs->fuseMknod(path, S_IFREG | 0644, 0) == 0);
+    }
+    REQUIRE(fs->fuseMknod("/a", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/a", w, size, 0, 3000) == (int) size);
+
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/a", &s) == 0);
+    REQUIRE(s.st_blksize == (blksize_t) blockSize);
+    REQUIRE(s.st_blocks == (blkcnt_t) ((size + blockSize - 1) / blockSize * (blockSize / 512)));
+    unmount(fs);
+
+    // the block size of an existing container wins over the configured one
+    info.blockSize= blockSize == DEFAULT_BLOCK_SIZE ? MIN_BLOCK_SIZE : 0;
+    fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->blockSize == blockSize);
+    REQUIRE(fs->superBlock.numBlocks == DEFAULT_CONTAINER_SIZE / blockSize);
+
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.size() == 103);
+    REQUIRE(readAll(fs, "/a", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_CHECKPOINT", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const int numFiles= 200;
+    char w[64];
+    char r[64];
+    char path[16];
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    for(int f= 0; f < numFiles; f++) {
+        sprintf(path, "/file%d", f);
+        snprintf(w, sizeof(w), "content of file %d", f);
+        REQUIRE(fs->fuseMknod(path, S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, path, w, strlen(w), 0, 64) == (int) strlen(w));
+    }
+    REQUIRE(fs->superBlock.state == 0);
+    unmount(fs);
+
+    SECTION("clean unmount loads inodes on demand") {
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->superBlock.state == 0);
+        REQUIRE(fs->superBlock.checkpointInode != 0);
+        REQUIRE(fs->dirIndex.size() == numFiles);
+
+        uint32_t loaded= 0;
+        for(uint32_t b= 0; b < fs->superBlock.inodeBlocks; b++)
+            loaded+= fs->inodeLoaded[b] ? 1 : 0;
+        REQUIRE(loaded <= 2);
+
+        for(int f= 0; f < numFiles; f++) {
+            sprintf(path, "/file%d", f);
+            snprintf(w, sizeof(w), "content of file %d", f);
+            REQUIRE(readAll(fs, path, r, sizeof(r), 0) == (int) strlen(w));
+            REQUIRE(memcmp(w, r, strlen(w)) == 0);
+        }
+
+        // changes after the mount survive the next one
+        REQUIRE(fs->fuseUnlink("/file0") == 0);
+        REQUIRE(fs->fuseRename("/file1", "/renamed") == 0);
+        REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+        unmount(fs);
+
+        fs= (MyOnDiskFS *) mount(&info);
+        std::set<std::string> names;
+        REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+        REQUIRE(names.size() == numFiles + 2);
+        REQUIRE(names.count("file0") == 0);
+        REQUIRE(names.count("renamed") == 1);
+        REQUIRE(names.count("new") == 1);
+        REQUIRE(readAll(fs, "/renamed", r, sizeof(r), 0) == (int) strlen("content of file 1"));
+        unmount(fs);
+    }
+
+    SECTION("unclean shutdown scans the inode table") {
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->fuseUnlink("/file0") == 0);
+        REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+
+        // the changes are committed, but the checkpoint is not written
+        REQUIRE(fs->commitJournal() == 1);
+        delete fs;
+
+        fs= (MyOnDiskFS *) mount(&info);
+        for(uint32_t b= 0; b < fs->superBlock.inodeBlocks; b++)
+            REQUIRE(fs->inodeLoaded[b]);
+        std::set<std::string> names;
+        REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+        REQUIRE(names.size() == numFiles + 2);
+        REQUIRE(names.count("file0") == 0);
+        REQUIRE(names.count("new") == 1);
+        unmount(fs);
+    }
+
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_JOURNAL", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 3 * DEFAULT_BLOCK_SIZE;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/kept", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/removed", S_IFREG | 0644, 0) == 0);
+    unmount(fs);
+
+    fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->journal->getNumPending() == 0);
+    REQUIRE(writeAll(fs, "/kept", w, size, 0, size) == (int) size);
+    REQUIRE(fs->fuseUnlink("/removed") == 0);
+    REQUIRE(fs->fuseMknod("/created", S_IFREG | 0644, 0) == 0);
+
+    // fsync commits the changes of all files
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    fileInfo.flags= O_RDONLY;
+    REQUIRE(fs->fuseOpen("/created", &fileInfo) == 0);
+    REQUIRE(fs->fuseFsync("/created", 0, &fileInfo) == 0);
+    REQUIRE(fs->fuseRelease("/created", &fileInfo) == 0);
+    REQUIRE(fs->journal->getNumPending() == 0);
+    REQUIRE(fs->journal->getNumCommits() > 0);
+
+    // changes after the last commit are lost in a crash
+    fs->stopCommits();
+    REQUIRE(fs->fuseMknod("/lost", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->journal->getNumPending() > 0);
+    delete fs;
+
+    fs= (MyOnDiskFS *) mount(&info);
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.count("kept") == 1);
+    REQUIRE(names.count("removed") == 0);
+    REQUIRE(names.count("created") == 1);
+    REQUIRE(names.count("lost") == 0);
+    REQUIRE(readAll(fs, "/kept", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+
+    // the replayed file system stays consistent
+    REQUIRE(fs->fuseMknod("/lost", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseUnlink("/kept") == 0);
+    unmount(fs);
+
+    fs= (MyOnDiskFS *) mount(&info);
+    names.clear();
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.count("kept") == 0);
+    REQUIRE(names.count("lost") == 1);
+    unmount(fs);
+
+    delete[] w;
+    delete[] r;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_JOURNAL_FREED_BLOCKS", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 16 * DEFAULT_BLOCK_SIZE;
+    std::vector<char> w(size), other(size), r(size);
+    gen_random(w.data(), size);
+    gen_random(other.data(), size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/old", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/old", w.data(), size, 0, size) == (int) size);
+    unmount(fs);
+
+    fs= (MyOnDiskFS *) mount(&info);
+    fs->stopCommits();
+    uint32_t oldIno, newIno;
+    REQUIRE(fs->resolvePath("/old", &oldIno) == 0);
+    REQUIRE(fs->loadInode(oldIno) == 0);
+    MyFsExtent oldExtent= fs->inodeInfo[oldIno].extents[0];
+    REQUIRE(oldExtent.length == 16);
+
+    // the freed blocks are not reused, although the next-fit position points at them
+    REQUIRE(fs->fuseTruncate("/old", 0) == 0);
+    fs->allocHint= oldExtent.start;
+    REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/new", other.data(), size, 0, size) == (int) size);
+    REQUIRE(fs->resolvePath("/new", &newIno) == 0);
+    REQUIRE(fs->flushFile(newIno) == 0);
+    const std::vector<MyFsExtent> &extents= fs->inodeInfo[newIno].extents;
+    for(size_t e= 0; e < extents.size(); e++) {
+        REQUIRE((extents[e].start + extents[e].length <= oldExtent.start ||
+                 extents[e].start >= oldExtent.start + oldExtent.length));
+    }
+
+    // the data of the new file reaches the container, the truncate is lost in the crash
+    REQUIRE(fs->getBlockCache()->flush() == 0);
+    delete fs;
+
+    fs= (MyOnDiskFS *) mount(&info);
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.count("new") == 0);
+    REQUIRE(readAll(fs, "/old", r.data(), size, 0) == (int) size);
+    REQUIRE(r == w);
+    unmount(fs);
+
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_LAZY_TIMES", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 3 * DEFAULT_BLOCK_SIZE;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    fs->stopCommits();
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, size) == (int) size);
+    struct utimbuf old;
+    old.actime= 1000;
+    old.modtime= 2000;
+    REQUIRE(fs->fuseUtime("/file", &old) == 0);
+    REQUIRE(fs->commitJournal() == 1);
+
+    uint32_t ino;
+    REQUIRE(fs->resolvePath("/file", &ino) == 0);
+    MyFsInode *inode= &fs->inodes[ino];
+
+    SECTION("overwrites keep the times in memory until the next commit") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, DEFAULT_BLOCK_SIZE) == (int) size);
+        REQUIRE(writeAll(fs, "/file", w, 100, 50, 100) == 100);
+        REQUIRE(fs->inodeInfo[ino].lazyTimes);
+        REQUIRE(fs->journal->getNumPending() == 0);
+        REQUIRE(fs->numLazyUpdates == 2);
+        int64_t mtime= inode->mtime;
+        REQUIRE(mtime > 2000);
+
+        // growing the file is logged right away
+        REQUIRE(writeAll(fs, "/file", w, 100, size, 100) == 100);
+        REQUIRE(fs->journal->getNumPending() > 0);
+
+        REQUIRE(fs->commitJournal() == 1);
+        REQUIRE_FALSE(fs->inodeInfo[ino].lazyTimes);
+        REQUIRE(fs->lazyInodes.empty());
+        delete fs;
+
+        fs= (MyOnDiskFS *) mount(&info);
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == 0);
+        REQUIRE(s.st_mtime >= mtime);
+        REQUIRE(s.st_size == (off_t) (size + 100));
+        unmount(fs);
+    }
+
+    SECTION("reads update the access time like relatime") {
+        REQUIRE(fs->atimeInterval == RELATIME_INTERVAL);
+
+        // older than the modification time
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(inode->atime > 2000);
+        REQUIRE(fs->inodeInfo[ino].lazyTimes);
+        REQUIRE(fs->journal->getNumPending() == 0);
+
+        // recent enough
+        int64_t now= time(NULL);
+        inode->atime= now - 10;
+        inode->mtime= inode->ctime= now - 100;
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(inode->atime == now - 10);
+
+        fs->atimeInterval= 0;
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(inode->atime >= now);
+
+        fs->atimeInterval= ATIME_NEVER;
+        inode->atime= 1000;
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(inode->atime == 1000);
+        unmount(fs);
+    }
+
+    delete[] w;
+    delete[] r;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_EXTENTS", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const int numFiles= 2;
+    const size_t size= 200 * DEFAULT_BLOCK_SIZE;
+    char *w[numFiles];
+    char *r= new char[size];
+    for(int f= 0; f < numFiles; f++) {
+        w[f]= new char[size];
+        gen_random(w[f], size);
+    }
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyFS *fs= mount(&info);
+    REQUIRE(fs->fuseMknod("/f0", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/f1", S_IFREG | 0644, 0) == 0);
+
+    // interleaved appends fragment both files into many extents, more than fit into the inode
+    for(size_t offset= 0; offset < size; offset+= DEFAULT_BLOCK_SIZE) {
+        for(int f= 0; f < numFiles; f++) {
+            char path[8];
+            sprintf(path, "/f%d", f);
+            REQUIRE(writeAll(fs, path, w[f] + offset, DEFAULT_BLOCK_SIZE, offset, DEFAULT_BLOCK_SIZE) ==
+                    DEFAULT_BLOCK_SIZE);
+        }
+    }
+
+    SECTION("random reads") {
+        for(int i= 0; i < 200; i++) {
+            size_t offset= rand() % size;
+            size_t n= std::min((size_t) (rand() % 3000), size - offset);
+            REQUIRE(readAll(fs, "/f1", r, n, offset) == (int) n);
+            REQUIRE(memcmp(w[1] + offset, r, n) == 0);
+        }
+    }
+
+    SECTION("sequential reads follow the extent cursor") {
+        struct fuse_file_info fileInfo;
+        memset(&fileInfo, 0, sizeof(fileInfo));
+        REQUIRE(fs->fuseOpen("/f0", &fileInfo) == 0);
+        MyFsHandle *handle= (MyFsHandle *) fileInfo.fh;
+
+        for(size_t offset= 0; offset < size; offset+= 700) {
+            size_t n= std::min((size_t) 700, size - offset);
+            REQUIRE(fs->fuseRead("/f0", r, n, offset, &fileInfo) == (int) n);
+            REQUIRE(memcmp(w[0] + offset, r, n) == 0);
+            REQUIRE(handle->nextOffset == offset + n);
+        }
+        REQUIRE(handle->extentCursor > INODE_NUM_EXTENTS);
+
+        // a stale cursor must not be trusted
+        REQUIRE(fs->fuseRead("/f0", r, 1000, 3, &fileInfo) == 1000);
+        REQUIRE(memcmp(w[0] + 3, r, 1000) == 0);
+        handle->extentCursor= 12345;
+        REQUIRE(fs->fuseRead("/f0", r, 1000, size / 2, &fileInfo) == 1000);
+        REQUIRE(memcmp(w[0] + size / 2, r, 1000) == 0);
+
+        REQUIRE(fs->fuseRelease("/f0", &fileInfo) == 0);
+    }
+
+    SECTION("extent chain survives remount") {
+        unmount(fs);
+        fs= mount(&info);
+
+        for(int f= 0; f < numFiles; f++) {
+            char path[8];
+            sprintf(path, "/f%d", f);
+            REQUIRE(readAll(fs, path, r, size, 0) == (int) size);
+            REQUIRE(memcmp(w[f], r, size) == 0);
+        }
+    }
+
+    SECTION("shrink and grow a fragmented file") {
+        REQUIRE(fs->fuseTruncate("/f0", 10 * DEFAULT_BLOCK_SIZE + 7) == 0);
+        REQUIRE(fs->fuseUnlink("/f1") == 0);
+        const size_t keep= 10 * DEFAULT_BLOCK_SIZE + 7;
+        REQUIRE(writeAll(fs, "/f0", w[0] + keep, size - keep, keep, 4096) == (int) (size - keep));
+
+        unmount(fs);
+        fs= mount(&info);
+
+        REQUIRE(readAll(fs, "/f0", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w[0], r, size) == 0);
+    }
+
+    unmount(fs);
+
+    delete [] r;
+    for(int f= 0; f < numFiles; f++)
+        delete [] w[f];
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_READAHEAD", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 1000 * DEFAULT_BLOCK_SIZE;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyFS *fs= mount(&info);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 65536) == (int) size);
+
+    // start with an empty cache
+    unmount(fs);
+    fs= mount(&info);
+    BlockCache *cache= ((MyOnDiskFS *) fs)->getBlockCache();
+
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+    MyFsHandle *handle= (MyFsHandle *) fileInfo.fh;
+
+    SECTION("sequential reads are served from the cache") {
+        for(size_t offset= 0; offset < size; offset+= 4096) {
+            size_t n= std::min((size_t) 4096, size - offset);
+            REQUIRE(fs->fuseRead("/file", r + offset, n, offset, &fileInfo) == (int) n);
+            cache->waitPrefetch();
+        }
+        REQUIRE(memcmp(w, r, size) == 0);
+        REQUIRE(handle->raWindow == RA_MAX_BLOCKS);
+        REQUIRE(cache->getPrefetchHits() > size / DEFAULT_BLOCK_SIZE / 2);
+        REQUIRE(cache->getPrefetchedBlocks() <= size / DEFAULT_BLOCK_SIZE);
+    }
+
+    SECTION("random reads do not read ahead") {
+        for(int i= 0; i < 100; i++) {
+            size_t offset= rand() % (size - 4096);
+            REQUIRE(fs->fuseRead("/file", r, 4096, offset, &fileInfo) == 4096);
+            REQUIRE(memcmp(w + offset, r, 4096) == 0);
+            if(offset != 0)
+                REQUIRE(handle->raWindow == 0);
+        }
+        cache->waitPrefetch();
+        REQUIRE(cache->getPrefetchedBlocks() <= 2 * RA_MIN_BLOCKS);
+    }
+
+    SECTION("written data is not hidden by read-ahead blocks") {
+        REQUIRE(fs->fuseRead("/file", r, 4096, 0, &fileInfo) == 4096);
+        REQUIRE(fs->fuseRead("/file", r, 4096, 4096, &fileInfo) == 4096);
+        gen_random(w + 8192, 4096);
+        REQUIRE(fs->fuseWrite("/file", w + 8192, 4096, 8192, &fileInfo) == 4096);
+        cache->waitPrefetch();
+        REQUIRE(fs->fuseRead("/file", r, 4096, 8192, &fileInfo) == 4096);
+        REQUIRE(memcmp(w + 8192, r, 4096) == 0);
+    }
+
+    REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+
+    std::string report(4096, '\0');
+    int n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, &report[0], report.size());
+    REQUIRE(n > 0);
+    report.resize(n);
+    REQUIRE(report.find("readahead blocks ") != std::string::npos);
+
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_DELAYED_ALLOCATION", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const int numFiles= 2;
+    const size_t size= 400 * 1024;
+    char *w[numFiles];
+    char *r= new char[size];
+    for(int f= 0; f < numFiles; f++) {
+        w[f]= new char[size];
+        gen_random(w[f], size);
+    }
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+
+    struct fuse_file_info fileInfo[numFiles];
+    const char *paths[numFiles]= { "/f0", "/f1" };
+    uint32_t inodes[numFiles];
+    for(int f= 0; f < numFiles; f++) {
+        memset(&fileInfo[f], 0, sizeof(fileInfo[f]));
+        REQUIRE(fs->fuseMknod(paths[f], S_IFREG | 0644, 0) == 0);
+        REQUIRE(fs->fuseOpen(paths[f], &fileInfo[f]) == 0);
+        inodes[f]= ((MyFsHandle *) fileInfo[f].fh)->ino;
+    }
+
+    // interleaved appends of open files are buffered, each file gets a single extent when it is flushed
+    for(size_t offset= 0; offset < size; offset+= 4096) {
+        for(int f= 0; f < numFiles; f++) {
+            REQUIRE(fs->fuseWrite(paths[f], w[f] + offset, 4096, offset, &fileInfo[f]) == 4096);
+        }
+    }
+    REQUIRE(fs->inodeInfo[inodes[0]].numBlocks == 0);
+
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/f0", &s) == 0);
+    REQUIRE(s.st_size == (off_t) size);
+    REQUIRE(fs->fuseRead("/f0", r, size, 0, &fileInfo[0]) == (int) size);
+    REQUIRE(memcmp(w[0], r, size) == 0);
+
+    SECTION("flush allocates contiguous extents") {
+        for(int f= 0; f < numFiles; f++) {
+            REQUIRE(fs->fuseFlush(paths[f], &fileInfo[f]) == 0);
+            REQUIRE(fs->inodeInfo[inodes[f]].extents.size() == 1);
+            REQUIRE(fs->inodeInfo[inodes[f]].numBlocks == size / fs->blockSize);
+        }
+    }
+
+    SECTION("overwrite, gap and truncate") {
+        REQUIRE(fs->fuseFlush("/f0", &fileInfo[0]) == 0);
+
+        // partial overwrite of stored blocks, joined by an append behind a gap
+        memcpy(w[0] + 1000, w[1], 3000);
+        REQUIRE(fs->fuseWrite("/f0", w[1], 3000, 1000, &fileInfo[0]) == 3000);
+        REQUIRE(fs->fuseWrite("/f0", w[1], 100, size + 200, &fileInfo[0]) == 100);
+        REQUIRE(fs->fuseRead("/f0", r, size, 0, &fileInfo[0]) == (int) size);
+        REQUIRE(memcmp(w[0], r, size) == 0);
+        REQUIRE(fs->fuseRead("/f0", r, 300, size, &fileInfo[0]) == 300);
+        for(int i= 0; i < 200; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(w[1], r + 200, 100) == 0);
+
+        REQUIRE(fs->fuseTruncate("/f0", 5000, &fileInfo[0]) == 0);
+        REQUIRE(fs->fuseGetattr("/f0", &s) == 0);
+        REQUIRE(s.st_size == 5000);
+        REQUIRE(fs->fuseRead("/f0", r, size, 0, &fileInfo[0]) == 5000);
+        REQUIRE(memcmp(w[0], r, 5000) == 0);
+    }
+
+    SECTION("buffered blocks survive remount") {
+        for(int f= 0; f < numFiles; f++) {
+            REQUIRE(fs->fuseRelease(paths[f], &fileInfo[f]) == 0);
+        }
+        unmount(fs);
+        fs= (MyOnDiskFS *) mount(&info);
+
+        for(int f= 0; f < numFiles; f++) {
+            REQUIRE(readAll(fs, paths[f], r, size, 0) == (int) size);
+            REQUIRE(memcmp(w[f], r, size) == 0);
+            REQUIRE(fs->fuseOpen(paths[f], &fileInfo[f]) == 0);
+        }
+    }
+
+    SECTION("writes larger than the buffer") {
+        const size_t large= 3 * DIRTY_MAX_SIZE + 123;
+        char *l= new char[large];
+        gen_random(l, large);
+        REQUIRE(fs->fuseMknod("/large", S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, "/large", l, large, 0, 4096) == (int) large);
+
+        // the buffer is written whenever it is full, later runs continue the extent
+        uint32_t ino;
+        REQUIRE(fs->resolvePath("/large", &ino) == 0);
+        REQUIRE(fs->inodeInfo[ino].extents.size() == 1);
+
+        char *lr= new char[large];
+        REQUIRE(readAll(fs, "/large", lr, large, 0) == (int) large);
+        REQUIRE(memcmp(l, lr, large) == 0);
+
+        delete [] lr;
+        delete [] l;
+    }
+
+    for(int f= 0; f < numFiles; f++) {
+        REQUIRE(fs->fuseRelease(paths[f], &fileInfo[f]) == 0);
+    }
+    unmount(fs);
+
+    delete [] r;
+    for(int f= 0; f < numFiles; f++)
+        delete [] w[f];
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_SPARSE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 64 * 1024 * 1024;
+    const size_t bs= DEFAULT_BLOCK_SIZE;
+    char *w= new char[2 * bs];
+    char *r= new char[2 * bs];
+    gen_random(w, 2 * bs);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/sparse", S_IFREG | 0644, 0) == 0);
+    uint32_t numFree= fs->bitmap.getNumFree();
+
+    // growing a file allocates nothing, the hole reads as zeros
+    REQUIRE(fs->fuseTruncate("/sparse", size) == 0);
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+    REQUIRE(s.st_size == (off_t) size);
+    REQUIRE(s.st_blocks == 0);
+    REQUIRE(fs->bitmap.getNumFree() == numFree);
+    memset(r, 1, 2 * bs);
+    REQUIRE(readAll(fs, "/sparse", r, 2 * bs, size / 2 + 100) == (int) (2 * bs));
+    for(size_t i= 0; i < 2 * bs; i++) {
+        REQUIRE(r[i] == 0);
+    }
+
+    // writes into the hole allocate only the blocks they touch
+    REQUIRE(writeAll(fs, "/sparse", w, 100, 10 * bs + 10, 100) == 100);
+    REQUIRE(writeAll(fs, "/sparse", w, 2 * bs, 1000 * bs, bs) == (int) (2 * bs));
+    REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+    REQUIRE(s.st_blocks == (blkcnt_t) (3 * bs / 512));
+    REQUIRE(fs->bitmap.getNumFree() == numFree - 3);
+    REQUIRE(readAll(fs, "/sparse", r, bs, 10 * bs) == (int) bs);
+    REQUIRE(memcmp(w, r + 10, 100) == 0);
+    for(size_t i= 0; i < bs; i++) {
+        if(i < 10 || i >= 110)
+            REQUIRE(r[i] == 0);
+    }
+
+    SECTION("writes behind the end leave a hole") {
+        REQUIRE(fs->fuseTruncate("/sparse", 0) == 0);
+        REQUIRE(fs->commitJournal() == 1);
+        REQUIRE(fs->bitmap.getNumFree() == numFree);
+
+        // the rest of a shortened last block reads as zeros once the file grows again
+        REQUIRE(writeAll(fs, "/sparse", w, bs, 0, bs) == (int) bs);
+        REQUIRE(fs->fuseTruncate("/sparse", 100) == 0);
+        REQUIRE(writeAll(fs, "/sparse", w, 50, 5 * bs, 50) == 50);
+        REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+        REQUIRE(s.st_size == (off_t) (5 * bs + 50));
+        REQUIRE(s.st_blocks == (blkcnt_t) (2 * bs / 512));
+        REQUIRE(readAll(fs, "/sparse", r, bs, 0) == (int) bs);
+        REQUIRE(memcmp(w, r, 100) == 0);
+        for(size_t i= 100; i < bs; i++) {
+            REQUIRE(r[i] == 0);
+        }
+
+        // buffered appends behind a hole
+        REQUIRE(writeAll(fs, "/sparse", w, 2 * bs, 20 * bs, 512) == (int) (2 * bs));
+        REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+        REQUIRE(s.st_blocks == (blkcnt_t) (4 * bs / 512));
+        REQUIRE(readAll(fs, "/sparse", r, 2 * bs, 20 * bs) == (int) (2 * bs));
+        REQUIRE(memcmp(w, r, 2 * bs) == 0);
+    }
+
+    SECTION("filling a hole merges the extents") {
+        for(size_t b= 11; b < 1000; b+= 64) {
+            size_t n= std::min((size_t) 64, 1000 - b) * bs;
+            char *fill= new char[n];
+            memset(fill, 7, n);
+            REQUIRE(writeAll(fs, "/sparse", fill, n, b * bs, n) == (int) n);
+            delete [] fill;
+        }
+        uint32_t ino;
+        REQUIRE(fs->resolvePath("/sparse", &ino) == 0);
+        REQUIRE(fs->inodeInfo[ino].usedBlocks == 992);
+        REQUIRE(fs->inodeInfo[ino].extents.size() == 1);
+    }
+
+    SECTION("holes survive remount") {
+        unmount(fs);
+        fs= (MyOnDiskFS *) mount(&info);
+
+        REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+        REQUIRE(s.st_size == (off_t) size);
+        REQUIRE(s.st_blocks == (blkcnt_t) (3 * bs / 512));
+        REQUIRE(readAll(fs, "/sparse", r, 2 * bs, 1000 * bs) == (int) (2 * bs));
+        REQUIRE(memcmp(w, r, 2 * bs) == 0);
+        REQUIRE(readAll(fs, "/sparse", r, bs, 500 * bs) == (int) bs);
+        for(size_t i= 0; i < bs; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_INLINE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    char w[2 * INODE_INLINE_SIZE];
+    char r[2 * INODE_INLINE_SIZE];
+    gen_random(w, sizeof(w));
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/small", S_IFREG | 0644, 0) == 0);
+    uint32_t ino;
+    REQUIRE(fs->resolvePath("/small", &ino) == 0);
+    uint32_t numFree= fs->bitmap.getNumFree();
+
+    // small files take no data block
+    REQUIRE(writeAll(fs, "/small", w, 150, 0, 100) == 150);
+    REQUIRE(fs->inodes[ino].flags & INODE_INLINE);
+    REQUIRE(fs->bitmap.getNumFree() == numFree);
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/small", &s) == 0);
+    REQUIRE(s.st_size == 150);
+    REQUIRE(s.st_blocks == 0);
+    REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == 150);
+    REQUIRE(memcmp(w, r, 150) == 0);
+
+    SECTION("truncate keeps small files in the inode") {
+        REQUIRE(fs->fuseTruncate("/small", 50) == 0);
+        REQUIRE(fs->fuseTruncate("/small", INODE_INLINE_SIZE) == 0);
+        REQUIRE(fs->inodes[ino].flags & INODE_INLINE);
+        REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == INODE_INLINE_SIZE);
+        REQUIRE(memcmp(w, r, 50) == 0);
+        for(int i= 50; i < INODE_INLINE_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+
+        REQUIRE(fs->fuseTruncate("/small", INODE_INLINE_SIZE + 1) == 0);
+        REQUIRE_FALSE(fs->inodes[ino].flags & INODE_INLINE);
+        REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == INODE_INLINE_SIZE + 1);
+        REQUIRE(memcmp(w, r, 50) == 0);
+        for(int i= 50; i <= INODE_INLINE_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    SECTION("growing files move to a data block") {
+        REQUIRE(writeAll(fs, "/small", w + 150, sizeof(w) - 150, 150, 100) == (int) sizeof(w) - 150);
+        REQUIRE_FALSE(fs->inodes[ino].flags & INODE_INLINE);
+        REQUIRE(fs->inodeInfo[ino].usedBlocks == 1);
+        REQUIRE(fs->bitmap.getNumFree() == numFree - 1);
+        REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == (int) sizeof(w));
+        REQUIRE(memcmp(w, r, sizeof(w)) == 0);
+
+        // shrinking does not move the file back
+        REQUIRE(fs->fuseTruncate("/small", 10) == 0);
+        REQUIRE_FALSE(fs->inodes[ino].flags & INODE_INLINE);
+        REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == 10);
+        REQUIRE(memcmp(w, r, 10) == 0);
+    }
+
+    SECTION("reading after remount touches no data block") {
+        unmount(fs);
+        info.compress= 0;
+        fs= (MyOnDiskFS *) mount(&info);
+        numFree= fs->bitmap.getNumFree();
+
+        REQUIRE(fs->fuseGetattr("/small", &s) == 0);
+        uint64_t misses= fs->getBlockCache()->getMisses();
+        REQUIRE(readAll(fs, "/small", r, sizeof(r), 0) == 150);
+        REQUIRE(memcmp(w, r, 150) == 0);
+        REQUIRE(fs->getBlockCache()->getMisses() == misses);
+    }
+
+    REQUIRE(fs->fuseUnlink("/small") == 0);
+    REQUIRE(fs->commitJournal() == 1);
+    REQUIRE(fs->bitmap.getNumFree() == numFree);
+    unmount(fs);
+
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_COMPRESSION", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    // log lines compress well, 4 full clusters and a partial one
+    const size_t size= 4 * COMPRESS_CLUSTER_SIZE + 10000;
+    std::string w;
+    for(int i= 0; w.size() < size; i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "{\"id\": %d, \"level\": \"info\", \"message\": \"request served\"}\n", i);
+        w+= line;
+    }
+    w.resize(size);
+    std::vector<char> r(size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.compress= 1;
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/log", S_IFREG | 0644, 0) == 0);
+    uint32_t ino;
+    REQUIRE(fs->resolvePath("/log", &ino) == 0);
+    uint32_t numFree= fs->bitmap.getNumFree();
+    uint32_t fileBlocks= (uint32_t) ((size + fs->blockSize - 1) / fs->blockSize);
+
+    REQUIRE(writeAll(fs, "/log", w.data(), size, 0, 4096) == (int) size);
+    REQUIRE(fs->inodeInfo[ino].numCompressed == 5);
+    REQUIRE(fs->inodeInfo[ino].usedBlocks < fileBlocks / 4);
+    REQUIRE(numFree - fs->bitmap.getNumFree() < fileBlocks / 4);
+    REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) size);
+    REQUIRE(memcmp(w.data(), r.data(), size) == 0);
+
+    char report[96];
+    int n= fs->fuseGetxattr("/log", MYFS_COMPRESSION_XATTR, report, sizeof(report) - 1);
+    REQUIRE(n > 0);
+    report[n]= 0;
+    double ratio;
+    unsigned long long logical, stored;
+    REQUIRE(sscanf(report, "ratio %lf logical %llu stored %llu", &ratio, &logical, &stored) == 3);
+    REQUIRE(logical == fileBlocks);
+    REQUIRE(stored == fs->inodeInfo[ino].usedBlocks);
+    REQUIRE(ratio > 4.0);
+    char list[64];
+    REQUIRE(fs->fuseListxattr("/log", list, sizeof(list)) == (int) sizeof(MYFS_COMPRESSION_XATTR));
+    REQUIRE(strcmp(list, MYFS_COMPRESSION_XATTR) == 0);
+
+    SECTION("overwriting a cluster compresses it again") {
+        memcpy(&w[COMPRESS_CLUSTER_SIZE + 1000], "overwritten", 11);
+        REQUIRE(writeAll(fs, "/log", "overwritten", 11, COMPRESS_CLUSTER_SIZE + 1000, 11) == 11);
+        REQUIRE(fs->inodeInfo[ino].numCompressed == 5);
+        REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) size);
+        REQUIRE(memcmp(w.data(), r.data(), size) == 0);
+    }
+
+    SECTION("truncating within a cluster stores it raw") {
+        const size_t cut= 2 * COMPRESS_CLUSTER_SIZE + 777;
+        REQUIRE(fs->fuseTruncate("/log", cut) == 0);
+        REQUIRE(fs->inodeInfo[ino].numCompressed == 2);
+        REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) cut);
+        REQUIRE(memcmp(w.data(), r.data(), cut) == 0);
+        w.resize(cut);
+    }
+
+    SECTION("a cluster stays compressed if its raw blocks do not fit") {
+        // the raw blocks are needed before the compressed ones are freed
+        std::vector<std::pair<uint32_t, uint32_t> > taken;
+        while(fs->bitmap.getNumFree() > fs->clusterBlocks - 1) {
+            uint32_t start, count;
+            REQUIRE(fs->allocateBlocks(0, fs->bitmap.getNumFree() - (fs->clusterBlocks - 1), &start, &count) == 0);
+            taken.push_back(std::make_pair(start, count));
+        }
+        REQUIRE(fs->fuseTruncate("/log", 2 * COMPRESS_CLUSTER_SIZE + 777) == -ENOSPC);
+        REQUIRE(fs->inodeInfo[ino].numCompressed == 5);
+        REQUIRE(fs->commitJournal() == 1);
+        REQUIRE(fs->bitmap.getNumFree() == fs->clusterBlocks - 1);
+        REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) size);
+        REQUIRE(memcmp(w.data(), r.data(), size) == 0);
+
+        for(size_t t= 0; t < taken.size(); t++)
+            REQUIRE(fs->freeBlocks(taken[t].first, taken[t].second) == 0);
+    }
+
+    SECTION("compressed files survive a remount") {
+        unmount(fs);
+        info.compress= 0;
+        fs= (MyOnDiskFS *) mount(&info);
+        numFree= fs->bitmap.getNumFree() + fs->inodeInfo[ino].usedBlocks;
+        REQUIRE(fs->resolvePath("/log", &ino) == 0);
+        REQUIRE(fs->inodeInfo[ino].numCompressed == 5);
+        REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) size);
+        REQUIRE(memcmp(w.data(), r.data(), size) == 0);
+
+        // without compression, writes store clusters raw
+        REQUIRE(writeAll(fs, "/log", "x", 1, 10, 1) == 1);
+        REQUIRE(fs->inodeInfo[ino].numCompressed == 4);
+        w[10]= 'x';
+    }
+
+    REQUIRE(readAll(fs, "/log", r.data(), size, 0) == (int) w.size());
+    REQUIRE(memcmp(w.data(), r.data(), w.size()) == 0);
+    REQUIRE(fs->fuseUnlink("/log") == 0);
+    REQUIRE(fs->commitJournal() == 1);
+    REQUIRE(fs->bitmap.getNumFree() == numFree);
+    unmount(fs);
+
+    remove(CONT_PATH);
+}
+
+#if FUSE_VERSION >= 29
+TEST_CASE( "ONDISK_SPLICE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t bs= DEFAULT_BLOCK_SIZE;
+    const size_t size= 64 * bs;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 65536) == (int) size);
+    fs->splice= true;
+
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+    struct fuse_bufvec *bufv;
+
+    SECTION("whole blocks are read from the container") {
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, 32 * bs, 100, &fileInfo) == 0);
+        REQUIRE(fuse_buf_size(bufv) == 32 * bs);
+        REQUIRE_FALSE(bufv->buf[0].flags & FUSE_BUF_IS_FD);
+        REQUIRE(bufv->buf[0].size == bs - 100);
+        REQUIRE(bufv->buf[1].flags & FUSE_BUF_IS_FD);
+        REQUIRE(copyBufs(bufv, r) > 0);
+        REQUIRE(memcmp(w + 100, r, 32 * bs) == 0);
+        REQUIRE(fs->bytesSpliced == 31 * bs);
+    }
+
+    SECTION("reads are cut at the end of the file") {
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, 8 * bs, size - 2 * bs - 10, &fileInfo) == 0);
+        REQUIRE(fuse_buf_size(bufv) == 2 * bs + 10);
+        REQUIRE(copyBufs(bufv, r) == 1);
+        REQUIRE(memcmp(w + size - 2 * bs - 10, r, 2 * bs + 10) == 0);
+
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, bs, size, &fileInfo) == 0);
+        REQUIRE(fuse_buf_size(bufv) == 0);
+        copyBufs(bufv, r);
+    }
+
+    SECTION("written blocks are not read from the container before they get there") {
+        gen_random(w + 10 * bs, 2 * bs);
+        REQUIRE(fs->fuseWrite("/file", w + 10 * bs, 2 * bs, 10 * bs, &fileInfo) == (int) (2 * bs));
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, size, 0, &fileInfo) == 0);
+        REQUIRE(copyBufs(bufv, r) > 0);
+        REQUIRE(memcmp(w, r, size) == 0);
+    }
+
+    SECTION("spliced blocks are not reused before the handle is released") {
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, size, 0, &fileInfo) == 0);
+        REQUIRE(bufv->buf[0].flags & FUSE_BUF_IS_FD);
+
+        // the file is truncated and another file is written before FUSE reads the buffers
+        REQUIRE(fs->fuseTruncate("/file", 0) == 0);
+        REQUIRE(fs->commitJournal() == 1);
+        REQUIRE(fs->numPinned == 64);
+        fs->allocHint= fs->superBlock.dataStart;
+        char *other= new char[size];
+        gen_random(other, size);
+        REQUIRE(fs->fuseMknod("/other", S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, "/other", other, size, 0, 65536) == (int) size);
+        REQUIRE(fs->getBlockCache()->flush() == 0);
+        delete [] other;
+
+        REQUIRE(copyBufs(bufv, r) > 0);
+        REQUIRE(memcmp(w, r, size) == 0);
+    }
+
+    SECTION("without splicing a single memory buffer is returned") {
+        fs->splice= false;
+        REQUIRE(fs->fuseReadBuf("/file", &bufv, 32 * bs, 100, &fileInfo) == 0);
+        REQUIRE(bufv->count == 1);
+        REQUIRE(copyBufs(bufv, r) == 0);
+        REQUIRE(memcmp(w + 100, r, 32 * bs) == 0);
+    }
+
+    SECTION("writes take memory and file descriptor buffers") {
+        gen_random(w, 2 * bs);
+        struct fuse_bufvec src= FUSE_BUFVEC_INIT(bs);
+        src.buf[0].mem= w;
+        REQUIRE(fs->fuseWriteBuf("/file", &src, 0, &fileInfo) == (int) bs);
+
+        FILE *f= tmpfile();
+        REQUIRE(f != NULL);
+        REQUIRE(fwrite(w, 1, 2 * bs, f) == 2 * bs);
+        fflush(f);
+        src= FUSE_BUFVEC_INIT(bs);
+        src.buf[0].flags= (enum fuse_buf_flags) (FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+        src.buf[0].fd= fileno(f);
+        src.buf[0].pos= bs;
+        REQUIRE(fs->fuseWriteBuf("/file", &src, bs, &fileInfo) == (int) bs);
+        fclose(f);
+
+        REQUIRE(fs->fuseRead("/file", r, size, 0, &fileInfo) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+    }
+
+    REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+    REQUIRE(fs->numPinned == 0);
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+#endif
+
+TEST_CASE( "ONDISK_STATFS", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 10 * DEFAULT_BLOCK_SIZE;
+    char *w= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    struct statvfs before, after;
+    REQUIRE(fs->fuseStatfs("/", &before) == 0);
+    REQUIRE(before.f_bsize == DEFAULT_BLOCK_SIZE);
+    REQUIRE(before.f_blocks == fs->superBlock.numBlocks - fs->superBlock.dataStart);
+    REQUIRE(before.f_bfree == fs->bitmap.getNumFree());
+    REQUIRE(before.f_files == fs->superBlock.numInodes);
+    REQUIRE(before.f_ffree == fs->superBlock.numInodes - 1);
+    REQUIRE(before.f_namemax == NAME_LENGTH);
+
+    // buffered blocks are not free anymore, whether they are allocated yet or not
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_bfree == before.f_bfree - 10);
+    REQUIRE(after.f_ffree == before.f_ffree - 1);
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    fileInfo.flags= O_RDONLY;
+    REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+    REQUIRE(fs->fuseFsync("/file", 0, &fileInfo) == 0);
+    REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+    REQUIRE(fs->numDirtyBlocks == 0);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_bfree == before.f_bfree - 10);
+    unmount(fs);
+
+    // the counts are stored with the checkpoint and checked at the next mount
+    fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->superBlock.checkpointInode != 0);
+    REQUIRE(fs->superBlock.numFreeBlocks == fs->bitmap.getNumFree());
+    REQUIRE(fs->superBlock.numFreeInodes == fs->inodeMap.getNumFree());
+    REQUIRE(fs->inodeLoaded[fs->superBlock.inodeBlocks - 1] == false);
+    REQUIRE(fs->fuseStatfs("/", &before) == 0);
+    REQUIRE(before.f_bfree == fs->superBlock.numFreeBlocks);
+
+    // freed blocks only count as free once the transaction freeing them has committed
+    REQUIRE(fs->fuseUnlink("/file") == 0);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_bfree == before.f_bfree);
+    REQUIRE(fs->commitJournal() == 1);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_bfree == before.f_bfree + 10);
+    REQUIRE(after.f_ffree == before.f_ffree + 1);
+    unmount(fs);
+
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "ONDISK_STRIPED", "[myfs]" ) {
+
+    remove(CONT_PATH);
+    remove(STRIPE_PATH_1);
+    remove(STRIPE_PATH_2);
+
+    const size_t size= 1000000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+    memset(r, 0, size);
+
+    char *files[]= { (char *) CONT_PATH, (char *) STRIPE_PATH_1, (char *) STRIPE_PATH_2 };
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.contFiles= files;
+    info.numContFiles= 3;
+    info.mapped= 1;
+    MyFS *fs= mount(&info);
+    std::string report(1000, '\0');
+    int n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, &report[0], report.size());
+    REQUIRE(n > 0);
+    report.resize(n);
+    REQUIRE(report.find("stripes members 3 chunk 65536 ") != std::string::npos);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 65536) == (int) size);
+    unmount(fs);
+
+    // the file data is spread over all members
+    struct stat s;
+    for(int f= 0; f < 3; f++) {
+        REQUIRE(stat(files[f], &s) == 0);
+        REQUIRE(s.st_blocks * 512 >= (blkcnt_t) (size / 4));
+    }
+
+    // reads of the whole file are split over the members
+    info.mapped= 0;
+    fs= mount(&info);
+    REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+    report.assign(1000, '\0');
+    n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, &report[0], report.size());
+    REQUIRE(n > 0);
+    report.resize(n);
+    REQUIRE(report.find("split 0\n") == std::string::npos);
+    unmount(fs);
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+    remove(STRIPE_PATH_1);
+    remove(STRIPE_PATH_2);
+}
+
+TEST_CASE( "ONDISK_CHECKSUMS", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const size_t size= 100000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+    memset(r, 0, size);
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.checksum= 1;
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    REQUIRE(fs->checksums != NULL);
+    REQUIRE(fs->superBlock.checksumBlocks > 0);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 3000) == (int) size);
+    REQUIRE(fs->fuseMknod("/packed", S_IFREG | 0644, 0) == 0);
+    std::vector<char> text(200000, 'c');
+    REQUIRE(writeAll(fs, "/packed", text.data(), text.size(), 0, 65536) == (int) text.size());
+
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+    uint32_t ino= ((MyFsHandle *) fileInfo.fh)->ino;
+    REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+    uint32_t block= fs->inodeInfo[ino].extents[0].start + 2;
+
+    REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+    REQUIRE(fs->numVerified > 0);
+    REQUIRE(fs->numChecksumErrors == 0);
+    REQUIRE(fs->scrub() == 0);
+    REQUIRE(fs->numScrubbed > 0);
+    REQUIRE(fs->numScrubs == 1);
+    unmount(fs);
+
+    SECTION("the checksums are kept by a clean unmount") {
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->checksums != NULL);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+        std::vector<char> back(text.size());
+        REQUIRE(readAll(fs, "/packed", back.data(), back.size(), 0) == (int) back.size());
+        REQUIRE(back == text);
+        REQUIRE(fs->numAdopted == 0);
+
+        std::string report(1000, '\0');
+        int n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, &report[0], report.size());
+        REQUIRE(n > 0);
+        report.resize(n);
+        REQUIRE(report.find("checksums verified ") != std::string::npos);
+        REQUIRE(report.find(" errors 0 ") != std::string::npos);
+        unmount(fs);
+    }
+
+    SECTION("a changed block is found") {
+        FILE *file= fopen(CONT_PATH, "r+b");
+        REQUIRE(file != NULL);
+        REQUIRE(fseek(file, (long) block * DEFAULT_BLOCK_SIZE + 100, SEEK_SET) == 0);
+        REQUIRE(fputc('x' ^ w[2 * DEFAULT_BLOCK_SIZE + 100], file) != EOF);
+        fclose(file);
+
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->scrub() == 1);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == -EIO);
+        REQUIRE(readAll(fs, "/file", r, DEFAULT_BLOCK_SIZE, 0) == DEFAULT_BLOCK_SIZE);
+        REQUIRE(fs->numChecksumErrors == 2);
+
+        // rewriting the block replaces its checksum
+        REQUIRE(writeAll(fs, "/file", w + 2 * DEFAULT_BLOCK_SIZE, DEFAULT_BLOCK_SIZE, 2 * DEFAULT_BLOCK_SIZE,
+                         DEFAULT_BLOCK_SIZE) == DEFAULT_BLOCK_SIZE);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+        REQUIRE(fs->scrub() == 0);
+        unmount(fs);
+    }
+
+    SECTION("after a crash the checksums are taken from the blocks") {
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, "/new", w, size, 0, 4096) == (int) size);
+        REQUIRE(fs->commitJournal() >= 0);
+        delete fs;
+
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+        REQUIRE(fs->numAdopted > 0);
+        uint64_t adopted= fs->numAdopted;
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(fs->numAdopted == adopted);
+        REQUIRE(fs->scrub() == 0);
+        unmount(fs);
+    }
+
+    SECTION("directory blocks have no checksums") {
+        fs= (MyOnDiskFS *) mount(&info);
+        REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+        REQUIRE(fs->commitJournal() >= 0);
+        delete fs;
+
+        // the scan reads the directory, later changes go through the journal only
+        fs= (MyOnDiskFS *) mount(&info);
+        char path[16];
+        for(int i= 0; i < 50; i++) {
+            sprintf(path, "/more%d", i);
+            REQUIRE(fs->fuseMknod(path, S_IFREG | 0644, 0) == 0);
+        }
+        std::vector<uint32_t> dirBlocks(fs->inodeInfo[ROOT_INODE].numBlocks);
+        REQUIRE(fs->mapBlocks(ROOT_INODE, 0, dirBlocks.size(), dirBlocks.data()) >= 0);
+        for(size_t b= 0; b < dirBlocks.size(); b++) {
+            REQUIRE(fs->checksums[dirBlocks[b]].load() == 0);
+        }
+        unmount(fs);
+
+        // a wrong free count makes the next mount fall back from the checkpoint to a scan with the stored checksums
+        FILE *file= fopen(CONT_PATH, "r+b");
+        REQUIRE(file != NULL);
+        REQUIRE(fseek(file, (long) offsetof(MyFsSuperBlock, numFreeBlocks), SEEK_SET) == 0);
+        uint32_t numFree= 1;
+        REQUIRE(fwrite(&numFree, sizeof(numFree), 1, file) == 1);
+        fclose(file);
+
+        fs= (MyOnDiskFS *) mount(&info);
+        std::set<std::string> names;
+        REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+        REQUIRE(names.size() == 55);
+        REQUIRE(fs->numChecksumErrors == 0);
+        unmount(fs);
+    }
+
+    SECTION("scrubs run in the background") {
+        info.scrubInterval= 1;
+        fs= (MyOnDiskFS *) mount(&info);
+        for(int i= 0; i < 300 && fs->numScrubs == 0; i++)
+            usleep(10000);
+        REQUIRE(fs->numScrubs > 0);
+        REQUIRE(fs->numChecksumErrors == 0);
+        unmount(fs);
+    }
+
+    delete [] r;
+    delete [] w;
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "INMEMORY_CREATE_WRITE_READ", "[myfs]" ) {
+
+    MyFsInfo info= testInfo(NULL);
+    MyFS *fs= mount(&info);
+
+    const size_t size= 100000;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+    memset(r, 0, size);
+
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == -EEXIST);
+
+    SECTION("write & read") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 333) == (int) size);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+
+        REQUIRE(writeAll(fs, "/file", w, 100, size + 1000, 100) == 100);
+        REQUIRE(readAll(fs, "/file", r, 1100, size) == 1100);
+        for(int i= 0; i < 1000; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(w, r + 1000, 100) == 0);
+    }
+
+    SECTION("truncate, rename & unlink") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+        REQUIRE(fs->fuseTruncate("/file", 10) == 0);
+        REQUIRE(fs->fuseTruncate("/file", 20) == 0);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == 20);
+        REQUIRE(memcmp(w, r, 10) == 0);
+        for(int i= 10; i < 20; i++) {
+            REQUIRE(r[i] == 0);
+        }
+
+        REQUIRE(fs->fuseMknod("/other", S_IFREG | 0644, 0) == 0);
+        REQUIRE(fs->fuseRename("/file", "/other") == 0);
+
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == -ENOENT);
+        REQUIRE(fs->fuseGetattr("/other", &s) == 0);
+        REQUIRE(s.st_size == 20);
+
+        REQUIRE(fs->fuseUnlink("/other") == 0);
+        REQUIRE(fs->fuseGetattr("/other", &s) == -ENOENT);
+    }
+
+    SECTION("unlinked file stays readable while open") {
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+
+        struct fuse_file_info fileInfo;
+        memset(&fileInfo, 0, sizeof(fileInfo));
+        REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+        REQUIRE(fs->fuseUnlink("/file") == 0);
+        REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+
+        REQUIRE(fs->fuseRead("/file", r, size, 0, &fileInfo) == (int) size);
+        REQUIRE(memcmp(w, r, size) == 0);
+        REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+
+        REQUIRE(readAll(fs, "/file", r, size, 0) == 0);
+    }
+
+    SECTION("chunks go back to the arena") {
+        ChunkArena *arena= &((MyInMemoryFS *) fs)->arena;
+
+        // a write far behind the end of the file only allocates the chunk it touches
+        REQUIRE(writeAll(fs, "/file", w, 100, 100 * MEM_CHUNK_SIZE - 50, 100) == 100);
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/file", &s) == 0);
+        REQUIRE(s.st_size == 100 * MEM_CHUNK_SIZE + 50);
+        REQUIRE(s.st_blocks == 2 * MEM_CHUNK_SIZE / 512);
+        REQUIRE(readAll(fs, "/file", r, 100, 100 * MEM_CHUNK_SIZE - 100) == 100);
+        for(int i= 0; i < 50; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(w, r + 50, 50) == 0);
+
+        REQUIRE(writeAll(fs, "/file", w, size, 0, 4096) == (int) size);
+        uint64_t numFree= arena->getNumFree();
+        uint64_t numChunks= arena->getNumChunks();
+        REQUIRE(fs->fuseTruncate("/file", 10) == 0);
+        REQUIRE(arena->getNumFree() == numFree + 3);
+
+        // growing again must not expose old content
+        REQUIRE(fs->fuseTruncate("/file", size) == 0);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+        REQUIRE(memcmp(w, r, 10) == 0);
+        for(size_t i= 10; i < size; i++) {
+            REQUIRE(r[i] == 0);
+        }
+
+        REQUIRE(fs->fuseUnlink("/file") == 0);
+        REQUIRE(arena->getNumFree() == arena->getNumChunks());
+        REQUIRE(arena->getNumChunks() == numChunks);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    unmount(fs);
+}
+
+TEST_CASE( "INMEMORY_IMAGE", "[myfs]" ) {
+
+    remove(IMAGE_PATH);
+
+    const size_t size= 10 * MEM_CHUNK_SIZE + 100;
+    char *w= new char[size];
+    char *r= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(NULL);
+    info.imageFile= (char *) IMAGE_PATH;
+    MyInMemoryFS *fs= (MyInMemoryFS *) mount(&info);
+    REQUIRE(fs->imageMap == NULL);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0640, 0) == 0);
+    REQUIRE(fs->fuseMknod("/sparse", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/gone", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 65536) == (int) size);
+    REQUIRE(writeAll(fs, "/sparse", w, 100, 5 * MEM_CHUNK_SIZE, 100) == 100);
+    REQUIRE(fs->fuseUnlink("/gone") == 0);
+    unmount(fs);
+
+    // the files come back mapped from the image
+    fs= (MyInMemoryFS *) mount(&info);
+    REQUIRE(fs->imageMap != NULL);
+    REQUIRE(fs->numImageChunks == 12);
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.count("file") == 1);
+    REQUIRE(names.count("sparse") == 1);
+    REQUIRE(names.count("gone") == 0);
+
+    struct stat s;
+    REQUIRE(fs->fuseGetattr("/file", &s) == 0);
+    REQUIRE(s.st_mode == (S_IFREG | 0640));
+    REQUIRE(s.st_size == (off_t) size);
+    REQUIRE(readAll(fs, "/file", r, size, 0) == (int) size);
+    REQUIRE(memcmp(w, r, size) == 0);
+    REQUIRE(fs->fuseGetattr("/sparse", &s) == 0);
+    REQUIRE(s.st_blocks == (blkcnt_t) (MEM_CHUNK_SIZE / 512));
+    REQUIRE(readAll(fs, "/sparse", r, 100, 5 * MEM_CHUNK_SIZE) == 100);
+    REQUIRE(memcmp(w, r, 100) == 0);
+
+    SECTION("mapped chunks can be changed and released") {
+        char *changed= w + MEM_CHUNK_SIZE - 500;
+        gen_random(changed, 1000);
+        REQUIRE(writeAll(fs, "/file", changed, 1000, MEM_CHUNK_SIZE - 500, 1000) == 1000);
+        REQUIRE(fs->fuseTruncate("/file", 3 * MEM_CHUNK_SIZE) == 0);
+        REQUIRE(fs->numImageChunks == 4);
+        REQUIRE(fs->fuseMknod("/new", S_IFREG | 0644, 0) == 0);
+        REQUIRE(writeAll(fs, "/new", changed, 1000, 0, 1000) == 1000);
+
+        // a snapshot on demand replaces the image that is still mapped
+        REQUIRE(fs->fuseSetxattr("/", MYFS_SNAPSHOT_XATTR, "", 0, 0) == 0);
+        REQUIRE(readAll(fs, "/file", r, 3 * MEM_CHUNK_SIZE, 0) == (int) (3 * MEM_CHUNK_SIZE));
+        REQUIRE(memcmp(w, r, 3 * MEM_CHUNK_SIZE) == 0);
+
+        delete fs;
+        fs= (MyInMemoryFS *) mount(&info);
+        REQUIRE(fs->numImageChunks == 5);
+        REQUIRE(readAll(fs, "/file", r, size, 0) == (int) (3 * MEM_CHUNK_SIZE));
+        REQUIRE(memcmp(w, r, 3 * MEM_CHUNK_SIZE) == 0);
+        REQUIRE(readAll(fs, "/new", r, 1000, 0) == 1000);
+        REQUIRE(memcmp(changed, r, 1000) == 0);
+    }
+
+    SECTION("invalid images are ignored") {
+        delete fs;
+        REQUIRE(truncate(IMAGE_PATH, 1000) == 0);
+        fs= (MyInMemoryFS *) mount(&info);
+        REQUIRE(fs->imageMap == NULL);
+        REQUIRE(fs->fuseGetattr("/file", &s) == -ENOENT);
+        REQUIRE(fs->fuseGetattr("/", &s) == 0);
+    }
+
+    delete fs;
+
+    delete [] r;
+    delete [] w;
+    remove(IMAGE_PATH);
+}
+
+TEST_CASE( "INMEMORY_ATIME", "[myfs]" ) {
+
+    MyFsInfo info= testInfo(NULL);
+    MyInMemoryFS *fs= (MyInMemoryFS *) mount(&info);
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", "content", 7, 0, 7) == 7);
+
+    uint32_t ino;
+    REQUIRE(fs->resolvePath("/file", &ino) == 0);
+    MyFsMemFile *file= fs->files[ino];
+    char r[16];
+    time_t now= time(NULL);
+
+    file->atime= now - 10;
+    file->mtime= file->ctime= now - 100;
+    REQUIRE(readAll(fs, "/file", r, sizeof(r), 0) == 7);
+    REQUIRE(file->atime == now - 10);
+
+    file->mtime= now - 5;
+    REQUIRE(readAll(fs, "/file", r, sizeof(r), 0) == 7);
+    REQUIRE(file->atime >= now);
+
+    fs->atimeInterval= ATIME_NEVER;
+    file->atime= 1000;
+    REQUIRE(readAll(fs, "/file", r, sizeof(r), 0) == 7);
+    REQUIRE(file->atime == 1000);
+
+    unmount(fs);
+}
+
+TEST_CASE( "INMEMORY_STATFS", "[myfs]" ) {
+
+    const size_t size= 3 * MEM_CHUNK_SIZE;
+    char *w= new char[size];
+    gen_random(w, size);
+
+    MyFsInfo info= testInfo(NULL);
+    MyInMemoryFS *fs= (MyInMemoryFS *) mount(&info);
+    struct statvfs before, after;
+    REQUIRE(fs->fuseStatfs("/", &before) == 0);
+    REQUIRE(before.f_bsize == MEM_CHUNK_SIZE);
+    REQUIRE(before.f_blocks > 0);
+    REQUIRE(before.f_files - before.f_ffree == 1);
+
+    REQUIRE(fs->fuseMknod("/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/sparse", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/file", w, size, 0, 65536) == (int) size);
+    REQUIRE(writeAll(fs, "/sparse", w, 100, 10 * MEM_CHUNK_SIZE, 100) == 100);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_blocks == before.f_blocks);
+    REQUIRE(after.f_bfree == before.f_bfree - 4);
+    REQUIRE(after.f_ffree == before.f_ffree - 2);
+
+    REQUIRE(fs->fuseTruncate("/file", MEM_CHUNK_SIZE) == 0);
+    REQUIRE(fs->fuseUnlink("/sparse") == 0);
+    REQUIRE(fs->fuseStatfs("/", &after) == 0);
+    REQUIRE(after.f_bfree == before.f_bfree - 1);
+    REQUIRE(after.f_ffree == before.f_ffree - 1);
+    unmount(fs);
+
+    delete [] w;
+}
+
+TEST_CASE( "DIR_MANY_FILES", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    const int numFiles= 20000;
+    bool onDisk= GENERATE(false, true);
+    MyFsInfo info= testInfo(onDisk ? CONT_PATH : NULL);
+    MyFS *fs= mount(&info);
+
+    char path[32];
+    for(int i= 0; i < numFiles; i++) {
+        sprintf(path, "/file-%d", i);
+        REQUIRE(fs->fuseMknod(path, S_IFREG | 0644, 0) == 0);
+    }
+
+    // every other file gets some content, the others are removed
+    for(int i= 0; i < numFiles; i+= 2) {
+        sprintf(path, "/file-%d", i);
+        REQUIRE(writeAll(fs, path, path, strlen(path), 0, 4096) == (int) strlen(path));
+        sprintf(path, "/file-%d", i + 1);
+        REQUIRE(fs->fuseUnlink(path) == 0);
+    }
+
+    if(onDisk) {
+        unmount(fs);
+        fs= mount(&info);
+    }
+
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.size() == numFiles / 2 + 2);
+
+    char content[32];
+    struct stat s;
+    for(int i= 0; i < numFiles; i++) {
+        sprintf(path, "/file-%d", i);
+        if(i % 2 == 0) {
+            REQUIRE(readAll(fs, path, content, sizeof(content), 0) == (int) strlen(path));
+            REQUIRE(memcmp(content, path, strlen(path)) == 0);
+        } else {
+            REQUIRE(fs->fuseGetattr(path, &s) == -ENOENT);
+        }
+    }
+
+    unmount(fs);
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "DIR_FULL_BLOCK", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    // names that stay in the first bucket for up to 64 buckets, they add up to exactly one block of 64 KiB
+    const size_t numLong= (MAX_BLOCK_SIZE - sizeof(MyFsDirBlockHeader)) / DIR_RECORD_SIZE(250);
+    const size_t shortLength= MAX_BLOCK_SIZE - sizeof(MyFsDirBlockHeader) - numLong * DIR_RECORD_SIZE(250) -
+                              sizeof(MyFsDirRecord);
+    std::vector<std::string> names;
+    for(unsigned n= 0; names.size() <= numLong; n++) {
+        char suffix[16];
+        sprintf(suffix, "-%u", n);
+        std::string name(names.size() < numLong ? 250 : shortLength, 'f');
+        name.replace(name.size() - strlen(suffix), strlen(suffix), suffix);
+        if(DirIndex::hash(ROOT_INODE, name.c_str()) % 64 == 0)
+            names.push_back(name);
+    }
+
+    MyFsInfo info= testInfo(CONT_PATH);
+    info.blockSize= MAX_BLOCK_SIZE;
+    MyOnDiskFS *fs= (MyOnDiskFS *) mount(&info);
+    for(size_t i= 0; i < names.size(); i++) {
+        REQUIRE(fs->fuseMknod(("/" + names[i]).c_str(), S_IFREG | 0644, 0) == 0);
+    }
+    REQUIRE(fs->fuseMknod("/last", S_IFREG | 0644, 0) == 0);
+
+    // without a checkpoint the next mount reads the directory blocks
+    REQUIRE(fs->commitJournal() == 1);
+    delete fs;
+
+    fs= (MyOnDiskFS *) mount(&info);
+    std::set<std::string> listed;
+    REQUIRE(fs->fuseReaddir("/", &listed, fillDir, 0, NULL) == 0);
+    REQUIRE(listed.size() == names.size() + 3);
+    for(size_t i= 0; i < names.size(); i++) {
+        REQUIRE(listed.count(names[i]) == 1);
+    }
+
+    unmount(fs);
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "DIR_DIRECTORIES", "[myfs]" ) {
+
+    remove(CONT_PATH);
+    remove(IMAGE_PATH);
+
+    bool onDisk= GENERATE(false, true);
+    MyFsInfo info= testInfo(onDisk ? CONT_PATH : NULL);
+    info.imageFile= (char *) IMAGE_PATH;
+    MyFS *fs= mount(&info);
+
+    struct stat s;
+    REQUIRE(fs->fuseMkdir("/a", 0755) == 0);
+    REQUIRE(fs->fuseMkdir("/a", 0755) == -EEXIST);
+    REQUIRE(fs->fuseMkdir("/a/b", 0700) == 0);
+    REQUIRE(fs->fuseMknod("/a/b/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMknod("/a/file", S_IFREG | 0644, 0) == 0);
+    REQUIRE(writeAll(fs, "/a/b/file", "nested", 6, 0, 6) == 6);
+
+    REQUIRE(fs->fuseGetattr("/a/b", &s) == 0);
+    REQUIRE(s.st_mode == (S_IFDIR | 0700));
+    REQUIRE(fs->fuseGetattr("/a", &s) == 0);
+    REQUIRE(s.st_nlink == 3);
+    REQUIRE(fs->fuseMknod("/missing/file", S_IFREG | 0644, 0) == -ENOENT);
+    REQUIRE(fs->fuseMknod("/a/file/x", S_IFREG | 0644, 0) == -ENOTDIR);
+    REQUIRE(fs->fuseGetattr("/a/file/x", &s) == -ENOTDIR);
+
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    REQUIRE(fs->fuseOpen("/a", &fileInfo) == -EISDIR);
+    REQUIRE(fs->fuseUnlink("/a/b") == -EISDIR);
+    REQUIRE(fs->fuseRmdir("/a/file") == -ENOTDIR);
+    REQUIRE(fs->fuseRmdir("/a") == -ENOTEMPTY);
+    REQUIRE(fs->fuseRename("/a", "/a/b/c") == -EINVAL);
+
+    std::set<std::string> names;
+    REQUIRE(fs->fuseReaddir("/a", &names, fillDir, 0, NULL) == 0);
+    REQUIRE(names.size() == 4);
+    REQUIRE(names.count("b") == 1);
+    REQUIRE(names.count("file") == 1);
+    REQUIRE(fs->fuseReaddir("/a/file", &names, fillDir, 0, NULL) == -ENOTDIR);
+
+    SECTION("negative entries are dropped when the file is created") {
+        uint64_t negativeHits= fs->dentries.getNegativeHits();
+        REQUIRE(fs->fuseGetattr("/a/new", &s) == -ENOENT);
+        REQUIRE(fs->fuseGetattr("/a/new", &s) == -ENOENT);
+        REQUIRE(fs->dentries.getNegativeHits() == negativeHits + 1);
+
+        REQUIRE(fs->fuseMknod("/a/new", S_IFREG | 0644, 0) == 0);
+        REQUIRE(fs->fuseGetattr("/a/new", &s) == 0);
+        REQUIRE(fs->fuseUnlink("/a/new") == 0);
+        REQUIRE(fs->fuseGetattr("/a/new", &s) == -ENOENT);
+    }
+
+    SECTION("a directory is moved with its entries") {
+        REQUIRE(fs->fuseGetattr("/a/b/file", &s) == 0);
+        REQUIRE(fs->fuseMkdir("/c", 0755) == 0);
+        REQUIRE(fs->fuseRename("/a/b", "/c/b") == 0);
+        REQUIRE(fs->fuseGetattr("/a/b/file", &s) == -ENOENT);
+        REQUIRE(fs->fuseGetattr("/a", &s) == 0);
+        REQUIRE(s.st_nlink == 2);
+        REQUIRE(fs->fuseGetattr("/c", &s) == 0);
+        REQUIRE(s.st_nlink == 3);
+
+        char r[16];
+        REQUIRE(readAll(fs, "/c/b/file", r, sizeof(r), 0) == 6);
+        REQUIRE(memcmp(r, "nested", 6) == 0);
+
+        // a directory replaces only an empty directory
+        REQUIRE(fs->fuseMkdir("/a/b", 0755) == 0);
+        REQUIRE(fs->fuseRename("/c/b", "/a/file") == -ENOTDIR);
+        REQUIRE(fs->fuseRename("/a/file", "/a/b") == -EISDIR);
+        REQUIRE(fs->fuseRename("/a/b", "/c/b") == -ENOTEMPTY);
+        REQUIRE(fs->fuseRmdir("/a/b") == 0);
+        REQUIRE(fs->fuseRmdir("/c/b") == -ENOTEMPTY);
+        REQUIRE(fs->fuseUnlink("/c/b/file") == 0);
+        REQUIRE(fs->fuseRmdir("/c/b") == 0);
+        REQUIRE(fs->fuseGetattr("/c", &s) == 0);
+        REQUIRE(s.st_nlink == 2);
+    }
+
+    SECTION("directories survive the next mount") {
+        if(onDisk) {
+            bool clean= GENERATE(true, false);
+            if(clean) {
+                unmount(fs);
+            } else {
+                REQUIRE(((MyOnDiskFS *) fs)->commitJournal() == 1);
+                delete fs;
+            }
+            fs= mount(&info);
+        } else {
+            unmount(fs);
+            fs= mount(&info);
+        }
+
+        names.clear();
+        REQUIRE(fs->fuseReaddir("/a", &names, fillDir, 0, NULL) == 0);
+        REQUIRE(names.size() == 4);
+        REQUIRE(fs->fuseGetattr("/a", &s) == 0);
+        REQUIRE(S_ISDIR(s.st_mode));
+        REQUIRE(s.st_nlink == 3);
+
+        char r[16];
+        REQUIRE(readAll(fs, "/a/b/file", r, sizeof(r), 0) == 6);
+        REQUIRE(memcmp(r, "nested", 6) == 0);
+    }
+
+    unmount(fs);
+    remove(CONT_PATH);
+    remove(IMAGE_PATH);
+}
+
+TEST_CASE( "STATS_XATTR", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    bool onDisk= GENERATE(false, true);
+    MyFsInfo info= testInfo(onDisk ? CONT_PATH : NULL);
+    MyFS *fs= mount(&info);
+
+    // calls are counted by the wrap_* functions, the unit tests call the file system directly
+    fs->stats.record(OP_MKNOD, OpStats::now(), fs->fuseMknod("/a", S_IFREG | 0644, 0));
+    REQUIRE(writeAll(fs, "/a", "some data", 9, 0, 9) == 9);
+
+    char list[64];
+    int n= fs->fuseListxattr("/", NULL, 0);
+    REQUIRE(n == (int) sizeof(MYFS_STATS_XATTR));
+    REQUIRE(fs->fuseListxattr("/", list, sizeof(list)) == n);
+    REQUIRE(strcmp(list, MYFS_STATS_XATTR) == 0);
+    // on disk, files have the compression attribute
+    REQUIRE(fs->fuseListxattr("/a", list, sizeof(list)) == (onDisk ? (int) sizeof(MYFS_COMPRESSION_XATTR) : 0));
+
+    n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, NULL, 0);
+    REQUIRE(n > 0);
+    REQUIRE(fs->fuseGetxattr("/", MYFS_STATS_XATTR, list, 4) == -ERANGE);
+    std::string report(n + 100, '\0');
+    n= fs->fuseGetxattr("/", MYFS_STATS_XATTR, &report[0], report.size());
+    REQUIRE(n > 0);
+    report.resize(n);
+    REQUIRE(report.find("mknod ") != std::string::npos);
+    if(onDisk) {
+        REQUIRE(report.find("cache hits") != std::string::npos);
+        REQUIRE(report.find("device reads") != std::string::npos);
+    } else {
+        REQUIRE(report.find("files 1 ") != std::string::npos);
+    }
+
+    REQUIRE(fs->fuseGetxattr("/", "user.other", list, sizeof(list)) < 0);
+    REQUIRE(fs->fuseGetxattr("/a", MYFS_STATS_XATTR, list, sizeof(list)) < 0);
+
+    unmount(fs);
+    remove(CONT_PATH);
+}
+
+TEST_CASE( "OPEN_FILE_TABLE", "[myfs]" ) {
+
+    remove(CONT_PATH);
+
+    bool onDisk= GENERATE(false, true);
+    MyFsInfo info= testInfo(onDisk ? CONT_PATH : NULL);
+    MyFS *fs= mount(&info);
+    REQUIRE(fs->openFiles.getCapacity() == NUM_OPEN_FILES);
+
+    SECTION("the capacity is configurable") {
+        const int numOpen= 3000;
+        fs->openFiles.setCapacity(numOpen);
+        REQUIRE(fs->fuseMknod("/a", S_IFREG | 0644, 0) == 0);
+
+        std::vector<struct fuse_file_info> fileInfo(numOpen + 1);
+        std::set<uint64_t> handles;
+        for(int i= 0; i < numOpen; i++) {
+            memset(&fileInfo[i], 0, sizeof(fileInfo[i]));
+            REQUIRE(fs->fuseOpen("/a", &fileInfo[i]) == 0);
+            handles.insert(fileInfo[i].fh);
+        }
+        REQUIRE(handles.size() == (size_t) numOpen);
+        memset(&fileInfo[numOpen], 0, sizeof(fileInfo[numOpen]));
+        REQUIRE(fs->fuseOpen("/a", &fileInfo[numOpen]) == -EMFILE);
+
+        // every handle works on its own, a released handle is handed out again
+        REQUIRE(fs->fuseWrite("/a", "abc", 3, 0, &fileInfo[17]) == 3);
+        char r[3];
+        REQUIRE(fs->fuseRead("/a", r, 3, 0, &fileInfo[2999]) == 3);
+        REQUIRE(memcmp(r, "abc", 3) == 0);
+        REQUIRE(fs->fuseRelease("/a", &fileInfo[17]) == 0);
+        REQUIRE(fs->fuseOpen("/a", &fileInfo[numOpen]) == 0);
+        REQUIRE(fileInfo[numOpen].fh == fileInfo[17].fh);
+        fileInfo[17]= fileInfo[numOpen];
+
+        for(int i= 0; i < numOpen; i++) {
+            REQUIRE(fs->fuseRelease("/a", &fileInfo[i]) == 0);
+        }
+        REQUIRE(fs->openFiles.getNumOpen() == 0);
+    }
+
+    SECTION("create opens the file") {
+        struct fuse_file_info fileInfo;
+        memset(&fileInfo, 0, sizeof(fileInfo));
+        REQUIRE(fs->fuseCreate("/b", S_IFREG | 0644, &fileInfo) == 0);
+        REQUIRE(fs->fuseWrite("/b", "xyz", 3, 0, &fileInfo) == 3);
+        REQUIRE(fs->fuseRelease("/b", &fileInfo) == 0);
+
+        struct stat s;
+        REQUIRE(fs->fuseGetattr("/b", &s) == 0);
+        REQUIRE(s.st_size == 3);
+
+        fileInfo.flags= O_CREAT | O_EXCL;
+        REQUIRE(fs->fuseCreate("/b", S_IFREG | 0644, &fileInfo) == -EEXIST);
+        fileInfo.flags= O_CREAT;
+        REQUIRE(fs->fuseCreate("/b", S_IFREG | 0644, &fileInfo) == 0);
+        REQUIRE(fs->fuseRelease("/b", &fileInfo) == 0);
+        REQUIRE(fs->openFiles.getNumOpen() == 0);
+    }
+
+    unmount(fs);
+    remove(CONT_PATH);
+}
+
+// ***
+// *** Helper functions
+// ***
+
+MyFsInfo testInfo(const char *contFile) {
+    MyFsInfo info;
+    memset(&info, 0, sizeof(MyFsInfo));
+    info.contFile= (char *) contFile;
+    info.logFile= (char *) LOG_PATH;
+    info.logLevel= LOG_LEVEL_RETURNS;
+    return info;
+}
+
+MyFS *mount(MyFsInfo *info) {
+    setFuseContext(info);
+
+    MyFS *fs;
+    if(info->contFile != NULL)
+        fs= new MyOnDiskFS();
+    else
+        fs= new MyInMemoryFS();
+    fs->fuseInit(NULL);
+    return fs;
+}
+
+void unmount(MyFS *fs) {
+    fs->fuseDestroy();
+    delete fs;
+}
+
+int fillDir(void *buf, const char *name, const struct stat *stbuf, off_t off) {
+    ((std::set<std::string> *) buf)->insert(name);
+    return 0;
+}
+
+int writeAll(MyFS *fs, const char *path, const char *buf, size_t size, off_t offset, size_t chunk) {
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+
+    int ret= fs->fuseOpen(path, &fileInfo);
+    size_t done= 0;
+    while(ret >= 0 && done < size) {
+        size_t n= std::min(chunk, size - done);
+        ret= fs->fuseWrite(path, buf + done, n, offset + done, &fileInfo);
+        if(ret >= 0)
+            done+= ret;
+    }
+    if(ret >= 0)
+        ret= fs->fuseFlush(path, &fileInfo);
+    fs->fuseRelease(path, &fileInfo);
+
+    return ret < 0 ? ret : (int) done;
+}
+
+int readAll(MyFS *fs, const char *path, char *buf, size_t size, off_t offset) {
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+
+    int ret= fs->fuseOpen(path, &fileInfo);
+    if(ret >= 0)
+        ret= fs->fuseRead(path, buf, size, offset, &fileInfo);
+    fs->fuseRelease(path, &fileInfo);
+
+    return ret;
+}
 
-// TODO: Implement your helper functions here!
+#if FUSE_VERSION >= 29
+// Copy the content of the buffers returned by fuseReadBuf() and free them, returns the number of file descriptor buffers.
+int copyBufs(struct fuse_bufvec *bufv, char *buf) {
+    int numFd= 0;
+    for(size_t i= 0; i < bufv->count; i++) {
+        if(bufv->buf[i].flags & FUSE_BUF_IS_FD) {
+            REQUIRE(pread(bufv->buf[i].fd, buf, bufv->buf[i].size, bufv->buf[i].pos) == (ssize_t) bufv->buf[i].size);
+            numFd++;
+        } else {
+            memcpy(buf, bufv->buf[i].mem, bufv->buf[i].size);
+        }
+        buf+= bufv->buf[i].size;
+        free(bufv->buf[i].mem);
+    }
+    free(bufv);
+    return numFd;
+}
+#endif
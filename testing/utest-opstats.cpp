@@ -0,0 +1,112 @@
+//
+//  utest-opstats.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opstats.h"
+
+#define NUM_THREADS 8
+#define NUM_CALLS 10000
+
+TEST_CASE( "OS_BUCKETS", "[opstats]" ) {
+
+    // buckets are consecutive and cover each latency with a relative error of at most 2^-OS_SUB_BITS
+    REQUIRE(OpStats::bucket(0) == 0);
+    for(uint32_t b= 1; b < OS_NUM_BUCKETS; b++) {
+        uint64_t start= OpStats::bucketStart(b);
+        REQUIRE(start > OpStats::bucketStart(b - 1));
+        REQUIRE(OpStats::bucket(start) == b);
+        REQUIRE(OpStats::bucket(start - 1) == b - 1);
+    }
+    for(uint64_t ns= 1; ns < ((uint64_t) 1 << 39); ns= ns * 3 + 1) {
+        uint64_t start= OpStats::bucketStart(OpStats::bucket(ns));
+        REQUIRE(start <= ns);
+        REQUIRE(ns - start <= (ns >> OS_SUB_BITS));
+    }
+    REQUIRE(OpStats::bucket(~(uint64_t) 0) == OS_NUM_BUCKETS - 1);
+}
+
+TEST_CASE( "OS_RECORD_MERGE", "[opstats]" ) {
+
+    OpStats stats;
+    OpSummary *s= new OpSummary;
+
+    SECTION("counters of all threads are merged") {
+        std::vector<std::thread> threads;
+        for(int t= 0; t < NUM_THREADS; t++) {
+            threads.push_back(std::thread([&stats]() {
+                for(int i= 0; i < NUM_CALLS; i++) {
+                    stats.record(OP_READ, OpStats::now(), 100);
+                    stats.record(OP_GETATTR, OpStats::now(), i % 10 == 0 ? -2 : 0);
+                }
+            }));
+        }
+        for(size_t t= 0; t < threads.size(); t++)
+            threads[t].join();
+
+        stats.getSummary(OP_READ, s);
+        REQUIRE(s->count == NUM_THREADS * NUM_CALLS);
+        REQUIRE(s->bytes == 100 * NUM_THREADS * NUM_CALLS);
+        REQUIRE(s->errors == 0);
+
+        stats.getSummary(OP_GETATTR, s);
+        REQUIRE(s->count == NUM_THREADS * NUM_CALLS);
+        REQUIRE(s->errors == NUM_THREADS * NUM_CALLS / 10);
+        REQUIRE(s->bytes == 0);
+
+        stats.getSummary(OP_WRITE, s);
+        REQUIRE(s->count == 0);
+    }
+
+    SECTION("percentiles") {
+        // 90 fast calls and 10 slow ones
+        uint64_t now= OpStats::now();
+        for(int i= 0; i < 90; i++)
+            stats.record(OP_OPEN, now - 1000, 0);
+        for(int i= 0; i < 10; i++)
+            stats.record(OP_OPEN, now - 1000000, 0);
+
+        stats.getSummary(OP_OPEN, s);
+        REQUIRE(OpStats::percentile(s, 0.5) >= 1000);
+        REQUIRE(OpStats::percentile(s, 0.5) < 1000000);
+        REQUIRE(OpStats::percentile(s, 0.99) >= 1000000);
+        REQUIRE(OpStats::percentile(s, 0.99) <= s->maxNs);
+    }
+
+    SECTION("report") {
+        stats.record(OP_WRITE, OpStats::now(), 4096);
+
+        std::string report;
+        stats.report(report);
+        REQUIRE(report.find("write ") != std::string::npos);
+        REQUIRE(report.find("read ") == std::string::npos);
+    }
+
+    delete s;
+}
+
+TEST_CASE( "OS_SEVERAL_INSTANCES", "[opstats]" ) {
+
+    // a thread switching between instances keeps one block of counters per instance
+    OpStats a, b;
+    OpSummary *s= new OpSummary;
+    for(int i= 0; i < 100; i++) {
+        a.record(OP_MKNOD, OpStats::now(), 0);
+        b.record(OP_MKNOD, OpStats::now(), 0);
+        b.record(OP_MKNOD, OpStats::now(), 0);
+    }
+
+    a.getSummary(OP_MKNOD, s);
+    REQUIRE(s->count == 100);
+    b.getSummary(OP_MKNOD, s);
+    REQUIRE(s->count == 200);
+
+    delete s;
+}